@@ -0,0 +1,171 @@
+/*alloc.c*/
+
+//
+// Allocation counters for the nuPython pipeline, see alloc.h.
+//
+// Jad Dibs
+//
+// Northwestern University
+// CS 211
+//
+
+// malloc_usable_size is a glibc extension:
+#define _GNU_SOURCE
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdbool.h>  // true, false
+#include <string.h>   // strlen
+
+#include "alloc.h"
+
+#if ALLOC_COUNTING
+
+#include <malloc.h>     // malloc_usable_size
+#include <stdatomic.h>
+
+
+//
+// glibc's own allocator, which the versions below call:
+//
+extern void* __libc_malloc(size_t size);
+extern void* __libc_calloc(size_t n, size_t size);
+extern void* __libc_realloc(void* p, size_t size);
+extern void  __libc_free(void* p);
+
+//
+// Counters, updated by every thread (batch mode runs programs in
+// parallel):
+//
+struct ALLOC_COUNTS
+{
+  atomic_long calls;
+  atomic_long frees;
+  atomic_long bytes;
+  atomic_long peak;
+};
+
+static struct ALLOC_COUNTS counters[ALLOC_NUM_SUBSYSTEMS];
+static atomic_long live;  // bytes in use right now
+
+_Thread_local int alloc_current = ALLOC_MAIN;
+
+
+//
+// Private functions:
+//
+static void alloc_counted(size_t added, size_t removed);
+
+
+//
+// alloc_counted
+//
+// Counts an allocation call that added and removed the given #
+// of bytes, and raises the running subsystem's peak if need be.
+//
+static void alloc_counted(size_t added, size_t removed)
+{
+  struct ALLOC_COUNTS* counter = &counters[alloc_current];
+
+  atomic_fetch_add_explicit(&counter->calls, 1, memory_order_relaxed);
+  atomic_fetch_add_explicit(&counter->bytes, (long) added, memory_order_relaxed);
+
+  long now = atomic_fetch_add_explicit(&live, (long) added - (long) removed, memory_order_relaxed) +
+             (long) added - (long) removed;
+  long peak = atomic_load_explicit(&counter->peak, memory_order_relaxed);
+
+  while (now > peak &&
+         !atomic_compare_exchange_weak_explicit(&counter->peak, &peak, now, memory_order_relaxed, memory_order_relaxed))
+    ;
+}
+
+
+//
+// Replacements for the C library's allocator. These definitions
+// replace glibc's at link time.
+//
+void* malloc(size_t size)
+{
+  void* p = __libc_malloc(size);
+
+  if (p != NULL)
+    alloc_counted(malloc_usable_size(p), 0);
+
+  return p;
+}
+
+void* calloc(size_t n, size_t size)
+{
+  void* p = __libc_calloc(n, size);
+
+  if (p != NULL)
+    alloc_counted(malloc_usable_size(p), 0);
+
+  return p;
+}
+
+void* realloc(void* p, size_t size)
+{
+  size_t removed = (p == NULL) ? 0 : malloc_usable_size(p);
+  void* q = __libc_realloc(p, size);
+
+  if (q != NULL)
+    alloc_counted(malloc_usable_size(q), removed);
+  else if (size == 0)  // freed
+    alloc_counted(0, removed);
+
+  return q;
+}
+
+void free(void* p)
+{
+  if (p == NULL)
+    return;
+
+  atomic_fetch_add_explicit(&counters[alloc_current].frees, 1, memory_order_relaxed);
+  atomic_fetch_sub_explicit(&live, (long) malloc_usable_size(p), memory_order_relaxed);
+
+  __libc_free(p);
+}
+
+#endif
+
+
+//
+// Public functions:
+//
+
+//
+// alloc_print
+//
+// Prints the counters of each subsystem, for people and then as a
+// single line of JSON.
+//
+void alloc_print(void)
+{
+#if ALLOC_COUNTING
+  static char* names[ALLOC_NUM_SUBSYSTEMS] = { "main", "parse", "graph", "execute", "ram" };
+
+  printf("**ALLOCATIONS**\n");
+
+  for (int s = 0; s < ALLOC_NUM_SUBSYSTEMS; s++)
+  {
+    printf(" %s:%*s %10ld calls, %10ld frees, %12ld bytes, peak %12ld bytes\n", names[s], (int) (8 - strlen(names[s])), "",
+      atomic_load(&counters[s].calls), atomic_load(&counters[s].frees), atomic_load(&counters[s].bytes),
+      atomic_load(&counters[s].peak));
+  }
+
+  printf("**allocs: {");
+
+  for (int s = 0; s < ALLOC_NUM_SUBSYSTEMS; s++)
+  {
+    printf("%s\"%s\":{\"calls\":%ld,\"frees\":%ld,\"bytes\":%ld,\"peak\":%ld}", s == 0 ? "" : ",", names[s],
+      atomic_load(&counters[s].calls), atomic_load(&counters[s].frees), atomic_load(&counters[s].bytes),
+      atomic_load(&counters[s].peak));
+  }
+
+  printf("}\n");
+#else
+  printf("**allocs: not counted, build with make counters\n");
+#endif
+}
@@ -0,0 +1,121 @@
+/*alloc.h*/
+
+//
+// Allocation counters for the nuPython pipeline. Built with
+// ALLOC_COUNTERS defined (make counters) on glibc, malloc,
+// calloc, realloc, and free are replaced by versions that count,
+// for each subsystem:
+//
+//   calls   # of malloc, calloc, and realloc calls
+//   frees   # of free calls (of non-NULL pointers)
+//   bytes   total bytes allocated, as handed out by the allocator
+//           (malloc_usable_size), a realloc counting its new size
+//   peak    most heap in use, by the whole process, while the
+//           subsystem was running
+//
+// and then call glibc's own. Every call is charged to the
+// subsystem running in the calling thread when it's made, which
+// the code marks with alloc_enter and alloc_leave: main marks
+// its phases, and the executor and VM mark their calls into RAM.
+// The scanner and token queue are driven from inside
+// parser_parse, so they are part of ALLOC_PARSE.
+//
+// Built without ALLOC_COUNTERS (the default), nothing is
+// replaced, alloc_enter and alloc_leave compile to nothing, and
+// alloc_print says so.
+//
+// Jad Dibs
+//
+// Northwestern University
+// CS 211
+//
+
+#pragma once
+
+#include <stdbool.h>  // true, false
+#include <stdlib.h>   // and glibc's features.h, for __GLIBC__
+
+
+#if defined(ALLOC_COUNTERS) && defined(__GLIBC__)
+#define ALLOC_COUNTING 1
+#else
+#define ALLOC_COUNTING 0
+#endif
+
+
+//
+// Subsystems
+//
+enum ALLOC_SUBSYSTEMS
+{
+  ALLOC_MAIN = 0,   // anything not marked, e.g. setup and teardown
+  ALLOC_PARSE,      // parser_parse: scanner, parser, token queue
+  ALLOC_GRAPH,      // programgraph_build
+  ALLOC_EXECUTE,    // the executor, VM, and what they use, except RAM
+  ALLOC_RAM,        // memory cells and their values
+  ALLOC_NUM_SUBSYSTEMS
+};
+
+
+//
+// Public functions:
+//
+
+//
+// alloc_print
+//
+// Prints the counters of each subsystem, for people and then as a
+// single line of JSON for tools, e.g.
+//
+//   **ALLOCATIONS**
+//    parse:        1042 calls,     12 frees,     81920 bytes, peak 143360 bytes
+//    ...
+//   **allocs: {"parse":{"calls":1042,"frees":12,"bytes":81920,"peak":143360},...}
+//
+void alloc_print(void);
+
+#if ALLOC_COUNTING
+
+extern _Thread_local int alloc_current;  // subsystem running in this thread
+
+//
+// alloc_enter
+//
+// The given subsystem starts running in this thread; returns the
+// one that was, to pass to alloc_leave.
+//
+static inline int alloc_enter(int subsystem)
+{
+  int previous = alloc_current;
+
+  alloc_current = subsystem;
+
+  return previous;
+}
+
+//
+// alloc_leave
+//
+// The subsystem is done; the given one (from alloc_enter) runs
+// again.
+//
+static inline void alloc_leave(int previous)
+{
+  alloc_current = previous;
+}
+
+#else
+
+static inline int alloc_enter(int subsystem)
+{
+  (void) subsystem;
+
+  return ALLOC_MAIN;
+}
+
+static inline void alloc_leave(int previous)
+{
+  (void) previous;
+}
+
+#endif
@@ -0,0 +1,451 @@
+/*arith.c*/
+
+//
+// Arithmetic kernels used by the nuPython executor.
+//
+// Jad Dibs
+//
+// Northwestern University
+// CS 211
+//
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdbool.h>  // true, false
+#include <stdint.h>
+#include <string.h>
+#include <limits.h>
+
+#include "arith.h"
+
+
+//
+// Digits are parsed 8 at a time (SWAR) where a 64-bit load puts
+// the first char in the low byte, i.e. little-endian machines:
+//
+#if defined(__BYTE_ORDER__) && __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__
+#define ARITH_SWAR 1
+#else
+#define ARITH_SWAR 0
+#endif
+
+#define ARITH_MAX_DIGITS 19   // significant digits that fit in a uint64_t
+#define ARITH_MAX_EXACT 22    // largest power of 10 that is an exact double
+#define ARITH_MAX_MANTISSA (UINT64_C(1) << 53)
+
+static const double arith_powers_of_ten[ARITH_MAX_EXACT + 1] =
+{
+  1e0, 1e1, 1e2, 1e3, 1e4, 1e5, 1e6, 1e7, 1e8, 1e9, 1e10, 1e11,
+  1e12, 1e13, 1e14, 1e15, 1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22
+};
+
+
+//
+// Private functions:
+//
+static bool arith_is_digit(char c);
+static bool arith_eight_digits(const char* p, uint64_t* digits);
+static const char* arith_parse_word(const char* p, const char* last);
+static double arith_strtod(const char* first, const char* last);
+
+
+//
+// arith_is_digit
+//
+// Returns true if c is '0'..'9' (isdigit depends on the locale).
+//
+static bool arith_is_digit(char c)
+{
+  return c >= '0' && c <= '9';
+}
+
+//
+// arith_eight_digits
+//
+// If the 8 chars at p (which must be there) are all digits, sets
+// *digits to their value and returns true. Each byte b is a digit
+// iff its high nibble is 3 and b + 6 doesn't carry into the next
+// nibble; the value is then put together 2, 4, and 8 digits at a
+// time with one multiply each.
+//
+static bool arith_eight_digits(const char* p, uint64_t* digits)
+{
+#if ARITH_SWAR
+  uint64_t v;
+
+  memcpy(&v, p, sizeof(v));
+
+  if (((v & UINT64_C(0xF0F0F0F0F0F0F0F0)) |
+       (((v + UINT64_C(0x0606060606060606)) & UINT64_C(0xF0F0F0F0F0F0F0F0)) >> 4)) != UINT64_C(0x3333333333333333))
+    return false;
+
+  v = (v & UINT64_C(0x0F0F0F0F0F0F0F0F)) * 2561 >> 8;
+  v = (v & UINT64_C(0x00FF00FF00FF00FF)) * 6553601 >> 16;
+  *digits = ((v & UINT64_C(0x0000FFFF0000FFFF)) * UINT64_C(42949672960001)) >> 32;
+
+  return true;
+#else
+  (void) p;
+  (void) digits;
+
+  return false;
+#endif
+}
+
+//
+// arith_parse_word
+//
+// If [p, last) starts with inf, infinity, or nan (any case),
+// returns the end of the word, otherwise p.
+//
+static const char* arith_parse_word(const char* p, const char* last)
+{
+  static const char* words[] = { "infinity", "inf", "nan" };
+
+  for (int w = 0; w < 3; w++)
+  {
+    int length = (int) strlen(words[w]);
+    int i = 0;
+
+    while (i < length && i < last - p && (p[i] | 0x20) == words[w][i])
+      i++;
+
+    if (i == length)
+      return p + length;
+  }
+
+  return p;
+}
+
+//
+// arith_strtod
+//
+// Converts the already validated real [first, last) with strtod,
+// copying it first since it need not end with '\0'.
+//
+static double arith_strtod(const char* first, const char* last)
+{
+  char small[64];
+  int length = (int) (last - first);
+  char* copy = small;
+
+  if (length >= (int) sizeof(small))
+  {
+    copy = (char*) malloc(length + 1);
+
+    if (copy == NULL)
+      exit(0);
+  }
+
+  memcpy(copy, first, length);
+  copy[length] = '\0';
+
+  double d = strtod(copy, NULL);
+
+  if (copy != small)
+    free(copy);
+
+  return d;
+}
+
+
+//
+// Public functions:
+//
+
+//
+// arith_power_ints
+//
+// Returns base ** exponent computed exactly in integer
+// arithmetic (exponentiation by squaring). The math is done
+// in unsigned so that overflow wraps instead of being undefined.
+//
+int arith_power_ints(int base, int exponent)
+{
+  unsigned int b = (unsigned int) base;
+
+  //
+  // small constant exponents (e.g. j = j ** 2) skip the loop:
+  //
+  switch (exponent)
+  {
+  case 0:
+    return 1;
+
+  case 1:
+    return base;
+
+  case 2:
+    return (int) (b * b);
+
+  case 3:
+    return (int) (b * b * b);
+
+  case 4:
+  {
+    unsigned int sq = b * b;
+    return (int) (sq * sq);
+  }
+
+  default:
+    break;
+  }
+
+  if (exponent < 0)
+  {
+    //
+    // 1 / (base ** -exponent) truncated toward zero:
+    //
+    if (base == 1)
+      return 1;
+    else if (base == -1)
+      return (exponent % 2 == 0) ? 1 : -1;
+    else
+      return 0;
+  }
+
+  //
+  // exponentiation by squaring:
+  //
+  unsigned int result = 1;
+  unsigned int e = (unsigned int) exponent;
+
+  while (e > 0)
+  {
+    if (e & 1)
+      result *= b;
+
+    e >>= 1;
+
+    if (e > 0)
+      b *= b;
+  }
+
+  return (int) result;
+}
+
+//
+// arith_parse_int
+//
+// Parses an int from the start of [first, last). The digits are
+// summed in 64 bits, which can't overflow: once the sum is past
+// any int, the rest of the digits are just skipped.
+//
+struct ARITH_PARSE arith_parse_int(const char* first, const char* last, int* value)
+{
+  const uint64_t limit = (uint64_t) INT_MAX + 1;
+  const char* p = first;
+  bool negative = false;
+
+  if (p < last && (*p == '+' || *p == '-'))
+  {
+    negative = (*p == '-');
+    p++;
+  }
+
+  const char* digits = p;
+  uint64_t n = 0;
+  uint64_t eight;
+
+  while (last - p >= 8 && n <= limit && arith_eight_digits(p, &eight))
+  {
+    n = n * 100000000 + eight;
+    p += 8;
+  }
+
+  while (p < last && arith_is_digit(*p))
+  {
+    if (n <= limit)
+      n = n * 10 + (*p - '0');
+
+    p++;
+  }
+
+  struct ARITH_PARSE result = { p, ARITH_PARSE_OK };
+
+  if (p == digits)
+  {
+    result.end = first;
+    result.error = ARITH_PARSE_INVALID;
+  }
+  else if (n > (negative ? limit : limit - 1))
+    result.error = ARITH_PARSE_RANGE;
+  else
+    *value = negative ? (int) -(int64_t) n : (int) n;
+
+  return result;
+}
+
+//
+// arith_parse_real
+//
+// Parses a real from the start of [first, last): the digits (up
+// to ARITH_MAX_DIGITS of them) go into a 64-bit mantissa, and the
+// exponent counts the digits after the '.'. When both are small
+// enough for Clinger's fast path, the result is the mantissa times
+// or divided by an exact power of ten, which rounds exactly once,
+// the same as strtod.
+//
+struct ARITH_PARSE arith_parse_real(const char* first, const char* last, double* value)
+{
+  const char* p = first;
+  bool negative = false;
+
+  if (p < last && (*p == '+' || *p == '-'))
+  {
+    negative = (*p == '-');
+    p++;
+  }
+
+  struct ARITH_PARSE result = { first, ARITH_PARSE_INVALID };
+
+  const char* word = arith_parse_word(p, last);
+
+  if (word != p)
+  {
+    *value = arith_strtod(first, word);
+
+    result.end = word;
+    result.error = ARITH_PARSE_OK;
+    return result;
+  }
+
+  uint64_t mantissa = 0;
+  int num_digits = 0;    // # of digits in the mantissa
+  bool exact = true;     // every digit is in the mantissa?
+  int exponent = 0;
+  uint64_t eight;
+
+  //
+  // digits before the '.':
+  //
+  const char* digits = p;
+
+  while (last - p >= 8 && num_digits + 8 <= ARITH_MAX_DIGITS && arith_eight_digits(p, &eight))
+  {
+    mantissa = mantissa * 100000000 + eight;
+    num_digits += 8;
+    p += 8;
+  }
+
+  for (; p < last && arith_is_digit(*p); p++)
+  {
+    if (num_digits < ARITH_MAX_DIGITS)
+    {
+      mantissa = mantissa * 10 + (*p - '0');
+      num_digits++;
+    }
+    else
+      exact = false;
+  }
+
+  bool any_digits = (p != digits);
+
+  //
+  // digits after the '.':
+  //
+  if (p < last && *p == '.')
+  {
+    p++;
+    digits = p;
+
+    while (last - p >= 8 && num_digits + 8 <= ARITH_MAX_DIGITS && arith_eight_digits(p, &eight))
+    {
+      mantissa = mantissa * 100000000 + eight;
+      num_digits += 8;
+      exponent -= 8;
+      p += 8;
+    }
+
+    for (; p < last && arith_is_digit(*p); p++)
+    {
+      if (num_digits < ARITH_MAX_DIGITS)
+      {
+        mantissa = mantissa * 10 + (*p - '0');
+        num_digits++;
+        exponent--;
+      }
+      else
+        exact = false;
+    }
+
+    any_digits = any_digits || (p != digits);
+  }
+
+  if (!any_digits)
+    return result;
+
+  //
+  // the exponent, if there's a number after the e:
+  //
+  if (p < last && (*p == 'e' || *p == 'E'))
+  {
+    const char* e = p + 1;
+    bool minus = false;
+
+    if (e < last && (*e == '+' || *e == '-'))
+    {
+      minus = (*e == '-');
+      e++;
+    }
+
+    if (e < last && arith_is_digit(*e))
+    {
+      int n = 0;
+
+      for (; e < last && arith_is_digit(*e); e++)
+      {
+        if (n < 100000)  // way past any double
+          n = n * 10 + (*e - '0');
+      }
+
+      exponent += minus ? -n : n;
+      p = e;
+    }
+  }
+
+  if (exact && mantissa <= ARITH_MAX_MANTISSA && exponent >= -ARITH_MAX_EXACT && exponent <= ARITH_MAX_EXACT)
+  {
+    double d = (double) mantissa;
+
+    if (exponent < 0)
+      d /= arith_powers_of_ten[-exponent];
+    else
+      d *= arith_powers_of_ten[exponent];
+
+    *value = negative ? -d : d;
+  }
+  else
+    *value = arith_strtod(first, p);
+
+  result.end = p;
+  result.error = ARITH_PARSE_OK;
+
+  return result;
+}
+
+//
+// arith_string_to_int
+//
+// Parses the whole string as an int.
+//
+bool arith_string_to_int(const char* s, int* value)
+{
+  const char* last = s + strlen(s);
+  struct ARITH_PARSE result = arith_parse_int(s, last, value);
+
+  return result.error == ARITH_PARSE_OK && result.end == last;
+}
+
+//
+// arith_string_to_real
+//
+// Parses the whole string as a real.
+//
+bool arith_string_to_real(const char* s, double* value)
+{
+  const char* last = s + strlen(s);
+  struct ARITH_PARSE result = arith_parse_real(s, last, value);
+
+  return result.error == ARITH_PARSE_OK && result.end == last;
+}
@@ -0,0 +1,96 @@
+/*arith.h*/
+
+//
+// Arithmetic kernels used by the nuPython executor.
+//
+// Jad Dibs
+//
+// Northwestern University
+// CS 211
+//
+
+#pragma once
+
+#include <stdbool.h>  // true, false
+
+
+//
+// Result of parsing a number: like C++'s from_chars, a number is
+// parsed from the start of [first, last) -- no leading spaces --
+// and end is set to the first char after it (first if there is no
+// number there, and then error is ARITH_PARSE_INVALID).
+//
+enum ARITH_PARSE_ERRORS
+{
+  ARITH_PARSE_OK = 0,
+  ARITH_PARSE_INVALID,  // no number at first
+  ARITH_PARSE_RANGE     // an int too big for an int
+};
+
+struct ARITH_PARSE
+{
+  const char* end;  // first char not part of the number
+  int error;        // enum ARITH_PARSE_ERRORS
+};
+
+
+//
+// Public functions:
+//
+
+//
+// arith_power_ints
+//
+// Returns base ** exponent computed exactly in integer
+// arithmetic (exponentiation by squaring), without going
+// through libm's pow() and double precision. Small exponents
+// such as ** 2 take a direct path with no loop.
+//
+// NOTE: results that do not fit in an int wrap around, the
+// same as the other int operators. A negative exponent
+// truncates toward zero (1 and -1 are the only bases with a
+// nonzero result), matching the previous (int)pow behavior.
+//
+int arith_power_ints(int base, int exponent);
+
+//
+// arith_parse_int
+//
+// Parses [+|-]digits from the start of [first, last) into *value,
+// which is only set if the result is ARITH_PARSE_OK. Digits are
+// taken 8 at a time where possible (SWAR: one 64-bit load and a
+// few multiplies), and no locale is consulted.
+//
+struct ARITH_PARSE arith_parse_int(const char* first, const char* last, int* value);
+
+//
+// arith_parse_real
+//
+// Parses [+|-]digits[.digits][(e|E)[+|-]digits], with digits on at
+// least one side of the '.', or inf, infinity, or nan (any case),
+// from the start of [first, last) into *value. There is no range
+// error: too big is +/-inf, too small is 0, as in Python.
+//
+// NOTE: with at most 19 significant digits and a power of ten up
+// to 22, the result is one exact double operation (Clinger's fast
+// path); other numbers are handed to strtod once validated, which
+// is exact but slower. nuPython never calls setlocale, so strtod
+// sees '.' as the decimal point.
+//
+struct ARITH_PARSE arith_parse_real(const char* first, const char* last, double* value);
+
+//
+// arith_string_to_int
+//
+// Returns true if the whole string is an int, setting *value to
+// it; "0abc", " 5", "" and ints out of range are not.
+//
+bool arith_string_to_int(const char* s, int* value);
+
+//
+// arith_string_to_real
+//
+// Returns true if the whole string is a real (see
+// arith_parse_real), setting *value to it.
+//
+bool arith_string_to_real(const char* s, double* value);
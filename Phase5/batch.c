@@ -0,0 +1,570 @@
+/*batch.c*/
+
+//
+// Batch runner for the nuPython executor, see batch.h.
+//
+// Jad Dibs
+//
+// Northwestern University
+// CS 211
+//
+
+// pthreads, dup2(), opendir(), ... are POSIX, not part of std=c11:
+#define _POSIX_C_SOURCE 200809L
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdbool.h>  // true, false
+#include <string.h>
+#include <pthread.h>
+#include <unistd.h>   // dup, dup2, pread, sysconf
+#include <dirent.h>   // opendir, readdir
+#include <sys/stat.h>
+
+#include "batch.h"
+#include "programgraph.h"
+#include "tokenqueue.h"
+#include "parser.h"
+#include "ram.h"
+#include "execute.h"
+#include "output.h"
+#include "input.h"
+#include "budget.h"
+#include "context.h"
+#include "alloc.h"
+
+
+//
+// Definition of a batch
+//
+struct BATCH_JOB
+{
+  char* filename;
+  struct OUTPUT* output;  // results, captured
+  bool done;
+};
+
+struct BATCH_RANGE  // a thread's jobs, [front, back)
+{
+  pthread_mutex_t lock;
+  int front;
+  int back;
+};
+
+struct BATCH
+{
+  struct BATCH_JOB* jobs;
+  int num_jobs;
+
+  struct BATCH_RANGE* ranges;  // one per thread
+  int num_threads;
+
+  struct BATCH_OPTIONS* options;
+
+  //
+  // the parser outputs its error messages with printf, so while
+  // it runs fd 1 goes to a temp file; nothing else may write to
+  // fd 1 then:
+  //
+  pthread_mutex_t parse_lock;
+  int messages;  // fd of the temp file, -1 if none
+
+  //
+  // results are written in order, by whichever thread finishes
+  // the next job to write:
+  //
+  pthread_mutex_t done_lock;
+  int next;  // index of the next job to write
+  struct OUTPUT* results;
+};
+
+struct BATCH_WORKER
+{
+  struct BATCH* batch;
+  int id;
+  pthread_t thread;
+  bool started;
+};
+
+
+//
+// Private functions:
+//
+
+//
+// batch_compare_names
+//
+// qsort comparison for filenames.
+//
+static int batch_compare_names(const void* a, const void* b)
+{
+  return strcmp(*((char* const*) a), *((char* const*) b));
+}
+
+//
+// batch_add_job
+//
+// Appends a job for the given file, growing the array of jobs
+// as needed.
+//
+static void batch_add_job(struct BATCH* batch, int* capacity, const char* filename)
+{
+  if (batch->num_jobs == *capacity)
+  {
+    *capacity = (*capacity == 0) ? 64 : 2 * *capacity;
+    batch->jobs = (struct BATCH_JOB*) realloc(batch->jobs, *capacity * sizeof(struct BATCH_JOB));
+
+    if (batch->jobs == NULL)
+      exit(0);
+  }
+
+  struct BATCH_JOB* job = &batch->jobs[batch->num_jobs];
+
+  job->filename = (char*) malloc(strlen(filename) + 1);
+  job->output = NULL;
+  job->done = false;
+
+  if (job->filename == NULL)
+    exit(0);
+
+  strcpy(job->filename, filename);
+
+  batch->num_jobs++;
+}
+
+//
+// batch_add_directory
+//
+// Adds a job for each .py file in the given directory, sorted
+// by name.
+//
+static void batch_add_directory(struct BATCH* batch, int* capacity, const char* path)
+{
+  DIR* dir = opendir(path);
+
+  if (dir == NULL)
+  {
+    batch_add_job(batch, capacity, path);  // reported when run
+    return;
+  }
+
+  int first = batch->num_jobs;
+  struct dirent* entry;
+
+  while ((entry = readdir(dir)) != NULL)
+  {
+    int length = (int) strlen(entry->d_name);
+
+    if (length < 4 || strcmp(entry->d_name + length - 3, ".py") != 0)
+      continue;
+
+    char* filename = (char*) malloc(strlen(path) + length + 2);
+
+    if (filename == NULL)
+      exit(0);
+
+    sprintf(filename, "%s/%s", path, entry->d_name);
+    batch_add_job(batch, capacity, filename);
+    free(filename);
+  }
+
+  closedir(dir);
+
+  //
+  // readdir's order is arbitrary; the filenames are the first
+  // member of a job, so the jobs can be sorted as names:
+  //
+  qsort(&batch->jobs[first], batch->num_jobs - first, sizeof(struct BATCH_JOB), batch_compare_names);
+}
+
+//
+// batch_parse
+//
+// Parses the program in the given file and builds its program
+// graph, one thread at a time. Whatever the parser outputs goes
+// to the job's output. Returns the tokens, NULL if the program
+// has a syntax error.
+//
+static struct TokenQueue* batch_parse(struct BATCH* batch, struct BATCH_JOB* job, FILE* file, struct STMT** program)
+{
+  pthread_mutex_lock(&batch->parse_lock);
+
+  int saved = -1;
+
+  if (batch->messages >= 0)
+  {
+    fflush(stdout);
+    saved = dup(1);
+
+    if (saved >= 0)
+      dup2(batch->messages, 1);
+  }
+
+  int previous = alloc_enter(ALLOC_PARSE);
+
+  struct TokenQueue* tokens = parser_parse(file);
+
+  alloc_enter(ALLOC_GRAPH);
+
+  *program = (tokens == NULL) ? NULL : programgraph_build(tokens);
+
+  alloc_leave(previous);
+
+  if (saved >= 0)
+  {
+    fflush(stdout);
+    dup2(saved, 1);
+    close(saved);
+
+    //
+    // copy the messages to the job's output, and empty the file
+    // for the next parse:
+    //
+    char buffer[4096];
+    off_t offset = 0;
+    ssize_t n;
+
+    while ((n = pread(batch->messages, buffer, sizeof(buffer), offset)) > 0)
+    {
+      output_write(job->output, buffer, (int) n);
+      offset += n;
+    }
+
+    if (ftruncate(batch->messages, 0) != 0 || lseek(batch->messages, 0, SEEK_SET) != 0)
+      batch->messages = -1;  // can't reuse it, stop capturing
+  }
+
+  pthread_mutex_unlock(&batch->parse_lock);
+
+  return tokens;
+}
+
+//
+// batch_print_memory
+//
+// Outputs the contents of memory, the same way as ram_print.
+//
+static void batch_print_memory(struct RAM* memory, struct OUTPUT* output)
+{
+  output_printf(output, "**MEMORY PRINT**\n");
+  output_printf(output, "Capacity: %d\n", memory->capacity);
+  output_printf(output, "Num values: %d\n", memory->num_values);
+  output_printf(output, "Contents:\n");
+
+  for (int i = 0; i < memory->num_values; i++)
+  {
+    struct RAM_VALUE* value = &memory->cells[i].value;
+
+    if (memory->cells[i].identifier != NULL)
+      output_printf(output, " %d: %s, ", i, memory->cells[i].identifier);
+
+    if (value->value_type == RAM_TYPE_INT)
+      output_printf(output, "int, %d", value->types.i);
+    else if (value->value_type == RAM_TYPE_REAL)
+      output_printf(output, "real, %lf", value->types.d);
+    else if (value->value_type == RAM_TYPE_STR)
+      output_printf(output, "str, '%s'", value->types.s);
+    else if (value->value_type == RAM_TYPE_PTR)
+      output_printf(output, "ptr, %d", value->types.i);
+    else if (value->value_type == RAM_TYPE_BOOLEAN)
+      output_printf(output, "boolean, %s", (value->types.i == 0) ? "False" : "True");
+    else
+      output_printf(output, "none, None");
+
+    output_printf(output, "\n");
+  }
+
+  output_printf(output, "**END PRINT**\n");
+}
+
+//
+// batch_execute
+//
+// Runs one job: parses and executes the program, capturing what
+// main would output for it.
+//
+static void batch_execute(struct BATCH* batch, struct BATCH_JOB* job)
+{
+  struct OUTPUT* output = output_init_memory();
+
+  job->output = output;
+
+  output_printf(output, "**BATCH: %s\n", job->filename);
+
+  FILE* file = fopen(job->filename, "r");
+
+  if (file == NULL)
+  {
+    output_printf(output, "**ERROR: unable to open input file '%s' for input.\n", job->filename);
+    return;
+  }
+
+  struct STMT* program = NULL;
+  struct TokenQueue* tokens = batch_parse(batch, job, file, &program);
+
+  fclose(file);
+
+  if (tokens == NULL)
+  {
+    output_printf(output, "**parsing failed...\n");
+    return;
+  }
+
+  output_printf(output, "**parsing successful, valid syntax\n");
+  output_printf(output, "**building program graph...\n");
+  output_printf(output, "**executing...\n");
+
+  int previous = alloc_enter(ALLOC_RAM);
+
+  struct RAM* memory = ram_init();
+
+  alloc_leave(previous);
+
+  struct INPUT* input = input_init_memory("");
+  struct CONTEXT* context = context_init(memory, output, input);
+  struct BUDGET budget;
+
+  context->vm_options = batch->options->vm_options;
+
+  if (batch->options->max_stmts > 0 || batch->options->max_seconds > 0.0)
+  {
+    budget_init(&budget, batch->options->max_stmts, batch->options->max_seconds);
+    context->budget = &budget;
+  }
+
+  alloc_enter(ALLOC_EXECUTE);
+
+  execute(program, context);
+
+  alloc_leave(previous);
+
+  output_printf(output, "**done\n");
+  batch_print_memory(memory, output);
+
+  context_destroy(context);
+  input_destroy(input);
+  ram_destroy(memory);
+  programgraph_destroy(program);
+  tokenqueue_destroy(tokens);
+}
+
+//
+// batch_finish
+//
+// Marks the job done, and writes the results of every job that
+// is done and next in order.
+//
+static void batch_finish(struct BATCH* batch, int j)
+{
+  pthread_mutex_lock(&batch->done_lock);
+
+  batch->jobs[j].done = true;
+
+  while (batch->next < batch->num_jobs && batch->jobs[batch->next].done)
+  {
+    struct BATCH_JOB* job = &batch->jobs[batch->next];
+
+    pthread_mutex_lock(&batch->parse_lock);  // fd 1 is ours
+
+    output_write(batch->results, output_contents(job->output), job->output->length);
+    output_flush(batch->results);
+
+    pthread_mutex_unlock(&batch->parse_lock);
+
+    output_destroy(job->output);
+    job->output = NULL;
+
+    batch->next++;
+  }
+
+  pthread_mutex_unlock(&batch->done_lock);
+}
+
+//
+// batch_next
+//
+// Returns the index of the next job for the given thread: the
+// front of its own range, or else stolen from the back half of
+// another thread's range. Returns -1 when there are no jobs left.
+//
+static int batch_next(struct BATCH* batch, int id)
+{
+  struct BATCH_RANGE* own = &batch->ranges[id];
+  int j = -1;
+
+  pthread_mutex_lock(&own->lock);
+
+  if (own->front < own->back)
+    j = own->front++;
+
+  pthread_mutex_unlock(&own->lock);
+
+  if (j >= 0)
+    return j;
+
+  //
+  // steal, trying the other threads in turn; a range never grows
+  // except by stealing, so once all are empty we're done:
+  //
+  for (int k = 1; k < batch->num_threads; k++)
+  {
+    struct BATCH_RANGE* victim = &batch->ranges[(id + k) % batch->num_threads];
+    int back = -1;
+
+    pthread_mutex_lock(&victim->lock);
+
+    if (victim->front < victim->back)
+    {
+      j = victim->front + (victim->back - victim->front) / 2;
+      back = victim->back;
+      victim->back = j;
+    }
+
+    pthread_mutex_unlock(&victim->lock);
+
+    if (j >= 0)
+    {
+      pthread_mutex_lock(&own->lock);
+
+      own->front = j + 1;
+      own->back = back;
+
+      pthread_mutex_unlock(&own->lock);
+
+      return j;
+    }
+  }
+
+  return -1;
+}
+
+//
+// batch_work
+//
+// A thread of the pool: runs jobs until there are none left.
+//
+static void* batch_work(void* arg)
+{
+  struct BATCH_WORKER* worker = (struct BATCH_WORKER*) arg;
+  int j;
+
+  while ((j = batch_next(worker->batch, worker->id)) >= 0)
+  {
+    batch_execute(worker->batch, &worker->batch->jobs[j]);
+    batch_finish(worker->batch, j);
+  }
+
+  return NULL;
+}
+
+
+//
+// Public functions:
+//
+
+//
+// batch_run
+//
+// Runs the programs on a pool of threads, writing their results
+// in order.
+//
+int batch_run(char* paths[], int num_paths, struct BATCH_OPTIONS* options, struct OUTPUT* results)
+{
+  struct BATCH batch;
+  int capacity = 0;
+
+  batch.jobs = NULL;
+  batch.num_jobs = 0;
+
+  for (int i = 0; i < num_paths; i++)
+  {
+    struct stat info;
+
+    if (stat(paths[i], &info) == 0 && S_ISDIR(info.st_mode))
+      batch_add_directory(&batch, &capacity, paths[i]);
+    else
+      batch_add_job(&batch, &capacity, paths[i]);
+  }
+
+  batch.num_threads = options->num_threads;
+
+  if (batch.num_threads <= 0)
+    batch.num_threads = (int) sysconf(_SC_NPROCESSORS_ONLN);
+
+  if (batch.num_threads > batch.num_jobs)
+    batch.num_threads = batch.num_jobs;
+
+  if (batch.num_threads < 1)
+    batch.num_threads = 1;
+
+  //
+  // divide the jobs among the threads, in contiguous ranges:
+  //
+  batch.ranges = (struct BATCH_RANGE*) malloc(batch.num_threads * sizeof(struct BATCH_RANGE));
+
+  struct BATCH_WORKER* workers = (struct BATCH_WORKER*) malloc(batch.num_threads * sizeof(struct BATCH_WORKER));
+
+  if (batch.ranges == NULL || workers == NULL)
+    exit(0);
+
+  for (int t = 0; t < batch.num_threads; t++)
+  {
+    pthread_mutex_init(&batch.ranges[t].lock, NULL);
+    batch.ranges[t].front = (int) ((long) batch.num_jobs * t / batch.num_threads);
+    batch.ranges[t].back = (int) ((long) batch.num_jobs * (t + 1) / batch.num_threads);
+
+    workers[t].batch = &batch;
+    workers[t].id = t;
+    workers[t].started = false;
+  }
+
+  batch.options = options;
+
+  FILE* messages = tmpfile();
+
+  pthread_mutex_init(&batch.parse_lock, NULL);
+  batch.messages = (messages == NULL) ? -1 : fileno(messages);
+
+  pthread_mutex_init(&batch.done_lock, NULL);
+  batch.next = 0;
+  batch.results = results;
+
+  //
+  // this thread is thread 0; if another thread can't be started,
+  // its jobs get stolen:
+  //
+  for (int t = 1; t < batch.num_threads; t++)
+    workers[t].started = (pthread_create(&workers[t].thread, NULL, batch_work, &workers[t]) == 0);
+
+  batch_work(&workers[0]);
+
+  for (int t = 1; t < batch.num_threads; t++)
+  {
+    if (workers[t].started)
+      pthread_join(workers[t].thread, NULL);
+  }
+
+  output_printf(results, "**BATCH: %d programs, %d threads\n", batch.num_jobs, batch.num_threads);
+  output_flush(results);
+
+  //
+  // cleanup:
+  //
+  if (messages != NULL)
+    fclose(messages);
+
+  for (int t = 0; t < batch.num_threads; t++)
+    pthread_mutex_destroy(&batch.ranges[t].lock);
+
+  pthread_mutex_destroy(&batch.parse_lock);
+  pthread_mutex_destroy(&batch.done_lock);
+
+  for (int j = 0; j < batch.num_jobs; j++)
+    free(batch.jobs[j].filename);
+
+  free(batch.jobs);
+  free(batch.ranges);
+  free(workers);
+
+  return batch.num_jobs;
+}
@@ -0,0 +1,58 @@
+/*batch.h*/
+
+//
+// Batch runner for the nuPython executor: runs many programs in
+// one process, in parallel, instead of one program per process.
+//
+// Each program is run on a thread from a pool, with its own RAM,
+// input (which is empty: input() returns ""), and output, which
+// is captured in memory. When a program is done its results ---
+// what main would output for it, parse errors included --- are
+// written out, in the order the programs were given.
+//
+// The pool is work-stealing: the programs are divided among the
+// threads up front, in contiguous ranges, and each thread runs
+// its own range from the front. A thread that runs out steals
+// the back half of another thread's range, so a few slow
+// programs don't leave the other threads idle.
+//
+// The parser is not reentrant, so programs are parsed one at a
+// time (while others execute).
+//
+// Jad Dibs
+//
+// Northwestern University
+// CS 211
+//
+
+#pragma once
+
+#include "output.h"
+
+
+//
+// Definition of the options for a batch: the same for every
+// program
+//
+struct BATCH_OPTIONS
+{
+  int    num_threads;  // 0 => one per CPU
+  int    vm_options;   // for vm_compile, e.g. VM_JIT
+  long   max_stmts;    // budget per program, 0 => no limit
+  double max_seconds;  // budget per program, 0 => no limit
+};
+
+
+//
+// Public functions:
+//
+
+//
+// batch_run
+//
+// Runs the nuPython programs in the given files --- a directory
+// stands for the .py files in it, sorted by name --- and writes
+// their results to the given sink, in order, followed by a line
+// with the # of programs and threads. Returns the # of programs.
+//
+int batch_run(char* paths[], int num_paths, struct BATCH_OPTIONS* options, struct OUTPUT* results);
@@ -0,0 +1,344 @@
+/*bench.c*/
+
+//
+// Microbenchmarks for the kernels used by the nuPython executor.
+// Each benchmark checks its kernel against a reference result
+// before timing it, so a fast-but-wrong kernel is reported.
+//
+// usage: make bench
+//
+// Jad Dibs
+//
+// Northwestern University
+// CS 211
+//
+
+// to eliminate warnings about stdlib in Visual Studio
+#define _CRT_SECURE_NO_WARNINGS
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdbool.h>  // true, false
+#include <string.h>
+#include <math.h>
+#include <time.h>     // clock
+
+#include "arith.h"
+#include "strbuild.h"
+
+
+//
+// volatile sink so the optimizer cannot drop the timed loops:
+//
+static volatile int sink_int;
+static volatile double sink_double;
+static volatile char sink_char;
+
+//
+// volatile exponent so (int)pow(x, 2) is a real libm call, the
+// same as it was in the executor, rather than folded into x * x:
+//
+static volatile double two = 2.0;
+
+//
+// elapsed_ms
+//
+// Returns the number of milliseconds between two clock() readings.
+//
+static double elapsed_ms(clock_t start, clock_t stop)
+{
+  return (double) (stop - start) * 1000.0 / CLOCKS_PER_SEC;
+}
+
+
+//
+// bench_power_ints
+//
+// Compares arith_power_ints against (int)pow for the exponents
+// seen in nuPython programs, e.g. j = j ** 2 in Phase2/test08.py.
+//
+static bool bench_power_ints(void)
+{
+  //
+  // correctness: exact for every result that fits in an int
+  //
+  for (int base = -20; base <= 20; base++)
+  {
+    long long expected = 1;
+
+    for (int exponent = 0; exponent <= 30; exponent++)
+    {
+      if (llabs(expected) <= 2147483647LL && arith_power_ints(base, exponent) != (int) expected)
+      {
+        printf("**FAILED: %d ** %d gave %d, expected %lld\n", base, exponent, arith_power_ints(base, exponent), expected);
+        return false;
+      }
+
+      if (llabs(expected) <= 2147483647LL)
+        expected *= base;
+    }
+  }
+
+  const int N = 20000000;
+  int acc = 0;
+
+  clock_t start = clock();
+  for (int i = 0; i < N; i++)
+    acc += (int) pow(i & 1023, two);
+  clock_t stop = clock();
+  sink_int = acc;
+  double pow2_ms = elapsed_ms(start, stop);
+
+  acc = 0;
+  start = clock();
+  for (int i = 0; i < N; i++)
+    acc += arith_power_ints(i & 1023, 2);
+  stop = clock();
+  sink_int = acc;
+  double sq2_ms = elapsed_ms(start, stop);
+
+  acc = 0;
+  start = clock();
+  for (int i = 0; i < N; i++)
+    acc += (int) pow(3, i & 15);
+  stop = clock();
+  sink_int = acc;
+  double powN_ms = elapsed_ms(start, stop);
+
+  acc = 0;
+  start = clock();
+  for (int i = 0; i < N; i++)
+    acc += arith_power_ints(3, i & 15);
+  stop = clock();
+  sink_int = acc;
+  double sqN_ms = elapsed_ms(start, stop);
+
+  printf("power_ints  x ** 2   : pow %8.1f ms, arith %8.1f ms\n", pow2_ms, sq2_ms);
+  printf("power_ints  3 ** n   : pow %8.1f ms, arith %8.1f ms\n", powN_ms, sqN_ms);
+
+  return true;
+}
+
+
+//
+// concat_naive
+//
+// What the executor did before string builders: every + makes
+// a new string with malloc, strcpy, strcat.
+//
+static char* concat_naive(char* lhs, char* rhs)
+{
+  char* concatenated = malloc((strlen(lhs) + strlen(rhs) + 1) * sizeof(char));
+
+  strcpy(concatenated, lhs);
+  strcat(concatenated, rhs);
+
+  return concatenated;
+}
+
+
+//
+// bench_string_concat
+//
+// Builds a 10 MB string one character at a time, the way a
+// nuPython loop of s = s + "x" does. The naive version is
+// quadratic, so it only builds a small string for comparison.
+//
+static bool bench_string_concat(void)
+{
+  const int BIG = 10 * 1024 * 1024;
+  const int SMALL = 128 * 1024;
+
+  struct STR_BUILDERS* sb = strbuild_init();
+
+  char* s = malloc(1);
+  s[0] = '\0';
+
+  clock_t start = clock();
+  for (int i = 0; i < BIG; i++)
+    s = strbuild_append(sb, 0, s, "x");
+  clock_t stop = clock();
+  double builder_ms = elapsed_ms(start, stop);
+
+  if ((int) strlen(s) != BIG || s[0] != 'x' || s[BIG - 1] != 'x')
+  {
+    printf("**FAILED: string builder produced %d chars, expected %d\n", (int) strlen(s), BIG);
+    return false;
+  }
+
+  sink_char = s[BIG / 2];
+  free(s);
+  strbuild_destroy(sb);
+
+  s = malloc(1);
+  s[0] = '\0';
+
+  start = clock();
+  for (int i = 0; i < SMALL; i++)
+  {
+    char* t = concat_naive(s, "x");
+    free(s);
+    s = t;
+  }
+  stop = clock();
+  double naive_ms = elapsed_ms(start, stop);
+
+  sink_char = s[SMALL / 2];
+  free(s);
+
+  printf("string_concat 10 MB  : builder %8.1f ms\n", builder_ms);
+  printf("string_concat 128 KB : naive   %8.1f ms (quadratic)\n", naive_ms);
+
+  return true;
+}
+
+
+//
+// make_numbers
+//
+// Returns n strings, one number each, the way input() returns
+// them: ints of 1 to 10 digits, or reals like 1234.5678 and
+// 6.02e23, depending on reals. The caller frees them with
+// free_numbers.
+//
+static char** make_numbers(int n, bool reals)
+{
+  char** numbers = (char**) malloc(n * sizeof(char*));
+  unsigned int seed = 211;
+
+  for (int i = 0; i < n; i++)
+  {
+    char s[64];
+
+    seed = seed * 1103515245 + 12345;
+
+    int r = (int) (seed >> 8);
+
+    if (!reals)
+      snprintf(s, sizeof(s), "%d", (i % 2 == 0) ? r % (1 << (i % 24 + 1)) : -r);
+    else if (i % 4 == 3)
+      snprintf(s, sizeof(s), "%d.%de%d", r % 10, r % 1000, r % 40 - 20);
+    else
+      snprintf(s, sizeof(s), "%d.%04d", r % 100000, r % 10000);
+
+    numbers[i] = (char*) malloc(strlen(s) + 1);
+    strcpy(numbers[i], s);
+  }
+
+  return numbers;
+}
+
+//
+// free_numbers
+//
+// Frees the strings of make_numbers.
+//
+static void free_numbers(char** numbers, int n)
+{
+  for (int i = 0; i < n; i++)
+    free(numbers[i]);
+
+  free(numbers);
+}
+
+
+//
+// bench_parse
+//
+// Converts millions of strings with int() and float(), comparing
+// arith_string_to_int/real against the atoi/atof they replace.
+// Each result is first checked against strtol/strtod.
+//
+static bool bench_parse(void)
+{
+  const int N = 4000000;
+
+  char** ints = make_numbers(N, false);
+  char** reals = make_numbers(N, true);
+
+  //
+  // correctness:
+  //
+  for (int i = 0; i < N; i++)
+  {
+    int n;
+    double d;
+
+    if (!arith_string_to_int(ints[i], &n) || n != (int) strtol(ints[i], NULL, 10))
+    {
+      printf("**FAILED: int(\"%s\") gave %d\n", ints[i], n);
+      return false;
+    }
+
+    if (!arith_string_to_real(reals[i], &d) || d != strtod(reals[i], NULL))
+    {
+      printf("**FAILED: float(\"%s\") gave %.17g, expected %.17g\n", reals[i], d, strtod(reals[i], NULL));
+      return false;
+    }
+  }
+
+  int acc = 0;
+
+  clock_t start = clock();
+  for (int i = 0; i < N; i++)
+    acc += atoi(ints[i]);
+  clock_t stop = clock();
+  sink_int = acc;
+  double atoi_ms = elapsed_ms(start, stop);
+
+  acc = 0;
+  start = clock();
+  for (int i = 0; i < N; i++)
+  {
+    int n = 0;
+    arith_string_to_int(ints[i], &n);
+    acc += n;
+  }
+  stop = clock();
+  sink_int = acc;
+  double parse_int_ms = elapsed_ms(start, stop);
+
+  double sum = 0.0;
+
+  start = clock();
+  for (int i = 0; i < N; i++)
+    sum += atof(reals[i]);
+  stop = clock();
+  sink_double = sum;
+  double atof_ms = elapsed_ms(start, stop);
+
+  sum = 0.0;
+  start = clock();
+  for (int i = 0; i < N; i++)
+  {
+    double d = 0.0;
+    arith_string_to_real(reals[i], &d);
+    sum += d;
+  }
+  stop = clock();
+  sink_double = sum;
+  double parse_real_ms = elapsed_ms(start, stop);
+
+  free_numbers(ints, N);
+  free_numbers(reals, N);
+
+  printf("parse int()   4M     : atoi %8.1f ms, arith %8.1f ms\n", atoi_ms, parse_int_ms);
+  printf("parse float() 4M     : atof %8.1f ms, arith %8.1f ms\n", atof_ms, parse_real_ms);
+
+  return true;
+}
+
+
+//
+// main
+//
+int main(void)
+{
+  bool ok = true;
+
+  ok = bench_power_ints() && ok;
+  ok = bench_string_concat() && ok;
+  ok = bench_parse() && ok;
+
+  return ok ? 0 : 1;
+}
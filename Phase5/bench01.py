@@ -0,0 +1,18 @@
+#
+# bench01.py
+#
+# counting loop benchmark: integer arithmetic, comparisons,
+# and loop back-edges
+#
+N = 10000000
+
+i = 0
+total = 0
+while i < N:
+{
+  r = i % 7
+  total = total + r
+  i = i + 1
+}
+
+print(total)
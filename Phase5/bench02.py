@@ -0,0 +1,18 @@
+#
+# bench02.py
+#
+# string concatenation benchmark: builds a 10 MB string
+# one character at a time
+#
+N = 10485760
+
+s = ""
+i = 0
+while i < N:
+{
+  s = s + "x"
+  i = i + 1
+}
+
+done = s == ""
+print(done)
@@ -0,0 +1,119 @@
+/*budget.c*/
+
+//
+// Execution budget for the nuPython executor, see budget.h.
+//
+// Jad Dibs
+//
+// Northwestern University
+// CS 211
+//
+
+#include <stdio.h>
+#include <stdbool.h>  // true, false
+#include <limits.h>
+#include <time.h>
+
+#include "budget.h"
+#include "output.h"
+
+
+//
+// Public functions:
+//
+
+//
+// budget_init
+//
+// Sets up the budget for one execution, starting the clock.
+//
+void budget_init(struct BUDGET* budget, long max_stmts, double max_seconds)
+{
+  budget->max_stmts = max_stmts;
+  budget->max_seconds = max_seconds;
+
+  budget->stmts = 0;
+  budget->exhausted = false;
+  budget->line = 0;
+
+  timespec_get(&budget->deadline, TIME_UTC);
+
+  long seconds = (long) max_seconds;
+  long nanoseconds = (long) ((max_seconds - seconds) * 1000000000.0);
+
+  budget->deadline.tv_sec += seconds;
+  budget->deadline.tv_nsec += nanoseconds;
+
+  if (budget->deadline.tv_nsec >= 1000000000L)
+  {
+    budget->deadline.tv_sec++;
+    budget->deadline.tv_nsec -= 1000000000L;
+  }
+
+  //
+  // with no time limit the clock is never read:
+  //
+  budget->until_clock = (max_seconds > 0.0) ? BUDGET_CLOCK_EVERY : INT_MAX;
+}
+
+
+//
+// budget_exceeded
+//
+// Either the stmt limit is reached or it's time to read the
+// clock; returns true (after outputting the error) if execution
+// has to stop.
+//
+bool budget_exceeded(struct BUDGET* budget, struct OUTPUT* output, int line)
+{
+  if (budget->max_stmts > 0 && budget->stmts > budget->max_stmts)
+  {
+    output_printf(output, "**BUDGET EXCEEDED: more than %ld stmts executed (line %d)\n", budget->max_stmts, line);
+  }
+  else if (budget->max_seconds > 0.0)
+  {
+    struct timespec now;
+
+    timespec_get(&now, TIME_UTC);
+    budget->until_clock = BUDGET_CLOCK_EVERY;
+
+    if (now.tv_sec < budget->deadline.tv_sec ||
+        (now.tv_sec == budget->deadline.tv_sec && now.tv_nsec < budget->deadline.tv_nsec))
+      return false;
+
+    output_printf(output, "**BUDGET EXCEEDED: time limit of %g seconds reached (line %d)\n", budget->max_seconds, line);
+  }
+  else
+  {
+    budget->until_clock = INT_MAX;
+    return false;
+  }
+
+  budget->exhausted = true;
+  budget->line = line;
+
+  return true;
+}
+
+
+//
+// budget_print
+//
+// Prints how execution ended. When the stmt limit stopped it, the
+// limit is printed rather than the count, which can overshoot it
+// by the rest of a loop body (see budget.h).
+//
+void budget_print(struct BUDGET* budget)
+{
+  if (budget->exhausted && budget->max_stmts > 0 && budget->stmts > budget->max_stmts)
+    printf("**BUDGET: more than %ld stmts executed, ", budget->max_stmts);
+  else
+    printf("**BUDGET: %ld stmts executed, ", budget->stmts);
+
+  if (budget->exhausted)
+    printf("stopped by the budget at line %d\n", budget->line);
+  else if (budget->line > 0)
+    printf("stopped by an error at line %d\n", budget->line);
+  else
+    printf("program completed\n");
+}
@@ -0,0 +1,107 @@
+/*budget.h*/
+
+//
+// Execution budget for the nuPython executor: a maximum # of
+// stmts and a wall-clock time limit, so a program that loops
+// forever (e.g. while var != loop_end, where the condition never
+// changes) is stopped with an error instead of running until
+// someone kills it.
+//
+// Every stmt executed is counted (a while loop once each time
+// its condition is evaluated, an if once), but the budget is
+// only checked at the back edge of a while loop, when the body
+// is done and the condition is about to be evaluated again; the
+// clock is read only every BUDGET_CLOCK_EVERY back edges. Code
+// without loops always runs to completion, so a program can
+// overrun the budget by at most one pass through a loop body.
+// When the budget runs out, an error is output:
+//
+//   **BUDGET EXCEEDED: more than 1000 stmts executed (line 7)
+//
+// where the line is the while loop's, and execution stops. The
+// stmts counted by then can be a few more than the limit, so
+// budget_print reports the limit, as the error does.
+//
+// Jad Dibs
+//
+// Northwestern University
+// CS 211
+//
+
+#pragma once
+
+#include <stdbool.h>  // true, false
+#include <time.h>
+
+#include "output.h"
+
+
+#define BUDGET_CLOCK_EVERY 256  // back edges between clock readings
+
+
+//
+// Definition of a budget
+//
+struct BUDGET
+{
+  long   max_stmts;    // stop after this many stmts, 0 => no limit
+  double max_seconds;  // stop after this much time, 0 => no limit
+
+  //
+  // set during execution:
+  //
+  long stmts;          // # of stmts executed
+  bool exhausted;      // true => execution stopped by the budget
+  int  line;           // line # where execution stopped (by the
+                       // budget or an error), 0 => it completed
+
+  struct timespec deadline;  // when the time is up
+  int until_clock;           // back edges until the clock is read
+};
+
+
+//
+// Public functions:
+//
+
+//
+// budget_init
+//
+// Sets up the given budget for one execution; the time limit is
+// counted from now. A limit of 0 means no limit.
+//
+void budget_init(struct BUDGET* budget, long max_stmts, double max_seconds);
+
+//
+// budget_exceeded
+//
+// Called by budget_check: if the budget is really exhausted,
+// outputs the error message and returns true.
+//
+bool budget_exceeded(struct BUDGET* budget, struct OUTPUT* output, int line);
+
+//
+// budget_print
+//
+// Prints how execution ended, the way the debugger reports the
+// last stmt executed, e.g.
+//
+//   **BUDGET: 52 stmts executed, program completed
+//   **BUDGET: more than 1000 stmts executed, stopped by the budget at line 7
+//
+void budget_print(struct BUDGET* budget);
+
+//
+// budget_check
+//
+// Called at the back edge of the while loop on the given line,
+// once budget->stmts is up to date. Returns true if execution can
+// go on; if not, outputs the error message and returns false.
+//
+static inline bool budget_check(struct BUDGET* budget, struct OUTPUT* output, int line)
+{
+  if ((budget->max_stmts > 0 && budget->stmts > budget->max_stmts) || --budget->until_clock <= 0)
+    return !budget_exceeded(budget, output, line);
+
+  return true;
+}
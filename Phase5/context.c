@@ -0,0 +1,86 @@
+/*context.c*/
+
+//
+// Interpreter context for the nuPython executor, see context.h.
+//
+// Jad Dibs
+//
+// Northwestern University
+// CS 211
+//
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdbool.h>  // true, false
+
+#include "context.h"
+#include "vm.h"
+
+
+//
+// Public functions:
+//
+
+//
+// context_init
+//
+// Returns a context for the given memory, output, and input.
+//
+struct CONTEXT* context_init(struct RAM* memory, struct OUTPUT* output, struct INPUT* input)
+{
+  struct CONTEXT* context = (struct CONTEXT*) malloc(sizeof(struct CONTEXT));
+
+  if (context == NULL)
+    exit(0);
+
+  context->memory = memory;
+  context->output = output;
+  context->input = input;
+
+  context->budget = NULL;
+  context->lines = NULL;
+  context->pairs = NULL;
+  context->memo = NULL;
+  context->trace = NULL;
+  context->timeline = NULL;
+  context->vm_options = 0;
+  context->threads = 1;
+  context->stop = NULL;
+
+  context->compiled = NULL;
+  context->compiled_options = 0;
+  context->code = NULL;
+
+  return context;
+}
+
+//
+// context_destroy
+//
+// Frees the context and its compiled code.
+//
+void context_destroy(struct CONTEXT* context)
+{
+  vm_free(context->code);
+  free(context);
+}
+
+//
+// context_code
+//
+// Returns the (cached) VM code for the program, NULL if the VM
+// can't run it.
+//
+struct VM_CODE* context_code(struct CONTEXT* context, struct STMT* program)
+{
+  if (context->compiled == program && context->compiled_options == context->vm_options)
+    return context->code;
+
+  vm_free(context->code);
+
+  context->code = vm_compile(program, context->vm_options);
+  context->compiled = program;
+  context->compiled_options = context->vm_options;
+
+  return context->code;
+}
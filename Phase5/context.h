@@ -0,0 +1,103 @@
+/*context.h*/
+
+//
+// Interpreter context: everything one execution of a nuPython
+// program works with --- its memory, where its output goes and
+// its input comes from, the budget it runs on, what to profile,
+// and the VM code compiled for it. Nothing the executor does
+// depends on global state, so several contexts can run programs
+// at the same time, in different threads.
+//
+// The context doesn't own the memory, output, input, budget,
+// profiles, memo tables, trace, timeline, or stop flag; the
+// caller creates and destroys those. It does own the compiled
+// code.
+//
+// Jad Dibs
+//
+// Northwestern University
+// CS 211
+//
+
+#pragma once
+
+#include <stdatomic.h>
+
+#include "programgraph.h"
+#include "ram.h"
+#include "output.h"
+#include "input.h"
+#include "budget.h"
+#include "lineprof.h"
+
+
+struct VM_CODE;     // see vm.h
+struct VM_PROFILE;
+struct MEMO;        // see memo.h
+struct TRACE;       // see trace.h
+struct TIMELINE;    // see timeline.h
+
+
+//
+// Definition of a context
+//
+struct CONTEXT
+{
+  struct RAM*    memory;  // the program's variables
+  struct OUTPUT* output;  // print(), input() prompts, errors
+  struct INPUT*  input;   // lines for input()
+
+  struct BUDGET*       budget;    // NULL => no limits
+  struct LINE_PROFILE* lines;     // NULL => not profiling by line
+  struct VM_PROFILE*   pairs;     // NULL => not counting VM pairs
+  struct MEMO*         memo;      // NULL => not memoizing loop bodies
+  struct TRACE*        trace;     // NULL => not tracing (else memo is ignored)
+  struct TIMELINE*     timeline;  // NULL => no spans for while loops
+  int vm_options;                 // for vm_compile, e.g. VM_JIT
+  int threads;                    // > 1 => run independent top-level
+                                  // stmts in parallel (see parallel.h)
+  atomic_bool* stop;              // NULL => runs to the end; once set,
+                                  // the VM stops at the next back edge
+
+  //
+  // cache: the VM code for the program last executed, compiled
+  // with the given options (code is NULL if the VM can't run it):
+  //
+  struct STMT*    compiled;
+  int             compiled_options;
+  struct VM_CODE* code;
+};
+
+
+//
+// Public functions:
+//
+
+//
+// context_init
+//
+// Returns a pointer to a dynamically-allocated context for the
+// given memory, output sink, and input source, with no budget,
+// no profiling, no memoization, no trace or timeline, default
+// VM options, one thread, and no stop flag; set the other fields
+// before executing to change that.
+//
+struct CONTEXT* context_init(struct RAM* memory, struct OUTPUT* output, struct INPUT* input);
+
+//
+// context_destroy
+//
+// Frees the context and its compiled code, but not its memory,
+// output, input, budget, profiles, memo tables, trace, or
+// timeline.
+//
+void context_destroy(struct CONTEXT* context);
+
+//
+// context_code
+//
+// Returns the VM code for the program, compiling it unless the
+// context already did for the same program and options, or NULL
+// if the VM can't run the program.
+//
+struct VM_CODE* context_code(struct CONTEXT* context, struct STMT* program);
@@ -23,45 +23,41 @@
 #include "programgraph.h"
 #include "ram.h"
 #include "execute.h"
-
-enum ASGNMT_TYPES
-{
-  ASGNMT_INT = 0,
-  ASGNMT_REAL,
-  ASGNMT_STRING,
-  ASGNMT_BOOL
-};
-
-// Return value of numerous helper functions, used to manage assignments and variables
-struct ASGNMT_VALUE
-{
-  int asgnmt_type; // enum ASGNMT_TYPES
-
-  bool success;
-
-  union
-  {
-    int i; // for ints and bools
-    double d;
-    char* s;
-  } types;
-};
+#include "arith.h"
+#include "output.h"
+#include "strbuild.h"
+#include "value.h"
+#include "vm.h"
+#include "lineprof.h"
+#include "budget.h"
+#include "input.h"
+#include "context.h"
+#include "memo.h"
+#include "trace.h"
+#include "timeline.h"
+#include "alloc.h"
+#include "parallel.h"
 
 //
 // Private functions:
 //
-static bool execute_function_call(struct STMT* stmt, struct RAM* memory);
-static struct ASGNMT_VALUE execute_get_var_value(struct RAM_VALUE* ram_value);
-static struct ASGNMT_VALUE execute_get_value(struct UNARY_EXPR* unary, struct STMT* stmt, struct RAM* memory);
-static struct ASGNMT_VALUE execute_binary_expression(struct ASGNMT_VALUE lhs, int operator, struct ASGNMT_VALUE rhs, int line);
-static struct ASGNMT_VALUE execute_binary_expression_ints(int lhs, int operator, int rhs, int line);
-static struct ASGNMT_VALUE execute_binary_expression_reals(double lhs, int operator, double rhs, int line);
-static struct ASGNMT_VALUE execute_binary_expression_int_real(int lhs, int operator, double rhs, int line);
-static struct ASGNMT_VALUE execute_binary_expression_real_int(double lhs, int operator, int rhs, int line);
-static struct ASGNMT_VALUE execute_binary_expression_strings(char* lhs, int operator, char* rhs);
-static bool execute_assignment(struct STMT* stmt, struct RAM* memory);
-static bool execute_assignment_func(struct STMT* stmt, struct RAM* memory, struct STMT_ASSIGNMENT* assign, struct RAM_VALUE* ram_value);
-static bool execute_assignment_expr(struct STMT* stmt, struct RAM* memory, struct STMT_ASSIGNMENT* assign, struct RAM_VALUE* ram_value);
+static bool execute_function_call(struct STMT* stmt, struct RAM* memory, struct OUTPUT* output);
+static struct RAM_VALUE* execute_read_var(struct RAM* memory, char* name);
+static bool execute_get_var_value(struct RAM_VALUE* ram_value, struct VM_VALUE* value);
+static bool execute_get_value(struct UNARY_EXPR* unary, struct STMT* stmt, struct RAM* memory, struct OUTPUT* output, struct VM_VALUE* value);
+static bool execute_binary_expression(struct VM_VALUE lhs, int operator, struct VM_VALUE rhs, int line, struct OUTPUT* output, struct VM_VALUE* result);
+static bool execute_binary_expression_ints(int lhs, int operator, int rhs, int line, struct OUTPUT* output, struct VM_VALUE* result);
+static bool execute_binary_expression_reals(double lhs, int operator, double rhs, int line, struct OUTPUT* output, struct VM_VALUE* result);
+static bool execute_binary_expression_strings(char* lhs, int operator, char* rhs, int line, struct OUTPUT* output, struct VM_VALUE* result);
+static bool execute_assignment(struct STMT* stmt, struct RAM* memory, struct OUTPUT* output, struct INPUT* input, struct STR_BUILDERS* strings);
+static bool execute_assignment_append(struct STMT* stmt, struct RAM* memory, struct OUTPUT* output, struct STR_BUILDERS* strings, struct STMT_ASSIGNMENT* assign, bool* success);
+static bool execute_assignment_func(struct STMT* stmt, struct RAM* memory, struct OUTPUT* output, struct INPUT* input, struct STMT_ASSIGNMENT* assign, struct RAM_VALUE* ram_value);
+static bool execute_assignment_expr(struct STMT* stmt, struct RAM* memory, struct OUTPUT* output, struct STMT_ASSIGNMENT* assign, struct RAM_VALUE* ram_value);
+static bool execute_condition(struct EXPR* condition, struct STMT* stmt, struct RAM* memory, struct OUTPUT* output, bool* result);
+static bool execute_compare_ints(int lhs, int operator, int rhs, bool* result);
+static bool execute_compare_reals(double lhs, int operator, double rhs, bool* result);
+static bool execute_is_true(struct VM_VALUE value);
+static inline void execute_walk(struct STMT* program, struct CONTEXT* context, struct LINE_PROFILE* profile, struct BUDGET* budget, struct MEMO* memo, struct TRACE* trace, struct TIMELINE* timeline);
 
 //
 // execute_function_call
@@ -75,7 +71,7 @@ static bool execute_assignment_expr(struct STMT* stmt, struct RAM* memory, struc
 //           print(x)
 //           print(123)
 //
-static bool execute_function_call(struct STMT* stmt, struct RAM* memory)
+static bool execute_function_call(struct STMT* stmt, struct RAM* memory, struct OUTPUT* output)
 {
   struct STMT_FUNCTION_CALL* call = stmt->types.function_call;
 
@@ -87,7 +83,7 @@ static bool execute_function_call(struct STMT* stmt, struct RAM* memory)
   assert(strcmp(function_name, "print") == 0);
 
   if (call->parameter == NULL)
-    printf("\n");
+    output_printf(output, "\n");
   else 
   {
     //
@@ -99,27 +95,27 @@ static bool execute_function_call(struct STMT* stmt, struct RAM* memory)
 
     if (call->parameter->element_type == ELEMENT_STR_LITERAL) 
     {
-      printf("%s\n", element_value);
+      output_printf(output, "%s\n", element_value);
     }
     else if (call->parameter->element_type == ELEMENT_INT_LITERAL) 
     {
       char* literal = element_value;
       int i = atoi(literal);
-      printf("%d\n", i);
+      output_printf(output, "%d\n", i);
     }
     else if (call->parameter->element_type == ELEMENT_REAL_LITERAL)
     {
       char* literal = element_value;
       double i = atof(literal);
-      printf("%f\n", i);
+      output_printf(output, "%f\n", i);
     }
     else if (call->parameter->element_type == ELEMENT_TRUE)
     {
-      printf("True\n");
+      output_printf(output, "True\n");
     }
     else if (call->parameter->element_type == ELEMENT_FALSE)
     {
-      printf("False\n");
+      output_printf(output, "False\n");
     }
     else 
     {
@@ -129,26 +125,26 @@ static bool execute_function_call(struct STMT* stmt, struct RAM* memory)
       assert(call->parameter->element_type == ELEMENT_IDENTIFIER);
 
       char* var_name = element_value;
-      struct RAM_VALUE* value = ram_read_cell_by_name(memory, var_name);
+      struct RAM_VALUE* value = execute_read_var(memory, var_name);
 
       if (value == NULL) 
       {
-        printf("**SEMANTIC ERROR: name '%s' is not defined (line %d)\n", var_name, stmt->line);
+        output_printf(output, "**SEMANTIC ERROR: name '%s' is not defined (line %d)\n", var_name, stmt->line);
         return false;
       }
 
       if (value->value_type == RAM_TYPE_INT)
-        printf("%d\n", value->types.i);
+        output_printf(output, "%d\n", value->types.i);
       else if (value->value_type == RAM_TYPE_REAL)
-        printf("%f\n", value->types.d);
+        output_printf(output, "%f\n", value->types.d);
       else if (value->value_type == RAM_TYPE_STR)
-        printf("%s\n", value->types.s);
+        output_printf(output, "%s\n", value->types.s);
       else if (value->value_type == RAM_TYPE_BOOLEAN)
       {
         if (value->types.i == 1)
-          printf("True\n");
+          output_printf(output, "True\n");
         else
-          printf("False\n");
+          output_printf(output, "False\n");
       }
     }
   }
@@ -158,115 +154,86 @@ static bool execute_function_call(struct STMT* stmt, struct RAM* memory)
 
 
 //
-// execute_get_var_value
+// execute_read_var
 //
-// Given a defined variable in the form of struct RAM_VALUE*, 
-// returns the value that it represents in a struct ASGNMT_VALUE.
-// The value of the variable is the active member of the types union in struct ASGNMT_VALUE.
+// If the given variable has been written to memory, returns a
+// pointer to its value; returns NULL if no such variable exists.
 //
-static struct ASGNMT_VALUE execute_get_var_value(struct RAM_VALUE* ram_value)
+// NOTE: unlike ram_read_cell_by_name, no copy is made and nothing
+// is allocated. The value (including a string) is borrowed from
+// the memory cell and is only valid until that variable is next
+// written, so the caller must not free it or hold on to it.
+//
+static struct RAM_VALUE* execute_read_var(struct RAM* memory, char* name)
 {
-  struct ASGNMT_VALUE res;
+  int address = ram_get_addr(memory, name);
 
-  if (ram_value->value_type == RAM_TYPE_INT) 
-  {
-    res.asgnmt_type = ASGNMT_INT;
-    res.success = true;
-    res.types.i = ram_value->types.i;
-  }
+  if (address < 0)
+    return NULL;
+
+  return &memory->cells[address].value;
+}
+
+
+//
+// execute_get_var_value
+//
+// Given a defined variable in the form of struct RAM_VALUE*,
+// stores the value that it represents in *value. Returns false
+// for a type of value the executor doesn't handle (e.g. None).
+//
+static bool execute_get_var_value(struct RAM_VALUE* ram_value, struct VM_VALUE* value)
+{
+  if (ram_value->value_type == RAM_TYPE_INT)
+    *value = vm_int(ram_value->types.i);
   else if (ram_value->value_type == RAM_TYPE_REAL)
-  {
-    res.asgnmt_type = ASGNMT_REAL;
-    res.success = true;
-    res.types.d = ram_value->types.d;
-  }
+    *value = vm_real(ram_value->types.d);
   else if (ram_value->value_type == RAM_TYPE_STR)
-  {
-    res.asgnmt_type = ASGNMT_STRING;
-    res.success = true;
-    res.types.s = ram_value->types.s;
-  }
+    *value = vm_str(ram_value->types.s);
   else if (ram_value->value_type == RAM_TYPE_BOOLEAN)
-  {
-    res.asgnmt_type = ASGNMT_BOOL;
-    res.success = true;
-
-    if (ram_value->types.i == 1)
-      res.types.i = 1;
-    else
-      res.types.i = 0;
-  }
+    *value = vm_bool(ram_value->types.i == 1);
   else
-  {
-    // doesn't handle other RAM value types
-    res.success = false;
-  }
+    return false;  // doesn't handle other RAM value types
 
-  return res;
+  return true;
 }
 
 
 //
 // execute_get_value
 //
-// Given a unary expr, returns the value that it represents in a struct ASGNMT_VALUE.
-// The value of the unary expr is the active member of the types union in struct ASGNMT_VALUE.
-// 
-// Note that this function can fail --- success or failure is
-// returned as a member of struct ASGNMT_VALUE,
-// where True or False is "returned" to denote success/failure.
+// Given a unary expr, stores the value that it represents in
+// *value. A string is borrowed, from the program graph or from
+// memory (see execute_read_var).
 //
-// Why would it fail? If the identifier does not exist in 
-// memory. This is a semantic error, and an error message is 
+// Note that this function can fail --- true is returned on
+// success, false on failure.
+//
+// Why would it fail? If the identifier does not exist in
+// memory. This is a semantic error, and an error message is
 // output before returning.
 //
-static struct ASGNMT_VALUE execute_get_value(struct UNARY_EXPR* unary, struct STMT* stmt, struct RAM* memory)
+static bool execute_get_value(struct UNARY_EXPR* unary, struct STMT* stmt, struct RAM* memory, struct OUTPUT* output, struct VM_VALUE* value)
 {
   //
   // we only have simple elements so far (no unary operators):
   //
   assert(unary->expr_type == UNARY_ELEMENT);
 
-  struct ASGNMT_VALUE res;
   struct ELEMENT* element = unary->element;
+  char* literal = element->element_value;
 
-  if (element->element_type == ELEMENT_INT_LITERAL) 
-  {
-    char* literal = element->element_value;
-
-    res.asgnmt_type = ASGNMT_INT;
-    res.success = true;
-    res.types.i = atoi(literal);
-  }
+  if (element->element_type == ELEMENT_INT_LITERAL)
+    *value = vm_int(atoi(literal));
   else if (element->element_type == ELEMENT_REAL_LITERAL)
-  {
-    char* literal = element->element_value;
-
-    res.asgnmt_type = ASGNMT_REAL;
-    res.success = true;
-    res.types.d = atof(literal);
-  }
+    *value = vm_real(atof(literal));
   else if (element->element_type == ELEMENT_STR_LITERAL)
-  {
-    char* literal = element->element_value;
-
-    res.asgnmt_type = ASGNMT_STRING;
-    res.success = true;
-    res.types.s = literal;
-  }
+    *value = vm_str(literal);
   else if (element->element_type == ELEMENT_TRUE)
-  {
-    res.asgnmt_type = ASGNMT_BOOL;
-    res.success = true;
-    res.types.i = 1;
-  }
+    *value = vm_bool(true);
   else if (element->element_type == ELEMENT_FALSE)
-  {
-    res.asgnmt_type = ASGNMT_BOOL;
-    res.success = true;
-    res.types.i = 0;
-  }
-  else 
+    *value = vm_bool(false);
+  else
   {
     //
     // identifier => variable
@@ -275,500 +242,217 @@ static struct ASGNMT_VALUE execute_get_value(struct UNARY_EXPR* unary, struct ST
 
     char* var_name = element->element_value;
 
-    struct RAM_VALUE* ram_value = ram_read_cell_by_name(memory, var_name);
+    struct RAM_VALUE* ram_value = execute_read_var(memory, var_name);
 
-    if (ram_value == NULL) 
+    if (ram_value == NULL)
     {
-      printf("**SEMANTIC ERROR: name '%s' is not defined (line %d)\n", var_name, stmt->line);
-      res.success = false;
-    }
-    else 
-    {
-      res = execute_get_var_value(ram_value);
+      output_printf(output, "**SEMANTIC ERROR: name '%s' is not defined (line %d)\n", var_name, stmt->line);
+      return false;
     }
+
+    return execute_get_var_value(ram_value, value);
   }
 
-  //
-  // success/failure has already been "returned", so
-  // return value (or -1 will be returned if failed):
-  //
-  return res;
+  return true;
 }
 
 
 //
 // execute_binary_expression
 //
-// Given two values and an operator, performs the operation
-// and returns the result.
+// Given two values and an operator, performs the operation and
+// stores the result in *result. Returns true if successful and
+// false if not (an error message will be output).
 //
-static struct ASGNMT_VALUE execute_binary_expression(struct ASGNMT_VALUE lhs, int operator, struct ASGNMT_VALUE rhs, int line)
+static bool execute_binary_expression(struct VM_VALUE lhs, int operator, struct VM_VALUE rhs, int line, struct OUTPUT* output, struct VM_VALUE* result)
 {
   assert(operator != OPERATOR_NO_OP);
 
-  struct ASGNMT_VALUE result;
-  
-  if (lhs.asgnmt_type == ASGNMT_INT && rhs.asgnmt_type == ASGNMT_INT)
-    result = execute_binary_expression_ints(lhs.types.i, operator, rhs.types.i, line);
-  else if (lhs.asgnmt_type == ASGNMT_REAL && rhs.asgnmt_type == ASGNMT_REAL)
-    result = execute_binary_expression_reals(lhs.types.d, operator, rhs.types.d, line);
-  else if (lhs.asgnmt_type == ASGNMT_INT && rhs.asgnmt_type == ASGNMT_REAL)
-    result = execute_binary_expression_int_real(lhs.types.i, operator, rhs.types.d, line);
-  else if (lhs.asgnmt_type == ASGNMT_REAL && rhs.asgnmt_type == ASGNMT_INT)
-    result = execute_binary_expression_real_int(lhs.types.d, operator, rhs.types.i, line);
-  else if (lhs.asgnmt_type == ASGNMT_STRING && rhs.asgnmt_type == ASGNMT_STRING)
-    result = execute_binary_expression_strings(lhs.types.s, operator, rhs.types.s);
-  else
-  {
-    printf("**SEMANTIC ERROR: invalid operand types (line %d)\n", line);
-    result.success = 0;
-  }
-  
-  return result;
-}
+  int lhs_type = vm_tag(lhs);
+  int rhs_type = vm_tag(rhs);
 
+  if (lhs_type == VM_INT && rhs_type == VM_INT)
+    return execute_binary_expression_ints(vm_as_int(lhs), operator, vm_as_int(rhs), line, output, result);
 
-//
-// execute_binary_expression_ints
-//
-// Given two ints and an operator, performs the operation
-// and returns the result.
-//
-static struct ASGNMT_VALUE execute_binary_expression_ints(int lhs, int operator, int rhs, int line)
-{
-  assert(operator != OPERATOR_NO_OP);
-  
-  struct ASGNMT_VALUE result;
-  result.success = 0;
   //
-  // perform the operation:
+  // an int with a real is promoted to a real:
   //
-  switch (operator)
+  if ((lhs_type == VM_INT || lhs_type == VM_REAL) && (rhs_type == VM_INT || rhs_type == VM_REAL))
   {
-  case OPERATOR_PLUS:
-    result.asgnmt_type = ASGNMT_INT;
-    result.success = 1;
-    result.types.i = lhs + rhs;
-    break;
-
-  case OPERATOR_MINUS:
-    result.asgnmt_type = ASGNMT_INT;
-    result.success = 1;
-    result.types.i = lhs - rhs;
-    break;
-
-  case OPERATOR_ASTERISK:
-    result.asgnmt_type = ASGNMT_INT;
-    result.success = 1;
-    result.types.i = lhs * rhs;
-    break;
-
-  case OPERATOR_POWER:
-    result.asgnmt_type = ASGNMT_INT;
-    result.success = 1;
-    result.types.i = (int)pow(lhs, rhs);
-    break;
-
-  case OPERATOR_MOD:
-    result.asgnmt_type = ASGNMT_INT;
-    result.success = 1;
-    result.types.i = lhs % rhs;
-    break;
-
-  case OPERATOR_DIV:
-    result.asgnmt_type = ASGNMT_INT;
-    if(rhs != 0)
-    {
-      result.success = 1;
-      result.types.i = lhs / rhs;
-    }
-
-      
-    else
-    {
-      printf("**ZeroDivisionError: division by zero (line %d)\n", line);
-      result.success = 0;
-    }
-    break;
+    double l = (lhs_type == VM_INT) ? vm_as_int(lhs) : vm_as_real(lhs);
+    double r = (rhs_type == VM_INT) ? vm_as_int(rhs) : vm_as_real(rhs);
 
-  case OPERATOR_EQUAL:
-    result.asgnmt_type = ASGNMT_BOOL;
-    result.success = 1;
-    result.types.i = lhs == rhs;
-    break;
-
-  case OPERATOR_NOT_EQUAL:
-    result.asgnmt_type = ASGNMT_BOOL;
-    result.success = 1;
-    result.types.i = lhs != rhs;
-    break;
-
-  case OPERATOR_LT:
-    result.asgnmt_type = ASGNMT_BOOL;
-    result.success = 1;
-    result.types.i = lhs < rhs;
-    break;
-
-  case OPERATOR_LTE:
-    result.asgnmt_type = ASGNMT_BOOL;
-    result.success = 1;
-    result.types.i = lhs <= rhs;
-    break;
-
-  case OPERATOR_GT:
-    result.asgnmt_type = ASGNMT_BOOL;
-    result.success = 1;
-    result.types.i = lhs > rhs;
-    break;
-
-  case OPERATOR_GTE:
-    result.asgnmt_type = ASGNMT_BOOL;
-    result.success = 1;
-    result.types.i = lhs >= rhs;
-    break;
-
-  default:
-    //
-    // did we miss something?
-    //
-    printf("**INTERNAL ERROR: unexpected operator (%d) in execute_binary_expr\n", operator);
-    assert(false);
+    return execute_binary_expression_reals(l, operator, r, line, output, result);
   }
 
-  return result;
-}
-
+  if (lhs_type == VM_STR && rhs_type == VM_STR)
+    return execute_binary_expression_strings(vm_as_str(lhs), operator, vm_as_str(rhs), line, output, result);
 
-//
-// execute_binary_expression_reals
-//
-// Given two reals and an operator, performs the operation
-// and returns the result.
-//
-static struct ASGNMT_VALUE execute_binary_expression_reals(double lhs, int operator, double rhs, int line)
-{
-  assert(operator != OPERATOR_NO_OP);
-  
-  struct ASGNMT_VALUE result;
-  result.success = 0;
-  //
-  // perform the operation:
-  //
-  switch (operator)
-  {
-  case OPERATOR_PLUS:
-    result.asgnmt_type = ASGNMT_REAL;
-    result.success = 1;
-    result.types.d = lhs + rhs;
-    break;
-
-  case OPERATOR_MINUS:
-    result.asgnmt_type = ASGNMT_REAL;
-    result.success = 1;
-    result.types.d = lhs - rhs;
-    break;
-
-  case OPERATOR_ASTERISK:
-    result.asgnmt_type = ASGNMT_REAL;
-    result.success = 1;
-    result.types.d = lhs * rhs;
-    break;
-
-  case OPERATOR_POWER:
-    result.asgnmt_type = ASGNMT_REAL;
-    result.success = 1;
-    result.types.d = pow(lhs, rhs);
-    break;
-
-  case OPERATOR_MOD:
-    result.asgnmt_type = ASGNMT_REAL;
-    result.success = 1;
-    result.types.d = fmod(lhs, rhs);
-    break;
-
-  case OPERATOR_DIV:
-    result.asgnmt_type = ASGNMT_REAL;
-    if(rhs != 0.0)
-    {
-      result.success = 1;
-      result.types.d = lhs / rhs;
-    }
-
-      
-    else
-    {
-      printf("**ZeroDivisionError: division by zero (line %d)\n", line);
-      result.success = 0;
-    }
-    break;
-
-  case OPERATOR_EQUAL:
-    result.asgnmt_type = ASGNMT_BOOL;
-    result.success = 1;
-    result.types.i = lhs == rhs;
-    break;
-
-  case OPERATOR_NOT_EQUAL:
-    result.asgnmt_type = ASGNMT_BOOL;
-    result.success = 1;
-    result.types.i = lhs != rhs;
-    break;
-
-  case OPERATOR_LT:
-    result.asgnmt_type = ASGNMT_BOOL;
-    result.success = 1;
-    result.types.i = lhs < rhs;
-    break;
-
-  case OPERATOR_LTE:
-    result.asgnmt_type = ASGNMT_BOOL;
-    result.success = 1;
-    result.types.i = lhs <= rhs;
-    break;
-
-  case OPERATOR_GT:
-    result.asgnmt_type = ASGNMT_BOOL;
-    result.success = 1;
-    result.types.i = lhs > rhs;
-    break;
-
-  case OPERATOR_GTE:
-    result.asgnmt_type = ASGNMT_BOOL;
-    result.success = 1;
-    result.types.i = lhs >= rhs;
-    break;
-
-  default:
-    //
-    // did we miss something?
-    //
-    printf("**INTERNAL ERROR: unexpected operator (%d) in execute_binary_expr\n", operator);
-    assert(false);
-  }
-
-  return result;
+  output_printf(output, "**SEMANTIC ERROR: invalid operand types (line %d)\n", line);
+  return false;
 }
 
 
 //
-// execute_binary_expression_int_real
+// execute_binary_expression_ints
 //
-// Given lhs as int, rhs as real, and an operator, performs the operation
-// and returns the result.
+// Given two ints and an operator, performs the operation
+// and stores the result in *result.
 //
-static struct ASGNMT_VALUE execute_binary_expression_int_real(int lhs, int operator, double rhs, int line)
+static bool execute_binary_expression_ints(int lhs, int operator, int rhs, int line, struct OUTPUT* output, struct VM_VALUE* result)
 {
   assert(operator != OPERATOR_NO_OP);
-  
-  struct ASGNMT_VALUE result;
-  result.success = 0;
+
   //
-  // perform the operation:
+  // perform the operation; +, -, * wrap around on overflow
+  // (in unsigned arithmetic, where that's defined), the same
+  // as in the VM:
   //
   switch (operator)
   {
   case OPERATOR_PLUS:
-    result.asgnmt_type = ASGNMT_REAL;
-    result.success = 1;
-    result.types.d = lhs + rhs;
+    *result = vm_int((int) ((unsigned int) lhs + (unsigned int) rhs));
     break;
 
   case OPERATOR_MINUS:
-    result.asgnmt_type = ASGNMT_REAL;
-    result.success = 1;
-    result.types.d = lhs - rhs;
+    *result = vm_int((int) ((unsigned int) lhs - (unsigned int) rhs));
     break;
 
   case OPERATOR_ASTERISK:
-    result.asgnmt_type = ASGNMT_REAL;
-    result.success = 1;
-    result.types.d = lhs * rhs;
+    *result = vm_int((int) ((unsigned int) lhs * (unsigned int) rhs));
     break;
 
   case OPERATOR_POWER:
-    result.asgnmt_type = ASGNMT_REAL;
-    result.success = 1;
-    result.types.d = pow(lhs, rhs);
+    *result = vm_int(arith_power_ints(lhs, rhs));
     break;
 
   case OPERATOR_MOD:
-    result.asgnmt_type = ASGNMT_REAL;
-    result.success = 1;
-    result.types.d = fmod(lhs, rhs);
-    break;
-
   case OPERATOR_DIV:
-    result.asgnmt_type = ASGNMT_REAL;
-    if(rhs != 0.0 && rhs != 0)
+    if (rhs == 0)
     {
-      result.success = 1;
-      result.types.d = lhs / rhs;
+      output_printf(output, "**ZeroDivisionError: division by zero (line %d)\n", line);
+      return false;
     }
 
-      
-    else
-    {
-      printf("**ZeroDivisionError: division by zero (line %d)\n", line);
-      result.success = 0;
-    }
+    *result = vm_int(operator == OPERATOR_MOD ? lhs % rhs : lhs / rhs);
     break;
 
   case OPERATOR_EQUAL:
-    result.asgnmt_type = ASGNMT_BOOL;
-    result.success = 1;
-    result.types.i = lhs == rhs;
+    *result = vm_bool(lhs == rhs);
     break;
 
   case OPERATOR_NOT_EQUAL:
-    result.asgnmt_type = ASGNMT_BOOL;
-    result.success = 1;
-    result.types.i = lhs != rhs;
+    *result = vm_bool(lhs != rhs);
     break;
 
   case OPERATOR_LT:
-    result.asgnmt_type = ASGNMT_BOOL;
-    result.success = 1;
-    result.types.i = lhs < rhs;
+    *result = vm_bool(lhs < rhs);
     break;
 
   case OPERATOR_LTE:
-    result.asgnmt_type = ASGNMT_BOOL;
-    result.success = 1;
-    result.types.i = lhs <= rhs;
+    *result = vm_bool(lhs <= rhs);
     break;
 
   case OPERATOR_GT:
-    result.asgnmt_type = ASGNMT_BOOL;
-    result.success = 1;
-    result.types.i = lhs > rhs;
+    *result = vm_bool(lhs > rhs);
     break;
 
   case OPERATOR_GTE:
-    result.asgnmt_type = ASGNMT_BOOL;
-    result.success = 1;
-    result.types.i = lhs >= rhs;
+    *result = vm_bool(lhs >= rhs);
     break;
 
   default:
     //
     // did we miss something?
     //
-    printf("**INTERNAL ERROR: unexpected operator (%d) in execute_binary_expr\n", operator);
+    output_printf(output, "**INTERNAL ERROR: unexpected operator (%d) in execute_binary_expr\n", operator);
     assert(false);
+    return false;
   }
 
-  return result;
+  return true;
 }
 
 
 //
-// execute_binary_expression_real_int
+// execute_binary_expression_reals
 //
-// Given lhs as real, rhs as int, and an operator, performs the operation
-// and returns the result.
+// Given two reals and an operator, performs the operation
+// and stores the result in *result.
 //
-static struct ASGNMT_VALUE execute_binary_expression_real_int(double lhs, int operator, int rhs, int line)
+static bool execute_binary_expression_reals(double lhs, int operator, double rhs, int line, struct OUTPUT* output, struct VM_VALUE* result)
 {
   assert(operator != OPERATOR_NO_OP);
-  
-  struct ASGNMT_VALUE result;
-  result.success = 0;
+
   //
   // perform the operation:
   //
   switch (operator)
   {
   case OPERATOR_PLUS:
-    result.asgnmt_type = ASGNMT_REAL;
-    result.success = 1;
-    result.types.d = lhs + rhs;
+    *result = vm_real(lhs + rhs);
     break;
 
   case OPERATOR_MINUS:
-    result.asgnmt_type = ASGNMT_REAL;
-    result.success = 1;
-    result.types.d = lhs - rhs;
+    *result = vm_real(lhs - rhs);
     break;
 
   case OPERATOR_ASTERISK:
-    result.asgnmt_type = ASGNMT_REAL;
-    result.success = 1;
-    result.types.d = lhs * rhs;
+    *result = vm_real(lhs * rhs);
     break;
 
   case OPERATOR_POWER:
-    result.asgnmt_type = ASGNMT_REAL;
-    result.success = 1;
-    result.types.d = pow(lhs, rhs);
+    *result = vm_real(pow(lhs, rhs));
     break;
 
   case OPERATOR_MOD:
-    result.asgnmt_type = ASGNMT_REAL;
-    result.success = 1;
-    result.types.d = fmod(lhs, rhs);
+    *result = vm_real(fmod(lhs, rhs));
     break;
 
   case OPERATOR_DIV:
-    result.asgnmt_type = ASGNMT_REAL;
-    if(rhs != 0.0 && rhs != 0)
+    if (rhs == 0.0)
     {
-      result.success = 1;
-      result.types.d = lhs / rhs;
+      output_printf(output, "**ZeroDivisionError: division by zero (line %d)\n", line);
+      return false;
     }
 
-      
-    else
-    {
-      printf("**ZeroDivisionError: division by zero (line %d)\n", line);
-      result.success = 0;
-    }
+    *result = vm_real(lhs / rhs);
     break;
 
   case OPERATOR_EQUAL:
-    result.asgnmt_type = ASGNMT_BOOL;
-    result.success = 1;
-    result.types.i = lhs == rhs;
+    *result = vm_bool(lhs == rhs);
     break;
 
   case OPERATOR_NOT_EQUAL:
-    result.asgnmt_type = ASGNMT_BOOL;
-    result.success = 1;
-    result.types.i = lhs != rhs;
+    *result = vm_bool(lhs != rhs);
     break;
 
   case OPERATOR_LT:
-    result.asgnmt_type = ASGNMT_BOOL;
-    result.success = 1;
-    result.types.i = lhs < rhs;
+    *result = vm_bool(lhs < rhs);
     break;
 
   case OPERATOR_LTE:
-    result.asgnmt_type = ASGNMT_BOOL;
-    result.success = 1;
-    result.types.i = lhs <= rhs;
+    *result = vm_bool(lhs <= rhs);
     break;
 
   case OPERATOR_GT:
-    result.asgnmt_type = ASGNMT_BOOL;
-    result.success = 1;
-    result.types.i = lhs > rhs;
+    *result = vm_bool(lhs > rhs);
     break;
 
   case OPERATOR_GTE:
-    result.asgnmt_type = ASGNMT_BOOL;
-    result.success = 1;
-    result.types.i = lhs >= rhs;
+    *result = vm_bool(lhs >= rhs);
     break;
 
   default:
     //
     // did we miss something?
     //
-    printf("**INTERNAL ERROR: unexpected operator (%d) in execute_binary_expr\n", operator);
+    output_printf(output, "**INTERNAL ERROR: unexpected operator (%d) in execute_binary_expr\n", operator);
     assert(false);
+    return false;
   }
 
-  return result;
+  return true;
 }
 
 
@@ -776,14 +460,12 @@ static struct ASGNMT_VALUE execute_binary_expression_real_int(double lhs, int op
 // execute_binary_expression_strings
 //
 // Given two strings and an operator, performs the operation
-// and returns the result.
+// and stores the result in *result. The result of + is a new
+// string, which the caller owns.
 //
-static struct ASGNMT_VALUE execute_binary_expression_strings(char* lhs, int operator, char* rhs)
+static bool execute_binary_expression_strings(char* lhs, int operator, char* rhs, int line, struct OUTPUT* output, struct VM_VALUE* result)
 {
   assert(operator != OPERATOR_NO_OP);
-  
-  struct ASGNMT_VALUE result;
-  result.success = 0;
 
   int compare_val = strcmp(lhs, rhs);
 
@@ -793,92 +475,52 @@ static struct ASGNMT_VALUE execute_binary_expression_strings(char* lhs, int oper
   switch (operator)
   {
   case OPERATOR_PLUS:
-    result.asgnmt_type = ASGNMT_STRING;
-    result.success = 1;
-
+  {
     char* concatenated = malloc((strlen(lhs) + strlen(rhs) + 1) * sizeof(char));
 
+    if (concatenated == NULL)
+      exit(0);
+
     strcpy(concatenated, lhs);
     strcat(concatenated, rhs);
 
-    result.types.s = concatenated;
+    *result = vm_str(concatenated);
     break;
+  }
 
   case OPERATOR_EQUAL:
-    result.asgnmt_type = ASGNMT_BOOL;
-    result.success = 1;
-
-    if (compare_val == 0)
-      result.types.i = 1;
-    else
-      result.types.i = 0;
-
+    *result = vm_bool(compare_val == 0);
     break;
 
   case OPERATOR_NOT_EQUAL:
-    result.asgnmt_type = ASGNMT_BOOL;
-    result.success = 1;
-    
-    if (compare_val != 0)
-      result.types.i = 1;
-    else
-      result.types.i = 0;
-
+    *result = vm_bool(compare_val != 0);
     break;
 
   case OPERATOR_LT:
-    result.asgnmt_type = ASGNMT_BOOL;
-    result.success = 1;
-
-    if (compare_val < 0)
-      result.types.i = 1;
-    else
-      result.types.i = 0;
-
+    *result = vm_bool(compare_val < 0);
     break;
 
   case OPERATOR_LTE:
-    result.asgnmt_type = ASGNMT_BOOL;
-    result.success = 1;
-    
-    if (compare_val <= 0)
-      result.types.i = 1;
-    else
-      result.types.i = 0;
-
+    *result = vm_bool(compare_val <= 0);
     break;
 
   case OPERATOR_GT:
-    result.asgnmt_type = ASGNMT_BOOL;
-    result.success = 1;
-
-    if (compare_val > 0)
-      result.types.i = 1;
-    else
-      result.types.i = 0;
-
+    *result = vm_bool(compare_val > 0);
     break;
 
   case OPERATOR_GTE:
-    result.asgnmt_type = ASGNMT_BOOL;
-    result.success = 1;
-
-    if (compare_val >= 0)
-      result.types.i = 1;
-    else
-      result.types.i = 0;
-
+    *result = vm_bool(compare_val >= 0);
     break;
 
   default:
     //
-    // did we miss something?
+    // e.g. "a" - "b":
     //
-    printf("**INTERNAL ERROR: unexpected operator (%d) in execute_binary_expr\n", operator);
-    assert(false);
+    output_printf(output, "**SEMANTIC ERROR: invalid operand types (line %d)\n", line);
+    return false;
   }
 
-  return result;
+  return true;
 }
 
 
@@ -893,7 +535,7 @@ static struct ASGNMT_VALUE execute_binary_expression_strings(char* lhs, int oper
 // Examples: x = 123
 //           y = x ** 2
 //
-static bool execute_assignment(struct STMT* stmt, struct RAM* memory)
+static bool execute_assignment(struct STMT* stmt, struct RAM* memory, struct OUTPUT* output, struct INPUT* input, struct STR_BUILDERS* strings)
 {
   struct STMT_ASSIGNMENT* assign = stmt->types.assignment;
 
@@ -907,9 +549,15 @@ static bool execute_assignment(struct STMT* stmt, struct RAM* memory)
   bool success;
   struct RAM_VALUE ram_value;
 
+  //
+  // s = s + "..." appends in place:
+  //
+  if (execute_assignment_append(stmt, memory, output, strings, assign, &success))
+    return success;
+
   if (assign->rhs->value_type == VALUE_FUNCTION_CALL)
   {
-    bool func_success = execute_assignment_func(stmt, memory, assign, &ram_value);
+    bool func_success = execute_assignment_func(stmt, memory, output, input, assign, &ram_value);
 
     if (!func_success)
       return false;
@@ -918,29 +566,129 @@ static bool execute_assignment(struct STMT* stmt, struct RAM* memory)
   {
     assert(assign->rhs->value_type == VALUE_EXPR);
 
-    bool expr_success = execute_assignment_expr(stmt, memory, assign, &ram_value);
+    bool expr_success = execute_assignment_expr(stmt, memory, output, assign, &ram_value);
 
     if (!expr_success)
       return false;
   }
 
+  //
+  // a string from input() or from concatenation was allocated
+  // for this statement; any other string is borrowed from a
+  // literal or from memory (see execute_read_var):
+  //
+  bool owned = ram_value.value_type == RAM_TYPE_STR &&
+               (assign->rhs->value_type == VALUE_FUNCTION_CALL || assign->rhs->types.expr->isBinaryExpr);
+
+  if (ram_value.value_type == RAM_TYPE_STR && !owned)
+  {
+    //
+    // s = s: the borrowed string is the one memory is about to
+    // free before duplicating the new value, and nothing would
+    // change anyway:
+    //
+    struct RAM_VALUE* current = execute_read_var(memory, var_name);
+
+    if (current != NULL && current->value_type == RAM_TYPE_STR && current->types.s == ram_value.types.s)
+      return true;
+  }
+
   //
   // write the value to memory:
   //
 
+  int previous = alloc_enter(ALLOC_RAM);
+
   success = ram_write_cell_by_name(memory, ram_value, var_name);
 
+  alloc_leave(previous);
+
+  //
+  // memory made its own copy:
+  //
+  if (owned)
+    free(ram_value.types.s);
+
+  //
+  // the old value was freed, so a string builder for this
+  // variable no longer describes what's in memory:
+  //
+  if (strings->num_active > 0)
+    strbuild_forget(strings, ram_get_addr(memory, var_name));
+
   return success;
 }
 
 
+//
+// execute_assignment_append
+//
+// Fast path for string concatenation onto the variable being
+// assigned, e.g. s = s + "x". The memory cell is the only
+// reference to its string (RAM copies strings on read and
+// write), so the string is grown in place by a string builder
+// instead of being copied into a new buffer every time. This
+// makes a loop of s = s + "x" linear instead of quadratic.
+//
+// Returns true if the statement was handled here, with success
+// or failure in *success. Returns false if the statement does
+// not have this shape (e.g. s is not a string), in which case
+// nothing was done and the caller executes it the normal way.
+//
+static bool execute_assignment_append(struct STMT* stmt, struct RAM* memory, struct OUTPUT* output, struct STR_BUILDERS* strings, struct STMT_ASSIGNMENT* assign, bool* success)
+{
+  if (assign->rhs->value_type != VALUE_EXPR)
+    return false;
+
+  struct EXPR* expr = assign->rhs->types.expr;
+
+  if (!expr->isBinaryExpr || expr->operator != OPERATOR_PLUS)
+    return false;
+
+  if (expr->lhs->expr_type != UNARY_ELEMENT ||
+      expr->lhs->element->element_type != ELEMENT_IDENTIFIER ||
+      strcmp(expr->lhs->element->element_value, assign->var_name) != 0)
+    return false;
+
+  int address = ram_get_addr(memory, assign->var_name);
+
+  if (address < 0)
+    return false;
+
+  //
+  // the string is updated in place, so we work with the cell
+  // directly rather than with a copy:
+  //
+  struct RAM_CELL* cell = &memory->cells[address];
+
+  if (cell->value.value_type != RAM_TYPE_STR)
+    return false;
+
+  struct VM_VALUE rhs_value;
+
+  if (!execute_get_value(expr->rhs, stmt, memory, output, &rhs_value))  // semantic error, message already output:
+  {
+    *success = false;
+    return true;
+  }
+
+  if (vm_tag(rhs_value) != VM_STR)
+    return false;
+
+  cell->value.types.s = strbuild_append(strings, address, cell->value.types.s, vm_as_str(rhs_value));
+
+  *success = true;
+  return true;
+}
+
+
 //
 // execute_assignment_func
 //
 // Executes an assignment statement whose right hand side is a function, 
 // returning true if successful and false if not.
 //
-static bool execute_assignment_func(struct STMT* stmt, struct RAM* memory, struct STMT_ASSIGNMENT* assign, struct RAM_VALUE* ram_value)
+static bool execute_assignment_func(struct STMT* stmt, struct RAM* memory, struct OUTPUT* output, struct INPUT* input, struct STMT_ASSIGNMENT* assign, struct RAM_VALUE* ram_value)
 {
   struct FUNCTION_CALL* func = assign->rhs->types.function_call;
 
@@ -951,32 +699,41 @@ static bool execute_assignment_func(struct STMT* stmt, struct RAM* memory, struc
   {
     assert(param->element_type == ELEMENT_STR_LITERAL);
 
-    printf("%s", param->element_value);
-
-    char line[256];
+    output_printf(output, "%s", param->element_value);
 
-    fgets(line, sizeof(line), stdin);
+    //
+    // the prompt must be visible before we block on input:
+    //
+    output_flush(output);
 
-    // delete EOL chars from input: 
-    line[strcspn(line, "\r\n")] = '\0';
+    char* user_input;
 
-    char* user_input = malloc(sizeof(line));
-    strcpy(user_input, line);
+    input_read_line(input, &user_input);
 
     ram_value->value_type = RAM_TYPE_STR;
     ram_value->types.s = user_input;
   }
   else if (strcmp(func_name, "int") == 0)
   {
-    struct RAM_VALUE* var_str = ram_read_cell_by_name(memory, param->element_value);
-    assert(var_str->value_type == RAM_TYPE_STR);
-    char* var_str_val = var_str->types.s;
+    struct RAM_VALUE* var_str = execute_read_var(memory, param->element_value);
+
+    if (var_str == NULL)
+    {
+      output_printf(output, "**SEMANTIC ERROR: name '%s' is not defined (line %d)\n", param->element_value, stmt->line);
+      return false;
+    }
+
+    if (var_str->value_type != RAM_TYPE_STR)
+    {
+      output_printf(output, "**SEMANTIC ERROR: invalid string for int() (line %d)\n", stmt->line);
+      return false;
+    }
 
-    int var_int = atoi(var_str_val);
+    int var_int;
 
-    if (var_int == 0 && var_str_val[0] != '0')
+    if (!arith_string_to_int(var_str->types.s, &var_int))
     {
-      printf("**SEMANTIC ERROR: invalid string for int() (line %d)\n", stmt->line);
+      output_printf(output, "**SEMANTIC ERROR: invalid string for int() (line %d)\n", stmt->line);
       return false;
     }
     else
@@ -987,21 +744,35 @@ static bool execute_assignment_func(struct STMT* stmt, struct RAM* memory, struc
   }
   else if (strcmp(func_name, "float") == 0)
   {
-    struct RAM_VALUE* var_str = ram_read_cell_by_name(memory, param->element_value);
-    assert(var_str->value_type == RAM_TYPE_STR);
-    char* var_str_val = var_str->types.s;
+    struct RAM_VALUE* var_str = execute_read_var(memory, param->element_value);
+
+    if (var_str == NULL)
+    {
+      output_printf(output, "**SEMANTIC ERROR: name '%s' is not defined (line %d)\n", param->element_value, stmt->line);
+      return false;
+    }
+
+    if (var_str->value_type != RAM_TYPE_STR)
+    {
+      output_printf(output, "**SEMANTIC ERROR: invalid string for float() (line %d)\n", stmt->line);
+      return false;
+    }
 
-    double var_float = atof(var_str_val);
+    double var_float;
 
-    if (var_float == 0 && var_str_val[0] != '0')
+    if (!arith_string_to_real(var_str->types.s, &var_float))
     {
-      printf("**SEMANTIC ERROR: invalid string for float() (line %d)\n", stmt->line);
+      output_printf(output, "**SEMANTIC ERROR: invalid string for float() (line %d)\n", stmt->line);
       return false;
     }
     else
     {
+      //
+      // a NaN is stored the way the VM boxes it, without its
+      // sign, so float("-nan") prints nan on both engines:
+      //
       ram_value->value_type = RAM_TYPE_REAL;
-      ram_value->types.d = var_float;
+      ram_value->types.d = vm_as_real(vm_real(var_float));
     }
   }
   else
@@ -1017,7 +788,7 @@ static bool execute_assignment_func(struct STMT* stmt, struct RAM* memory, struc
 // Executes an assignment statement whose right hand side is an expression, 
 // returning true if successful and false if not.
 //
-static bool execute_assignment_expr(struct STMT* stmt, struct RAM* memory, struct STMT_ASSIGNMENT* assign, struct RAM_VALUE* ram_value)
+static bool execute_assignment_expr(struct STMT* stmt, struct RAM* memory, struct OUTPUT* output, struct STMT_ASSIGNMENT* assign, struct RAM_VALUE* ram_value)
 {
   struct EXPR* expr = assign->rhs->types.expr;
 
@@ -1026,79 +797,58 @@ static bool execute_assignment_expr(struct STMT* stmt, struct RAM* memory, struc
   //
   assert(expr->lhs != NULL);
 
-  struct ASGNMT_VALUE lhs_value = execute_get_value(expr->lhs, stmt, memory);
+  struct VM_VALUE value;
 
-  if (!lhs_value.success)  // semantic error? If so, return now:
+  if (!execute_get_value(expr->lhs, stmt, memory, output, &value))  // semantic error? If so, return now:
     return false;
 
   //
   // do we have a binary expression?
   //
-  if (!expr->isBinaryExpr) 
-  {
-    if (lhs_value.asgnmt_type == ASGNMT_INT)
-    {
-      ram_value->value_type = RAM_TYPE_INT;
-      ram_value->types.i = lhs_value.types.i;
-    }
-    else if (lhs_value.asgnmt_type == ASGNMT_REAL)
-    {
-      ram_value->value_type = RAM_TYPE_REAL;
-      ram_value->types.d = lhs_value.types.d;
-    }
-    else if (lhs_value.asgnmt_type == ASGNMT_STRING)
-    {
-      ram_value->value_type = RAM_TYPE_STR;
-      ram_value->types.s = lhs_value.types.s;
-    }
-    else
-    {
-      assert(lhs_value.asgnmt_type == ASGNMT_BOOL);
-
-      ram_value->value_type = RAM_TYPE_BOOLEAN;
-      ram_value->types.i = lhs_value.types.i;
-    }
-  }
-  else 
+  if (expr->isBinaryExpr)
   {
     //
     // binary expression such as x + y
     //
     assert(expr->operator != OPERATOR_NO_OP);  // we must have an operator
 
-    struct ASGNMT_VALUE rhs_value = execute_get_value(expr->rhs, stmt, memory);
+    struct VM_VALUE rhs_value;
 
-    if (!rhs_value.success)  // semantic error? If so, return now:
+    if (!execute_get_value(expr->rhs, stmt, memory, output, &rhs_value))  // semantic error? If so, return now:
       return false;
 
     //
     // perform the operation:
     //
-    struct ASGNMT_VALUE expr_result = execute_binary_expression(lhs_value, expr->operator, rhs_value, stmt->line);
+    struct VM_VALUE lhs_value = value;
 
-    if(!expr_result.success)
+    if (!execute_binary_expression(lhs_value, expr->operator, rhs_value, stmt->line, output, &value))
       return false;
-    
-    if (expr_result.asgnmt_type == ASGNMT_INT)
-    {
-      ram_value->value_type = RAM_TYPE_INT;
-      ram_value->types.i = expr_result.types.i;
-    }
-    else if (expr_result.asgnmt_type == ASGNMT_REAL)
-    {
-      ram_value->value_type = RAM_TYPE_REAL;
-      ram_value->types.d = expr_result.types.d;
-    }
-    else if (expr_result.asgnmt_type == ASGNMT_STRING)
-    {
-      ram_value->value_type = RAM_TYPE_STR;
-      ram_value->types.s = expr_result.types.s;
-    }
-    else if (expr_result.asgnmt_type == ASGNMT_BOOL)
-    {
-      ram_value->value_type = RAM_TYPE_BOOLEAN;
-      ram_value->types.i = expr_result.types.i;
-    }
+  }
+
+  switch (vm_tag(value))
+  {
+  case VM_INT:
+    ram_value->value_type = RAM_TYPE_INT;
+    ram_value->types.i = vm_as_int(value);
+    break;
+
+  case VM_REAL:
+    ram_value->value_type = RAM_TYPE_REAL;
+    ram_value->types.d = vm_as_real(value);
+    break;
+
+  case VM_STR:
+    ram_value->value_type = RAM_TYPE_STR;
+    ram_value->types.s = vm_as_str(value);
+    break;
+
+  default:
+    assert(vm_tag(value) == VM_BOOL);
+
+    ram_value->value_type = RAM_TYPE_BOOLEAN;
+    ram_value->types.i = vm_as_bool(value);
+    break;
   }
 
   return true;
@@ -1106,48 +856,256 @@ static bool execute_assignment_expr(struct STMT* stmt, struct RAM* memory, struc
 
 
 //
-// Public functions:
+// execute_condition
+//
+// Evaluates the condition of a while loop or if statement and
+// stores whether it holds in *result. Returns true if successful
+// and false if not (an error message will be output before false
+// is returned, so the caller doesn't need to output anything).
+//
+// Conditions are nearly always comparisons, so comparing two ints
+// or two reals produces the bool directly, without building
+// a value in the general binary expression code. Any other
+// condition is evaluated the normal way and its truthiness
+// is used, e.g. while x: where x is a boolean.
+//
+static bool execute_condition(struct EXPR* condition, struct STMT* stmt, struct RAM* memory, struct OUTPUT* output, bool* result)
+{
+  assert(condition->lhs != NULL);
+
+  struct VM_VALUE lhs_value;
+
+  if (!execute_get_value(condition->lhs, stmt, memory, output, &lhs_value))  // semantic error? If so, return now:
+    return false;
+
+  if (!condition->isBinaryExpr)
+  {
+    *result = execute_is_true(lhs_value);
+    return true;
+  }
+
+  struct VM_VALUE rhs_value;
+
+  if (!execute_get_value(condition->rhs, stmt, memory, output, &rhs_value))  // semantic error? If so, return now:
+    return false;
+
+  //
+  // specialized comparisons:
+  //
+  if (vm_tag(lhs_value) == VM_INT && vm_tag(rhs_value) == VM_INT &&
+      execute_compare_ints(vm_as_int(lhs_value), condition->operator, vm_as_int(rhs_value), result))
+    return true;
+
+  if (vm_tag(lhs_value) == VM_REAL && vm_tag(rhs_value) == VM_REAL &&
+      execute_compare_reals(vm_as_real(lhs_value), condition->operator, vm_as_real(rhs_value), result))
+    return true;
+
+  //
+  // everything else, e.g. strings or mixed int and real:
+  //
+  struct VM_VALUE value;
+
+  if (!execute_binary_expression(lhs_value, condition->operator, rhs_value, stmt->line, output, &value))
+    return false;
+
+  *result = execute_is_true(value);
+
+  if (vm_tag(value) == VM_STR)  // result of concatenation, not needed:
+    free(vm_as_str(value));
+
+  return true;
+}
+
+
 //
+// execute_compare_ints
+//
+// If operator is a comparison, stores lhs operator rhs in *result
+// and returns true. Returns false for any other operator.
+//
+static bool execute_compare_ints(int lhs, int operator, int rhs, bool* result)
+{
+  switch (operator)
+  {
+  case OPERATOR_EQUAL:     *result = lhs == rhs; return true;
+  case OPERATOR_NOT_EQUAL: *result = lhs != rhs; return true;
+  case OPERATOR_LT:        *result = lhs < rhs;  return true;
+  case OPERATOR_LTE:       *result = lhs <= rhs; return true;
+  case OPERATOR_GT:        *result = lhs > rhs;  return true;
+  case OPERATOR_GTE:       *result = lhs >= rhs; return true;
+  default:                 return false;
+  }
+}
+
 
 //
-// execute
+// execute_compare_reals
+//
+// If operator is a comparison, stores lhs operator rhs in *result
+// and returns true. Returns false for any other operator.
+//
+static bool execute_compare_reals(double lhs, int operator, double rhs, bool* result)
+{
+  switch (operator)
+  {
+  case OPERATOR_EQUAL:     *result = lhs == rhs; return true;
+  case OPERATOR_NOT_EQUAL: *result = lhs != rhs; return true;
+  case OPERATOR_LT:        *result = lhs < rhs;  return true;
+  case OPERATOR_LTE:       *result = lhs <= rhs; return true;
+  case OPERATOR_GT:        *result = lhs > rhs;  return true;
+  case OPERATOR_GTE:       *result = lhs >= rhs; return true;
+  default:                 return false;
+  }
+}
+
+
 //
-// Given a nuPython program graph and a memory, 
-// executes the statements in the program graph.
-// If a semantic error occurs (e.g. type error),
-// an error message is output, execution stops,
-// and the function returns.
+// execute_is_true
 //
-void execute(struct STMT* program, struct RAM* memory)
+// Returns the truthiness of a value, as in Python: False, 0,
+// 0.0, and "" are false, everything else is true.
+//
+static bool execute_is_true(struct VM_VALUE value)
 {
+  if (vm_tag(value) == VM_INT || vm_tag(value) == VM_BOOL)
+    return vm_as_int(value) != 0;
+  else if (vm_tag(value) == VM_REAL)
+    return vm_as_real(value) != 0.0;
+  else
+  {
+    assert(vm_tag(value) == VM_STR);
+
+    return vm_as_str(value)[0] != '\0';
+  }
+}
+
+
+//
+// execute_walk
+//
+// Executes the program by walking the program graph. If profile
+// is not NULL, every stmt is counted and timed by line; if
+// budget is not NULL, execution stops when it runs out; if memo
+// is not NULL, passes through pure loop bodies are replayed from
+// it (see memo.h); if trace is not NULL, every stmt executed is
+// recorded in it (see trace.h), after it runs if it's an
+// assignment; if timeline is not NULL, every run of a while loop
+// and every pass through its body is a span in it (see
+// timeline.h). All are NULL unless the context asks for them,
+// and this function is inlined into execute_tree, so then the
+// checks disappear.
+//
+static inline void execute_walk(struct STMT* program, struct CONTEXT* context, struct LINE_PROFILE* profile, struct BUDGET* budget, struct MEMO* memo, struct TRACE* trace, struct TIMELINE* timeline)
+{
+  struct RAM* memory = context->memory;
+  struct OUTPUT* output = context->output;
+  struct INPUT* input = context->input;
+
   struct STMT* stmt = program;
+  struct STMT* previous = NULL;  // stmt executed last, on a budget
+
+  struct STR_BUILDERS* strings = strbuild_init();
 
   //
   // traverse through the program statements:
   //
   while (stmt != NULL) 
   {
+    if (profile != NULL)
+      lineprof_enter(profile, stmt->line);
+
+    if (budget != NULL)
+    {
+      //
+      // a while loop reached from a stmt after it (in its body),
+      // or from itself (a replayed pass), is a back edge:
+      //
+      if (stmt->stmt_type == STMT_WHILE_LOOP && previous != NULL && previous->line >= stmt->line &&
+          !budget_check(budget, output, stmt->line))
+        break;
+
+      budget->stmts++;
+      previous = stmt;
+    }
+
+    if (trace != NULL && stmt->stmt_type != STMT_ASSIGNMENT)
+      trace_stmt(trace, stmt->line);
 
     if (stmt->stmt_type == STMT_ASSIGNMENT) 
     {
+      if (memo != NULL && memo->num_recording > 0)
+        memo_written(memo, stmt->types.assignment->var_name);
+
+      bool success = execute_assignment(stmt, memory, output, input, strings);
 
-      bool success = execute_assignment(stmt, memory);
+      if (trace != NULL && success)
+        trace_write(trace, stmt->line, memory, ram_get_addr(memory, stmt->types.assignment->var_name));
+      else if (trace != NULL)
+        trace_stmt(trace, stmt->line);
 
       if (!success)
-        return;
+        break;
 
       stmt = stmt->types.assignment->next_stmt;  // advance
     }
     else if (stmt->stmt_type == STMT_FUNCTION_CALL) 
     {
 
-      bool success = execute_function_call(stmt, memory);
+      bool success = execute_function_call(stmt, memory, output);
 
       if (!success)
-        return;
+        break;
 
       stmt = stmt->types.function_call->next_stmt;
     }
+    else if (stmt->stmt_type == STMT_WHILE_LOOP)
+    {
+      struct STMT_WHILE_LOOP* loop = stmt->types.while_loop;
+
+      //
+      // back from a pass through the body being recorded?
+      //
+      if (memo != NULL && memo->num_recording > 0)
+        memo_record(memo, stmt, memory);
+
+      bool condition;
+      bool success = execute_condition(loop->condition, stmt, memory, output, &condition);
+
+      if (!success)
+        break;
+
+      if (timeline != NULL)
+        timeline_loop(timeline, stmt, condition);
+
+      //
+      // the last stmt of the body links back to this stmt,
+      // so the condition is re-evaluated after each pass (a
+      // pass that was replayed instead stays here):
+      //
+      if (!condition)
+        stmt = loop->next_stmt;
+      else if (memo == NULL || !memo_replay(memo, stmt, memory, strings))
+        stmt = loop->loop_body;
+    }
+    else if (stmt->stmt_type == STMT_IF_THEN_ELSE)
+    {
+      struct STMT_IF_THEN_ELSE* if_then_else = stmt->types.if_then_else;
+
+      bool condition;
+      bool success = execute_condition(if_then_else->condition, stmt, memory, output, &condition);
+
+      if (!success)
+        break;
+
+      //
+      // elif is an if stmt on the false path; both paths link
+      // to the stmt after the whole if when they're done:
+      //
+      if (condition)
+        stmt = if_then_else->true_path;
+      else
+        stmt = if_then_else->false_path;
+    }
     else 
     {
       assert(stmt->stmt_type == STMT_PASS);
@@ -1160,8 +1118,99 @@ void execute(struct STMT* program, struct RAM* memory)
     }
   }//while
 
+  if (profile != NULL)
+    lineprof_leave(profile);
+
+  if (budget != NULL && stmt != NULL && !budget->exhausted)  // error
+    budget->line = stmt->line;
+
+  if (memo != NULL)  // a pass cut short by an error isn't recorded
+    memo_cancel(memo);
+
+  if (timeline != NULL)
+    timeline_unwind(timeline);
+
   //
-  // done:
+  // done, success or error --- either way the output
+  // has to reach the caller before we return:
   //
+  output_flush(output);
+
+  strbuild_destroy(strings);
+
   return;
 }
+
+
+
+//
+// Public functions:
+//
+
+//
+// execute
+//
+// Given a nuPython program graph and a context, executes the
+// statements in the program graph with the context's memory,
+// output, and input. If a semantic error occurs (e.g. type
+// error), an error message is output, execution stops, and the
+// function returns. All output goes to the context's sink, which
+// is flushed before returning.
+//
+// The program is compiled for the VM (see vm.h) when possible,
+// and walked statement by statement if not, or if the context
+// profiles by line, memoizes loop bodies, traces, or keeps a
+// timeline. With more than one thread, and no budget or VM
+// profile, independent top-level stmts run in parallel when
+// that pays (see parallel.h).
+//
+void execute(struct STMT* program, struct CONTEXT* context)
+{
+  if (context->lines != NULL || context->memo != NULL || context->trace != NULL || context->timeline != NULL)  // only known to the tree walk:
+  {
+    execute_tree(program, context);
+    return;
+  }
+
+  if (context->threads > 1 && context->budget == NULL && context->pairs == NULL)
+  {
+    struct PARALLEL_PLAN* plan = parallel_plan(program, context->vm_options);
+
+    if (plan != NULL)
+    {
+      parallel_run(plan, context, context->threads);
+      parallel_free(plan);
+      return;
+    }
+  }
+
+  struct VM_CODE* code = context_code(context, program);
+
+  if (code == NULL)  // not supported by the VM:
+  {
+    execute_tree(program, context);
+    return;
+  }
+
+  vm_run(code, context);
+}
+
+
+//
+// execute_tree
+//
+// Executes the program by walking the program graph, profiling
+// by line, on a budget, memoizing loop bodies, tracing, and
+// keeping a timeline if the context says so. A trace records
+// every stmt, so loop bodies aren't memoized when tracing.
+//
+void execute_tree(struct STMT* program, struct CONTEXT* context)
+{
+  if (context->lines == NULL && context->budget == NULL && context->memo == NULL && context->trace == NULL &&
+      context->timeline == NULL)
+    execute_walk(program, context, NULL, NULL, NULL, NULL, NULL);  // no checks inlined
+  else if (context->trace != NULL)
+    execute_walk(program, context, context->lines, context->budget, NULL, context->trace, context->timeline);
+  else
+    execute_walk(program, context, context->lines, context->budget, context->memo, NULL, context->timeline);
+}
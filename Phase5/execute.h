@@ -12,6 +12,8 @@
 
 #include "programgraph.h"
 #include "ram.h"
+#include "output.h"
+#include "context.h"
 
 //
 // Public functions:
@@ -20,10 +22,36 @@
 //
 // execute
 //
-// Given a nuPython program graph and a memory, 
-// executes the statements in the program graph.
-// If a semantic error occurs (e.g. type error),
-// and error message is output, execution stops,
-// and the function returns.
+// Given a nuPython program graph and a context (see context.h),
+// executes the statements in the program graph using the
+// context's memory. If a semantic error occurs (e.g. type error),
+// and error message is output, execution stops, and the function
+// returns.
 //
-void execute(struct STMT* program, struct RAM* memory);
+// Output from print(), input() prompts, and error messages is
+// written to the context's output sink, and input() reads from
+// the context's input source. The sink is flushed before input()
+// reads and before execute returns.
+//
+// If the context has a budget, execution stops with an error
+// message once it runs out (see budget.h); afterwards the budget
+// holds the # of stmts executed and where execution stopped. If
+// the context has a line profile, every stmt executed is counted
+// and timed by line (see lineprof.h). If the context has a
+// trace, every stmt executed and what it wrote is recorded in it
+// (see trace.h); if it has a timeline, every run of a while loop
+// and pass through its body is a span in it (see timeline.h).
+// If the context has more than one thread, independent top-level
+// stmts may run at the same time (see parallel.h), with the same
+// output and final memory.
+//
+void execute(struct STMT* program, struct CONTEXT* context);
+
+//
+// execute_tree
+//
+// Same as execute, but always walks the program graph
+// instead of running it on the VM. Used when the VM can't
+// run a program, and to check the VM against.
+//
+void execute_tree(struct STMT* program, struct CONTEXT* context);
@@ -0,0 +1,454 @@
+/*input.c*/
+
+//
+// Input source for the nuPython executor, see input.h.
+//
+// Jad Dibs
+//
+// Northwestern University
+// CS 211
+//
+
+// pthreads are POSIX, not part of std=c11:
+#define _POSIX_C_SOURCE 200809L
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdbool.h>  // true, false
+#include <string.h>
+#include <pthread.h>
+
+#include "input.h"
+
+
+#define INPUT_CHUNK 4096  // most the reader reads at a time
+
+
+//
+// The ring a stream is read ahead into. It's shared by the
+// source and its reader thread, and freed by whichever is done
+// with it last.
+//
+struct INPUT_RING
+{
+  pthread_mutex_t lock;
+  pthread_cond_t filled;   // bytes were put in, or the stream ended
+  pthread_cond_t drained;  // bytes were taken out, or the source closed
+
+  char data[INPUT_RING_SIZE];
+  long head;      // # of bytes taken out so far
+  long tail;      // # of bytes put in so far
+  bool ended;     // the reader got to the end of the stream
+  bool closed;    // the source was destroyed
+
+  FILE* file;
+  bool owned;     // close the file when done?
+  bool reading;   // is there a reader thread?
+  int users;      // the source, and the reader until it's done
+};
+
+
+//
+// Private functions:
+//
+static void input_release(struct INPUT_RING* ring);
+static void* input_reader(void* arg);
+static void input_start(struct INPUT* input);
+static char* input_append(char* line, int* capacity, int length, const char* s, int n);
+static bool input_read_stream(FILE* file, char** line);
+static bool input_read_ring(struct INPUT_RING* ring, char** line);
+
+
+//
+// input_release
+//
+// One of the ring's users is done with it, the ring is locked;
+// unlocks it, and frees it (closing its file if it owns it) if
+// that was the last user.
+//
+static void input_release(struct INPUT_RING* ring)
+{
+  ring->users--;
+
+  bool last = (ring->users == 0);
+
+  pthread_mutex_unlock(&ring->lock);
+
+  if (last)
+  {
+    if (ring->owned)
+      fclose(ring->file);
+
+    pthread_mutex_destroy(&ring->lock);
+    pthread_cond_destroy(&ring->filled);
+    pthread_cond_destroy(&ring->drained);
+    free(ring);
+  }
+}
+
+//
+// input_reader
+//
+// The reader thread: reads the stream a line (or a chunk of a
+// long line) at a time into the ring, waiting whenever the ring
+// is full, until the stream ends or the source is closed.
+//
+static void* input_reader(void* arg)
+{
+  struct INPUT_RING* ring = (struct INPUT_RING*) arg;
+  char chunk[INPUT_CHUNK];
+
+  while (true)
+  {
+    bool more = (fgets(chunk, sizeof(chunk), ring->file) != NULL);
+    int length = more ? (int) strlen(chunk) : 0;
+    int written = 0;
+
+    pthread_mutex_lock(&ring->lock);
+
+    while (written < length && !ring->closed)
+    {
+      while (ring->tail - ring->head == INPUT_RING_SIZE && !ring->closed)
+        pthread_cond_wait(&ring->drained, &ring->lock);
+
+      if (ring->closed)
+        break;
+
+      //
+      // as much as fits before the end of the data array:
+      //
+      int start = (int) (ring->tail % INPUT_RING_SIZE);
+      int n = length - written;
+
+      if (n > INPUT_RING_SIZE - (int) (ring->tail - ring->head))
+        n = INPUT_RING_SIZE - (int) (ring->tail - ring->head);
+
+      if (n > INPUT_RING_SIZE - start)
+        n = INPUT_RING_SIZE - start;
+
+      memcpy(&ring->data[start], &chunk[written], n);
+
+      ring->tail += n;
+      written += n;
+
+      pthread_cond_signal(&ring->filled);
+    }
+
+    if (!more)
+    {
+      ring->ended = true;
+      pthread_cond_signal(&ring->filled);
+    }
+
+    if (!more || ring->closed)
+    {
+      input_release(ring);
+      return NULL;
+    }
+
+    pthread_mutex_unlock(&ring->lock);
+  }
+}
+
+//
+// input_start
+//
+// Creates the source's ring, and starts its reader thread. If
+// the thread can't be started, the stream is read as needed.
+//
+static void input_start(struct INPUT* input)
+{
+  struct INPUT_RING* ring = (struct INPUT_RING*) malloc(sizeof(struct INPUT_RING));
+
+  if (ring == NULL)
+    exit(0);
+
+  pthread_mutex_init(&ring->lock, NULL);
+  pthread_cond_init(&ring->filled, NULL);
+  pthread_cond_init(&ring->drained, NULL);
+
+  ring->head = 0;
+  ring->tail = 0;
+  ring->ended = false;
+  ring->closed = false;
+  ring->file = input->file;
+  ring->owned = input->owned;
+  ring->users = 2;
+
+  pthread_t reader;
+
+  ring->reading = (pthread_create(&reader, NULL, input_reader, ring) == 0);
+
+  if (ring->reading)
+    pthread_detach(reader);  // never joined, see input_destroy
+  else
+    ring->users = 1;
+
+  input->ring = ring;
+}
+
+//
+// input_append
+//
+// Appends n chars of s to the line of the given length, growing
+// it as needed, and '\0'-terminates it. Returns the line.
+//
+static char* input_append(char* line, int* capacity, int length, const char* s, int n)
+{
+  if (length + n + 1 > *capacity)
+  {
+    while (length + n + 1 > *capacity)
+      *capacity *= 2;
+
+    line = (char*) realloc(line, *capacity);
+
+    if (line == NULL)
+      exit(0);
+  }
+
+  memcpy(line + length, s, n);
+  line[length + n] = '\0';
+
+  return line;
+}
+
+//
+// input_read_stream
+//
+// Reads the next line straight from the stream, when there's no
+// reader thread.
+//
+static bool input_read_stream(FILE* file, char** line)
+{
+  int capacity = 256;
+  int length = 0;
+  char chunk[INPUT_CHUNK];
+  char* s = (char*) malloc(capacity);
+
+  if (s == NULL)
+    exit(0);
+
+  s[0] = '\0';
+
+  while ((length == 0 || s[length - 1] != '\n') && fgets(chunk, sizeof(chunk), file) != NULL)
+  {
+    int n = (int) strlen(chunk);
+
+    s = input_append(s, &capacity, length, chunk, n);
+    length += n;
+  }
+
+  *line = s;
+
+  return length > 0;
+}
+
+//
+// input_read_ring
+//
+// Takes the next line out of the ring, waiting for the reader as
+// needed.
+//
+static bool input_read_ring(struct INPUT_RING* ring, char** line)
+{
+  int capacity = 256;
+  int length = 0;
+  bool found = false;  // the end of the line?
+  char* s = (char*) malloc(capacity);
+
+  if (s == NULL)
+    exit(0);
+
+  s[0] = '\0';
+
+  pthread_mutex_lock(&ring->lock);
+
+  while (!found)
+  {
+    while (ring->head == ring->tail && !ring->ended)
+      pthread_cond_wait(&ring->filled, &ring->lock);
+
+    if (ring->head == ring->tail)  // end of the stream
+      break;
+
+    //
+    // up to the '\n', or as much as there is before the end of
+    // the data array:
+    //
+    int start = (int) (ring->head % INPUT_RING_SIZE);
+    int n = (int) (ring->tail - ring->head);
+
+    if (n > INPUT_RING_SIZE - start)
+      n = INPUT_RING_SIZE - start;
+
+    char* eol = (char*) memchr(&ring->data[start], '\n', n);
+
+    if (eol != NULL)
+    {
+      n = (int) (eol - &ring->data[start]) + 1;
+      found = true;
+    }
+
+    s = input_append(s, &capacity, length, &ring->data[start], n);
+    length += n;
+
+    ring->head += n;
+
+    pthread_cond_signal(&ring->drained);
+  }
+
+  pthread_mutex_unlock(&ring->lock);
+
+  *line = s;
+
+  return length > 0;
+}
+
+
+//
+// Public functions:
+//
+
+//
+// input_init_file
+//
+// Returns a source that reads from the given stream.
+//
+struct INPUT* input_init_file(FILE* file)
+{
+  struct INPUT* input = (struct INPUT*) malloc(sizeof(struct INPUT));
+
+  if (input == NULL)
+    exit(0);
+
+  input->kind = INPUT_FILE;
+  input->file = file;
+  input->owned = false;
+  input->ring = NULL;
+  input->text = NULL;
+  input->position = 0;
+
+  return input;
+}
+
+//
+// input_init_path
+//
+// Returns a source that reads from the given file, NULL if it
+// can't be opened.
+//
+struct INPUT* input_init_path(const char* filename)
+{
+  FILE* file = fopen(filename, "r");
+
+  if (file == NULL)
+    return NULL;
+
+  struct INPUT* input = input_init_file(file);
+
+  input->owned = true;
+
+  return input;
+}
+
+//
+// input_init_memory
+//
+// Returns a source that reads the lines of a copy of text.
+//
+struct INPUT* input_init_memory(const char* text)
+{
+  struct INPUT* input = (struct INPUT*) malloc(sizeof(struct INPUT));
+
+  if (input == NULL)
+    exit(0);
+
+  input->kind = INPUT_MEMORY;
+  input->file = NULL;
+  input->owned = false;
+  input->ring = NULL;
+  input->text = (char*) malloc(strlen(text) + 1);
+  input->position = 0;
+
+  if (input->text == NULL)
+    exit(0);
+
+  strcpy(input->text, text);
+
+  return input;
+}
+
+//
+// input_destroy
+//
+// Frees the source, closing its stream only if it opened it. The
+// ring (and so the stream) is left to the reader thread if it's
+// still running.
+//
+void input_destroy(struct INPUT* input)
+{
+  if (input->ring != NULL)
+  {
+    pthread_mutex_lock(&input->ring->lock);
+
+    input->ring->closed = true;
+    pthread_cond_signal(&input->ring->drained);
+
+    input_release(input->ring);
+  }
+  else if (input->owned)
+    fclose(input->file);
+
+  free(input->text);
+  free(input);
+}
+
+//
+// input_read_line
+//
+// Reads the next line, of any length, into a new string.
+//
+bool input_read_line(struct INPUT* input, char** line)
+{
+  bool read;
+
+  if (input->kind == INPUT_FILE)
+  {
+    if (input->ring == NULL)
+      input_start(input);
+
+    if (input->ring->reading)
+      read = input_read_ring(input->ring, line);
+    else
+      read = input_read_stream(input->file, line);
+  }
+  else
+  {
+    char* next = input->text + input->position;
+
+    //
+    // up to and including the '\n':
+    //
+    int length = (int) strcspn(next, "\n");
+
+    if (next[length] == '\n')
+      length++;
+
+    *line = (char*) malloc(length + 1);
+
+    if (*line == NULL)
+      exit(0);
+
+    memcpy(*line, next, length);
+    (*line)[length] = '\0';
+
+    input->position += length;
+
+    read = (length > 0);
+  }
+
+  // delete EOL chars from input:
+  (*line)[strcspn(*line, "\r\n")] = '\0';
+
+  return read;
+}
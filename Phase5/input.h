@@ -0,0 +1,106 @@
+/*input.h*/
+
+//
+// Input source for the nuPython executor: where the lines read
+// by input() come from. Either a stdio stream (e.g. stdin, or a
+// file of test input), or a string in memory, so a program can
+// be run without touching the process's stdin.
+//
+// A stream is read by a background thread, started by the first
+// read: it reads ahead, a line at a time (so it never waits for
+// more than the user has typed), into a ring buffer of
+// INPUT_RING_SIZE bytes, and input() takes its lines from there.
+// A script feeding thousands of input() values through a pipe
+// or from a file then doesn't make the program wait for each
+// read. Lines can be any length; a line longer than the ring is
+// taken out of it as it's read.
+//
+// Jad Dibs
+//
+// Northwestern University
+// CS 211
+//
+
+#pragma once
+
+#include <stdio.h>
+#include <stdbool.h>  // true, false
+
+
+#define INPUT_RING_SIZE (64 * 1024)  // bytes read ahead from a stream
+
+
+//
+// Definition of an input source
+//
+enum INPUT_KINDS
+{
+  INPUT_FILE = 0,  // read from a stdio stream
+  INPUT_MEMORY     // read from a string, see input_init_memory()
+};
+
+struct INPUT_RING;  // see input.c
+
+struct INPUT
+{
+  int kind;      // enum INPUT_KINDS
+
+  FILE* file;    // stream if kind == INPUT_FILE
+  bool owned;    // close the stream when done with it?
+  struct INPUT_RING* ring;  // read ahead from it, NULL until the first read
+
+  char* text;    // copy of the string if kind == INPUT_MEMORY
+  int position;  // index of the next char to read from text
+};
+
+
+//
+// Public functions:
+//
+
+//
+// input_init_file
+//
+// Returns a pointer to a dynamically-allocated input source that
+// reads from the given stream (e.g. stdin). Nothing else may
+// read from the stream once input has been read from the source.
+// The stream is not closed by input_destroy.
+//
+struct INPUT* input_init_file(FILE* file);
+
+//
+// input_init_path
+//
+// Returns a pointer to a dynamically-allocated input source that
+// reads from the given file, or NULL if it can't be opened. The
+// file is closed once the source is destroyed and done with it.
+//
+struct INPUT* input_init_path(const char* filename);
+
+//
+// input_init_memory
+//
+// Returns a pointer to a dynamically-allocated input source that
+// reads the lines of the given string (which is copied).
+//
+struct INPUT* input_init_memory(const char* text);
+
+//
+// input_destroy
+//
+// Frees the input source. After the call returns, you cannot use
+// the source. If its background thread is waiting for input
+// (e.g. from the keyboard), it's left to finish the read and
+// free what it uses (and close the file of input_init_path).
+//
+void input_destroy(struct INPUT* input);
+
+//
+// input_read_line
+//
+// Reads the next line, however long, without the end of line
+// chars, into a dynamically-allocated string the caller must
+// free, and sets *line to it. At the end of the input, *line is
+// set to "" (which must also be freed) and false is returned.
+//
+bool input_read_line(struct INPUT* input, char** line);
@@ -0,0 +1,819 @@
+/*jit.c*/
+
+//
+// Baseline (template) JIT for the nuPython VM, see jit.h.
+//
+// The machine code for a loop is a function
+//
+//   int loop(struct VM_VALUE* regs);
+//
+// that runs the VM instructions top..bottom with register r at
+// [rdi + 8*r], and returns the pc where the VM must continue:
+// where the loop exits to, or the instruction it can't run. Only
+// rax, rcx, rdx and xmm0-xmm2 are used, which the caller saves,
+// and nothing is called, so there is no prologue or epilogue.
+//
+// Jad Dibs
+//
+// Northwestern University
+// CS 211
+//
+
+// mmap's MAP_ANONYMOUS is not part of std=c11:
+#define _DEFAULT_SOURCE
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdbool.h>  // true, false
+#include <stdint.h>
+#include <string.h>
+
+#if defined(__x86_64__) && defined(__unix__)
+#define JIT_SUPPORTED 1
+#include <sys/mman.h>
+#else
+#define JIT_SUPPORTED 0
+#endif
+
+#include "programgraph.h"
+#include "vm.h"
+#include "value.h"
+#include "jit.h"
+
+
+#define JIT_HOT        1000  // back edges before a loop is compiled
+#define JIT_MAX_EXITS  1000  // deoptimizations before a loop is given up
+
+typedef int (*JIT_FUNCTION)(struct VM_VALUE* regs);
+
+struct JIT_LOOP
+{
+  int count;              // # of back edges seen before compiling
+  int exits;              // # of deoptimizations since
+  bool disabled;          // interpreted from now on
+  void* memory;           // mmap'd machine code, NULL => none
+  size_t size;
+  JIT_FUNCTION function;  // entry point, same address as memory
+};
+
+struct JIT
+{
+  struct VM_CODE* code;
+  struct JIT_LOOP* loops;  // indexed by the pc of the loop's top
+};
+
+//
+// Machine code being generated for the loop top..bottom. A jump
+// to a VM instruction is emitted with a 0 displacement and fixed
+// up once every instruction's machine code offset is known;
+// jumps out of the loop, and exits before an instruction, go to
+// a small stub at the end that returns the pc.
+//
+struct JIT_FIXUP
+{
+  int at;     // offset of the rel32 to patch
+  int pc;     // VM instruction jumped to
+  bool exit;  // return pc to the VM even if it's in the loop
+};
+
+struct JIT_BUFFER
+{
+  unsigned char* bytes;
+  int length;
+  int capacity;
+
+  int top;
+  int bottom;
+  int num_vars;
+  int* offsets;  // offset of instruction pc at offsets[pc - top]
+
+  struct JIT_FIXUP* fixups;
+  int num_fixups;
+  int fixups_capacity;
+};
+
+
+//
+// Private functions:
+//
+static void jit_byte(struct JIT_BUFFER* b, int byte);
+static void jit_bytes(struct JIT_BUFFER* b, const char* bytes, int n);
+static void jit_int32(struct JIT_BUFFER* b, int32_t value);
+static void jit_int64(struct JIT_BUFFER* b, uint64_t value);
+static void jit_reg(struct JIT_BUFFER* b, const char* opcode, int n, int reg);
+static void jit_jump(struct JIT_BUFFER* b, const char* opcode, int n, int pc, bool leave);
+static int jit_local(struct JIT_BUFFER* b, const char* opcode, int n);
+static void jit_patch(struct JIT_BUFFER* b, int at);
+static void jit_store_boxed(struct JIT_BUFFER* b, int tag, int dst);
+static void jit_store_real(struct JIT_BUFFER* b, int dst);
+static void jit_guard_tag(struct JIT_BUFFER* b, int reg, int tag, int pc);
+static void jit_guard_plain(struct JIT_BUFFER* b, int reg, bool source, int pc);
+static bool jit_int_op(struct JIT_BUFFER* b, struct VM_INSTR* instr, int pc);
+static bool jit_real_op(struct JIT_BUFFER* b, struct VM_INSTR* instr, int pc);
+static void jit_int_branch(struct JIT_BUFFER* b, struct VM_INSTR* instr, int operator);
+static void jit_real_branch(struct JIT_BUFFER* b, struct VM_INSTR* instr, int operator);
+static void jit_instr(struct JIT_BUFFER* b, struct VM_INSTR* instr, int pc);
+static bool jit_compile(struct JIT* jit, struct JIT_LOOP* loop, int top, int bottom);
+
+
+//
+// Code generation
+//
+
+//
+// jit_byte, jit_bytes, jit_int32, jit_int64
+//
+// Append machine code to the buffer; multi-byte values are
+// little-endian.
+//
+static void jit_byte(struct JIT_BUFFER* b, int byte)
+{
+  if (b->length == b->capacity)
+  {
+    b->capacity *= 2;
+    b->bytes = (unsigned char*) realloc(b->bytes, b->capacity);
+
+    if (b->bytes == NULL)
+      exit(0);
+  }
+
+  b->bytes[b->length++] = (unsigned char) byte;
+}
+
+static void jit_bytes(struct JIT_BUFFER* b, const char* bytes, int n)
+{
+  for (int i = 0; i < n; i++)
+    jit_byte(b, (unsigned char) bytes[i]);
+}
+
+static void jit_int32(struct JIT_BUFFER* b, int32_t value)
+{
+  uint32_t u = (uint32_t) value;
+
+  for (int i = 0; i < 4; i++)
+    jit_byte(b, (u >> (8 * i)) & 0xFF);
+}
+
+static void jit_int64(struct JIT_BUFFER* b, uint64_t value)
+{
+  for (int i = 0; i < 8; i++)
+    jit_byte(b, (int) ((value >> (8 * i)) & 0xFF));
+}
+
+//
+// jit_reg
+//
+// Emits an instruction whose memory operand is VM register reg,
+// i.e. [rdi + 8*reg]: the opcode bytes (ending in the ModRM byte)
+// followed by the displacement.
+//
+static void jit_reg(struct JIT_BUFFER* b, const char* opcode, int n, int reg)
+{
+  jit_bytes(b, opcode, n);
+  jit_int32(b, reg * (int) sizeof(struct VM_VALUE));
+}
+
+//
+// jit_jump
+//
+// Emits a jump (jmp or jcc rel32) to VM instruction pc, or, if
+// leave, back to the VM at pc.
+//
+static void jit_jump(struct JIT_BUFFER* b, const char* opcode, int n, int pc, bool leave)
+{
+  jit_bytes(b, opcode, n);
+
+  if (b->num_fixups == b->fixups_capacity)
+  {
+    b->fixups_capacity *= 2;
+    b->fixups = (struct JIT_FIXUP*) realloc(b->fixups, b->fixups_capacity * sizeof(struct JIT_FIXUP));
+
+    if (b->fixups == NULL)
+      exit(0);
+  }
+
+  b->fixups[b->num_fixups].at = b->length;
+  b->fixups[b->num_fixups].pc = pc;
+  b->fixups[b->num_fixups].exit = leave;
+  b->num_fixups++;
+
+  jit_int32(b, 0);
+}
+
+//
+// jit_local, jit_patch
+//
+// A forward jump within one instruction's machine code: jit_local
+// emits it and returns where its rel32 is, jit_patch makes it
+// jump to the current end of the code.
+//
+static int jit_local(struct JIT_BUFFER* b, const char* opcode, int n)
+{
+  jit_bytes(b, opcode, n);
+  jit_int32(b, 0);
+
+  return b->length - 4;
+}
+
+static void jit_patch(struct JIT_BUFFER* b, int at)
+{
+  uint32_t rel = (uint32_t) (b->length - (at + 4));
+
+  for (int i = 0; i < 4; i++)
+    b->bytes[at + i] = (unsigned char) ((rel >> (8 * i)) & 0xFF);
+}
+
+//
+// jit_store_boxed
+//
+// Stores the payload in eax (upper half of rax zero) into
+// register dst, boxed with the given tag.
+//
+static void jit_store_boxed(struct JIT_BUFFER* b, int tag, int dst)
+{
+  jit_bytes(b, "\x48\xB9", 2);                                  // mov rcx, box
+  jit_int64(b, VM_BOXED | ((uint64_t) tag << VM_TAG_SHIFT));
+  jit_bytes(b, "\x48\x09\xC8", 3);                              // or rax, rcx
+  jit_reg(b, "\x48\x89\x87", 3, dst);                           // mov [dst], rax
+}
+
+//
+// jit_store_real
+//
+// Stores the double in xmm0 into register dst, making a NaN
+// canonical like vm_real does.
+//
+static void jit_store_real(struct JIT_BUFFER* b, int dst)
+{
+  jit_bytes(b, "\x66\x48\x0F\x7E\xC0", 5);  // movq rax, xmm0
+  jit_bytes(b, "\x66\x0F\x2E\xC0", 4);      // ucomisd xmm0, xmm0
+  jit_bytes(b, "\x7B\x0A", 2);              // jnp over the next instruction
+  jit_bytes(b, "\x48\xB8", 2);              // mov rax, canonical NaN
+  jit_int64(b, VM_CANON_NAN);
+  jit_reg(b, "\x48\x89\x87", 3, dst);       // mov [dst], rax
+}
+
+//
+// jit_guard_tag
+//
+// Returns to the VM at pc unless register reg holds a value
+// with the given tag (VM_INT, VM_REAL or VM_BOOL).
+//
+static void jit_guard_tag(struct JIT_BUFFER* b, int reg, int tag, int pc)
+{
+  jit_reg(b, "\x48\x8B\x87", 3, reg);         // mov rax, [reg]
+
+  if (tag == VM_REAL)
+  {
+    jit_bytes(b, "\x48\xB9", 2);              // mov rcx, VM_BOXED
+    jit_int64(b, VM_BOXED);
+    jit_bytes(b, "\x48\x39\xC8", 3);          // cmp rax, rcx
+    jit_jump(b, "\x0F\x83", 2, pc, true);     // jae: boxed, not a real
+  }
+  else
+  {
+    jit_bytes(b, "\x48\xC1\xE8\x30", 4);      // shr rax, 48
+    jit_byte(b, 0x3D);                        // cmp eax, boxed tag
+    jit_int32(b, (int32_t) ((VM_BOXED >> VM_TAG_SHIFT) | (uint64_t) tag));
+    jit_jump(b, "\x0F\x85", 2, pc, true);     // jne
+  }
+}
+
+//
+// jit_guard_plain
+//
+// Returns to the VM at pc if register reg holds a string, which
+// can't be copied or overwritten raw. An undefined source is an
+// error, and an undefined variable has no memory cell yet, so
+// those return too (an undefined temporary can be written).
+//
+static void jit_guard_plain(struct JIT_BUFFER* b, int reg, bool source, int pc)
+{
+  uint64_t boxed = VM_BOXED >> VM_TAG_SHIFT;
+
+  jit_reg(b, "\x48\x8B\x87", 3, reg);         // mov rax, [reg]
+  jit_bytes(b, "\x48\xC1\xE8\x30", 4);        // shr rax, 48
+  jit_byte(b, 0x3D);                          // cmp eax, string tag
+  jit_int32(b, (int32_t) (boxed | VM_STR));
+  jit_jump(b, "\x0F\x84", 2, pc, true);       // je
+
+  if (source || reg < b->num_vars)
+  {
+    jit_byte(b, 0x3D);                        // cmp eax, undefined tag
+    jit_int32(b, (int32_t) (boxed | VM_UNDEFINED));
+    jit_jump(b, "\x0F\x84", 2, pc, true);     // je
+  }
+}
+
+//
+// jit_int_op
+//
+// Emits dst = a op b for ints, known to be ints. Returns false
+// if the operator has no template (**).
+//
+static bool jit_int_op(struct JIT_BUFFER* b, struct VM_INSTR* instr, int pc)
+{
+  //
+  // setcc for ==, !=, <, <=, >, >=:
+  //
+  static const char setcc[] = { '\x94', '\x95', '\x9C', '\x9E', '\x9F', '\x9D' };
+
+  if (instr->operator == OPERATOR_POWER)
+    return false;
+
+  jit_reg(b, "\x8B\x87", 2, instr->a);          // mov eax, [a]
+  jit_reg(b, "\x8B\x8F", 2, instr->b);          // mov ecx, [b]
+
+  switch (instr->operator)
+  {
+  case OPERATOR_PLUS:
+    jit_bytes(b, "\x01\xC8", 2);                // add eax, ecx
+    break;
+
+  case OPERATOR_MINUS:
+    jit_bytes(b, "\x29\xC8", 2);                // sub eax, ecx
+    break;
+
+  case OPERATOR_ASTERISK:
+    jit_bytes(b, "\x0F\xAF\xC1", 3);            // imul eax, ecx
+    break;
+
+  case OPERATOR_MOD:
+  case OPERATOR_DIV:
+    if (instr->opcode != VM_DIV_NZ_II && instr->opcode != VM_MOD_NZ_II)  // else proven safe
+    {
+      jit_bytes(b, "\x85\xC9", 2);              // test ecx, ecx
+      jit_jump(b, "\x0F\x84", 2, pc, true);     // je: division by zero, the VM reports it
+    }
+
+    jit_bytes(b, "\x99\xF7\xF9", 3);            // cdq; idiv ecx
+
+    if (instr->operator == OPERATOR_MOD)
+      jit_bytes(b, "\x89\xD0", 2);              // mov eax, edx
+    break;
+
+  default:  // comparison
+    jit_bytes(b, "\x39\xC8\x0F", 3);            // cmp eax, ecx; setcc al
+    jit_byte(b, setcc[instr->operator - OPERATOR_EQUAL]);
+    jit_bytes(b, "\xC0\x0F\xB6\xC0", 4);        // movzx eax, al
+    jit_store_boxed(b, VM_BOOL, instr->dst);
+    return true;
+  }
+
+  jit_store_boxed(b, VM_INT, instr->dst);
+  return true;
+}
+
+//
+// jit_real_op
+//
+// Emits dst = a op b for reals, known to be reals. Returns false
+// if the operator has no template (** and %).
+//
+static bool jit_real_op(struct JIT_BUFFER* b, struct VM_INSTR* instr, int pc)
+{
+  if (instr->operator == OPERATOR_POWER || instr->operator == OPERATOR_MOD)
+    return false;
+
+  jit_reg(b, "\xF2\x0F\x10\x87", 4, instr->a);   // movsd xmm0, [a]
+  jit_reg(b, "\xF2\x0F\x10\x8F", 4, instr->b);   // movsd xmm1, [b]
+
+  switch (instr->operator)
+  {
+  case OPERATOR_PLUS:
+    jit_bytes(b, "\xF2\x0F\x58\xC1", 4);         // addsd xmm0, xmm1
+    break;
+
+  case OPERATOR_MINUS:
+    jit_bytes(b, "\xF2\x0F\x5C\xC1", 4);         // subsd xmm0, xmm1
+    break;
+
+  case OPERATOR_ASTERISK:
+    jit_bytes(b, "\xF2\x0F\x59\xC1", 4);         // mulsd xmm0, xmm1
+    break;
+
+  case OPERATOR_DIV:
+    jit_bytes(b, "\x66\x0F\x57\xD2", 4);         // xorpd xmm2, xmm2
+    jit_bytes(b, "\x66\x0F\x2E\xCA", 4);         // ucomisd xmm1, xmm2
+    jit_jump(b, "\x0F\x84", 2, pc, true);        // je (or NaN): let the VM decide
+    jit_bytes(b, "\xF2\x0F\x5E\xC1", 4);         // divsd xmm0, xmm1
+    break;
+
+  //
+  // comparisons are false if either side is NaN, which sets
+  // ZF, PF and CF; a < b is b > a, which needs CF = ZF = 0:
+  //
+  case OPERATOR_EQUAL:
+    jit_bytes(b, "\x66\x0F\x2E\xC1", 4);         // ucomisd xmm0, xmm1
+    jit_bytes(b, "\x0F\x94\xC0\x0F\x9B\xC1", 6); // sete al; setnp cl
+    jit_bytes(b, "\x20\xC8", 2);                 // and al, cl
+    break;
+
+  case OPERATOR_NOT_EQUAL:
+    jit_bytes(b, "\x66\x0F\x2E\xC1", 4);         // ucomisd xmm0, xmm1
+    jit_bytes(b, "\x0F\x95\xC0\x0F\x9A\xC1", 6); // setne al; setp cl
+    jit_bytes(b, "\x08\xC8", 2);                 // or al, cl
+    break;
+
+  case OPERATOR_LT:
+    jit_bytes(b, "\x66\x0F\x2E\xC8\x0F\x97\xC0", 7);  // ucomisd xmm1, xmm0; seta al
+    break;
+
+  case OPERATOR_LTE:
+    jit_bytes(b, "\x66\x0F\x2E\xC8\x0F\x93\xC0", 7);  // ucomisd xmm1, xmm0; setae al
+    break;
+
+  case OPERATOR_GT:
+    jit_bytes(b, "\x66\x0F\x2E\xC1\x0F\x97\xC0", 7);  // ucomisd xmm0, xmm1; seta al
+    break;
+
+  case OPERATOR_GTE:
+    jit_bytes(b, "\x66\x0F\x2E\xC1\x0F\x93\xC0", 7);  // ucomisd xmm0, xmm1; setae al
+    break;
+
+  default:
+    return false;
+  }
+
+  if (instr->operator >= OPERATOR_EQUAL)
+  {
+    jit_bytes(b, "\x0F\xB6\xC0", 3);             // movzx eax, al
+    jit_store_boxed(b, VM_BOOL, instr->dst);
+  }
+  else
+    jit_store_real(b, instr->dst);
+
+  return true;
+}
+
+//
+// jit_int_branch
+//
+// Emits "if not (a op b) goto dst" for ints.
+//
+static void jit_int_branch(struct JIT_BUFFER* b, struct VM_INSTR* instr, int operator)
+{
+  //
+  // jcc for the opposite of ==, !=, <, <=, >, >=:
+  //
+  static const char* jcc[] = { "\x0F\x85", "\x0F\x84", "\x0F\x8D", "\x0F\x8F", "\x0F\x8E", "\x0F\x8C" };
+
+  jit_reg(b, "\x8B\x87", 2, instr->a);          // mov eax, [a]
+  jit_reg(b, "\x3B\x87", 2, instr->b);          // cmp eax, [b]
+  jit_jump(b, jcc[operator - OPERATOR_EQUAL], 2, instr->dst, false);
+}
+
+//
+// jit_real_branch
+//
+// Emits "if not (a op b) goto dst" for reals; NaN compares false
+// (except !=), so it jumps.
+//
+static void jit_real_branch(struct JIT_BUFFER* b, struct VM_INSTR* instr, int operator)
+{
+  jit_reg(b, "\xF2\x0F\x10\x87", 4, instr->a);   // movsd xmm0, [a]
+  jit_reg(b, "\xF2\x0F\x10\x8F", 4, instr->b);   // movsd xmm1, [b]
+
+  switch (operator)
+  {
+  case OPERATOR_EQUAL:
+    jit_bytes(b, "\x66\x0F\x2E\xC1", 4);         // ucomisd xmm0, xmm1
+    jit_jump(b, "\x0F\x85", 2, instr->dst, false);  // jne
+    jit_jump(b, "\x0F\x8A", 2, instr->dst, false);  // jp
+    break;
+
+  case OPERATOR_NOT_EQUAL:
+    jit_bytes(b, "\x66\x0F\x2E\xC1", 4);         // ucomisd xmm0, xmm1
+    jit_bytes(b, "\x7A\x06", 2);                 // jp over the je
+    jit_jump(b, "\x0F\x84", 2, instr->dst, false);  // je
+    break;
+
+  case OPERATOR_LT:
+    jit_bytes(b, "\x66\x0F\x2E\xC8", 4);         // ucomisd xmm1, xmm0
+    jit_jump(b, "\x0F\x86", 2, instr->dst, false);  // jbe
+    break;
+
+  case OPERATOR_LTE:
+    jit_bytes(b, "\x66\x0F\x2E\xC8", 4);         // ucomisd xmm1, xmm0
+    jit_jump(b, "\x0F\x82", 2, instr->dst, false);  // jb
+    break;
+
+  case OPERATOR_GT:
+    jit_bytes(b, "\x66\x0F\x2E\xC1", 4);         // ucomisd xmm0, xmm1
+    jit_jump(b, "\x0F\x86", 2, instr->dst, false);  // jbe
+    break;
+
+  default:  // OPERATOR_GTE
+    jit_bytes(b, "\x66\x0F\x2E\xC1", 4);         // ucomisd xmm0, xmm1
+    jit_jump(b, "\x0F\x82", 2, instr->dst, false);  // jb
+    break;
+  }
+}
+
+//
+// jit_instr
+//
+// Emits the machine code for the VM instruction at pc; if there
+// is no template for it, the code returns to the VM instead.
+//
+static void jit_instr(struct JIT_BUFFER* b, struct VM_INSTR* instr, int pc)
+{
+  int op = instr->opcode;
+
+  if ((op >= VM_ADD_II && op <= VM_GE_II) || op == VM_DIV_NZ_II || op == VM_MOD_NZ_II)
+  {
+    if (!jit_int_op(b, instr, pc))
+      jit_jump(b, "\xE9", 1, pc, true);
+  }
+  else if (op >= VM_ADD_RR && op <= VM_GE_RR)
+  {
+    if (!jit_real_op(b, instr, pc))
+      jit_jump(b, "\xE9", 1, pc, true);
+  }
+  else if (op >= VM_JUMP_UNLESS_EQ_II && op <= VM_JUMP_UNLESS_GE_II)
+  {
+    jit_int_branch(b, instr, OPERATOR_EQUAL + (op - VM_JUMP_UNLESS_EQ_II));
+  }
+  else if (op >= VM_JUMP_UNLESS_EQ_RR && op <= VM_JUMP_UNLESS_GE_RR)
+  {
+    jit_real_branch(b, instr, OPERATOR_EQUAL + (op - VM_JUMP_UNLESS_EQ_RR));
+  }
+  else if (op == VM_MOVE_RAW || op == VM_MOVE)
+  {
+    if (op == VM_MOVE)
+    {
+      jit_guard_plain(b, instr->a, true, pc);
+      jit_guard_plain(b, instr->dst, false, pc);
+    }
+
+    jit_reg(b, "\x48\x8B\x87", 3, instr->a);    // mov rax, [a]
+    jit_reg(b, "\x48\x89\x87", 3, instr->dst);  // mov [dst], rax
+  }
+  else if (op == VM_ADD_IMM_II)
+  {
+    jit_reg(b, "\x8B\x87", 2, instr->a);        // mov eax, [a]
+    jit_byte(b, 0x05);                          // add eax, imm32
+    jit_int32(b, instr->b);
+    jit_store_boxed(b, VM_INT, instr->dst);
+  }
+  else if (op == VM_BINARY)
+  {
+    //
+    // int op int or real op real, whichever the operands turn
+    // out to be; anything else is left to the VM:
+    //
+    jit_guard_plain(b, instr->dst, false, pc);
+
+    jit_reg(b, "\x48\x8B\x87", 3, instr->a);    // mov rax, [a]
+    jit_bytes(b, "\x48\xC1\xE8\x30", 4);        // shr rax, 48
+    jit_byte(b, 0x3D);                          // cmp eax, int tag
+    jit_int32(b, (int32_t) ((VM_BOXED >> VM_TAG_SHIFT) | VM_INT));
+    int not_int = jit_local(b, "\x0F\x85", 2);  // jne
+
+    jit_guard_tag(b, instr->b, VM_INT, pc);
+
+    if (!jit_int_op(b, instr, pc))
+      jit_jump(b, "\xE9", 1, pc, true);
+
+    int done = jit_local(b, "\xE9", 1);         // jmp
+
+    jit_patch(b, not_int);
+    jit_guard_tag(b, instr->a, VM_REAL, pc);
+    jit_guard_tag(b, instr->b, VM_REAL, pc);
+
+    if (!jit_real_op(b, instr, pc))
+      jit_jump(b, "\xE9", 1, pc, true);
+
+    jit_patch(b, done);
+  }
+  else if (op == VM_JUMP)
+  {
+    jit_jump(b, "\xE9", 1, instr->a, false);
+  }
+  else if (op == VM_JUMP_IF_FALSE || op == VM_JUMP_IF_FALSE_BOOL)
+  {
+    if (op == VM_JUMP_IF_FALSE)
+      jit_guard_tag(b, instr->a, VM_BOOL, pc);
+
+    jit_reg(b, "\xF6\x87", 2, instr->a);        // test byte [a], 1
+    jit_byte(b, 0x01);
+    jit_jump(b, "\x0F\x84", 2, instr->b, false);  // jz
+  }
+  else  // print, input, int(), float(): the VM's job
+  {
+    jit_jump(b, "\xE9", 1, pc, true);
+  }
+}
+
+//
+// jit_compile
+//
+// Generates the machine code for the loop top..bottom. Returns
+// false if no executable memory can be had.
+//
+static bool jit_compile(struct JIT* jit, struct JIT_LOOP* loop, int top, int bottom)
+{
+#if JIT_SUPPORTED
+  struct JIT_BUFFER b;
+
+  b.capacity = 1024;
+  b.length = 0;
+  b.bytes = (unsigned char*) malloc(b.capacity);
+  b.top = top;
+  b.bottom = bottom;
+  b.num_vars = jit->code->num_vars;
+  b.offsets = (int*) malloc((bottom - top + 1) * sizeof(int));
+  b.fixups_capacity = 64;
+  b.num_fixups = 0;
+  b.fixups = (struct JIT_FIXUP*) malloc(b.fixups_capacity * sizeof(struct JIT_FIXUP));
+
+  if (b.bytes == NULL || b.offsets == NULL || b.fixups == NULL)
+    exit(0);
+
+  for (int pc = top; pc <= bottom; pc++)
+  {
+    b.offsets[pc - top] = b.length;
+    jit_instr(&b, &jit->code->instrs[pc], pc);
+  }
+
+  //
+  // resolve the jumps; ones that leave go to a stub returning
+  // the pc, one stub per pc:
+  //
+  int num_fixups = b.num_fixups;
+  int* stubs = (int*) malloc((num_fixups + 1) * sizeof(int));
+
+  if (stubs == NULL)
+    exit(0);
+
+  for (int f = 0; f < num_fixups; f++)
+  {
+    struct JIT_FIXUP* fixup = &b.fixups[f];
+    int target;
+
+    if (!fixup->exit && fixup->pc >= top && fixup->pc <= bottom)
+      target = b.offsets[fixup->pc - top];
+    else
+    {
+      target = -1;
+
+      for (int g = 0; g < f && target < 0; g++)
+        if (stubs[g] >= 0 && b.fixups[g].pc == fixup->pc)
+          target = stubs[g];
+
+      if (target < 0)
+      {
+        target = b.length;
+        jit_byte(&b, 0xB8);        // mov eax, pc
+        jit_int32(&b, fixup->pc);
+        jit_byte(&b, 0xC3);        // ret
+      }
+    }
+
+    stubs[f] = (fixup->exit || fixup->pc < top || fixup->pc > bottom) ? target : -1;
+
+    int rel = target - (fixup->at + 4);
+
+    for (int i = 0; i < 4; i++)
+      b.bytes[fixup->at + i] = (unsigned char) (((uint32_t) rel >> (8 * i)) & 0xFF);
+  }
+
+  free(stubs);
+
+  //
+  // copy into fresh pages, then make them executable (and no
+  // longer writable):
+  //
+  size_t size = ((size_t) b.length + 4095) & ~(size_t) 4095;
+  void* memory = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+  bool ok = (memory != MAP_FAILED);
+
+  if (ok)
+  {
+    memcpy(memory, b.bytes, b.length);
+
+    if (mprotect(memory, size, PROT_READ | PROT_EXEC) != 0)
+    {
+      munmap(memory, size);
+      ok = false;
+    }
+  }
+
+  free(b.bytes);
+  free(b.offsets);
+  free(b.fixups);
+
+  if (!ok)
+    return false;
+
+  loop->memory = memory;
+  loop->size = size;
+
+  // ISO C has no cast from object to function pointer:
+  memcpy(&loop->function, &memory, sizeof(loop->function));
+
+  return true;
+#else
+  return false;
+#endif
+}
+
+
+//
+// Public functions:
+//
+
+//
+// jit_init
+//
+// Returns a JIT for the code, NULL if not supported here.
+//
+struct JIT* jit_init(struct VM_CODE* code)
+{
+  if (!JIT_SUPPORTED)
+    return NULL;
+
+  struct JIT* jit = (struct JIT*) malloc(sizeof(struct JIT));
+
+  if (jit == NULL)
+    exit(0);
+
+  jit->code = code;
+  jit->loops = (struct JIT_LOOP*) malloc((code->num_instrs + 1) * sizeof(struct JIT_LOOP));
+
+  if (jit->loops == NULL)
+    exit(0);
+
+  for (int pc = 0; pc < code->num_instrs; pc++)
+  {
+    jit->loops[pc].count = 0;
+    jit->loops[pc].exits = 0;
+    jit->loops[pc].disabled = false;
+    jit->loops[pc].memory = NULL;
+    jit->loops[pc].size = 0;
+    jit->loops[pc].function = NULL;
+  }
+
+  return jit;
+}
+
+//
+// jit_destroy
+//
+// Frees the JIT and its machine code.
+//
+void jit_destroy(struct JIT* jit)
+{
+  if (jit == NULL)
+    return;
+
+#if JIT_SUPPORTED
+  for (int pc = 0; pc < jit->code->num_instrs; pc++)
+    if (jit->loops[pc].memory != NULL)
+      munmap(jit->loops[pc].memory, jit->loops[pc].size);
+#endif
+
+  free(jit->loops);
+  free(jit);
+}
+
+//
+// jit_run
+//
+// Runs the loop top..bottom as machine code once it's hot.
+//
+int jit_run(struct JIT* jit, int top, int bottom, struct VM_VALUE* regs)
+{
+  struct JIT_LOOP* loop = &jit->loops[top];
+
+  if (loop->function == NULL)
+  {
+    if (loop->disabled || ++loop->count < JIT_HOT)
+      return top;
+
+    if (!jit_compile(jit, loop, top, bottom))
+    {
+      loop->disabled = true;
+      return top;
+    }
+  }
+
+  int pc = loop->function(regs);
+
+  //
+  // deoptimized, rather than done with the loop? If that keeps
+  // happening (e.g. a print in the loop) the machine code isn't
+  // worth it:
+  //
+  if (pc >= top && pc <= bottom && ++loop->exits >= JIT_MAX_EXITS)
+  {
+#if JIT_SUPPORTED
+    munmap(loop->memory, loop->size);
+#endif
+    loop->memory = NULL;
+    loop->function = NULL;
+    loop->disabled = true;
+  }
+
+  return pc;
+}
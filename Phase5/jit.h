@@ -0,0 +1,69 @@
+/*jit.h*/
+
+//
+// Baseline (template) JIT for the nuPython VM. When a while loop
+// of the VM code gets hot, its instructions are translated one
+// by one into x86-64 machine code copied from fixed templates,
+// into memory obtained from mmap and then made executable. The
+// machine code works directly on the VM's registers, so control
+// can pass back and forth between it and vm_run at any
+// instruction boundary.
+//
+// Only int and real operations are translated. Anything else in
+// the loop (print, input, strings, **, a division by zero, a
+// variable's first assignment, ...) leaves the machine code
+// right before that instruction --- a deoptimization --- and
+// vm_run carries on from there, exactly as if the loop had never
+// been compiled. Typed instructions need no checks, the type
+// analysis proved their operand types; generic instructions
+// check the types of their operands and leave if they changed.
+// A loop that leaves too often is given back to the interpreter
+// for good.
+//
+// Only available on x86-64 with mmap; elsewhere jit_init returns
+// NULL and the VM interprets everything.
+//
+// Jad Dibs
+//
+// Northwestern University
+// CS 211
+//
+
+#pragma once
+
+#include "vm.h"
+#include "value.h"
+
+
+struct JIT;  // opaque, see jit.c
+
+
+//
+// Public functions:
+//
+
+//
+// jit_init
+//
+// Returns a JIT for the given VM code, with no loops compiled
+// yet, or NULL if this platform isn't supported.
+//
+struct JIT* jit_init(struct VM_CODE* code);
+
+//
+// jit_destroy
+//
+// Frees the JIT and all the machine code it generated.
+//
+void jit_destroy(struct JIT* jit);
+
+//
+// jit_run
+//
+// Called by the VM at the back edge of the loop top..bottom (the
+// jump at bottom goes back to top). Counts the iteration, and
+// once the loop is hot runs it as machine code on the given
+// registers until it exits or deoptimizes. Returns the pc at
+// which the VM continues: top if the loop isn't compiled (yet).
+//
+int jit_run(struct JIT* jit, int top, int bottom, struct VM_VALUE* regs);
@@ -0,0 +1,240 @@
+/*lineprof.c*/
+
+//
+// Per-line profiler for the nuPython executor, see lineprof.h.
+//
+// Jad Dibs
+//
+// Northwestern University
+// CS 211
+//
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <time.h>
+
+#include "lineprof.h"
+
+
+//
+// Private functions:
+//
+
+//
+// lineprof_sorting: the profile being sorted by lineprof_print,
+// for lineprof_compare_lines (qsort has no context parameter)
+//
+static struct LINE_PROFILE* lineprof_sorting = NULL;
+
+//
+// lineprof_estimate
+//
+// Estimated total ticks spent on the given line: the average of
+// its samples, less the cost of reading the clock, times the #
+// of times it ran.
+//
+static double lineprof_estimate(struct LINE_PROFILE* profile, int line)
+{
+  if (profile->samples[line] == 0)
+    return 0.0;
+
+  double average = (double) profile->ticks[line] / profile->samples[line] - profile->overhead;
+
+  if (average < 0.0)
+    average = 0.0;
+
+  return average * profile->counts[line];
+}
+
+//
+// lineprof_compare_lines
+//
+// qsort comparison: the most time first, then by line #.
+//
+static int lineprof_compare_lines(const void* a, const void* b)
+{
+  int x = *((const int*) a);
+  int y = *((const int*) b);
+  double tx = lineprof_estimate(lineprof_sorting, x);
+  double ty = lineprof_estimate(lineprof_sorting, y);
+
+  if (tx != ty)
+    return (tx > ty) ? -1 : 1;
+  else
+    return x - y;
+}
+
+
+//
+// Public functions:
+//
+
+//
+// lineprof_init
+//
+// Returns a new, empty line profile.
+//
+struct LINE_PROFILE* lineprof_init(void)
+{
+  struct LINE_PROFILE* profile = (struct LINE_PROFILE*) malloc(sizeof(struct LINE_PROFILE));
+
+  if (profile == NULL)
+    exit(0);
+
+  profile->capacity = 64;
+  profile->counts = (long*) calloc(profile->capacity, sizeof(long));
+  profile->samples = (long*) calloc(profile->capacity, sizeof(long));
+  profile->ticks = (uint64_t*) calloc(profile->capacity, sizeof(uint64_t));
+
+  if (profile->counts == NULL || profile->samples == NULL || profile->ticks == NULL)
+    exit(0);
+
+  profile->timing = -1;
+  profile->since = 0;
+  profile->countdown = LINEPROF_EVERY;
+  profile->random = 2463534242u;
+
+  //
+  // the smallest difference between two clock readings is what
+  // reading the clock adds to every sample:
+  //
+  profile->overhead = UINT64_MAX;
+
+  for (int i = 0; i < 100; i++)
+  {
+    uint64_t before = lineprof_now();
+    uint64_t after = lineprof_now();
+
+    if (after - before < profile->overhead)
+      profile->overhead = after - before;
+  }
+
+  timespec_get(&profile->start_time, TIME_UTC);
+  profile->start_ticks = lineprof_now();
+
+  return profile;
+}
+
+
+//
+// lineprof_destroy
+//
+// Frees the memory used by the profile.
+//
+void lineprof_destroy(struct LINE_PROFILE* profile)
+{
+  free(profile->counts);
+  free(profile->samples);
+  free(profile->ticks);
+  free(profile);
+}
+
+
+//
+// lineprof_grow
+//
+// Makes room to count the given line.
+//
+void lineprof_grow(struct LINE_PROFILE* profile, int line)
+{
+  int capacity = profile->capacity;
+
+  while (capacity <= line)
+    capacity *= 2;
+
+  profile->counts = (long*) realloc(profile->counts, capacity * sizeof(long));
+  profile->samples = (long*) realloc(profile->samples, capacity * sizeof(long));
+  profile->ticks = (uint64_t*) realloc(profile->ticks, capacity * sizeof(uint64_t));
+
+  if (profile->counts == NULL || profile->samples == NULL || profile->ticks == NULL)
+    exit(0);
+
+  int added = capacity - profile->capacity;
+
+  memset(profile->counts + profile->capacity, 0, added * sizeof(long));
+  memset(profile->samples + profile->capacity, 0, added * sizeof(long));
+  memset(profile->ticks + profile->capacity, 0, added * sizeof(uint64_t));
+
+  profile->capacity = capacity;
+}
+
+
+//
+// lineprof_sample
+//
+// Starts timing the stmt on the given line, and picks how many
+// stmts to skip before the next sample: 1 .. 2*LINEPROF_EVERY-1
+// at random, so a loop's stmts don't fall in step with it.
+//
+void lineprof_sample(struct LINE_PROFILE* profile, int line)
+{
+  uint32_t x = profile->random;
+
+  x ^= x << 13;
+  x ^= x >> 17;
+  x ^= x << 5;
+
+  profile->random = x;
+  profile->countdown = 1 + (int) (x % (2 * LINEPROF_EVERY - 1));
+
+  profile->timing = line;
+  profile->since = lineprof_now();
+}
+
+
+//
+// lineprof_print
+//
+// Prints the lines that were executed, the most time first. The
+// estimated ticks are converted to milliseconds using the time
+// and ticks that passed since the profile was created.
+//
+void lineprof_print(struct LINE_PROFILE* profile)
+{
+  struct timespec now;
+
+  timespec_get(&now, TIME_UTC);
+  uint64_t elapsed_ticks = lineprof_now() - profile->start_ticks;
+
+  double elapsed_ms = (now.tv_sec - profile->start_time.tv_sec) * 1000.0 +
+                      (now.tv_nsec - profile->start_time.tv_nsec) / 1000000.0;
+  double ms_per_tick = (elapsed_ticks > 0) ? elapsed_ms / elapsed_ticks : 0.0;
+
+  int* order = (int*) malloc(profile->capacity * sizeof(int));
+
+  if (order == NULL)
+    exit(0);
+
+  int num_lines = 0;
+  long total_count = 0;
+  double total_ticks = 0.0;
+
+  for (int line = 0; line < profile->capacity; line++)
+  {
+    if (profile->counts[line] > 0)
+      order[num_lines++] = line;
+
+    total_count += profile->counts[line];
+    total_ticks += lineprof_estimate(profile, line);
+  }
+
+  lineprof_sorting = profile;
+  qsort(order, num_lines, sizeof(int), lineprof_compare_lines);
+
+  printf("**LINE PROFILE**\n");
+  printf("Total: %.3f ms, %ld stmts\n", total_ticks * ms_per_tick, total_count);
+  printf("Lines:\n");
+
+  for (int i = 0; i < num_lines; i++)
+  {
+    int line = order[i];
+    double ticks = lineprof_estimate(profile, line);
+
+    printf(" line %d: %ld stmts, %.3f ms (%.1f%%)\n", line, profile->counts[line],
+      ticks * ms_per_tick, (total_ticks > 0) ? 100.0 * ticks / total_ticks : 0.0);
+  }
+
+  free(order);
+}
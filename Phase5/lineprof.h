@@ -0,0 +1,175 @@
+/*lineprof.h*/
+
+//
+// Per-line profiler for the nuPython executor. For each line of
+// the program it counts how many times the statement on that
+// line was executed, and how much time was spent in it: from
+// the moment the statement starts until the next one starts,
+// so a while loop or an if is charged for evaluating its
+// condition, and the lines' times add up to the whole run.
+//
+// Counts are exact. Reading a clock costs about as much as
+// executing a simple stmt, so times are sampled instead: about 1
+// in LINEPROF_EVERY stmts, chosen at random, is timed (and every
+// line the first time it runs), and a line's time is estimated
+// as its average sampled time times its count. That keeps the
+// overhead to a few percent, and the time it takes to read the
+// clock is measured and left out of the estimates.
+//
+// Time is measured in CPU timestamp counter ticks (rdtsc) where
+// available, otherwise in nanoseconds with timespec_get(), and
+// converted to seconds when printed. Either way it's wall time:
+// waiting for input() counts too.
+//
+// Jad Dibs
+//
+// Northwestern University
+// CS 211
+//
+
+#pragma once
+
+#include <stdint.h>
+#include <time.h>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>  // __rdtsc
+#endif
+
+
+#define LINEPROF_EVERY 16  // average # of stmts per sample
+
+
+//
+// Definition of a line profile
+//
+struct LINE_PROFILE
+{
+  int       capacity;    // lines 0..capacity-1 are counted
+  long*     counts;      // # of times the stmt on each line ran
+  long*     samples;     // # of those that were timed
+  uint64_t* ticks;       // total ticks of the timed ones
+
+  int       timing;      // line being timed, -1 if none
+  uint64_t  since;       // when it started
+  int       countdown;   // # of stmts until the next sample
+  uint32_t  random;      // xorshift state for the countdown
+  uint64_t  overhead;    // ticks taken by reading the clock
+
+  uint64_t        start_ticks;  // to convert ticks to seconds
+  struct timespec start_time;
+};
+
+
+//
+// Public functions:
+//
+
+//
+// lineprof_init
+//
+// Returns a new, empty line profile; the caller must call
+// lineprof_destroy when done.
+//
+struct LINE_PROFILE* lineprof_init(void);
+
+//
+// lineprof_destroy
+//
+// Frees the memory used by the profile.
+//
+void lineprof_destroy(struct LINE_PROFILE* profile);
+
+//
+// lineprof_grow
+//
+// Makes room to count the given line; called by lineprof_enter.
+//
+void lineprof_grow(struct LINE_PROFILE* profile, int line);
+
+//
+// lineprof_sample
+//
+// Starts timing the stmt on the given line; called by
+// lineprof_enter.
+//
+void lineprof_sample(struct LINE_PROFILE* profile, int line);
+
+//
+// lineprof_print
+//
+// Prints the lines that were executed, the most time first,
+// with their counts and times, e.g.
+//
+//   **LINE PROFILE**
+//   Total: 612.403 ms, 4000007 stmts
+//   Lines:
+//    line 7: 1000000 stmts, 301.550 ms (49.2%)
+//
+// Times are estimates, see above.
+//
+void lineprof_print(struct LINE_PROFILE* profile);
+
+//
+// lineprof_now
+//
+// Current value of the profile's clock, in ticks.
+//
+static inline uint64_t lineprof_now(void)
+{
+#if defined(__x86_64__) || defined(__i386__)
+  return __rdtsc();
+#else
+  struct timespec now;
+
+  timespec_get(&now, TIME_UTC);
+
+  return (uint64_t) now.tv_sec * 1000000000u + (uint64_t) now.tv_nsec;
+#endif
+}
+
+//
+// lineprof_stop
+//
+// If a stmt is being timed, it's done.
+//
+static inline void lineprof_stop(struct LINE_PROFILE* profile)
+{
+  if (profile->timing >= 0)
+  {
+    profile->ticks[profile->timing] += lineprof_now() - profile->since;
+    profile->samples[profile->timing]++;
+    profile->timing = -1;
+  }
+}
+
+//
+// lineprof_enter
+//
+// The stmt on the given line starts executing, so the one before
+// it is done. Called by the executor for every stmt, so it's
+// inline and reads the clock only when sampling.
+//
+static inline void lineprof_enter(struct LINE_PROFILE* profile, int line)
+{
+  lineprof_stop(profile);
+
+  if (line >= profile->capacity)
+    lineprof_grow(profile, line);
+
+  profile->counts[line]++;
+
+  if (--profile->countdown <= 0 || profile->samples[line] == 0)
+    lineprof_sample(profile, line);
+}
+
+//
+// lineprof_leave
+//
+// Execution stopped (normally or with an error): the last stmt
+// executed is done.
+//
+static inline void lineprof_leave(struct LINE_PROFILE* profile)
+{
+  lineprof_stop(profile);
+}
@@ -11,10 +11,19 @@
 // to eliminate warnings about stdlib in Visual Studio
 #define _CRT_SECURE_NO_WARNINGS
 
+// fileno(), getrusage() are POSIX, not part of std=c11:
+#define _POSIX_C_SOURCE 200809L
+
 #include <stdio.h>
 #include <stdlib.h>
 #include <stdbool.h>  // true, false
-#include <string.h>   // strcspn
+#include <string.h>   // strcspn, strcmp
+#include <time.h>     // timespec_get
+
+#if defined(__unix__) || defined(__APPLE__)
+#include <sys/resource.h>  // getrusage
+#include <unistd.h>        // sysconf
+#endif
 
 #include "token.h"    // token defs
 #include "scanner.h" 
@@ -23,21 +32,322 @@
 #include "programgraph.h" 
 #include "ram.h"
 #include "execute.h"
+#include "output.h"
+#include "vm.h"
+#include "transpile.h"
+#include "lineprof.h"
+#include "budget.h"
+#include "input.h"
+#include "context.h"
+#include "batch.h"
+#include "memo.h"
+#include "trace.h"
+#include "timeline.h"
+#include "alloc.h"
+
+
+//
+// Timings of the phases of a run, for --timings:
+//
+enum PHASES
+{
+  PHASE_PARSE = 0,
+  PHASE_BUILD,
+  PHASE_EXECUTE,
+  PHASE_TEARDOWN,
+  NUM_PHASES
+};
+
+static char* phase_names[NUM_PHASES] = { "parser_parse", "programgraph_build", "execute", "teardown" };
+
+struct PHASE_TIMING
+{
+  bool   ran;
+  double seconds;      // wall time
+  long   peak_rss_kb;  // the process's peak RSS when the phase was done
+};
+
+
+//
+// wall_seconds
+//
+// Returns the current wall-clock time in seconds.
+//
+static double wall_seconds(void)
+{
+  struct timespec now;
+
+  timespec_get(&now, TIME_UTC);
+
+  return now.tv_sec + now.tv_nsec / 1e9;
+}
+
+//
+// peak_rss_kb
+//
+// Returns the most memory the process has had resident so far, in
+// KB, or 0 if the platform doesn't say.
+//
+static long peak_rss_kb(void)
+{
+#if defined(__unix__) || defined(__APPLE__)
+  struct rusage usage;
+
+  if (getrusage(RUSAGE_SELF, &usage) != 0)
+    return 0;
+
+#if defined(__APPLE__)
+  return usage.ru_maxrss / 1024;  // bytes
+#else
+  return usage.ru_maxrss;
+#endif
+#else
+  return 0;
+#endif
+}
+
+//
+// phase_done
+//
+// The given phase, started at the given time, is done.
+//
+static void phase_done(struct PHASE_TIMING* timings, int phase, double start)
+{
+  timings[phase].ran = true;
+  timings[phase].seconds = wall_seconds() - start;
+  timings[phase].peak_rss_kb = peak_rss_kb();
+}
+
+//
+// print_timings
+//
+// Prints the phases that ran, for people and then as a single
+// line of JSON for tools, e.g.
+//
+//   **TIMINGS**
+//    parser_parse:            1.204 ms, peak RSS 3412 KB
+//    ...
+//    total:                 812.553 ms, peak RSS 9876 KB
+//   **timings: {"parser_parse":{"ms":1.204,"peak_rss_kb":3412},...,"total":{...}}
+//
+// Peak RSS is a high-water mark, so it never goes down from one
+// phase to the next; what a phase added is the difference.
+//
+static void print_timings(struct PHASE_TIMING* timings)
+{
+  double total = 0.0;
+  long peak = 0;
+
+  printf("**TIMINGS**\n");
+
+  for (int p = 0; p < NUM_PHASES; p++)
+  {
+    if (!timings[p].ran)
+      continue;
+
+    printf(" %s:%*s %10.3f ms, peak RSS %ld KB\n", phase_names[p], (int) (18 - strlen(phase_names[p])), "",
+      timings[p].seconds * 1000.0, timings[p].peak_rss_kb);
+
+    total += timings[p].seconds;
+    peak = timings[p].peak_rss_kb;
+  }
+
+  printf(" %-19s %10.3f ms, peak RSS %ld KB\n", "total:", total * 1000.0, peak);
+
+  printf("**timings: {");
+
+  for (int p = 0; p < NUM_PHASES; p++)
+  {
+    if (timings[p].ran)
+      printf("\"%s\":{\"ms\":%.3f,\"peak_rss_kb\":%ld},", phase_names[p], timings[p].seconds * 1000.0, timings[p].peak_rss_kb);
+  }
+
+  printf("\"total\":{\"ms\":%.3f,\"peak_rss_kb\":%ld}}\n", total * 1000.0, peak);
+}
 
 
 //
 // main
 //
-// usage: program.exe [filename.py]
+// usage: program.exe [--hoisted] [--profile] [--lines] [--jit] [--memo] [--emit-c out.c]
+//                    [--trace trace.log] [--timeline out.json] [--timings] [--allocs]
+//                    [--parallel] [--threads N] [--input lines.txt]
+//                    [--max-stmts N] [--max-seconds S] [filename.py]
+//        program.exe --batch [--threads N] [--jit] [--max-stmts N]
+//                    [--max-seconds S] file.py|directory ...
 // 
 // If a filename is given, the file is opened and serves as
 // input to the program. If a filename is not given, then 
 // input is taken from the keyboard until $ is input.
 //
+// --hoisted: before executing, list the expressions that
+//            were moved out of while loops.
+// --profile: run without superinstructions, and list the
+//            pairs of VM instructions executed most often
+//            (candidates for new superinstructions).
+// --lines:   walk the program graph instead of using the VM,
+//            and list how many times each line was executed
+//            and how long it took, the slowest lines first.
+// --jit:     compile hot while loops to machine code (x86-64
+//            only, ignored elsewhere).
+// --memo:    walk the program graph instead of using the VM,
+//            replaying passes through pure while-loop bodies
+//            that already ran with the same values (see memo.h),
+//            and report how many were replayed. Ignored with
+//            --profile and --trace.
+// --trace:   walk the program graph instead of using the VM,
+//            recording every stmt executed and what it wrote in
+//            the given file (see trace.h; read it back with
+//            traceread.out). Ignored with --profile.
+// --timeline: walk the program graph instead of using the VM,
+//            and write spans for parsing, building the program
+//            graph, executing, and each run of and pass through
+//            a while loop to the given file, in Chrome's trace
+//            event format (see timeline.h). Ignored with
+//            --profile and --emit-c.
+// --timings: at the end, list the wall time and peak RSS of
+//            parser_parse, programgraph_build, execute, and
+//            teardown, then the same as one line of JSON.
+// --allocs:  at the end, list the # of allocation calls, bytes,
+//            and peak heap of each subsystem (only counted in a
+//            build with make counters, see alloc.h).
+// --parallel: run independent top-level stmts (while loops
+//            that don't read what the others write) at the same
+//            time on N threads (one per CPU by default), see
+//            parallel.h. Ignored with --lines, --memo, --trace,
+//            --timeline, --profile, and the --max options.
+// --input:   input() reads the lines of the given file instead
+//            of the keyboard.
+// --emit-c:  instead of executing, translate the program into
+//            the given self-contained C file.
+// --max-stmts, --max-seconds: stop the program with an error
+//            once it has executed N stmts or run for S seconds
+//            (checked each time around a while loop), and
+//            report where it stopped. Ignored with --lines and
+//            --profile; overrides --jit.
+// --batch:   run all the given programs (a directory stands for
+//            the .py files in it) in parallel on N threads (one
+//            per CPU by default), and output the results of each
+//            in turn, in order. input() returns "" (see batch.h).
+//
 int main(int argc, char* argv[])
 {
   FILE* input = NULL;
   bool  keyboardInput = false;
+  bool  reportHoisted = false;
+  bool  profile = false;
+  bool  lines = false;
+  bool  jit = false;
+  bool  memoize = false;
+  char* emitC = NULL;
+  char* traceFile = NULL;
+  char* timelineFile = NULL;
+  char* inputFile = NULL;
+  bool  reportTimings = false;
+  bool  reportAllocs = false;
+  long  maxStmts = 0;
+  double maxSeconds = 0.0;
+  bool  batch = false;
+  bool  parallel = false;
+  int   numThreads = 0;
+
+  //
+  // options come first:
+  //
+  while (argc > 1 && strncmp(argv[1], "--", 2) == 0)
+  {
+    if (strcmp(argv[1], "--hoisted") == 0)
+      reportHoisted = true;
+    else if (strcmp(argv[1], "--profile") == 0)
+      profile = true;
+    else if (strcmp(argv[1], "--lines") == 0)
+      lines = true;
+    else if (strcmp(argv[1], "--jit") == 0)
+      jit = true;
+    else if (strcmp(argv[1], "--memo") == 0)
+      memoize = true;
+    else if (strcmp(argv[1], "--emit-c") == 0 && argc > 2)
+    {
+      emitC = argv[2];
+      argv++;
+      argc--;
+    }
+    else if (strcmp(argv[1], "--trace") == 0 && argc > 2)
+    {
+      traceFile = argv[2];
+      argv++;
+      argc--;
+    }
+    else if (strcmp(argv[1], "--timeline") == 0 && argc > 2)
+    {
+      timelineFile = argv[2];
+      argv++;
+      argc--;
+    }
+    else if (strcmp(argv[1], "--input") == 0 && argc > 2)
+    {
+      inputFile = argv[2];
+      argv++;
+      argc--;
+    }
+    else if (strcmp(argv[1], "--timings") == 0)
+      reportTimings = true;
+    else if (strcmp(argv[1], "--allocs") == 0)
+      reportAllocs = true;
+    else if (strcmp(argv[1], "--batch") == 0)
+      batch = true;
+    else if (strcmp(argv[1], "--parallel") == 0)
+      parallel = true;
+    else if (strcmp(argv[1], "--threads") == 0 && argc > 2 && atoi(argv[2]) > 0)
+    {
+      numThreads = atoi(argv[2]);
+      argv++;
+      argc--;
+    }
+    else if (strcmp(argv[1], "--max-stmts") == 0 && argc > 2 && atol(argv[2]) > 0)
+    {
+      maxStmts = atol(argv[2]);
+      argv++;
+      argc--;
+    }
+    else if (strcmp(argv[1], "--max-seconds") == 0 && argc > 2 && atof(argv[2]) > 0.0)
+    {
+      maxSeconds = atof(argv[2]);
+      argv++;
+      argc--;
+    }
+    else
+    {
+      printf("**ERROR: unknown option '%s'.\n", argv[1]);
+      return 0;
+    }
+
+    argv++;
+    argc--;
+  }
+
+  if (batch)
+  {
+    struct BATCH_OPTIONS options;
+
+    options.num_threads = numThreads;
+    options.vm_options = jit ? VM_JIT : 0;
+    options.max_stmts = maxStmts;
+    options.max_seconds = maxSeconds;
+
+    fflush(stdout);
+
+    struct OUTPUT* results = output_init_fd(1);
+
+    batch_run(argv + 1, argc - 1, &options, results);
+
+    output_destroy(results);
+
+    if (reportAllocs)
+      alloc_print();
+
+    return 0;
+  }
 
   //
   // where is the input coming from?
@@ -66,6 +376,30 @@ int main(int argc, char* argv[])
     keyboardInput = false;
   }
 
+  //
+  // the timeline is written through its own output sink:
+  //
+  FILE* timelineOut = NULL;
+  struct OUTPUT* timelineSink = NULL;
+  struct TIMELINE* timeline = NULL;
+  double started = 0.0;
+
+  struct PHASE_TIMING phases[NUM_PHASES] = { { false, 0.0, 0 } };
+  double phaseStart = 0.0;
+
+  if (timelineFile != NULL && !profile && emitC == NULL)
+  {
+    timelineOut = fopen(timelineFile, "w");
+
+    if (timelineOut == NULL)
+      printf("**ERROR: unable to open timeline file '%s', no timeline.\n", timelineFile);
+    else
+    {
+      timelineSink = output_init_fd(fileno(timelineOut));
+      timeline = timeline_init(timelineSink);
+    }
+  }
+
   if (keyboardInput)  // prompt the user if appropriate:
   {
     printf("nuPython input (enter $ when you're done)>\n");
@@ -74,8 +408,22 @@ int main(int argc, char* argv[])
   //
   // call parser to check program syntax:
   //
+  if (timeline != NULL)
+    started = timeline_now(timeline);
+
+  phaseStart = wall_seconds();
+
+  int subsystem = alloc_enter(ALLOC_PARSE);
+
   struct TokenQueue* tokens = parser_parse(input);
 
+  alloc_leave(subsystem);
+
+  phase_done(phases, PHASE_PARSE, phaseStart);
+
+  if (timeline != NULL)
+    timeline_span(timeline, "parse", "phase", started, timeline_now(timeline));
+
   if (tokens == NULL)
   {
     // 
@@ -88,29 +436,261 @@ int main(int argc, char* argv[])
     printf("**parsing successful, valid syntax\n");
     printf("**building program graph...\n");
 
+    if (timeline != NULL)
+      started = timeline_now(timeline);
+
+    phaseStart = wall_seconds();
+
+    subsystem = alloc_enter(ALLOC_GRAPH);
+
     struct STMT* program = programgraph_build(tokens);
 
+    alloc_leave(subsystem);
+
+    phase_done(phases, PHASE_BUILD, phaseStart);
+
+    if (timeline != NULL)
+      timeline_span(timeline, "programgraph_build", "phase", started, timeline_now(timeline));
+
     // programgraph_print(program); // debugging purpose. Comment out for submission.
 
+    if (emitC != NULL)
+    {
+      FILE* out = fopen(emitC, "w");
+
+      if (out == NULL)
+        printf("**ERROR: unable to open output file '%s'.\n", emitC);
+      else
+      {
+        bool written = transpile(program, out);
+
+        fclose(out);
+
+        if (written)
+          printf("**C program written to '%s'\n", emitC);
+      }
+
+      programgraph_destroy(program);
+      tokenqueue_destroy(tokens);
+
+      if (reportTimings)
+        print_timings(phases);
+
+      if (reportAllocs)
+        alloc_print();
+
+      if (!keyboardInput)
+        fclose(input);
+
+      return 0;
+    }
+
     //
     // now execute the program:
     //
+    if (reportHoisted)
+    {
+      struct VM_CODE* code = vm_compile(program, 0);
+
+      if (code != NULL)
+      {
+        vm_print_hoisted(code);
+        vm_free(code);
+      }
+    }
+
+    struct TRACE* trace = NULL;
+
+    if (traceFile != NULL && !profile)
+    {
+      trace = trace_open(traceFile);
+
+      if (trace == NULL)
+        printf("**ERROR: unable to open trace file '%s', not tracing.\n", traceFile);
+    }
+
     printf("**executing...\n");
 
+    subsystem = alloc_enter(ALLOC_RAM);
+
     struct RAM* memory = ram_init();
 
-    execute(program, memory);
+    alloc_leave(subsystem);
+
+    //
+    // input() reads from the keyboard, even when the program
+    // comes from a file, unless told otherwise:
+    //
+    struct INPUT* keyboard = NULL;
+
+    if (inputFile != NULL)
+    {
+      keyboard = input_init_path(inputFile);
+
+      if (keyboard == NULL)
+        printf("**ERROR: unable to open input file '%s', reading the keyboard.\n", inputFile);
+    }
+
+    if (keyboard == NULL)
+      keyboard = input_init_file(stdin);
+
+    //
+    // program output is buffered and written to stdout (fd 1)
+    // in large blocks, so flush what stdio has first to keep
+    // the output in order:
+    //
+    fflush(stdout);
+
+    struct OUTPUT* output = output_init_fd(1);
+
+    struct CONTEXT* context = context_init(memory, output, keyboard);
+
+    struct VM_PROFILE* pairs = NULL;
+    struct LINE_PROFILE* timings = NULL;
+    struct MEMO* memo = NULL;
+    bool budgeted = (maxStmts > 0 || maxSeconds > 0.0) && !lines && !profile;
+    struct BUDGET budget;
+
+    if (lines)
+    {
+      timings = lineprof_init();
+      context->lines = timings;
+    }
+    else if (budgeted)
+    {
+      budget_init(&budget, maxStmts, maxSeconds);
+      context->budget = &budget;
+    }
+    else if (profile || jit)
+    {
+      if (profile)
+      {
+        pairs = (struct VM_PROFILE*) calloc(1, sizeof(struct VM_PROFILE));
+
+        if (pairs == NULL)
+          exit(0);
+
+        context->pairs = pairs;
+      }
+
+      context->vm_options = (profile ? VM_NO_SUPERINSTRUCTIONS : 0) | (jit ? VM_JIT : 0);
+    }
+
+    if (parallel)
+    {
+      context->threads = numThreads;
+
+#if defined(__unix__) || defined(__APPLE__)
+      if (context->threads <= 0)
+        context->threads = (int) sysconf(_SC_NPROCESSORS_ONLN);  // one per CPU
+#endif
+
+      if (context->threads <= 0)
+        context->threads = 1;
+    }
+
+    if (timeline != NULL)
+      context->timeline = timeline;
+
+    if (trace != NULL)
+      context->trace = trace;
+    else if (memoize && !profile)
+    {
+      memo = memo_init();
+      context->memo = memo;
+    }
+
+    if (timeline != NULL)
+      started = timeline_now(timeline);
+
+    phaseStart = wall_seconds();
+
+    subsystem = alloc_enter(ALLOC_EXECUTE);
+
+    execute(program, context);
+
+    alloc_leave(subsystem);
+
+    phase_done(phases, PHASE_EXECUTE, phaseStart);
+
+    if (timeline != NULL)
+      timeline_span(timeline, "execute", "phase", started, timeline_now(timeline));
+
+    output_destroy(output);
 
     printf("**done\n");
 
     ram_print(memory);
 
+    if (budgeted)
+      budget_print(&budget);
+
+    if (profile)
+    {
+      if (context->code == NULL)
+        printf("**profile: program not supported by the VM\n");
+      else
+        vm_print_profile(pairs, 10);
+
+      free(pairs);
+    }
+
+    if (timings != NULL)
+    {
+      lineprof_print(timings);
+      lineprof_destroy(timings);
+    }
+
+    if (memo != NULL)
+    {
+      memo_print(memo);
+      memo_destroy(memo);
+    }
+
+    if (trace != NULL)
+    {
+      long steps = trace->steps;
+
+      if (trace_close(trace))
+        printf("**trace: %ld steps written to '%s'\n", steps, traceFile);
+      else
+        printf("**ERROR: unable to write trace file '%s'.\n", traceFile);
+    }
+
     //
     // cleanup:
     //
+    phaseStart = wall_seconds();
+
+    context_destroy(context);
+    input_destroy(keyboard);
+    ram_destroy(memory);
+    programgraph_destroy(program);
     tokenqueue_destroy(tokens);
+
+    phase_done(phases, PHASE_TEARDOWN, phaseStart);
+  }
+
+  if (timeline != NULL)
+  {
+    long spans = timeline->events;
+    long dropped = timeline->dropped;
+
+    timeline_close(timeline);
+    output_destroy(timelineSink);
+
+    if (fclose(timelineOut) == 0)
+      printf("**timeline: %ld spans written to '%s' (%ld dropped)\n", spans, timelineFile, dropped);
+    else
+      printf("**ERROR: unable to write timeline file '%s'.\n", timelineFile);
   }
 
+  if (reportTimings)
+    print_timings(phases);
+
+  if (reportAllocs)
+    alloc_print();
+
   //
   // done:
   //
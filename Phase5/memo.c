@@ -0,0 +1,749 @@
+/*memo.c*/
+
+//
+// Memoization of pure while-loop bodies for the nuPython
+// executor, see memo.h.
+//
+// Jad Dibs
+//
+// Northwestern University
+// CS 211
+//
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdbool.h>  // true, false
+#include <stdint.h>
+#include <string.h>
+
+#include "programgraph.h"
+#include "ram.h"
+#include "strbuild.h"
+#include "memo.h"
+#include "alloc.h"
+
+
+//
+// While analyzing a loop body, each stmt in it is a node: what
+// it reads and assigns, and which nodes can run next:
+//
+struct MEMO_NODE
+{
+  struct STMT* stmt;
+  char* reads[2];      // variables it reads
+  int num_reads;
+  char* assigned;      // variable it assigns, NULL if none
+  struct STMT* next[2];
+  int num_next;
+};
+
+
+//
+// Private functions:
+//
+static void memo_add_read(struct MEMO_LOOP* loop, char* name);
+static bool memo_operand_reads(struct MEMO_NODE* node, struct UNARY_EXPR* unary);
+static bool memo_expr_reads(struct MEMO_NODE* node, struct EXPR* expr);
+static bool memo_node(struct MEMO_NODE* node, struct STMT* stmt);
+static int memo_index(struct MEMO_NODE* nodes, int num_nodes, struct STMT* stmt);
+static void memo_analyze(struct MEMO_LOOP* loop);
+static struct MEMO_LOOP* memo_find(struct MEMO* memo, struct STMT* stmt);
+static bool memo_same(struct RAM_VALUE* x, struct RAM_VALUE* y);
+static uint64_t memo_hash(struct RAM_VALUE* key, int num_reads);
+static struct RAM_VALUE memo_copy(struct RAM_VALUE value);
+static void memo_free_entry(struct MEMO_ENTRY* entry, int num_reads);
+static void memo_add_write(struct MEMO_LOOP* loop, char* name);
+
+
+//
+// memo_add_read
+//
+// Adds the variable to the loop's read set, unless it's there.
+//
+static void memo_add_read(struct MEMO_LOOP* loop, char* name)
+{
+  for (int r = 0; r < loop->num_reads; r++)
+    if (strcmp(loop->reads[r], name) == 0)
+      return;
+
+  loop->reads = (char**) realloc(loop->reads, (loop->num_reads + 1) * sizeof(char*));
+
+  if (loop->reads == NULL)
+    exit(0);
+
+  loop->reads[loop->num_reads] = name;
+  loop->num_reads++;
+}
+
+//
+// memo_operand_reads
+//
+// Adds the variable the operand reads, if any, to the node's
+// reads. Returns false if the operand isn't pure (a pointer) or
+// can't be memoized (None).
+//
+static bool memo_operand_reads(struct MEMO_NODE* node, struct UNARY_EXPR* unary)
+{
+  if (unary->expr_type != UNARY_ELEMENT)
+    return false;
+
+  if (unary->element->element_type == ELEMENT_IDENTIFIER)
+    node->reads[node->num_reads++] = unary->element->element_value;
+
+  return unary->element->element_type != ELEMENT_NONE;
+}
+
+//
+// memo_expr_reads
+//
+// Adds the variables the expression reads to the node's reads.
+// Returns false if the expression isn't pure.
+//
+static bool memo_expr_reads(struct MEMO_NODE* node, struct EXPR* expr)
+{
+  if (!memo_operand_reads(node, expr->lhs))
+    return false;
+
+  return !expr->isBinaryExpr || memo_operand_reads(node, expr->rhs);
+}
+
+//
+// memo_node
+//
+// Fills in the node for the stmt. Returns false if the stmt
+// isn't pure.
+//
+static bool memo_node(struct MEMO_NODE* node, struct STMT* stmt)
+{
+  node->stmt = stmt;
+  node->num_reads = 0;
+  node->assigned = NULL;
+  node->num_next = 0;
+
+  switch (stmt->stmt_type)
+  {
+  case STMT_ASSIGNMENT:
+  {
+    struct STMT_ASSIGNMENT* assign = stmt->types.assignment;
+
+    node->assigned = assign->var_name;
+    node->next[node->num_next++] = assign->next_stmt;
+
+    if (assign->isPtrDeref)
+      return false;
+
+    if (assign->rhs->value_type == VALUE_EXPR)
+      return memo_expr_reads(node, assign->rhs->types.expr);
+
+    //
+    // int(x) and float(x) are pure, input() isn't:
+    //
+    struct FUNCTION_CALL* call = assign->rhs->types.function_call;
+
+    if (call->parameter == NULL || strcmp(call->function_name, "input") == 0)
+      return false;
+
+    node->reads[node->num_reads++] = call->parameter->element_value;  // always a variable name
+    return true;
+  }
+
+  case STMT_IF_THEN_ELSE:
+    node->next[node->num_next++] = stmt->types.if_then_else->true_path;
+    node->next[node->num_next++] = stmt->types.if_then_else->false_path;
+    return memo_expr_reads(node, stmt->types.if_then_else->condition);
+
+  case STMT_WHILE_LOOP:
+    node->next[node->num_next++] = stmt->types.while_loop->loop_body;
+    node->next[node->num_next++] = stmt->types.while_loop->next_stmt;
+    return memo_expr_reads(node, stmt->types.while_loop->condition);
+
+  case STMT_PASS:
+    node->next[node->num_next++] = stmt->types.pass->next_stmt;
+    return true;
+
+  default:  // print() has to run
+    return false;
+  }
+}
+
+//
+// memo_index
+//
+// Returns the index of the stmt's node, -1 if it has none.
+//
+static int memo_index(struct MEMO_NODE* nodes, int num_nodes, struct STMT* stmt)
+{
+  for (int n = 0; n < num_nodes; n++)
+    if (nodes[n].stmt == stmt)
+      return n;
+
+  return -1;
+}
+
+//
+// memo_analyze
+//
+// Finds whether the loop's body is pure, and its read set: the
+// variables some stmt in it reads that may not have been
+// assigned yet in the same pass (a variable assigned before it's
+// read on every path, e.g. a temporary, gets its value from the
+// rest of the read set). Every stmt reachable from the top of
+// the body is visited; the body's stmts all lead back to the
+// loop, where the search stops. Then the variables assigned on
+// every path to each stmt are found by iterating to a fixed
+// point.
+//
+static void memo_analyze(struct MEMO_LOOP* loop)
+{
+  int capacity = 16;
+  int num_nodes = 0;
+  struct MEMO_NODE* nodes = (struct MEMO_NODE*) malloc(capacity * sizeof(struct MEMO_NODE));
+
+  if (nodes == NULL)
+    exit(0);
+
+  loop->pure = memo_node(&nodes[num_nodes++], loop->loop->types.while_loop->loop_body);
+
+  for (int visited = 0; visited < num_nodes && loop->pure; visited++)
+  {
+    for (int n = 0; n < nodes[visited].num_next && loop->pure; n++)
+    {
+      struct STMT* next = nodes[visited].next[n];
+
+      if (next == NULL || next == loop->loop || memo_index(nodes, num_nodes, next) >= 0)
+        continue;
+
+      if (num_nodes == capacity)
+      {
+        capacity *= 2;
+        nodes = (struct MEMO_NODE*) realloc(nodes, capacity * sizeof(struct MEMO_NODE));
+
+        if (nodes == NULL)
+          exit(0);
+      }
+
+      loop->pure = memo_node(&nodes[num_nodes++], next);
+    }
+  }
+
+  if (!loop->pure)
+  {
+    free(nodes);
+    return;
+  }
+
+  //
+  // assigned[n * num_nodes + m]: is the variable node m assigns
+  // assigned on every path from the top of the body to node n?
+  // Everything is, to start with, except at the top:
+  //
+  bool* assigned = (bool*) malloc(num_nodes * num_nodes * sizeof(bool));
+
+  if (assigned == NULL)
+    exit(0);
+
+  for (int n = 0; n < num_nodes; n++)
+    for (int m = 0; m < num_nodes; m++)
+      assigned[n * num_nodes + m] = (n != 0);
+
+  bool changed = true;
+
+  while (changed)
+  {
+    changed = false;
+
+    for (int n = 0; n < num_nodes; n++)
+    {
+      for (int s = 0; s < nodes[n].num_next; s++)
+      {
+        int next = memo_index(nodes, num_nodes, nodes[n].next[s]);
+
+        if (next <= 0)  // the loop, or the top of the body
+          continue;
+
+        for (int m = 0; m < num_nodes; m++)
+        {
+          bool after = assigned[n * num_nodes + m] ||
+                       (nodes[m].assigned != NULL && nodes[n].assigned != NULL && strcmp(nodes[m].assigned, nodes[n].assigned) == 0);
+
+          if (assigned[next * num_nodes + m] && !after)
+          {
+            assigned[next * num_nodes + m] = false;
+            changed = true;
+          }
+        }
+      }
+    }
+  }
+
+  for (int n = 0; n < num_nodes; n++)
+  {
+    for (int r = 0; r < nodes[n].num_reads; r++)
+    {
+      bool before = false;
+
+      for (int m = 0; m < num_nodes && !before; m++)
+        before = assigned[n * num_nodes + m] && nodes[m].assigned != NULL && strcmp(nodes[m].assigned, nodes[n].reads[r]) == 0;
+
+      if (!before)
+        memo_add_read(loop, nodes[n].reads[r]);
+    }
+  }
+
+  free(assigned);
+  free(nodes);
+}
+
+//
+// memo_find
+//
+// Returns the memo table of the given while loop, analyzing the
+// loop the first time it's seen.
+//
+static struct MEMO_LOOP* memo_find(struct MEMO* memo, struct STMT* stmt)
+{
+  for (int l = 0; l < memo->num_loops; l++)
+    if (memo->loops[l].loop == stmt)
+      return &memo->loops[l];
+
+  if (memo->num_loops == memo->capacity)
+  {
+    memo->capacity *= 2;
+    memo->loops = (struct MEMO_LOOP*) realloc(memo->loops, memo->capacity * sizeof(struct MEMO_LOOP));
+
+    if (memo->loops == NULL)
+      exit(0);
+  }
+
+  struct MEMO_LOOP* loop = &memo->loops[memo->num_loops++];
+
+  loop->loop = stmt;
+  loop->reads = NULL;
+  loop->num_reads = 0;
+  loop->buckets = NULL;
+  loop->num_entries = 0;
+  loop->hits = 0;
+  loop->misses = 0;
+  loop->pending = NULL;
+  loop->writes_capacity = 0;
+
+  memo_analyze(loop);
+
+  return loop;
+}
+
+//
+// memo_same
+//
+// Are the two values the same? Reals are compared bit for bit,
+// so e.g. -0.0 and 0.0 (which print differently) are not.
+//
+static bool memo_same(struct RAM_VALUE* x, struct RAM_VALUE* y)
+{
+  if (x->value_type != y->value_type)
+    return false;
+
+  switch (x->value_type)
+  {
+  case RAM_TYPE_INT:
+  case RAM_TYPE_PTR:
+  case RAM_TYPE_BOOLEAN:
+    return x->types.i == y->types.i;
+
+  case RAM_TYPE_REAL:
+    return memcmp(&x->types.d, &y->types.d, sizeof(double)) == 0;
+
+  case RAM_TYPE_STR:
+    return strcmp(x->types.s, y->types.s) == 0;
+
+  default:  // None, or not in memory
+    return true;
+  }
+}
+
+//
+// memo_hash
+//
+// FNV-1a hash of the values of the read set.
+//
+static uint64_t memo_hash(struct RAM_VALUE* key, int num_reads)
+{
+  uint64_t hash = 14695981039346656037ULL;
+
+  for (int r = 0; r < num_reads; r++)
+  {
+    const unsigned char* bytes = NULL;
+    size_t length = 0;
+
+    if (key[r].value_type == RAM_TYPE_STR)
+    {
+      bytes = (const unsigned char*) key[r].types.s;
+      length = strlen(key[r].types.s);
+    }
+    else if (key[r].value_type == RAM_TYPE_REAL)
+    {
+      bytes = (const unsigned char*) &key[r].types.d;
+      length = sizeof(double);
+    }
+    else if (key[r].value_type == RAM_TYPE_INT || key[r].value_type == RAM_TYPE_PTR || key[r].value_type == RAM_TYPE_BOOLEAN)
+    {
+      bytes = (const unsigned char*) &key[r].types.i;
+      length = sizeof(int);
+    }
+
+    hash = (hash ^ (unsigned char) key[r].value_type) * 1099511628211ULL;
+
+    for (size_t b = 0; b < length; b++)
+      hash = (hash ^ bytes[b]) * 1099511628211ULL;
+  }
+
+  return hash;
+}
+
+//
+// memo_copy
+//
+// Returns a copy of the value that owns its string, if any.
+//
+static struct RAM_VALUE memo_copy(struct RAM_VALUE value)
+{
+  if (value.value_type == RAM_TYPE_STR)
+  {
+    char* s = (char*) malloc(strlen(value.types.s) + 1);
+
+    if (s == NULL)
+      exit(0);
+
+    strcpy(s, value.types.s);
+    value.types.s = s;
+  }
+
+  return value;
+}
+
+//
+// memo_free_entry
+//
+// Frees the entry and the strings it owns.
+//
+static void memo_free_entry(struct MEMO_ENTRY* entry, int num_reads)
+{
+  for (int r = 0; r < num_reads; r++)
+    if (entry->key[r].value_type == RAM_TYPE_STR)
+      free(entry->key[r].types.s);
+
+  for (int w = 0; w < entry->num_writes; w++)
+    if (entry->writes[w].value.value_type == RAM_TYPE_STR)
+      free(entry->writes[w].value.types.s);
+
+  free(entry->key);
+  free(entry->writes);
+  free(entry);
+}
+
+//
+// memo_add_write
+//
+// Adds the variable to the writes of the loop's pass being
+// recorded, unless it's there.
+//
+static void memo_add_write(struct MEMO_LOOP* loop, char* name)
+{
+  struct MEMO_ENTRY* pending = loop->pending;
+
+  for (int w = 0; w < pending->num_writes; w++)
+    if (strcmp(pending->writes[w].name, name) == 0)
+      return;
+
+  if (pending->num_writes == loop->writes_capacity)
+  {
+    loop->writes_capacity = (loop->writes_capacity == 0) ? 4 : loop->writes_capacity * 2;
+    pending->writes = (struct MEMO_WRITE*) realloc(pending->writes, loop->writes_capacity * sizeof(struct MEMO_WRITE));
+
+    if (pending->writes == NULL)
+      exit(0);
+  }
+
+  pending->writes[pending->num_writes].name = name;
+  pending->writes[pending->num_writes].value.value_type = RAM_TYPE_NONE;
+  pending->num_writes++;
+}
+
+
+//
+// Public functions:
+//
+
+//
+// memo_init
+//
+// Returns a new, empty set of memo tables.
+//
+struct MEMO* memo_init(void)
+{
+  struct MEMO* memo = (struct MEMO*) malloc(sizeof(struct MEMO));
+
+  if (memo == NULL)
+    exit(0);
+
+  memo->capacity = 4;
+  memo->num_loops = 0;
+  memo->loops = (struct MEMO_LOOP*) malloc(memo->capacity * sizeof(struct MEMO_LOOP));
+
+  if (memo->loops == NULL)
+    exit(0);
+
+  memo->recording_capacity = 4;
+  memo->num_recording = 0;
+  memo->recording = (int*) malloc(memo->recording_capacity * sizeof(int));
+
+  if (memo->recording == NULL)
+    exit(0);
+
+  memo->hits = 0;
+  memo->misses = 0;
+
+  return memo;
+}
+
+//
+// memo_destroy
+//
+// Frees the memo tables.
+//
+void memo_destroy(struct MEMO* memo)
+{
+  memo_cancel(memo);
+
+  for (int l = 0; l < memo->num_loops; l++)
+  {
+    struct MEMO_LOOP* loop = &memo->loops[l];
+
+    if (loop->buckets != NULL)
+    {
+      for (int b = 0; b < MEMO_BUCKETS; b++)
+      {
+        struct MEMO_ENTRY* entry = loop->buckets[b];
+
+        while (entry != NULL)
+        {
+          struct MEMO_ENTRY* next = entry->next;
+
+          memo_free_entry(entry, loop->num_reads);
+          entry = next;
+        }
+      }
+    }
+
+    free(loop->buckets);
+    free(loop->reads);
+  }
+
+  free(memo->loops);
+  free(memo->recording);
+  free(memo);
+}
+
+//
+// memo_replay
+//
+// Replays the loop's pass for the values in memory if it's been
+// recorded, else starts recording it if possible.
+//
+bool memo_replay(struct MEMO* memo, struct STMT* loop_stmt, struct RAM* memory, struct STR_BUILDERS* strings)
+{
+  struct MEMO_LOOP* loop = memo_find(memo, loop_stmt);
+
+  if (!loop->pure)
+    return false;
+
+  //
+  // the key, borrowed from memory for now:
+  //
+  struct RAM_VALUE* key = (struct RAM_VALUE*) malloc((loop->num_reads + 1) * sizeof(struct RAM_VALUE));
+
+  if (key == NULL)
+    exit(0);
+
+  for (int r = 0; r < loop->num_reads; r++)
+  {
+    int address = ram_get_addr(memory, loop->reads[r]);
+
+    if (address < 0)
+      key[r].value_type = -1;
+    else
+      key[r] = memory->cells[address].value;
+  }
+
+  uint64_t hash = memo_hash(key, loop->num_reads);
+  struct MEMO_ENTRY* entry = (loop->buckets == NULL) ? NULL : loop->buckets[hash % MEMO_BUCKETS];
+
+  for (; entry != NULL; entry = entry->next)
+  {
+    bool same = (entry->hash == hash);
+
+    for (int r = 0; r < loop->num_reads && same; r++)
+      same = memo_same(&entry->key[r], &key[r]);
+
+    if (same)
+      break;
+  }
+
+  if (entry != NULL)
+  {
+    for (int w = 0; w < entry->num_writes; w++)
+    {
+      struct MEMO_WRITE* write = &entry->writes[w];
+
+      int previous = alloc_enter(ALLOC_RAM);
+
+      ram_write_cell_by_name(memory, write->value, write->name);  // makes its own copy
+
+      alloc_leave(previous);
+
+      //
+      // as with any other assignment, see execute_assignment:
+      //
+      if (strings->num_active > 0)
+        strbuild_forget(strings, ram_get_addr(memory, write->name));
+
+      if (memo->num_recording > 0)
+        memo_written(memo, write->name);
+    }
+
+    free(key);
+
+    loop->hits++;
+    memo->hits++;
+    return true;
+  }
+
+  loop->misses++;
+  memo->misses++;
+
+  if (loop->hits == 0 && loop->num_entries >= MEMO_MAX_ENTRIES)  // give up
+    loop->pure = false;
+
+  if (loop->num_entries >= MEMO_MAX_ENTRIES || !loop->pure)
+  {
+    free(key);
+    return false;
+  }
+
+  //
+  // record this pass:
+  //
+  for (int r = 0; r < loop->num_reads; r++)
+    key[r] = memo_copy(key[r]);
+
+  struct MEMO_ENTRY* pending = (struct MEMO_ENTRY*) malloc(sizeof(struct MEMO_ENTRY));
+
+  if (pending == NULL)
+    exit(0);
+
+  pending->hash = hash;
+  pending->key = key;
+  pending->writes = NULL;
+  pending->num_writes = 0;
+  pending->next = NULL;
+
+  loop->pending = pending;
+  loop->writes_capacity = 0;
+
+  if (memo->num_recording == memo->recording_capacity)
+  {
+    memo->recording_capacity *= 2;
+    memo->recording = (int*) realloc(memo->recording, memo->recording_capacity * sizeof(int));
+
+    if (memo->recording == NULL)
+      exit(0);
+  }
+
+  memo->recording[memo->num_recording++] = (int) (loop - memo->loops);
+
+  return false;
+}
+
+//
+// memo_written
+//
+// Adds the variable to the writes of every pass being recorded.
+//
+void memo_written(struct MEMO* memo, char* name)
+{
+  for (int r = 0; r < memo->num_recording; r++)
+    memo_add_write(&memo->loops[memo->recording[r]], name);
+}
+
+//
+// memo_record
+//
+// Caches the innermost pass being recorded if it's the given
+// loop's, with the values it wrote.
+//
+void memo_record(struct MEMO* memo, struct STMT* loop_stmt, struct RAM* memory)
+{
+  struct MEMO_LOOP* loop = &memo->loops[memo->recording[memo->num_recording - 1]];
+  struct MEMO_ENTRY* pending = loop->pending;
+
+  if (loop->loop != loop_stmt)  // a loop inside it
+    return;
+
+  for (int w = 0; w < pending->num_writes; w++)
+  {
+    int address = ram_get_addr(memory, pending->writes[w].name);
+
+    pending->writes[w].value = memo_copy(memory->cells[address].value);
+  }
+
+  if (loop->buckets == NULL)
+  {
+    loop->buckets = (struct MEMO_ENTRY**) calloc(MEMO_BUCKETS, sizeof(struct MEMO_ENTRY*));
+
+    if (loop->buckets == NULL)
+      exit(0);
+  }
+
+  struct MEMO_ENTRY** bucket = &loop->buckets[pending->hash % MEMO_BUCKETS];
+
+  pending->next = *bucket;
+  *bucket = pending;
+  loop->num_entries++;
+
+  loop->pending = NULL;
+  memo->num_recording--;
+}
+
+//
+// memo_cancel
+//
+// Drops the passes being recorded.
+//
+void memo_cancel(struct MEMO* memo)
+{
+  for (int r = 0; r < memo->num_recording; r++)
+  {
+    struct MEMO_LOOP* loop = &memo->loops[memo->recording[r]];
+
+    memo_free_entry(loop->pending, loop->num_reads);
+    loop->pending = NULL;
+  }
+
+  memo->num_recording = 0;
+}
+
+//
+// memo_print
+//
+// Prints the # of passes replayed and run.
+//
+void memo_print(struct MEMO* memo)
+{
+  int memoized = 0;
+
+  for (int l = 0; l < memo->num_loops; l++)
+    if (memo->loops[l].pure || memo->loops[l].hits > 0)
+      memoized++;
+
+  printf("**memo: %ld passes replayed, %ld run (%d of %d loops memoized)\n", memo->hits, memo->misses, memoized, memo->num_loops);
+}
@@ -0,0 +1,173 @@
+/*memo.h*/
+
+//
+// Memoization of pure while-loop bodies for the nuPython
+// executor. A loop body is pure if all it does is assign
+// variables from expressions and int() / float() (including in
+// nested ifs and loops): no print(), no input(), no pointers.
+// What such a body does is then a function of the values of the
+// variables it may read before assigning them, its read set,
+// found by analyzing the body once.
+//
+// Each time around a pure loop, the read set's values are looked
+// up in the loop's cache. On a hit, the variables the body wrote
+// the last time it ran with those values are written again, in
+// the same order (so new memory cells are created in the same
+// order), instead of running the body. On a miss the body runs,
+// and the variables it writes are recorded, with their values
+// once it's done; a pass that stops with an error is not
+// recorded. Passes of nested loops are recorded at the same
+// time, so a pass of an outer loop records what the passes of
+// the loops inside it wrote, whether they ran or were replayed.
+//
+// A cache holds MEMO_MAX_ENTRIES passes at most. A loop whose
+// cache fills up without a single hit (e.g. one that reads its
+// own counter) isn't looked up any more.
+//
+// Memoization is opt-in: it pays off only when bodies really do
+// run again with the same values, and costs a lookup every time
+// around otherwise. On a budget, the stmts of a replayed pass
+// aren't counted, but the budget is checked after every pass.
+//
+// Jad Dibs
+//
+// Northwestern University
+// CS 211
+//
+
+#pragma once
+
+#include <stdbool.h>  // true, false
+#include <stdint.h>
+
+#include "programgraph.h"
+#include "ram.h"
+#include "strbuild.h"
+
+
+#define MEMO_BUCKETS     1024  // per loop
+#define MEMO_MAX_ENTRIES 4096  // per loop
+
+
+//
+// Definition of the memo tables
+//
+struct MEMO_WRITE
+{
+  char* name;              // variable, owned by the program graph
+  struct RAM_VALUE value;  // its value after the pass (strings are owned)
+};
+
+struct MEMO_ENTRY
+{
+  uint64_t hash;
+  struct RAM_VALUE* key;     // value of each variable in the read set,
+                             // value_type -1 if it wasn't in memory
+  struct MEMO_WRITE* writes; // in the order first written
+  int num_writes;
+
+  struct MEMO_ENTRY* next;   // in the same bucket
+};
+
+struct MEMO_LOOP
+{
+  struct STMT* loop;
+  bool pure;            // false => never looked up
+  char** reads;         // the read set
+  int num_reads;
+
+  struct MEMO_ENTRY** buckets;  // NULL until the first pass is recorded
+  int num_entries;
+  long hits;
+  long misses;
+
+  //
+  // the pass being recorded, NULL if none:
+  //
+  struct MEMO_ENTRY* pending;  // its key and the variables written so far
+  int writes_capacity;
+};
+
+struct MEMO
+{
+  struct MEMO_LOOP* loops;  // every while loop seen so far
+  int num_loops;
+  int capacity;
+
+  //
+  // the loops whose passes are being recorded, innermost last
+  // (indexes into loops, which may move):
+  //
+  int* recording;
+  int num_recording;
+  int recording_capacity;
+
+  long hits;    // passes replayed
+  long misses;  // passes of pure loops run
+};
+
+
+//
+// Public functions:
+//
+
+//
+// memo_init
+//
+// Returns a pointer to a dynamically-allocated, empty set of
+// memo tables; the caller must call memo_destroy when done.
+//
+struct MEMO* memo_init(void);
+
+//
+// memo_destroy
+//
+// Frees the memo tables and the values cached in them.
+//
+void memo_destroy(struct MEMO* memo);
+
+//
+// memo_replay
+//
+// Called when the given while loop's condition is true and its
+// body is about to run. If the body is pure and has run before
+// with the values now in memory, writes what it wrote then and
+// returns true; the body must not run. Otherwise returns false,
+// and if the body is pure, starts recording the pass.
+//
+bool memo_replay(struct MEMO* memo, struct STMT* loop, struct RAM* memory, struct STR_BUILDERS* strings);
+
+//
+// memo_written
+//
+// Called with the name of every variable assigned while a pass
+// is being recorded (num_recording > 0).
+//
+void memo_written(struct MEMO* memo, char* name);
+
+//
+// memo_record
+//
+// Called when a while loop is reached while a pass is being
+// recorded, before the loop's condition is evaluated. If it's
+// the innermost loop being recorded, its pass is done, so the
+// values of the variables it wrote are cached.
+//
+void memo_record(struct MEMO* memo, struct STMT* loop, struct RAM* memory);
+
+//
+// memo_cancel
+//
+// Drops the passes being recorded, if any (e.g. execution
+// stopped with an error).
+//
+void memo_cancel(struct MEMO* memo);
+
+//
+// memo_print
+//
+// Prints how many passes were replayed and run, e.g.
+//
+//   **memo: 99000 passes replayed, 1100 run (1 of 2 loops memoized)
+//
+void memo_print(struct MEMO* memo);
@@ -0,0 +1,284 @@
+/*output.c*/
+
+//
+// Buffered output sink for the nuPython executor.
+//
+// Jad Dibs
+//
+// Northwestern University
+// CS 211
+//
+
+// write() is POSIX, not part of std=c11:
+#define _POSIX_C_SOURCE 200809L
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdbool.h>  // true, false
+#include <string.h>
+#include <stdarg.h>   // va_list
+#include <errno.h>
+#include <unistd.h>   // write
+
+#include "output.h"
+
+
+//
+// size of the buffer for an fd sink; output reaches the OS
+// in blocks of this size:
+//
+#define OUTPUT_BUFFER_SIZE (64 * 1024)
+
+
+//
+// Helper functions
+//
+
+//
+// output_create
+//
+// Allocates a sink of the given kind with an empty buffer.
+//
+static struct OUTPUT* output_create(int kind, int fd, int capacity);
+
+//
+// output_write_fd
+//
+// Writes all length bytes to fd, retrying partial writes.
+//
+static void output_write_fd(int fd, const char* s, int length);
+
+//
+// output_reserve
+//
+// Makes room for at least n more bytes (plus a '\0') in the
+// buffer, by flushing an fd sink or growing a memory sink.
+//
+static void output_reserve(struct OUTPUT* output, int n);
+
+
+//
+// Public functions:
+//
+
+//
+// output_init_fd
+//
+// Returns a sink that buffers output for the given file descriptor.
+//
+struct OUTPUT* output_init_fd(int fd)
+{
+  return output_create(OUTPUT_FD, fd, OUTPUT_BUFFER_SIZE);
+}
+
+//
+// output_init_memory
+//
+// Returns a sink that keeps all output in memory.
+//
+struct OUTPUT* output_init_memory(void)
+{
+  return output_create(OUTPUT_MEMORY, -1, 1024);
+}
+
+//
+// output_destroy
+//
+// Flushes pending output and frees the sink.
+//
+void output_destroy(struct OUTPUT* output)
+{
+  if (output == NULL)
+    return;
+
+  output_flush(output);
+
+  free(output->buffer);
+  free(output);
+}
+
+//
+// output_write
+//
+// Appends length bytes starting at s to the sink.
+//
+void output_write(struct OUTPUT* output, const char* s, int length)
+{
+  if (output->kind == OUTPUT_FD && length >= output->capacity)
+  {
+    //
+    // too big to buffer, keep order and write it straight through:
+    //
+    output_flush(output);
+    output_write_fd(output->fd, s, length);
+    return;
+  }
+
+  output_reserve(output, length);
+
+  memcpy(output->buffer + output->length, s, length);
+  output->length += length;
+  output->buffer[output->length] = '\0';
+}
+
+//
+// output_printf
+//
+// printf-style formatted output to the sink. Formats directly
+// into the buffer; only if it doesn't fit is room made and the
+// formatting redone.
+//
+void output_printf(struct OUTPUT* output, const char* format, ...)
+{
+  va_list args;
+
+  int room = output->capacity - output->length;
+
+  va_start(args, format);
+  int n = vsnprintf(output->buffer + output->length, room, format, args);
+  va_end(args);
+
+  if (n < 0)  // encoding error, nothing sensible to output:
+  {
+    output->buffer[output->length] = '\0';
+    return;
+  }
+
+  if (n < room)  // common case, it fit:
+  {
+    output->length += n;
+    return;
+  }
+
+  output->buffer[output->length] = '\0';
+
+  if (output->kind == OUTPUT_FD && n >= output->capacity)
+  {
+    //
+    // larger than the whole buffer, format into a temporary:
+    //
+    char* temp = (char*) malloc(n + 1);
+
+    if (temp == NULL)
+      exit(0);
+
+    va_start(args, format);
+    vsnprintf(temp, n + 1, format, args);
+    va_end(args);
+
+    output_write(output, temp, n);
+
+    free(temp);
+    return;
+  }
+
+  output_reserve(output, n);
+
+  va_start(args, format);
+  vsnprintf(output->buffer + output->length, n + 1, format, args);
+  va_end(args);
+
+  output->length += n;
+}
+
+//
+// output_flush
+//
+// Writes any pending output to the file descriptor.
+//
+void output_flush(struct OUTPUT* output)
+{
+  if (output->kind != OUTPUT_FD || output->length == 0)
+    return;
+
+  output_write_fd(output->fd, output->buffer, output->length);
+
+  output->length = 0;
+  output->buffer[0] = '\0';
+}
+
+//
+// output_contents
+//
+// Returns the output collected by a memory sink.
+//
+char* output_contents(struct OUTPUT* output)
+{
+  if (output->kind != OUTPUT_MEMORY)
+    return NULL;
+
+  return output->buffer;
+}
+
+
+//
+// Helper functions
+//
+
+static struct OUTPUT* output_create(int kind, int fd, int capacity)
+{
+  struct OUTPUT* output = (struct OUTPUT*) malloc(sizeof(struct OUTPUT));
+
+  if (output == NULL)
+    exit(0);
+
+  output->kind = kind;
+  output->fd = fd;
+  output->length = 0;
+  output->capacity = capacity;
+  output->buffer = (char*) malloc(capacity);
+
+  if (output->buffer == NULL)
+    exit(0);
+
+  output->buffer[0] = '\0';
+
+  return output;
+}
+
+static void output_write_fd(int fd, const char* s, int length)
+{
+  while (length > 0)
+  {
+    ssize_t n = write(fd, s, length);
+
+    if (n < 0)
+    {
+      if (errno == EINTR)
+        continue;
+
+      return;  // nowhere to report it, drop the output
+    }
+
+    s += n;
+    length -= (int) n;
+  }
+}
+
+static void output_reserve(struct OUTPUT* output, int n)
+{
+  if (output->length + n < output->capacity)  // room for n bytes + '\0'
+    return;
+
+  if (output->kind == OUTPUT_FD)
+  {
+    output_flush(output);
+    return;
+  }
+
+  //
+  // memory sink, double until it fits:
+  //
+  int capacity = output->capacity;
+
+  while (output->length + n >= capacity)
+    capacity *= 2;
+
+  char* buffer = (char*) realloc(output->buffer, capacity);
+
+  if (buffer == NULL)
+    exit(0);
+
+  output->buffer = buffer;
+  output->capacity = capacity;
+}
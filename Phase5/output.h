@@ -0,0 +1,101 @@
+/*output.h*/
+
+//
+// Buffered output sink for the nuPython executor. Output from
+// print() and error messages is collected in a large user-space
+// buffer and handed to the OS in a few big write() calls, rather
+// than one stdio call per line.
+//
+// Jad Dibs
+//
+// Northwestern University
+// CS 211
+//
+
+#pragma once
+
+#include <stdbool.h>  // true, false
+
+
+//
+// Definition of an output sink
+//
+enum OUTPUT_KINDS
+{
+  OUTPUT_FD = 0,   // buffered, then written to a file descriptor
+  OUTPUT_MEMORY    // kept in memory, see output_contents()
+};
+
+struct OUTPUT
+{
+  int kind;      // enum OUTPUT_KINDS
+  int fd;        // file descriptor if kind == OUTPUT_FD
+
+  char* buffer;  // pending output (OUTPUT_FD) or all output (OUTPUT_MEMORY)
+  int length;    // # of bytes currently in buffer
+  int capacity;  // total # of bytes available in buffer
+};
+
+
+//
+// Public functions:
+//
+
+//
+// output_init_fd
+//
+// Returns a pointer to a dynamically-allocated output sink that
+// buffers output and writes it to the given file descriptor
+// (e.g. 1 for stdout) when the buffer fills or is flushed.
+//
+struct OUTPUT* output_init_fd(int fd);
+
+//
+// output_init_memory
+//
+// Returns a pointer to a dynamically-allocated output sink that
+// keeps all output in memory; the buffer grows as needed. Use
+// output_contents() to retrieve what was written.
+//
+struct OUTPUT* output_init_memory(void);
+
+//
+// output_destroy
+//
+// Flushes any pending output and frees the sink. After the
+// call returns, you cannot use the sink.
+//
+void output_destroy(struct OUTPUT* output);
+
+//
+// output_write
+//
+// Appends length bytes starting at s to the sink.
+//
+void output_write(struct OUTPUT* output, const char* s, int length);
+
+//
+// output_printf
+//
+// printf-style formatted output to the sink.
+//
+void output_printf(struct OUTPUT* output, const char* format, ...);
+
+//
+// output_flush
+//
+// Writes any pending output to the file descriptor. Must be
+// called before reading input so that prompts are visible, and
+// before anything else writes to the same descriptor. Does
+// nothing for a memory sink.
+//
+void output_flush(struct OUTPUT* output);
+
+//
+// output_contents
+//
+// Returns the '\0'-terminated output collected by a memory sink.
+// The sink keeps ownership of the string. Returns NULL for an
+// fd sink.
+//
+char* output_contents(struct OUTPUT* output);
@@ -0,0 +1,691 @@
+/*parallel.c*/
+
+//
+// Parallel execution of independent top-level stmts, see
+// parallel.h.
+//
+// Jad Dibs
+//
+// Northwestern University
+// CS 211
+//
+
+// pthreads are POSIX, not part of std=c11:
+#define _POSIX_C_SOURCE 200809L
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdbool.h>  // true, false
+#include <string.h>
+#include <assert.h>
+#include <pthread.h>
+#include <stdatomic.h>
+
+#include "parallel.h"
+#include "programgraph.h"
+#include "walk.h"
+#include "ram.h"
+#include "output.h"
+#include "context.h"
+#include "vm.h"
+#include "alloc.h"
+
+
+//
+// A unit of a parallel wave, as it runs
+//
+struct PARALLEL_JOB
+{
+  struct PARALLEL_UNIT* unit;
+  struct RAM* memory;       // its own
+  struct OUTPUT* output;    // captured
+  struct CONTEXT* context;
+  bool ok;                  // ran to completion?
+  atomic_bool stop;         // set => an earlier unit failed
+};
+
+struct PARALLEL_POOL
+{
+  struct PARALLEL_JOB* jobs;
+  int num_jobs;
+  atomic_int next;          // index of the next job to run
+};
+
+
+//
+// Private functions:
+//
+static bool parallel_contains(char** names, int num_names, char* name);
+static void parallel_add(char*** names, int* num_names, char* name);
+static void parallel_read(struct PARALLEL_UNIT* unit, char* name, int defined);
+static void parallel_operand(struct PARALLEL_UNIT* unit, struct UNARY_EXPR* unary, int defined);
+static void parallel_expr(struct PARALLEL_UNIT* unit, struct EXPR* expr, int defined);
+static bool parallel_is_input(struct STMT* stmt);
+static bool parallel_is_simple(struct STMT* stmt);
+static void parallel_stmt(struct PARALLEL_UNIT* unit, struct STMT* stmt, int defined);
+static void parallel_analyze(struct PARALLEL_UNIT* unit);
+static void parallel_add_wave(struct PARALLEL_PLAN* plan, int* capacity, int first);
+static void* parallel_work(void* arg);
+static bool parallel_run_wave(struct PARALLEL_PLAN* plan, struct PARALLEL_WAVE* wave, struct CONTEXT* context, int num_threads);
+
+
+//
+// parallel_contains
+//
+// Returns true if the name is one of the given names.
+//
+static bool parallel_contains(char** names, int num_names, char* name)
+{
+  for (int i = 0; i < num_names; i++)
+  {
+    if (strcmp(names[i], name) == 0)
+      return true;
+  }
+
+  return false;
+}
+
+//
+// parallel_add
+//
+// Adds the name to the given names unless it's already there,
+// growing the array by one.
+//
+static void parallel_add(char*** names, int* num_names, char* name)
+{
+  if (parallel_contains(*names, *num_names, name))
+    return;
+
+  *names = (char**) realloc(*names, (*num_names + 1) * sizeof(char*));
+
+  if (*names == NULL)
+    exit(0);
+
+  (*names)[*num_names] = name;
+  (*num_names)++;
+}
+
+//
+// parallel_read
+//
+// Adds the variable to the unit's reads, unless it's one of the
+// first defined variables the unit writes, which are assigned
+// before anything in the unit reads them.
+//
+static void parallel_read(struct PARALLEL_UNIT* unit, char* name, int defined)
+{
+  if (!parallel_contains(unit->writes, defined, name))
+    parallel_add(&unit->reads, &unit->num_reads, name);
+}
+
+//
+// parallel_operand
+//
+// Adds the variable the operand reads, if any, to the unit's
+// reads.
+//
+static void parallel_operand(struct PARALLEL_UNIT* unit, struct UNARY_EXPR* unary, int defined)
+{
+  if (unary->element->element_type == ELEMENT_IDENTIFIER)
+    parallel_read(unit, unary->element->element_value, defined);
+}
+
+//
+// parallel_expr
+//
+// Adds the variables the expression reads to the unit's reads.
+//
+static void parallel_expr(struct PARALLEL_UNIT* unit, struct EXPR* expr, int defined)
+{
+  parallel_operand(unit, expr->lhs, defined);
+
+  if (expr->isBinaryExpr)
+    parallel_operand(unit, expr->rhs, defined);
+}
+
+//
+// parallel_is_input
+//
+// Returns true if the stmt is an assignment from input().
+//
+static bool parallel_is_input(struct STMT* stmt)
+{
+  if (stmt->stmt_type != STMT_ASSIGNMENT || stmt->types.assignment->rhs->value_type != VALUE_FUNCTION_CALL)
+    return false;
+
+  return strcmp(stmt->types.assignment->rhs->types.function_call->function_name, "input") == 0;
+}
+
+//
+// parallel_is_simple
+//
+// Returns true if the stmt is executed once, by itself, i.e.
+// isn't a while loop, an if, or a call to input().
+//
+static bool parallel_is_simple(struct STMT* stmt)
+{
+  return stmt->stmt_type != STMT_WHILE_LOOP && stmt->stmt_type != STMT_IF_THEN_ELSE && !parallel_is_input(stmt);
+}
+
+//
+// parallel_stmt
+//
+// Adds what the stmt reads and writes to the unit's, and notes
+// a while loop or a call to input().
+//
+static void parallel_stmt(struct PARALLEL_UNIT* unit, struct STMT* stmt, int defined)
+{
+  switch (stmt->stmt_type)
+  {
+  case STMT_ASSIGNMENT:
+  {
+    struct STMT_ASSIGNMENT* assign = stmt->types.assignment;
+
+    if (assign->rhs->value_type == VALUE_EXPR)
+      parallel_expr(unit, assign->rhs->types.expr, defined);
+    else
+    {
+      struct FUNCTION_CALL* call = assign->rhs->types.function_call;
+
+      if (call->parameter != NULL && call->parameter->element_type == ELEMENT_IDENTIFIER)
+        parallel_read(unit, call->parameter->element_value, defined);
+    }
+
+    parallel_add(&unit->writes, &unit->num_writes, assign->var_name);
+    unit->input = unit->input || parallel_is_input(stmt);
+    break;
+  }
+
+  case STMT_FUNCTION_CALL:
+  {
+    struct STMT_FUNCTION_CALL* call = stmt->types.function_call;
+
+    if (call->parameter != NULL && call->parameter->element_type == ELEMENT_IDENTIFIER)
+      parallel_read(unit, call->parameter->element_value, defined);
+
+    break;
+  }
+
+  case STMT_IF_THEN_ELSE:
+    parallel_expr(unit, stmt->types.if_then_else->condition, defined);
+    break;
+
+  case STMT_WHILE_LOOP:
+    unit->loops = true;
+    parallel_expr(unit, stmt->types.while_loop->condition, defined);
+    break;
+
+  default:
+    assert(stmt->stmt_type == STMT_PASS);
+    break;
+  }
+}
+
+//
+// parallel_analyze
+//
+// Finds the variables the unit reads and writes, and whether it
+// has a while loop or calls input(), by visiting every stmt
+// reachable from its first one before its stop.
+//
+static void parallel_analyze(struct PARALLEL_UNIT* unit)
+{
+  //
+  // the simple stmts that start the unit run in order, so what
+  // they assign before it's read isn't read from outside:
+  //
+  struct STMT* stmt = unit->first;
+  int defined = 0;
+
+  for (; stmt != unit->stop && parallel_is_simple(stmt); stmt = walk_next(stmt, NULL))
+  {
+    parallel_stmt(unit, stmt, defined);
+    defined = unit->num_writes;
+  }
+
+  //
+  // then the loop or if, and everything in it:
+  //
+  int capacity = 16;
+  int num_visited = 0;
+  int num_pending = 0;
+  struct STMT** visited = (struct STMT**) malloc(capacity * sizeof(struct STMT*));
+  struct STMT** pending = (struct STMT**) malloc(capacity * sizeof(struct STMT*));
+
+  if (visited == NULL || pending == NULL)
+    exit(0);
+
+  pending[num_pending++] = stmt;
+
+  while (num_pending > 0)
+  {
+    stmt = pending[--num_pending];
+
+    if (stmt == NULL || stmt == unit->stop)
+      continue;
+
+    bool seen = false;
+
+    for (int i = 0; i < num_visited && !seen; i++)
+      seen = (visited[i] == stmt);
+
+    if (seen)
+      continue;
+
+    //
+    // each stmt adds at most 2 pending, so both arrays grow
+    // together:
+    //
+    if (num_visited + 1 >= capacity || num_pending + 2 >= capacity)
+    {
+      capacity *= 2;
+      visited = (struct STMT**) realloc(visited, capacity * sizeof(struct STMT*));
+      pending = (struct STMT**) realloc(pending, capacity * sizeof(struct STMT*));
+
+      if (visited == NULL || pending == NULL)
+        exit(0);
+    }
+
+    visited[num_visited++] = stmt;
+
+    parallel_stmt(unit, stmt, defined);
+
+    switch (stmt->stmt_type)
+    {
+    case STMT_ASSIGNMENT:
+      pending[num_pending++] = stmt->types.assignment->next_stmt;
+      break;
+
+    case STMT_FUNCTION_CALL:
+      pending[num_pending++] = stmt->types.function_call->next_stmt;
+      break;
+
+    case STMT_IF_THEN_ELSE:
+      pending[num_pending++] = stmt->types.if_then_else->true_path;
+      pending[num_pending++] = stmt->types.if_then_else->false_path;
+      break;
+
+    case STMT_WHILE_LOOP:
+      pending[num_pending++] = stmt->types.while_loop->loop_body;
+      pending[num_pending++] = stmt->types.while_loop->next_stmt;
+      break;
+
+    default:
+      pending[num_pending++] = stmt->types.pass->next_stmt;
+      break;
+    }
+  }
+
+  free(visited);
+  free(pending);
+}
+
+//
+// parallel_add_wave
+//
+// Starts a new wave at the given unit, growing the array of
+// waves as needed.
+//
+static void parallel_add_wave(struct PARALLEL_PLAN* plan, int* capacity, int first)
+{
+  if (plan->num_waves == *capacity)
+  {
+    *capacity = (*capacity == 0) ? 16 : 2 * *capacity;
+    plan->waves = (struct PARALLEL_WAVE*) realloc(plan->waves, *capacity * sizeof(struct PARALLEL_WAVE));
+
+    if (plan->waves == NULL)
+      exit(0);
+  }
+
+  struct PARALLEL_WAVE* wave = &plan->waves[plan->num_waves];
+
+  wave->first = first;
+  wave->num_units = 0;
+  wave->parallel = false;
+
+  plan->num_waves++;
+}
+
+//
+// parallel_work
+//
+// A thread of the pool: runs jobs until there are none left. A
+// unit that fails stops the units after it, which are dropped
+// anyway: those not started yet are skipped, those running stop
+// at their next back edge (so one that would loop forever
+// doesn't keep the program from ending, as it wouldn't have run
+// at all one unit after another).
+//
+static void* parallel_work(void* arg)
+{
+  struct PARALLEL_POOL* pool = (struct PARALLEL_POOL*) arg;
+  int previous = alloc_enter(ALLOC_EXECUTE);
+
+  while (true)
+  {
+    int j = atomic_fetch_add(&pool->next, 1);
+
+    if (j >= pool->num_jobs)
+      break;
+
+    struct PARALLEL_JOB* job = &pool->jobs[j];
+
+    if (atomic_load(&job->stop))
+      continue;
+
+    job->ok = vm_run(job->unit->code, job->context);
+
+    if (!job->ok)
+    {
+      for (int k = j + 1; k < pool->num_jobs; k++)
+        atomic_store(&pool->jobs[k].stop, true);
+    }
+  }
+
+  alloc_leave(previous);
+
+  return NULL;
+}
+
+//
+// parallel_run_wave
+//
+// Runs the units of a parallel wave at the same time, then
+// writes out their output and commits what they wrote, in
+// program order. Returns false if a unit stopped with an error.
+//
+static bool parallel_run_wave(struct PARALLEL_PLAN* plan, struct PARALLEL_WAVE* wave, struct CONTEXT* context, int num_threads)
+{
+  struct PARALLEL_POOL pool;
+
+  pool.num_jobs = wave->num_units;
+  pool.jobs = (struct PARALLEL_JOB*) malloc(pool.num_jobs * sizeof(struct PARALLEL_JOB));
+  atomic_init(&pool.next, 0);
+
+  if (pool.jobs == NULL)
+    exit(0);
+
+  //
+  // each unit starts from a copy of the variables it reads:
+  //
+  for (int j = 0; j < pool.num_jobs; j++)
+  {
+    struct PARALLEL_JOB* job = &pool.jobs[j];
+    struct PARALLEL_UNIT* unit = &plan->units[wave->first + j];
+
+    int previous = alloc_enter(ALLOC_RAM);
+
+    job->unit = unit;
+    job->memory = ram_init();
+
+    for (int r = 0; r < unit->num_reads; r++)
+    {
+      int address = ram_get_addr(context->memory, unit->reads[r]);
+
+      if (address >= 0)
+        ram_write_cell_by_name(job->memory, context->memory->cells[address].value, unit->reads[r]);
+    }
+
+    alloc_leave(previous);
+
+    job->output = output_init_memory();
+    job->context = context_init(job->memory, job->output, context->input);
+    job->context->vm_options = context->vm_options;
+    job->ok = false;
+
+    //
+    // the first unit always runs to the end, the others can be
+    // stopped:
+    //
+    atomic_init(&job->stop, false);
+
+    if (j > 0)
+      job->context->stop = &job->stop;
+  }
+
+  //
+  // the calling thread is one of the pool:
+  //
+  int num_workers = (num_threads < pool.num_jobs ? num_threads : pool.num_jobs) - 1;
+  pthread_t* workers = (pthread_t*) malloc((num_workers + 1) * sizeof(pthread_t));
+  bool* started = (bool*) malloc((num_workers + 1) * sizeof(bool));
+
+  if (workers == NULL || started == NULL)
+    exit(0);
+
+  for (int t = 0; t < num_workers; t++)
+    started[t] = (pthread_create(&workers[t], NULL, parallel_work, &pool) == 0);
+
+  parallel_work(&pool);
+
+  for (int t = 0; t < num_workers; t++)
+  {
+    if (started[t])
+      pthread_join(workers[t], NULL);
+  }
+
+  free(workers);
+  free(started);
+
+  //
+  // commit, in program order, up to the first unit that failed:
+  //
+  bool ok = true;
+
+  for (int j = 0; j < pool.num_jobs; j++)
+  {
+    struct PARALLEL_JOB* job = &pool.jobs[j];
+
+    if (ok)
+    {
+      output_write(context->output, output_contents(job->output), job->output->length);
+
+      int previous = alloc_enter(ALLOC_RAM);
+
+      for (int c = 0; c < job->memory->num_values; c++)
+      {
+        struct RAM_CELL* cell = &job->memory->cells[c];
+
+        if (parallel_contains(job->unit->writes, job->unit->num_writes, cell->identifier))
+          ram_write_cell_by_name(context->memory, cell->value, cell->identifier);
+      }
+
+      alloc_leave(previous);
+
+      ok = job->ok;
+    }
+
+    context_destroy(job->context);
+    output_destroy(job->output);
+    ram_destroy(job->memory);
+  }
+
+  free(pool.jobs);
+
+  return ok;
+}
+
+
+//
+// Public functions:
+//
+
+//
+// parallel_plan
+//
+// Splits the program into units and waves; returns NULL if no
+// wave runs in parallel or the VM can't run a unit.
+//
+struct PARALLEL_PLAN* parallel_plan(struct STMT* program, int vm_options)
+{
+  struct PARALLEL_PLAN* plan = (struct PARALLEL_PLAN*) malloc(sizeof(struct PARALLEL_PLAN));
+
+  if (plan == NULL)
+    exit(0);
+
+  plan->units = NULL;
+  plan->num_units = 0;
+  plan->waves = NULL;
+  plan->num_waves = 0;
+  plan->num_parallel = 0;
+
+  //
+  // the units: a top-level loop or if with the simple stmts
+  // before it, or a call to input() by itself:
+  //
+  int capacity = 0;
+
+  for (struct STMT* stmt = program; stmt != NULL; )
+  {
+    struct STMT* last = stmt;
+
+    if (!parallel_is_input(stmt))
+    {
+      while (parallel_is_simple(last) && walk_next(last, NULL) != NULL && !parallel_is_input(walk_next(last, NULL)))
+        last = walk_next(last, NULL);
+    }
+
+    if (plan->num_units == capacity)
+    {
+      capacity = (capacity == 0) ? 16 : 2 * capacity;
+      plan->units = (struct PARALLEL_UNIT*) realloc(plan->units, capacity * sizeof(struct PARALLEL_UNIT));
+
+      if (plan->units == NULL)
+        exit(0);
+    }
+
+    struct PARALLEL_UNIT* unit = &plan->units[plan->num_units];
+
+    unit->first = stmt;
+    unit->stop = walk_next(last, NULL);
+    unit->reads = NULL;
+    unit->num_reads = 0;
+    unit->writes = NULL;
+    unit->num_writes = 0;
+    unit->loops = false;
+    unit->input = false;
+    unit->code = NULL;
+
+    plan->num_units++;
+
+    parallel_analyze(unit);
+
+    stmt = unit->stop;
+  }
+
+  //
+  // the waves: a unit joins the current one unless it reads
+  // what a unit in it writes, or either calls input():
+  //
+  capacity = 0;
+
+  for (int u = 0; u < plan->num_units; u++)
+  {
+    struct PARALLEL_UNIT* unit = &plan->units[u];
+    struct PARALLEL_WAVE* wave = (plan->num_waves == 0) ? NULL : &plan->waves[plan->num_waves - 1];
+    bool joins = (wave != NULL && !unit->input && !plan->units[wave->first].input);
+
+    for (int w = (wave == NULL) ? u : wave->first; w < u && joins; w++)
+    {
+      for (int r = 0; r < unit->num_reads && joins; r++)
+        joins = !parallel_contains(plan->units[w].writes, plan->units[w].num_writes, unit->reads[r]);
+    }
+
+    if (!joins)
+    {
+      parallel_add_wave(plan, &capacity, u);
+      wave = &plan->waves[plan->num_waves - 1];
+    }
+
+    wave->num_units++;
+  }
+
+  for (int w = 0; w < plan->num_waves; w++)
+  {
+    struct PARALLEL_WAVE* wave = &plan->waves[w];
+    int loops = 0;
+
+    for (int u = wave->first; u < wave->first + wave->num_units; u++)
+    {
+      if (plan->units[u].loops)
+        loops++;
+    }
+
+    wave->parallel = (loops >= 2);
+
+    if (wave->parallel)
+      plan->num_parallel++;
+  }
+
+  if (plan->num_parallel == 0)
+  {
+    parallel_free(plan);
+    return NULL;
+  }
+
+  //
+  // compile each unit:
+  //
+  for (int u = 0; u < plan->num_units; u++)
+  {
+    struct PARALLEL_UNIT* unit = &plan->units[u];
+
+    unit->code = vm_compile_until(unit->first, unit->stop, vm_options);
+
+    if (unit->code == NULL)  // not supported by the VM:
+    {
+      parallel_free(plan);
+      return NULL;
+    }
+  }
+
+  return plan;
+}
+
+//
+// parallel_free
+//
+// Frees the plan and its compiled code.
+//
+void parallel_free(struct PARALLEL_PLAN* plan)
+{
+  for (int u = 0; u < plan->num_units; u++)
+  {
+    free(plan->units[u].reads);
+    free(plan->units[u].writes);
+    vm_free(plan->units[u].code);
+  }
+
+  free(plan->units);
+  free(plan->waves);
+  free(plan);
+}
+
+//
+// parallel_run
+//
+// Executes the plan, wave by wave. Returns true if the program
+// ran to completion.
+//
+bool parallel_run(struct PARALLEL_PLAN* plan, struct CONTEXT* context, int num_threads)
+{
+  bool ok = true;
+
+  for (int w = 0; w < plan->num_waves && ok; w++)
+  {
+    struct PARALLEL_WAVE* wave = &plan->waves[w];
+
+    if (wave->parallel)
+    {
+      ok = parallel_run_wave(plan, wave, context, num_threads);
+      continue;
+    }
+
+    for (int u = wave->first; u < wave->first + wave->num_units && ok; u++)
+      ok = vm_run(plan->units[u].code, context);
+  }
+
+  output_flush(context->output);
+
+  return ok;
+}
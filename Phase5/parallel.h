@@ -0,0 +1,119 @@
+/*parallel.h*/
+
+//
+// Parallel execution of independent top-level stmts. The
+// program is split into units: each top-level while loop or if
+// (with everything inside it), together with the simple stmts
+// (assignments, print(), pass) right before it, and each call to
+// input() by itself. A unit has the set of variables it reads
+// from outside (not counting those its simple stmts assign
+// before reading them) and the set it writes. Consecutive units
+// are grouped into waves: a unit joins the current wave unless
+// it reads a variable a unit already in the wave writes, or
+// either calls input(), which reads the input in program order
+// and so always runs by itself.
+//
+// The units of a wave run at the same time, each on the VM with a
+// memory of its own, starting from a copy of the variables it
+// reads, and with its output captured. Then, in program order,
+// each unit's output is written out and the variables it wrote
+// are written to memory, in the order they were first assigned,
+// so memory ends up exactly as if the units had run one after
+// the other (the cells are created in the same order, a later
+// unit's write wins). If a unit stops with an error, its output
+// (and the error message) is written out, and the units after it
+// are dropped, as if execution had stopped there; those still
+// running are stopped at their next back edge, so a unit after
+// the error that loops forever doesn't hang the program. Those
+// later units don't use the JIT, which can't be stopped.
+//
+// A nuPython assignment is a single operation, far cheaper than
+// starting a thread, so only waves with at least two while loops
+// in them are run in parallel; the other waves run one unit
+// after another, on the VM against the program's memory. A
+// program with no such wave, or that the VM can't run, isn't
+// worth the trouble: parallel_plan returns NULL, and it is run
+// as usual.
+//
+// Jad Dibs
+//
+// Northwestern University
+// CS 211
+//
+
+#pragma once
+
+#include <stdbool.h>  // true, false
+
+#include "programgraph.h"
+#include "context.h"
+
+
+//
+// Definition of a plan
+//
+struct PARALLEL_UNIT
+{
+  struct STMT* first;   // its first top-level stmt
+  struct STMT* stop;    // the next unit's, NULL if none
+
+  char** reads;         // variables it reads, owned by the program graph
+  int num_reads;
+  char** writes;        // variables it assigns
+  int num_writes;
+
+  bool loops;           // has a while loop?
+  bool input;           // calls input()?
+
+  struct VM_CODE* code; // the unit compiled for the VM
+};
+
+struct PARALLEL_WAVE
+{
+  int first;            // index of its first unit
+  int num_units;
+  bool parallel;        // run the units at the same time?
+};
+
+struct PARALLEL_PLAN
+{
+  struct PARALLEL_UNIT* units;  // in program order
+  int num_units;
+
+  struct PARALLEL_WAVE* waves;  // in program order
+  int num_waves;
+  int num_parallel;             // # of waves run in parallel
+};
+
+
+//
+// Public functions:
+//
+
+//
+// parallel_plan
+//
+// Splits the program into units and waves, compiling each unit
+// with the given VM options. Returns a pointer to the plan, or
+// NULL if no wave would run in parallel or the VM can't run the
+// program. The caller must call parallel_free.
+//
+struct PARALLEL_PLAN* parallel_plan(struct STMT* program, int vm_options);
+
+//
+// parallel_free
+//
+// Frees the plan and its compiled code.
+//
+void parallel_free(struct PARALLEL_PLAN* plan);
+
+//
+// parallel_run
+//
+// Executes the plan in the given context (whose memory, output,
+// and input are used as by execute), running the units of each
+// parallel wave on up to num_threads threads. Returns true if
+// the program ran to completion, false if it stopped with an
+// error.
+//
+bool parallel_run(struct PARALLEL_PLAN* plan, struct CONTEXT* context, int num_threads);
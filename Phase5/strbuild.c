@@ -0,0 +1,179 @@
+/*strbuild.c*/
+
+//
+// String builders for the nuPython executor.
+//
+// Jad Dibs
+//
+// Northwestern University
+// CS 211
+//
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdbool.h>  // true, false
+#include <string.h>
+#include <assert.h>
+
+#include "strbuild.h"
+
+
+//
+// Helper functions
+//
+
+//
+// strbuild_get
+//
+// Returns the builder for the given address, growing the
+// array of builders if necessary.
+//
+static struct STR_BUILDER* strbuild_get(struct STR_BUILDERS* sb, int address);
+
+
+//
+// Public functions:
+//
+
+//
+// strbuild_init
+//
+// Returns a pointer to an empty set of string builders.
+//
+struct STR_BUILDERS* strbuild_init(void)
+{
+  struct STR_BUILDERS* sb = (struct STR_BUILDERS*) malloc(sizeof(struct STR_BUILDERS));
+
+  if (sb == NULL)
+    exit(0);
+
+  sb->builders = NULL;
+  sb->capacity = 0;
+  sb->num_active = 0;
+
+  return sb;
+}
+
+//
+// strbuild_destroy
+//
+// Frees the builders, but not the strings.
+//
+void strbuild_destroy(struct STR_BUILDERS* sb)
+{
+  if (sb == NULL)
+    return;
+
+  free(sb->builders);
+  free(sb);
+}
+
+//
+// strbuild_append
+//
+// Appends suffix to current in place, returns the (possibly
+// moved) string.
+//
+char* strbuild_append(struct STR_BUILDERS* sb, int address, char* current, const char* suffix)
+{
+  struct STR_BUILDER* b = strbuild_get(sb, address);
+
+  if (b->s != current)
+  {
+    //
+    // not a string we built (first append, or the variable was
+    // assigned something else since), start over:
+    //
+    if (b->s == NULL)
+      sb->num_active++;
+
+    b->s = current;
+    b->length = strlen(current);
+    b->capacity = b->length + 1;
+  }
+
+  size_t suffix_len = strlen(suffix);
+  size_t needed = b->length + suffix_len + 1;
+
+  //
+  // s = s + s: the suffix is the string we are about to grow:
+  //
+  bool self = (suffix == b->s);
+
+  if (needed > b->capacity)
+  {
+    size_t capacity = b->capacity * 2;
+
+    if (capacity < needed)
+      capacity = needed;
+
+    char* s = (char*) realloc(b->s, capacity);
+
+    if (s == NULL)
+      exit(0);
+
+    b->s = s;
+    b->capacity = capacity;
+  }
+
+  if (self)
+    suffix = b->s;
+
+  memmove(b->s + b->length, suffix, suffix_len);
+  b->s[b->length + suffix_len] = '\0';
+  b->length += suffix_len;
+
+  return b->s;
+}
+
+//
+// strbuild_forget
+//
+// Drops what the builder knows about the given address.
+//
+void strbuild_forget(struct STR_BUILDERS* sb, int address)
+{
+  if (address < 0 || address >= sb->capacity || sb->builders[address].s == NULL)
+    return;
+
+  sb->builders[address].s = NULL;
+  sb->builders[address].length = 0;
+  sb->builders[address].capacity = 0;
+
+  sb->num_active--;
+}
+
+
+//
+// Helper functions
+//
+
+static struct STR_BUILDER* strbuild_get(struct STR_BUILDERS* sb, int address)
+{
+  assert(address >= 0);
+
+  if (address >= sb->capacity)
+  {
+    int capacity = (sb->capacity == 0) ? 4 : sb->capacity;
+
+    while (address >= capacity)
+      capacity *= 2;
+
+    struct STR_BUILDER* builders = (struct STR_BUILDER*) realloc(sb->builders, capacity * sizeof(struct STR_BUILDER));
+
+    if (builders == NULL)
+      exit(0);
+
+    for (int i = sb->capacity; i < capacity; i++)
+    {
+      builders[i].s = NULL;
+      builders[i].length = 0;
+      builders[i].capacity = 0;
+    }
+
+    sb->builders = builders;
+    sb->capacity = capacity;
+  }
+
+  return &sb->builders[address];
+}
@@ -0,0 +1,82 @@
+/*strbuild.h*/
+
+//
+// String builders for the nuPython executor. Makes repeated
+// concatenation such as s = s + "x" append in place with
+// amortized (doubling) growth, instead of allocating and
+// copying a brand new string every time.
+//
+// Jad Dibs
+//
+// Northwestern University
+// CS 211
+//
+
+#pragma once
+
+#include <stddef.h>  // size_t
+
+//
+// Definition of the string builders
+//
+struct STR_BUILDER
+{
+  char*  s;         // string being built, NULL => unused
+  size_t length;    // strlen(s)
+  size_t capacity;  // # of bytes allocated for s
+};
+
+struct STR_BUILDERS
+{
+  struct STR_BUILDER* builders;  // indexed by memory address (or VM register)
+  int capacity;                  // # of builders available
+  int num_active;                // # of builders with s != NULL
+};
+
+
+//
+// Public functions:
+//
+
+//
+// strbuild_init
+//
+// Returns a pointer to a dynamically-allocated, empty set
+// of string builders.
+//
+struct STR_BUILDERS* strbuild_init(void);
+
+//
+// strbuild_destroy
+//
+// Frees the builders. The strings themselves are not freed,
+// they belong to whoever holds them (e.g. the RAM cells).
+//
+void strbuild_destroy(struct STR_BUILDERS* sb);
+
+//
+// strbuild_append
+//
+// Appends suffix to the string current, which is the string
+// held at the given memory address, and returns the result.
+// current must be a malloc'd string that is the only reference
+// to its value, since it may be grown in place with realloc;
+// the returned pointer replaces current (which may no longer
+// be valid). suffix may be current itself (s = s + s).
+//
+// If current is the string this builder returned last time,
+// its length and spare capacity are known and the append costs
+// O(strlen(suffix)) amortized. Otherwise the builder starts
+// over from current.
+//
+char* strbuild_append(struct STR_BUILDERS* sb, int address, char* current, const char* suffix);
+
+//
+// strbuild_forget
+//
+// Must be called whenever the value at the given address is
+// replaced by anything other than strbuild_append: the old
+// string is freed, and malloc may hand the same pointer out
+// again for an unrelated string.
+//
+void strbuild_forget(struct STR_BUILDERS* sb, int address);
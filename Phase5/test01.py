@@ -0,0 +1,59 @@
+#
+# test01.py
+#
+# a nuPython program of while loops and if/elif/else
+#
+print("")
+print("TEST CASE: test01.py")
+print("")
+
+i = 0
+small = 0
+big = 0
+evens = ""
+
+while i < 10:
+{
+  if i < 3:
+  {
+    small = small + 1
+  }
+  elif i == 5:
+  {
+    pass
+  }
+  else:
+  {
+    big = big + 1
+  }
+
+  r = i % 2
+  if r == 0:
+  {
+    evens = evens + "e"
+  }
+
+  i = i + 1
+}
+
+x = 1.5
+while x < 10.0:
+{
+  x = x * 2
+}
+
+done = i == 10
+while done:
+{
+  print("loop on a boolean")
+  done = False
+}
+
+print(small)   # 3
+print(big)     # 6
+print(evens)   # eeeee
+print(x)       # 12.000000
+
+print("")
+print("DONE")
+print("")
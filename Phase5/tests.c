@@ -0,0 +1,2422 @@
+/*tests.c*/
+
+//
+// Tests for the nuPython executor that can't be checked by
+// running a .py file and looking at the output.
+//
+// usage: make test
+//
+// Jad Dibs
+//
+// Northwestern University
+// CS 211
+//
+
+// fileno(), popen() are POSIX, not part of std=c11:
+#define _POSIX_C_SOURCE 200809L
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdbool.h>  // true, false
+#include <string.h>
+#include <math.h>
+
+#include "token.h"    // token defs
+#include "scanner.h"
+#include "parser.h"
+
+#include "programgraph.h"
+#include "ram.h"
+#include "execute.h"
+#include "output.h"
+#include "vm.h"
+#include "value.h"
+#include "transpile.h"
+#include "lineprof.h"
+#include "input.h"
+#include "context.h"
+#include "batch.h"
+#include "memo.h"
+#include "trace.h"
+#include "timeline.h"
+#include "parallel.h"
+#include "arith.h"
+
+
+//
+// Allocation counting: while counting is on, every call to
+// malloc, calloc, or realloc is counted. These definitions
+// replace the C library's at link time (glibc).
+//
+extern void* __libc_malloc(size_t size);
+extern void* __libc_calloc(size_t n, size_t size);
+extern void* __libc_realloc(void* p, size_t size);
+extern void  __libc_free(void* p);
+
+static bool counting = false;
+static long num_allocs = 0;
+
+void* malloc(size_t size)
+{
+  if (counting)
+    num_allocs++;
+
+  return __libc_malloc(size);
+}
+
+void* calloc(size_t n, size_t size)
+{
+  if (counting)
+    num_allocs++;
+
+  return __libc_calloc(n, size);
+}
+
+void* realloc(void* p, size_t size)
+{
+  if (counting)
+    num_allocs++;
+
+  return __libc_realloc(p, size);
+}
+
+void free(void* p)
+{
+  __libc_free(p);
+}
+
+
+//
+// build_program
+//
+// Parses the given nuPython source and returns its program
+// graph, or NULL if it doesn't parse. The graph and the tokens
+// it was built from (returned in *tokens) are freed together
+// with free_program, once nothing uses the program.
+//
+static struct STMT* build_program(char* source, struct TokenQueue** tokens)
+{
+  FILE* input = tmpfile();
+
+  *tokens = NULL;
+
+  if (input == NULL)
+    return NULL;
+
+  fputs(source, input);
+  rewind(input);
+
+  *tokens = parser_parse(input);
+
+  fclose(input);
+
+  if (*tokens == NULL)
+    return NULL;
+
+  struct STMT* program = programgraph_build(*tokens);
+
+  if (program == NULL)
+  {
+    tokenqueue_destroy(*tokens);
+    *tokens = NULL;
+  }
+
+  return program;
+}
+
+static void free_program(struct STMT* program, struct TokenQueue* tokens)
+{
+  if (program != NULL)
+    programgraph_destroy(program);
+
+  if (tokens != NULL)
+    tokenqueue_destroy(tokens);
+}
+
+
+//
+// context_for
+//
+// Returns a context for the given memory and output, whose
+// input() lines come from the given text. Free with
+// context_free.
+//
+static struct CONTEXT* context_for(struct RAM* memory, struct OUTPUT* output, char* input_text)
+{
+  return context_init(memory, output, input_init_memory(input_text));
+}
+
+static void context_free(struct CONTEXT* context)
+{
+  input_destroy(context->input);
+  context_destroy(context);
+}
+
+
+//
+// count_execute_allocs
+//
+// Executes the given program with the VM (if use_vm) or the
+// tree-walking interpreter, and returns the number of heap
+// allocations made during the call to execute. Output goes to
+// /dev/null through an fd sink, which never allocates.
+//
+static long count_execute_allocs(char* source, struct RAM* memory, bool use_vm)
+{
+  struct TokenQueue* tokens;
+  struct STMT* program = build_program(source, &tokens);
+
+  if (program == NULL)
+    return -1;
+
+  FILE* devnull = fopen("/dev/null", "w");
+  struct OUTPUT* output = output_init_fd(fileno(devnull));
+  struct CONTEXT* context = context_for(memory, output, "");
+
+  num_allocs = 0;
+  counting = true;
+
+  if (use_vm)
+    execute(program, context);
+  else
+    execute_tree(program, context);
+
+  counting = false;
+
+  context_free(context);
+  output_destroy(output);
+  fclose(devnull);
+  free_program(program, tokens);
+
+  return num_allocs;
+}
+
+
+//
+// test_variable_reads_do_not_allocate
+//
+// Reading variables (in expressions, conditions, print, int())
+// must not allocate: in steady state a loop iteration that only
+// reads variables and writes existing non-string variables makes
+// zero heap allocations, so running the loop 10 times or 1000
+// times costs the same number of allocations. That goes for the
+// tree-walker's reads from memory as well as the VM's registers.
+//
+static bool test_variable_reads_do_not_allocate(void)
+{
+  char* format =
+    "x = 1\n"
+    "y = 0\n"
+    "r = 0.5\n"
+    "b = False\n"
+    "s = \"apple\"\n"
+    "t = \"12\"\n"
+    "i = 0\n"
+    "n = 0\n"
+    "while n < %d:\n"
+    "{\n"
+    "  y = x + n\n"
+    "  r = r * 1.5\n"
+    "  b = s == \"APPLE\"\n"
+    "  if s < t:\n"
+    "  {\n"
+    "    pass\n"
+    "  }\n"
+    "  i = int(t)\n"
+    "  print(s)\n"
+    "  print(y)\n"
+    "  n = n + 1\n"
+    "}\n";
+
+  char* engines[2] = { "tree-walker", "VM" };
+  bool ok = true;
+
+  for (int use_vm = 0; use_vm <= 1; use_vm++)
+  {
+    long counts[2];
+    int iterations[2] = { 10, 1000 };
+
+    for (int k = 0; k < 2; k++)
+    {
+      char source[1024];
+
+      snprintf(source, sizeof(source), format, iterations[k]);
+
+      struct RAM* memory = ram_init();
+
+      counts[k] = count_execute_allocs(source, memory, use_vm);
+
+      ram_destroy(memory);
+    }
+
+    if (counts[0] < 0 || counts[0] != counts[1])
+    {
+      printf("**FAILED: %s loop iterations allocate: %ld allocs for %d iterations, %ld for %d\n",
+        engines[use_vm], counts[0], iterations[0], counts[1], iterations[1]);
+      ok = false;
+    }
+    else
+      printf("passed: variable reads do not allocate on the %s (%ld allocs, none per loop iteration)\n", engines[use_vm], counts[0]);
+  }
+
+  return ok;
+}
+
+
+//
+// captured
+//
+// Appends the contents of memory to what a program output, and
+// returns it all in a string the caller must free. Destroys the
+// memory and output.
+//
+static char* captured(struct RAM* memory, struct OUTPUT* output)
+{
+  for (int i = 0; i < memory->num_values; i++)
+  {
+    struct RAM_VALUE* value = &memory->cells[i].value;
+
+    output_printf(output, "%d: %s = ", i, memory->cells[i].identifier);
+
+    if (value->value_type == RAM_TYPE_INT)
+      output_printf(output, "int %d\n", value->types.i);
+    else if (value->value_type == RAM_TYPE_REAL)
+      output_printf(output, "real %f\n", value->types.d);
+    else if (value->value_type == RAM_TYPE_STR)
+      output_printf(output, "str '%s'\n", value->types.s);
+    else if (value->value_type == RAM_TYPE_BOOLEAN)
+      output_printf(output, "bool %d\n", value->types.i);
+    else
+      output_printf(output, "type %d\n", value->value_type);
+  }
+
+  char* result = strdup(output_contents(output));
+
+  output_destroy(output);
+  ram_destroy(memory);
+
+  return result;
+}
+
+//
+// run_captured
+//
+// Executes the given program with the VM (if use_vm) or the
+// tree-walking interpreter, and returns everything it output
+// followed by the final contents of memory, in a string the
+// caller must free. Returns NULL if the program doesn't parse.
+//
+static char* run_captured(char* source, bool use_vm)
+{
+  struct TokenQueue* tokens;
+  struct STMT* program = build_program(source, &tokens);
+
+  if (program == NULL)
+    return NULL;
+
+  struct RAM* memory = ram_init();
+  struct OUTPUT* output = output_init_memory();
+  struct CONTEXT* context = context_for(memory, output, "");
+
+  if (use_vm)
+    execute(program, context);
+  else
+    execute_tree(program, context);
+
+  context_free(context);
+  free_program(program, tokens);
+
+  return captured(memory, output);
+}
+
+
+//
+// test_vm_matches_tree
+//
+// The VM must behave exactly like the tree-walking interpreter:
+// same output, same errors, same memory afterwards (including
+// the order in which variables were created).
+//
+static bool test_vm_matches_tree(void)
+{
+  char* programs[] =
+  {
+    // int and real loops, the typed fast paths:
+    "i = 0\n"
+    "total = 0\n"
+    "x = 1.5\n"
+    "while i < 100:\n"
+    "{\n"
+    "  r = i % 7\n"
+    "  total = total + r\n"
+    "  x = x * 1.01\n"
+    "  i = i + 1\n"
+    "}\n"
+    "print(total)\n"
+    "print(x)\n",
+
+    // a variable that changes type, mixed arithmetic, strings:
+    "x = 1\n"
+    "y = x / 2.0\n"
+    "x = \"abc\"\n"
+    "s = x + \"def\"\n"
+    "s = s + s\n"
+    "t = s\n"
+    "b = s < x\n"
+    "x = b\n"
+    "print(t)\n"
+    "print(x)\n"
+    "print()\n",
+
+    // if / elif / else nested in a loop, variables first
+    // assigned inside the loop:
+    "n = 0\n"
+    "while n < 10:\n"
+    "{\n"
+    "  r = n % 3\n"
+    "  if r == 0:\n"
+    "  {\n"
+    "    fizz = n\n"
+    "  }\n"
+    "  elif r == 1:\n"
+    "  {\n"
+    "    s = \"one\"\n"
+    "  }\n"
+    "  else:\n"
+    "  {\n"
+    "    pass\n"
+    "  }\n"
+    "  n = n + 1\n"
+    "}\n",
+
+    // errors stop the program, memory keeps what was done:
+    "i = 0\n"
+    "while i < 5:\n"
+    "{\n"
+    "  i = i + 1\n"
+    "  j = 10 / i\n"
+    "  z = i - i\n"
+    "  k = 7 % z\n"
+    "}\n",
+
+    "a = 5\n"
+    "b = a - 5\n"
+    "c = a % b\n",
+
+    "s = \"x\"\n"
+    "t = s - \"y\"\n",
+
+    "x = 1\n"
+    "y = x + z\n",
+
+    "x = 2\n"
+    "y = int(x)\n",
+
+    "s = \"12\"\n"
+    "i = int(s)\n"
+    "r = float(s)\n"
+    "t = \"abc\"\n"
+    "j = int(t)\n",
+  };
+
+  int num_programs = sizeof(programs) / sizeof(programs[0]);
+  bool ok = true;
+
+  for (int p = 0; p < num_programs; p++)
+  {
+    char* expected = run_captured(programs[p], false);
+    char* actual = run_captured(programs[p], true);
+
+    if (expected == NULL || actual == NULL || strcmp(expected, actual) != 0)
+    {
+      printf("**FAILED: VM differs from tree-walker on program %d\n", p);
+      printf("tree-walker:\n%s\nVM:\n%s\n", expected ? expected : "(NULL)", actual ? actual : "(NULL)");
+      ok = false;
+    }
+
+    free(expected);
+    free(actual);
+  }
+
+  if (ok)
+    printf("passed: VM matches tree-walker (%d programs)\n", num_programs);
+
+  return ok;
+}
+
+
+//
+// test_long_scripts
+//
+// A long script with no loops must compile to a register per
+// variable and per distinct literal (not per literal written),
+// and run on the VM just as on the tree-walker.
+//
+static bool test_long_scripts(void)
+{
+  int num_stmts = 2000;
+  int num_literals = 100;  // 0..99, and 1 is one of them
+  char* source = (char*) malloc(num_stmts * 32 + 1);
+  int length = 0;
+
+  for (int i = 0; i < num_stmts; i++)
+    length += sprintf(source + length, "x%d = %d + 1\n", i, i % num_literals);
+
+  struct TokenQueue* tokens;
+  struct STMT* program = build_program(source, &tokens);
+  struct VM_CODE* code = (program == NULL) ? NULL : vm_compile(program, 0);
+  bool ok = (code != NULL && code->num_regs == num_stmts + num_literals);
+
+  if (!ok)
+    printf("**FAILED: long script compiled to %d registers, expected %d\n", code == NULL ? -1 : code->num_regs, num_stmts + num_literals);
+
+  vm_free(code);
+  free_program(program, tokens);
+
+  char* vm = ok ? run_captured(source, true) : NULL;
+  char* tree = ok ? run_captured(source, false) : NULL;
+
+  if (ok && (vm == NULL || tree == NULL || strcmp(vm, tree) != 0))
+  {
+    printf("**FAILED: long script: VM and tree-walker differ\n");
+    ok = false;
+  }
+
+  free(vm);
+  free(tree);
+  free(source);
+
+  if (ok)
+    printf("passed: long scripts share literal registers (%d stmts)\n", num_stmts);
+
+  return ok;
+}
+
+//
+// test_branchy_scripts
+//
+// A script with thousands of if/elses, each assigning new
+// variables, has too many blocks times registers to analyze: it
+// must still compile (left untyped), without searching the rest
+// of the script for the end of each if, and run on the VM just
+// as on the tree-walker.
+//
+static bool test_branchy_scripts(void)
+{
+  int num_ifs = 2000;
+  char* source = (char*) malloc(num_ifs * 128 + 64);
+  int length = 0;
+
+  for (int i = 0; i < num_ifs; i++)
+    length += sprintf(source + length, "x%d = %d %% 7\nif x%d > 0:\n{\n  y%d = 100 / x%d\n}\nelse:\n{\n  y%d = 0\n}\n",
+                      i, i, i, i, i, i);
+
+  sprintf(source + length, "print(y%d)\n", num_ifs - 1);
+
+  struct TokenQueue* tokens;
+  struct STMT* program = build_program(source, &tokens);
+  struct VM_CODE* code = (program == NULL) ? NULL : vm_compile(program, 0);
+  bool ok = (code != NULL);
+
+  if (!ok)
+    printf("**FAILED: branchy script did not compile\n");
+
+  vm_free(code);
+  free_program(program, tokens);
+
+  char* vm = ok ? run_captured(source, true) : NULL;
+  char* tree = ok ? run_captured(source, false) : NULL;
+
+  if (ok && (vm == NULL || tree == NULL || strcmp(vm, tree) != 0))
+  {
+    printf("**FAILED: branchy script: VM and tree-walker differ\n");
+    ok = false;
+  }
+
+  free(vm);
+  free(tree);
+  free(source);
+
+  if (ok)
+    printf("passed: branchy scripts compile and run (%d ifs)\n", num_ifs);
+
+  return ok;
+}
+
+
+//
+// test_value_boxing
+//
+// Every kind of value must come back out of its 8-byte box
+// unchanged, with the right tag; in particular reals that are
+// NaN or negative must not be mistaken for boxed values.
+//
+static bool test_value_boxing(void)
+{
+  bool ok = true;
+
+  int ints[] = { 0, 1, -1, 123456, -2147483647 - 1, 2147483647 };
+
+  for (int k = 0; k < (int) (sizeof(ints) / sizeof(ints[0])); k++)
+  {
+    struct VM_VALUE v = vm_int(ints[k]);
+
+    if (vm_tag(v) != VM_INT || vm_as_int(v) != ints[k])
+    {
+      printf("**FAILED: int %d does not round-trip\n", ints[k]);
+      ok = false;
+    }
+  }
+
+  double reals[] = { 0.0, -0.0, 1.5, -1.5, 1e308, -1e-308, HUGE_VAL, -HUGE_VAL };
+
+  for (int k = 0; k < (int) (sizeof(reals) / sizeof(reals[0])); k++)
+  {
+    struct VM_VALUE v = vm_real(reals[k]);
+
+    if (vm_tag(v) != VM_REAL || memcmp(&reals[k], &v.bits, sizeof(double)) != 0)
+    {
+      printf("**FAILED: real %g does not round-trip\n", reals[k]);
+      ok = false;
+    }
+  }
+
+  //
+  // NaNs of either sign stay reals:
+  //
+  struct VM_VALUE nan1 = vm_real(nan(""));
+  struct VM_VALUE nan2 = vm_real(-nan(""));
+
+  if (vm_tag(nan1) != VM_REAL || vm_tag(nan2) != VM_REAL || !isnan(vm_as_real(nan1)) || !isnan(vm_as_real(nan2)))
+  {
+    printf("**FAILED: NaN is not a real\n");
+    ok = false;
+  }
+
+  char* s = malloc(8);
+  struct VM_VALUE str = vm_str(s);
+
+  if (vm_tag(str) != VM_STR || vm_as_str(str) != s)
+  {
+    printf("**FAILED: string pointer does not round-trip\n");
+    ok = false;
+  }
+
+  free(s);
+
+  if (vm_tag(vm_bool(true)) != VM_BOOL || !vm_as_bool(vm_bool(true)) || vm_as_bool(vm_bool(false)) ||
+      vm_tag(vm_none()) != VM_NONE || vm_tag(vm_undefined()) != VM_UNDEFINED)
+  {
+    printf("**FAILED: bool/None/undefined tags\n");
+    ok = false;
+  }
+
+  if (ok)
+    printf("passed: values are 8 bytes and round-trip through their boxes\n");
+
+  return ok;
+}
+
+
+//
+// test_loop_invariants_hoisted
+//
+// Expressions whose operands aren't written in a loop are moved
+// out of it (and out of enclosing loops where possible), except
+// ones that could fail; either way the program must behave as
+// before.
+//
+static bool test_loop_invariants_hoisted(void)
+{
+  char* source =
+    "a = 3\n"
+    "b = 4.5\n"
+    "z = 0\n"
+    "n = 0\n"
+    "total = 0\n"
+    "while n < 5:\n"
+    "{\n"
+    "  c = a * 7\n"        // line 8: out of the outer loop
+    "  d = b / 2.0\n"      // line 9: out of the outer loop
+    "  e = a / z\n"        // line 10: may divide by zero, stays
+    "  s = input(\"?\")\n"
+    "  m = 0\n"
+    "  while m < 3:\n"
+    "  {\n"
+    "    f = a + 1\n"      // line 15: out of both loops
+    "    g = c % 4\n"      // line 16: out of the inner loop only
+    "    total = total + g\n"
+    "    m = m + 1\n"
+    "  }\n"
+    "  n = n + 1\n"
+    "}\n";
+
+  struct { int line; int loop_line; } expected[] =
+  {
+    { 8, 6 }, { 9, 6 }, { 15, 6 }, { 16, 13 }
+  };
+
+  int num_expected = sizeof(expected) / sizeof(expected[0]);
+
+  struct TokenQueue* tokens;
+  struct STMT* program = build_program(source, &tokens);
+  struct VM_CODE* code = (program == NULL) ? NULL : vm_compile(program, 0);
+
+  if (code == NULL)
+  {
+    printf("**FAILED: loop invariant program did not compile\n");
+    free_program(program, tokens);
+    return false;
+  }
+
+  bool ok = (code->num_hoisted == num_expected);
+
+  for (int e = 0; e < num_expected && ok; e++)
+  {
+    bool found = false;
+
+    for (int h = 0; h < code->num_hoisted; h++)
+      if (code->hoisted[h].line == expected[e].line && code->hoisted[h].loop_line == expected[e].loop_line)
+        found = true;
+
+    ok = found;
+  }
+
+  if (!ok)
+  {
+    printf("**FAILED: wrong expressions hoisted:\n");
+    vm_print_hoisted(code);
+  }
+
+  vm_free(code);
+  free_program(program, tokens);
+
+  //
+  // z is 0, so the program stops in the first iteration --- a
+  // hoisted a / z would have stopped it before input():
+  //
+  char* expected_run = run_captured(source, false);
+  char* actual_run = run_captured(source, true);
+
+  if (expected_run == NULL || actual_run == NULL || strcmp(expected_run, actual_run) != 0)
+  {
+    printf("**FAILED: hoisting changed the program's behavior\n");
+    printf("tree-walker:\n%s\nVM:\n%s\n", expected_run ? expected_run : "(NULL)", actual_run ? actual_run : "(NULL)");
+    ok = false;
+  }
+
+  free(expected_run);
+  free(actual_run);
+
+  if (ok)
+    printf("passed: loop invariants hoisted (%d expressions)\n", num_expected);
+
+  return ok;
+}
+
+
+//
+// test_superinstructions
+//
+// The counting loop idioms compile to superinstructions, and
+// compiling without them gives the same output and memory.
+//
+static bool test_superinstructions(void)
+{
+  char* source =
+    "n = 1000\n"
+    "i = 0\n"
+    "x = 0.5\n"
+    "while i <= n:\n"
+    "{\n"
+    "  i = i + 1\n"
+    "  x = x * 1.001\n"
+    "}\n"
+    "while 2.0 > x:\n"
+    "{\n"
+    "  x = x + 0.25\n"
+    "  i = 5 + i\n"
+    "  n = n - 3\n"
+    "}\n"
+    "print(i)\n"
+    "print(x)\n"
+    "print(n)\n";
+
+  int expected[] = { VM_ADD_IMM_II, VM_JUMP_UNLESS_LE_II, VM_JUMP_UNLESS_GT_RR, VM_PRINT_INT, VM_PRINT_REAL };
+  int num_expected = sizeof(expected) / sizeof(expected[0]);
+
+  struct TokenQueue* tokens;
+  struct STMT* program = build_program(source, &tokens);
+  struct VM_CODE* fused = (program == NULL) ? NULL : vm_compile(program, 0);
+  struct VM_CODE* plain = (program == NULL) ? NULL : vm_compile(program, VM_NO_SUPERINSTRUCTIONS);
+
+  if (fused == NULL || plain == NULL)
+  {
+    printf("**FAILED: superinstruction program did not compile\n");
+    vm_free(fused);
+    vm_free(plain);
+    free_program(program, tokens);
+    return false;
+  }
+
+  bool ok = (fused->num_instrs < plain->num_instrs);
+
+  for (int e = 0; e < num_expected; e++)
+  {
+    bool in_fused = false;
+    bool in_plain = false;
+
+    for (int pc = 0; pc < fused->num_instrs; pc++)
+      in_fused = in_fused || (fused->instrs[pc].opcode == expected[e]);
+
+    for (int pc = 0; pc < plain->num_instrs; pc++)
+      in_plain = in_plain || (plain->instrs[pc].opcode == expected[e]);
+
+    ok = ok && in_fused && !in_plain;
+  }
+
+  if (!ok)
+  {
+    printf("**FAILED: wrong superinstructions:\n");
+    vm_print(fused);
+  }
+
+  //
+  // both versions must do what the tree-walker does:
+  //
+  char* expected_run = run_captured(source, false);
+
+  for (int v = 0; v < 2; v++)
+  {
+    struct VM_CODE* code = (v == 0) ? fused : plain;
+    struct RAM* memory = ram_init();
+    struct OUTPUT* output = output_init_memory();
+    struct CONTEXT* context = context_for(memory, output, "");
+
+    vm_run(code, context);
+    context_free(context);
+
+    char* actual_run = captured(memory, output);
+
+    if (expected_run == NULL || actual_run == NULL || strcmp(expected_run, actual_run) != 0)
+    {
+      printf("**FAILED: superinstructions changed the program's behavior\n");
+      printf("tree-walker:\n%s\nVM:\n%s\n", expected_run ? expected_run : "(NULL)", actual_run ? actual_run : "(NULL)");
+      ok = false;
+    }
+
+    free(actual_run);
+  }
+
+  if (ok)
+    printf("passed: superinstructions fused (%d instructions saved)\n", plain->num_instrs - fused->num_instrs);
+
+  free(expected_run);
+  vm_free(fused);
+  vm_free(plain);
+  free_program(program, tokens);
+
+  return ok;
+}
+
+
+//
+// test_range_checks
+//
+// The range analysis drops the checks from an int division only
+// where the divisor can't be 0 (nor -1 with a dividend that can
+// be INT_MIN), and the programs still do what the tree-walker
+// does, division by zero included.
+//
+static bool test_range_checks(void)
+{
+  char* sources[] = {
+    // loop counter from 1 up:
+    "i = 1\n"
+    "q = 0\n"
+    "r = 0\n"
+    "s = 0\n"
+    "while i <= 100:\n"
+    "{\n"
+    "  q = 1000 / i\n"
+    "  r = 1000 % i\n"
+    "  s = s + q\n"
+    "  s = s + r\n"
+    "  i = i + 1\n"
+    "}\n"
+    "print(s)\n",
+
+    // guarded by an if:
+    "d = 5\n"
+    "m = 0 - 5\n"
+    "x = 0\n"
+    "while d > m:\n"
+    "{\n"
+    "  if d != 0:\n"
+    "  {\n"
+    "    x = 100 / d\n"
+    "  }\n"
+    "  d = d - 1\n"
+    "}\n"
+    "print(x)\n",
+
+    // reaches 0, so it's checked:
+    "d = 3\n"
+    "x = 0\n"
+    "while d >= 0:\n"
+    "{\n"
+    "  x = 12 / d\n"
+    "  d = d - 1\n"
+    "}\n",
+
+    // INT_MIN / -1 overflows (not run, it traps):
+    "y = 0 - 2147483647\n"
+    "y = y - 1\n"
+    "d = 0 - 1\n"
+    "x = 0\n"
+    "if d != 0:\n"
+    "{\n"
+    "  x = y / d\n"
+    "}\n",
+  };
+
+  int expected_unchecked[] = { 2, 1, 0, 0 };
+  bool run[] = { true, true, true, false };
+  int num_sources = sizeof(sources) / sizeof(sources[0]);
+  bool ok = true;
+
+  for (int i = 0; i < num_sources; i++)
+  {
+    struct TokenQueue* tokens;
+    struct STMT* program = build_program(sources[i], &tokens);
+    struct VM_CODE* code = (program == NULL) ? NULL : vm_compile(program, 0);
+
+    if (code == NULL)
+    {
+      printf("**FAILED: range program %d did not compile\n", i);
+      free_program(program, tokens);
+      ok = false;
+      continue;
+    }
+
+    int unchecked = 0;
+
+    for (int pc = 0; pc < code->num_instrs; pc++)
+      if (code->instrs[pc].opcode == VM_DIV_NZ_II || code->instrs[pc].opcode == VM_MOD_NZ_II)
+        unchecked++;
+
+    if (unchecked != expected_unchecked[i])
+    {
+      printf("**FAILED: range program %d: %d unchecked divisions, expected %d\n", i, unchecked, expected_unchecked[i]);
+      vm_print(code);
+      ok = false;
+    }
+
+    vm_free(code);
+    free_program(program, tokens);
+
+    if (!run[i])
+      continue;
+
+    char* expected_run = run_captured(sources[i], false);
+    char* actual_run = run_captured(sources[i], true);
+
+    if (expected_run == NULL || actual_run == NULL || strcmp(expected_run, actual_run) != 0)
+    {
+      printf("**FAILED: range program %d changed behavior\n", i);
+      printf("tree-walker:\n%s\nVM:\n%s\n", expected_run ? expected_run : "(NULL)", actual_run ? actual_run : "(NULL)");
+      ok = false;
+    }
+
+    free(expected_run);
+    free(actual_run);
+  }
+
+  if (ok)
+    printf("passed: range analysis drops only safe division checks (%d programs)\n", num_sources);
+
+  return ok;
+}
+
+
+//
+// test_counted_loops
+//
+// Counted loops are run in closed form, and end with the same
+// values (wrapped the same way) as when they run; loops that
+// read other types, or whose counter would wrap, still run.
+//
+static bool test_counted_loops(void)
+{
+  char* sources[] = {
+    // a sum of a function of the counter:
+    "i = 0\n"
+    "n = 1000\n"
+    "k = 7\n"
+    "acc = 0\n"
+    "while i < n:\n"
+    "{\n"
+    "  t = i * k\n"
+    "  acc = acc + t\n"
+    "  i = i + 1\n"
+    "}\n"
+    "print(acc)\n"
+    "print(t)\n",
+
+    // counting down, squares and cubes that wrap around:
+    "i = 100000\n"
+    "s = 0\n"
+    "q = 0\n"
+    "while 0 < i:\n"
+    "{\n"
+    "  sq = i * i\n"
+    "  cube = sq * i\n"
+    "  s = s - sq\n"
+    "  q = cube + q\n"
+    "  pass\n"
+    "  i = i - 3\n"
+    "}\n"
+    "print(s)\n"
+    "print(q)\n",
+
+    // runs 0 times, then a real sum (runs as usual):
+    "i = 5\n"
+    "acc = 9\n"
+    "while i < 5:\n"
+    "{\n"
+    "  acc = acc + i\n"
+    "  i = i + 1\n"
+    "}\n"
+    "x = 0\n"
+    "r = 1.5\n"
+    "while x <= 10:\n"
+    "{\n"
+    "  r = r + x\n"
+    "  x = x + 2\n"
+    "}\n"
+    "print(acc)\n"
+    "print(r)\n",
+
+    // not counted: the sum is read, and a value comes from the
+    // previous time around:
+    "i = 0\n"
+    "s = 0\n"
+    "p = 0\n"
+    "while i < 10:\n"
+    "{\n"
+    "  s = s + i\n"
+    "  t = s * 2\n"
+    "  i = i + 1\n"
+    "}\n"
+    "while i > 0:\n"
+    "{\n"
+    "  q = p + 1\n"
+    "  p = i * 2\n"
+    "  i = i - 1\n"
+    "}\n"
+    "print(t)\n"
+    "print(q)\n",
+  };
+
+  int expected_counted[] = { 1, 1, 2, 0 };
+  int num_sources = sizeof(sources) / sizeof(sources[0]);
+  bool ok = true;
+
+  for (int i = 0; i < num_sources; i++)
+  {
+    struct TokenQueue* tokens;
+    struct STMT* program = build_program(sources[i], &tokens);
+    struct VM_CODE* code = (program == NULL) ? NULL : vm_compile(program, 0);
+
+    if (code == NULL)
+    {
+      printf("**FAILED: counted program %d did not compile\n", i);
+      free_program(program, tokens);
+      ok = false;
+      continue;
+    }
+
+    int counted = 0;
+
+    for (int pc = 0; pc < code->num_instrs; pc++)
+      if (code->instrs[pc].opcode == VM_COUNTED_LOOP)
+        counted++;
+
+    if (counted != expected_counted[i])
+    {
+      printf("**FAILED: counted program %d: %d counted loops, expected %d\n", i, counted, expected_counted[i]);
+      vm_print(code);
+      ok = false;
+    }
+
+    vm_free(code);
+    free_program(program, tokens);
+
+    char* expected_run = run_captured(sources[i], false);
+    char* actual_run = run_captured(sources[i], true);
+
+    if (expected_run == NULL || actual_run == NULL || strcmp(expected_run, actual_run) != 0)
+    {
+      printf("**FAILED: counted program %d changed behavior\n", i);
+      printf("tree-walker:\n%s\nVM:\n%s\n", expected_run ? expected_run : "(NULL)", actual_run ? actual_run : "(NULL)");
+      ok = false;
+    }
+
+    free(expected_run);
+    free(actual_run);
+  }
+
+  if (ok)
+    printf("passed: counted loops run in closed form (%d programs)\n", num_sources);
+
+  return ok;
+}
+
+
+//
+// test_jit_matches_tree
+//
+// Hot loops run as machine code (where supported) must behave
+// like the tree-walker, including when a value changes type in
+// the middle of a compiled loop and when the loop stops with an
+// error.
+//
+static bool test_jit_matches_tree(void)
+{
+  char* source =
+    "i = 0\n"
+    "x = 0\n"
+    "total = 0.5\n"
+    "while i < 5000:\n"
+    "{\n"
+    "  x = i % 7\n"
+    "  total = total * 1.0001\n"
+    "  total = total + 0.5\n"
+    "  if i == 2500:\n"
+    "  {\n"
+    "    x = \"changed\"\n"
+    "    print(x)\n"
+    "  }\n"
+    "  d = i - 4990\n"
+    "  q = 100 / d\n"
+    "  i = i + 1\n"
+    "}\n"
+    "print(total)\n";
+
+  struct TokenQueue* tokens;
+  struct STMT* program = build_program(source, &tokens);
+  struct VM_CODE* code = (program == NULL) ? NULL : vm_compile(program, VM_JIT);
+
+  if (code == NULL)
+  {
+    printf("**FAILED: JIT program did not compile\n");
+    free_program(program, tokens);
+    return false;
+  }
+
+  struct RAM* memory = ram_init();
+  struct OUTPUT* output = output_init_memory();
+  struct CONTEXT* context = context_for(memory, output, "");
+
+  vm_run(code, context);
+  context_free(context);
+
+  char* actual_run = captured(memory, output);
+  char* expected_run = run_captured(source, false);
+  bool ok = true;
+
+  if (expected_run == NULL || actual_run == NULL || strcmp(expected_run, actual_run) != 0)
+  {
+    printf("**FAILED: JIT changed the program's behavior\n");
+    printf("tree-walker:\n%s\nJIT:\n%s\n", expected_run ? expected_run : "(NULL)", actual_run ? actual_run : "(NULL)");
+    ok = false;
+  }
+
+  free(expected_run);
+  free(actual_run);
+  vm_free(code);
+  free_program(program, tokens);
+
+  if (ok)
+    printf("passed: JIT matches tree-walker\n");
+
+  return ok;
+}
+
+
+//
+// test_transpiled_matches_tree
+//
+// The C program written by transpile, compiled with the system's
+// C compiler, must output exactly what the tree-walker does,
+// including the error that stops it. Skipped if there's no C
+// compiler.
+//
+static bool test_transpiled_matches_tree(void)
+{
+  char* source =
+    "a = \"-42\"\n"
+    "n = int(a)\n"
+    "b = \"2.5e3\"\n"
+    "f = float(b)\n"
+    "print(n)\n"
+    "print(f)\n"
+    "s = \"\"\n"
+    "i = 0\n"
+    "x = 1.5\n"
+    "while i < 1000:\n"
+    "{\n"
+    "  r = i % 100\n"
+    "  if r == 0:\n"
+    "  {\n"
+    "    s = s + \"ab\"\n"
+    "    x = x * 2\n"
+    "  }\n"
+    "  elif i == 501:\n"
+    "  {\n"
+    "    x = \"now a string\"\n"
+    "    print(x)\n"
+    "  }\n"
+    "  i = i + 1\n"
+    "}\n"
+    "print(s)\n"
+    "sq = i ** 2\n"
+    "print(sq)\n"
+    "y = x + 1\n"
+    "print(y)\n"
+    "print(\"not reached\")\n";
+
+  struct TokenQueue* tokens;
+  struct STMT* program = build_program(source, &tokens);
+  FILE* out = fopen("tests_transpiled.c", "w");
+
+  if (program == NULL || out == NULL || !transpile(program, out))
+  {
+    printf("**FAILED: program did not transpile\n");
+    free_program(program, tokens);
+    return false;
+  }
+
+  fclose(out);
+
+  if (system("cc -std=c11 -O2 -w tests_transpiled.c -o tests_transpiled -lm > /dev/null 2>&1") != 0)
+  {
+    printf("skipped: transpiled C (no C compiler)\n");
+    remove("tests_transpiled.c");
+    free_program(program, tokens);
+    return true;
+  }
+
+  //
+  // what the compiled program outputs:
+  //
+  struct OUTPUT* actual = output_init_memory();
+  FILE* pipe = popen("./tests_transpiled", "r");
+  char line[256];
+
+  while (pipe != NULL && fgets(line, sizeof(line), pipe) != NULL)
+    output_printf(actual, "%s", line);
+
+  if (pipe != NULL)
+    pclose(pipe);
+
+  //
+  // what the tree-walker outputs:
+  //
+  struct RAM* memory = ram_init();
+  struct OUTPUT* expected = output_init_memory();
+  struct CONTEXT* context = context_for(memory, expected, "");
+
+  execute_tree(program, context);
+  context_free(context);
+
+  bool ok = (strcmp(output_contents(expected), output_contents(actual)) == 0);
+
+  if (!ok)
+  {
+    printf("**FAILED: transpiled C changed the program's behavior\n");
+    printf("tree-walker:\n%s\nC:\n%s\n", output_contents(expected), output_contents(actual));
+  }
+  else
+    printf("passed: transpiled C matches tree-walker\n");
+
+  output_destroy(expected);
+  output_destroy(actual);
+  ram_destroy(memory);
+  free_program(program, tokens);
+
+  remove("tests_transpiled.c");
+  remove("tests_transpiled");
+
+  return ok;
+}
+
+
+//
+// test_line_profile
+//
+// Profiling by line must count every stmt exactly, time every
+// line that ran at least once, and not change what the program
+// does.
+//
+static bool test_line_profile(void)
+{
+  char* source =
+    "i = 0\n"
+    "total = 0\n"
+    "while i < 1000:\n"
+    "{\n"
+    "  r = i % 10\n"
+    "  if r == 0:\n"
+    "  {\n"
+    "    total = total + i\n"
+    "  }\n"
+    "  else:\n"
+    "  {\n"
+    "    pass\n"
+    "  }\n"
+    "  i = i + 1\n"
+    "}\n"
+    "print(total)\n";
+
+  long expected[] = { 0, 1, 1, 1001, 0, 1000, 1000, 0, 100, 0, 0, 0, 900, 0, 1000, 0, 1 };
+  int num_lines = sizeof(expected) / sizeof(expected[0]);
+
+  struct TokenQueue* tokens;
+  struct STMT* program = build_program(source, &tokens);
+
+  if (program == NULL)
+  {
+    printf("**FAILED: line profile program did not parse\n");
+    return false;
+  }
+
+  struct RAM* memory = ram_init();
+  struct OUTPUT* output = output_init_memory();
+  struct LINE_PROFILE* profile = lineprof_init();
+  struct CONTEXT* context = context_for(memory, output, "");
+
+  context->lines = profile;
+  execute(program, context);
+  context_free(context);
+
+  char* actual_run = captured(memory, output);
+  char* expected_run = run_captured(source, false);
+  bool ok = (strcmp(expected_run, actual_run) == 0);
+
+  if (!ok)
+    printf("**FAILED: profiling changed the program's behavior\n");
+
+  for (int line = 0; line < num_lines; line++)
+  {
+    long count = (line < profile->capacity) ? profile->counts[line] : 0;
+    long samples = (line < profile->capacity) ? profile->samples[line] : 0;
+
+    if (count != expected[line] || (count > 0 && samples == 0) || samples > count)
+    {
+      printf("**FAILED: line %d ran %ld times (%ld timed), expected %ld\n", line, count, samples, expected[line]);
+      ok = false;
+    }
+  }
+
+  free(expected_run);
+  free(actual_run);
+  lineprof_destroy(profile);
+  free_program(program, tokens);
+
+  if (ok)
+    printf("passed: line profile counts every stmt\n");
+
+  return ok;
+}
+
+
+//
+// test_budget
+//
+// On a budget, every stmt is counted (a while loop each time its
+// condition is evaluated), including passes the VM has no
+// instructions for, and a program that loops forever is stopped
+// at the loop's back edge, the first time it's over the budget.
+//
+static bool test_budget(void)
+{
+  char* sources[] = {
+    // loops forever once the inner loop is reached; 3 stmts,
+    // then 3 for the outer loop, then 2 per inner iteration:
+    "i = 0\n"
+    "loop_end = 5\n"
+    "var = 99\n"
+    "while i < 3:\n"
+    "{\n"
+    "  pass\n"
+    "  i = i + 1\n"
+    "  while var != loop_end:\n"
+    "  {\n"
+    "    pass\n"
+    "  }\n"
+    "}\n",
+
+    // completes: 2 + 4 * 5 + 3 * 6 + 3 * 7 + 1 + 1 stmts
+    "i = 0\n"
+    "pass\n"
+    "while i < 10:\n"
+    "{\n"
+    "  r = i % 3\n"
+    "  if r == 0:\n"
+    "  {\n"
+    "    pass\n"
+    "  }\n"
+    "  elif r == 1:\n"
+    "  {\n"
+    "    x = i\n"
+    "  }\n"
+    "  else:\n"
+    "  {\n"
+    "    x = 0\n"
+    "    pass\n"
+    "  }\n"
+    "  i = i + 1\n"
+    "}\n"
+    "print(x)\n",
+
+    // stops with an error:
+    "x = 1\n"
+    "while x < 5:\n"
+    "{\n"
+    "  x = x + 1\n"
+    "}\n"
+    "y = z\n",
+  };
+
+  long expected_stmts[] = { 1002, 63, 11 };
+  int expected_lines[] = { 8, 0, 6 };
+  bool expected_exhausted[] = { true, false, false };
+  int num_sources = sizeof(sources) / sizeof(sources[0]);
+  bool ok = true;
+
+  for (int i = 0; i < num_sources; i++)
+  {
+    struct TokenQueue* tokens;
+    struct STMT* program = build_program(sources[i], &tokens);
+
+    if (program == NULL)
+    {
+      printf("**FAILED: budget program %d did not parse\n", i);
+      ok = false;
+      continue;
+    }
+
+    struct BUDGET budget;
+    struct RAM* memory = ram_init();
+    struct OUTPUT* output = output_init_memory();
+
+    struct CONTEXT* context = context_for(memory, output, "");
+
+    budget_init(&budget, 1000, 0.0);
+    context->budget = &budget;
+    execute(program, context);
+    context_free(context);
+
+    char* run = captured(memory, output);
+
+    if (budget.stmts != expected_stmts[i] || budget.line != expected_lines[i] || budget.exhausted != expected_exhausted[i])
+    {
+      printf("**FAILED: budget program %d: %ld stmts, stopped at line %d, expected %ld and line %d\n",
+        i, budget.stmts, budget.line, expected_stmts[i], expected_lines[i]);
+      printf("%s\n", run);
+      ok = false;
+    }
+
+    free(run);
+    free_program(program, tokens);
+  }
+
+  if (ok)
+    printf("passed: budget counts stmts and stops runaway loops (%d programs)\n", num_sources);
+
+  return ok;
+}
+
+
+//
+// test_memo
+//
+// Memoized loop bodies leave the same output and memory as the
+// plain tree walk: the inner loop's passes repeat for every pass
+// of the outer loop, so all but the first outer pass replay
+// them; the loop that prints isn't pure, so it isn't memoized.
+//
+static bool test_memo(void)
+{
+  char* source =
+    "r = 0\n"
+    "total = 0\n"
+    "s = \"\"\n"
+    "while r < 10:\n"
+    "{\n"
+    "  k = 20\n"
+    "  t = 0\n"
+    "  while k > 0:\n"
+    "  {\n"
+    "    m = k % 3\n"
+    "    if m == 0:\n"
+    "    {\n"
+    "      d = k * 2\n"
+    "      t = t + d\n"
+    "    }\n"
+    "    else:\n"
+    "    {\n"
+    "      s = \"x\"\n"
+    "      s = s + \"y\"\n"
+    "    }\n"
+    "    k = k - 1\n"
+    "  }\n"
+    "  total = total + t\n"
+    "  r = r + 1\n"
+    "}\n"
+    "j = 0\n"
+    "while j < 3:\n"
+    "{\n"
+    "  print(j)\n"
+    "  j = j + 1\n"
+    "}\n"
+    "print(total)\n";
+
+  char* expected = run_captured(source, false);
+  struct TokenQueue* tokens;
+  struct STMT* program = build_program(source, &tokens);
+
+  if (expected == NULL || program == NULL)
+  {
+    printf("**FAILED: memo program did not parse\n");
+    free(expected);
+    free_program(program, tokens);
+    return false;
+  }
+
+  struct RAM* memory = ram_init();
+  struct OUTPUT* output = output_init_memory();
+  struct CONTEXT* context = context_for(memory, output, "");
+  struct MEMO* memo = memo_init();
+
+  context->memo = memo;
+  execute(program, context);
+  context_free(context);
+
+  char* actual = captured(memory, output);
+  bool ok = true;
+
+  if (actual == NULL || strcmp(expected, actual) != 0)
+  {
+    printf("**FAILED: memoized loops changed behavior\n");
+    printf("tree-walker:\n%s\nmemoized:\n%s\n", expected, actual ? actual : "(NULL)");
+    ok = false;
+  }
+
+  if (memo->hits != 9 * 20 || memo->misses != 10 + 20)
+  {
+    printf("**FAILED: memo: %ld passes replayed, %ld run, expected %d and %d\n", memo->hits, memo->misses, 9 * 20, 10 + 20);
+    ok = false;
+  }
+
+  memo_destroy(memo);
+  free(expected);
+  free(actual);
+  free_program(program, tokens);
+
+  if (ok)
+    printf("passed: memoized loop bodies replay their writes (%ld passes)\n", 9 * 20L);
+
+  return ok;
+}
+
+
+//
+// replay_trace
+//
+// Rebuilds memory from the first steps of the trace in the given
+// file (all of them if steps < 0), the way traceread.c does, and
+// returns it, or NULL if the trace can't be read. Sets *total to
+// the # of steps read.
+//
+static struct RAM* replay_trace(char* filename, long steps, long* total)
+{
+  struct TRACE_READER* reader = trace_reader_open(filename);
+
+  if (reader == NULL)
+    return NULL;
+
+  struct RAM* memory = ram_init();
+  struct TRACE_RECORD record;
+  char* names[64];
+
+  while ((steps < 0 || reader->steps < steps) && trace_next(reader, &record))
+  {
+    if (record.name != NULL && record.address < 64)
+      names[record.address] = record.name;
+
+    if (record.address >= 0 && record.address < 64)
+      ram_write_cell_by_name(memory, record.value, names[record.address]);
+  }
+
+  *total = reader->steps;
+  trace_reader_close(reader);
+
+  return memory;
+}
+
+//
+// test_trace
+//
+// A traced run behaves like a plain one, records every stmt
+// (including the one that stopped with an error), and replaying
+// the trace rebuilds memory, at the end and part-way through.
+//
+static bool test_trace(void)
+{
+  char* source =
+    "x = 1\n"
+    "s = \"ab\"\n"
+    "r = 2.5\n"
+    "i = 0\n"
+    "while i < 3:\n"
+    "{\n"
+    "  x = x * 2\n"
+    "  s = s + \"c\"\n"
+    "  r = r + 0.5\n"
+    "  i = i + 1\n"
+    "}\n"
+    "b = x > 5\n"
+    "print(s)\n"
+    "y = x / 0\n";
+
+  char* filename = "test_trace.log";
+  long expected_steps = 4 + 3 * 5 + 1 + 3;
+
+  char* expected = run_captured(source, false);
+  struct TokenQueue* tokens;
+  struct STMT* program = build_program(source, &tokens);
+  struct TRACE* trace = trace_open(filename);
+
+  if (expected == NULL || program == NULL || trace == NULL)
+  {
+    printf("**FAILED: trace program did not parse, or trace not created\n");
+    free(expected);
+    free_program(program, tokens);
+    return false;
+  }
+
+  struct RAM* memory = ram_init();
+  struct OUTPUT* output = output_init_memory();
+  struct CONTEXT* context = context_for(memory, output, "");
+
+  context->trace = trace;
+  execute(program, context);
+  context_free(context);
+
+  long recorded = trace->steps;
+  bool ok = trace_close(trace);
+
+  char* actual = captured(memory, output);
+
+  if (!ok || actual == NULL || strcmp(expected, actual) != 0 || recorded != expected_steps)
+  {
+    printf("**FAILED: traced run: %ld steps, expected %ld\n", recorded, expected_steps);
+    printf("tree-walker:\n%s\ntraced:\n%s\n", expected, actual ? actual : "(NULL)");
+    ok = false;
+  }
+
+  //
+  // the end: memory as the program left it (without its output):
+  //
+  long total = 0;
+  struct RAM* rebuilt = replay_trace(filename, -1, &total);
+  char* replayed = rebuilt == NULL ? NULL : captured(rebuilt, output_init_memory());
+  char* memory_only = strstr(expected, "0: x");
+
+  if (replayed == NULL || memory_only == NULL || strcmp(replayed, memory_only) != 0 || total != expected_steps)
+  {
+    printf("**FAILED: trace replayed %ld steps into:\n%s\nexpected %ld steps into:\n%s\n",
+      total, replayed ? replayed : "(NULL)", expected_steps, memory_only ? memory_only : "(NULL)");
+    ok = false;
+  }
+
+  free(replayed);
+
+  //
+  // part-way: after the first pass through the loop:
+  //
+  rebuilt = replay_trace(filename, 4 + 5, &total);
+
+  int x = rebuilt == NULL ? -1 : ram_get_addr(rebuilt, "x");
+  int s = rebuilt == NULL ? -1 : ram_get_addr(rebuilt, "s");
+
+  if (rebuilt == NULL || rebuilt->num_values != 4 || x != 0 || s != 1 ||
+      rebuilt->cells[x].value.types.i != 2 || strcmp(rebuilt->cells[s].value.types.s, "abc") != 0)
+  {
+    printf("**FAILED: trace replayed to step 9 has the wrong memory\n");
+    ok = false;
+  }
+
+  if (rebuilt != NULL)
+    ram_destroy(rebuilt);
+
+  remove(filename);
+  free(expected);
+  free(actual);
+  free_program(program, tokens);
+
+  if (ok)
+    printf("passed: trace records every stmt and rebuilds memory (%ld steps)\n", expected_steps);
+
+  return ok;
+}
+
+//
+// count_occurrences
+//
+// Returns the # of times needle occurs in haystack.
+//
+static int count_occurrences(char* haystack, char* needle)
+{
+  int count = 0;
+
+  for (char* p = strstr(haystack, needle); p != NULL; p = strstr(p + 1, needle))
+    count++;
+
+  return count;
+}
+
+//
+// test_timeline
+//
+// The timeline has a span for each run of a while loop and each
+// pass through it, nested loops included (the inner loop runs
+// once per outer pass); a loop that stops with an error still
+// gets its spans; and the JSON is complete.
+//
+static bool test_timeline(void)
+{
+  char* source =
+    "i = 0\n"
+    "while i < 3:\n"
+    "{\n"
+    "  j = 0\n"
+    "  while j < 2:\n"
+    "  {\n"
+    "    j = j + 1\n"
+    "  }\n"
+    "  i = i + 1\n"
+    "}\n"
+    "while i > 0:\n"
+    "{\n"
+    "  i = i - 1\n"
+    "  x = 1 / i\n"
+    "}\n";
+
+  struct TokenQueue* tokens;
+  struct STMT* program = build_program(source, &tokens);
+
+  if (program == NULL)
+  {
+    printf("**FAILED: timeline program did not parse\n");
+    return false;
+  }
+
+  struct OUTPUT* json = output_init_memory();
+  struct TIMELINE* timeline = timeline_init(json);
+
+  struct RAM* memory = ram_init();
+  struct OUTPUT* output = output_init_memory();
+  struct CONTEXT* context = context_for(memory, output, "");
+
+  double start = timeline_now(timeline);
+
+  context->timeline = timeline;
+  execute(program, context);
+  context_free(context);
+
+  timeline_span(timeline, "execute", "phase", start, timeline_now(timeline));
+  timeline_close(timeline);
+
+  char* contents = output_contents(json);
+
+  int loops[] = { count_occurrences(contents, "\"while line 2\""), count_occurrences(contents, "\"while line 5\""),
+                  count_occurrences(contents, "\"while line 11\"") };
+  int passes[] = { count_occurrences(contents, "\"pass line 2\""), count_occurrences(contents, "\"pass line 5\""),
+                   count_occurrences(contents, "\"pass line 11\"") };
+  int expected_loops[] = { 1, 3, 1 };
+  int expected_passes[] = { 3, 6, 3 };  // the last one stops with an error
+  bool ok = true;
+
+  for (int l = 0; l < 3; l++)
+  {
+    if (loops[l] != expected_loops[l] || passes[l] != expected_passes[l])
+    {
+      printf("**FAILED: timeline: loop %d has %d spans and %d passes, expected %d and %d\n",
+        l, loops[l], passes[l], expected_loops[l], expected_passes[l]);
+      ok = false;
+    }
+  }
+
+  size_t length = strlen(contents);
+
+  if (contents[0] != '{' || length < 4 || strcmp(contents + length - 4, "\n]}\n") != 0 ||
+      count_occurrences(contents, "\"execute\"") != 1 || count_occurrences(contents, "\"ph\":\"X\"") != 1 + 3 + 1 + 3 + 6 + 3 + 1)
+  {
+    printf("**FAILED: timeline JSON is incomplete:\n%s\n", contents);
+    ok = false;
+  }
+
+  output_destroy(json);
+  ram_destroy(memory);
+  output_destroy(output);
+  free_program(program, tokens);
+
+  if (ok)
+    printf("passed: timeline spans every loop run and pass (%d spans)\n", 1 + 3 + 1 + 3 + 6 + 3 + 1);
+
+  return ok;
+}
+
+//
+// test_contexts
+//
+// Two contexts executing the same program, one run after the
+// other, don't share anything: each reads its own input, writes
+// its own output, and compiles the program once.
+//
+static bool test_contexts(void)
+{
+  char* source =
+    "s = input('n? ')\n"
+    "n = int(s)\n"
+    "t = n * 2\n"
+    "s = input('n? ')\n"
+    "n = int(s)\n"
+    "t = t + n\n"
+    "print(t)\n";
+
+  struct TokenQueue* tokens;
+  struct STMT* program = build_program(source, &tokens);
+
+  if (program == NULL)
+  {
+    printf("**FAILED: context program did not parse\n");
+    return false;
+  }
+
+  char* inputs[] = { "20\n1\n300\n4000\n", "3\n4\n5\n6" };
+  char* expected[] = { "n? n? 41\nn? n? 4600\n", "n? n? 10\nn? n? 16\n" };
+  struct RAM* memories[2];
+  struct OUTPUT* outputs[2];
+  struct CONTEXT* contexts[2];
+  struct VM_CODE* codes[2];
+  bool ok = true;
+
+  for (int c = 0; c < 2; c++)
+  {
+    memories[c] = ram_init();
+    outputs[c] = output_init_memory();
+    contexts[c] = context_for(memories[c], outputs[c], inputs[c]);
+  }
+
+  //
+  // interleaved: A, B, A, B
+  //
+  for (int run = 0; run < 2; run++)
+  {
+    for (int c = 0; c < 2; c++)
+    {
+      execute(program, contexts[c]);
+
+      if (run == 0)
+        codes[c] = contexts[c]->code;
+      else if (contexts[c]->code != codes[c] || codes[c] == NULL)
+      {
+        printf("**FAILED: context %d did not reuse its compiled code\n", c);
+        ok = false;
+      }
+    }
+  }
+
+  for (int c = 0; c < 2; c++)
+  {
+    if (strcmp(output_contents(outputs[c]), expected[c]) != 0)
+    {
+      printf("**FAILED: context %d output:\n%s\nexpected:\n%s\n", c, output_contents(outputs[c]), expected[c]);
+      ok = false;
+    }
+
+    context_free(contexts[c]);
+    output_destroy(outputs[c]);
+    ram_destroy(memories[c]);
+  }
+
+  free_program(program, tokens);
+
+  if (ok)
+    printf("passed: contexts keep their own input, output, and code\n");
+
+  return ok;
+}
+
+
+//
+// test_input
+//
+// input() gets whole lines, however long, from memory and from a
+// file read ahead by a background thread, then "" at the end; a
+// source destroyed before its file is read is cleaned up.
+//
+static bool test_input(void)
+{
+  int long_length = 3 * INPUT_RING_SIZE + 5;  // wraps around the ring
+  int num_short = 5000;
+  char* long_line = (char*) malloc(long_length + 1);
+  bool ok = true;
+
+  memset(long_line, 'y', long_length);
+  long_line[long_length] = '\0';
+
+  FILE* file = fopen("tests_input.txt", "w");
+
+  if (long_line == NULL || file == NULL)
+  {
+    printf("**FAILED: input: unable to write tests_input.txt\n");
+    free(long_line);
+    return false;
+  }
+
+  fprintf(file, "first\r\n%s\n", long_line);
+
+  for (int i = 0; i < num_short; i++)
+    fprintf(file, "%d\n", i);
+
+  fprintf(file, "last");  // no end of line
+  fclose(file);
+
+  //
+  // the whole file, from memory and read ahead:
+  //
+  struct OUTPUT* text = output_init_memory();
+
+  output_printf(text, "first\r\n%s\n", long_line);
+
+  for (int i = 0; i < num_short; i++)
+    output_printf(text, "%d\n", i);
+
+  output_printf(text, "last");
+
+  struct INPUT* sources[2] = { input_init_memory(output_contents(text)), input_init_path("tests_input.txt") };
+
+  output_destroy(text);
+
+  for (int k = 0; k < 2 && ok; k++)
+  {
+    struct INPUT* input = sources[k];
+    char* line;
+    char expected[32];
+
+    ok = (input != NULL);
+
+    if (ok)
+    {
+      ok = input_read_line(input, &line) && strcmp(line, "first") == 0;
+      free(line);
+    }
+
+    if (ok)
+    {
+      ok = input_read_line(input, &line) && strcmp(line, long_line) == 0;
+      free(line);
+    }
+
+    for (int i = 0; i < num_short && ok; i++)
+    {
+      sprintf(expected, "%d", i);
+      ok = input_read_line(input, &line) && strcmp(line, expected) == 0;
+      free(line);
+    }
+
+    if (ok)
+    {
+      ok = input_read_line(input, &line) && strcmp(line, "last") == 0;
+      free(line);
+    }
+
+    if (ok)
+    {
+      ok = !input_read_line(input, &line) && strcmp(line, "") == 0;
+      free(line);
+    }
+
+    if (!ok)
+      printf("**FAILED: input: wrong lines from the %s\n", k == 0 ? "memory source" : "file source");
+  }
+
+  for (int k = 0; k < 2; k++)
+  {
+    if (sources[k] != NULL)
+      input_destroy(sources[k]);
+  }
+
+  //
+  // destroyed with most of the file unread, the reader waiting
+  // for room in the ring:
+  //
+  struct INPUT* input = input_init_path("tests_input.txt");
+  char* line;
+
+  if (input == NULL || !input_read_line(input, &line))
+  {
+    printf("**FAILED: input: unable to read tests_input.txt again\n");
+    ok = false;
+  }
+  else
+    free(line);
+
+  if (input != NULL)
+    input_destroy(input);
+
+  remove("tests_input.txt");
+  free(long_line);
+
+  if (ok)
+    printf("passed: input() reads whole lines, read ahead from files (%d lines)\n", num_short + 3);
+
+  return ok;
+}
+
+
+//
+// test_parallel
+//
+// Independent top-level loops run at the same time must give
+// exactly what running them one after the other does: the same
+// output, in order, the same errors, and the same memory,
+// variables created in the same order, the last write winning.
+//
+static bool test_parallel(void)
+{
+  char* programs[] =
+  {
+    // two independent loops, then one that reads both, and a
+    // variable both of them write:
+    "n = 200\n"
+    "i = 0\n"
+    "a = 0\n"
+    "while i < n:\n"
+    "{\n"
+    "  a = a + i\n"
+    "  i = i + 1\n"
+    "  last = 1\n"
+    "}\n"
+    "j = 0\n"
+    "s = \"\"\n"
+    "while j < 10:\n"
+    "{\n"
+    "  s = s + \"x\"\n"
+    "  print(j)\n"
+    "  j = j + 1\n"
+    "  last = 2.5\n"
+    "}\n"
+    "k = 0\n"
+    "while k < 3:\n"
+    "{\n"
+    "  print(s)\n"
+    "  k = k + 1\n"
+    "}\n"
+    "t = a + j\n"
+    "print(t)\n",
+
+    // the second loop fails, what the third does is dropped:
+    "i = 0\n"
+    "j = 3\n"
+    "k = 0\n"
+    "m3 = 0 - 3\n"
+    "while i < 5:\n"
+    "{\n"
+    "  print(i)\n"
+    "  i = i + 1\n"
+    "}\n"
+    "while j > m3:\n"
+    "{\n"
+    "  q = 12 / j\n"
+    "  print(q)\n"
+    "  j = j - 1\n"
+    "}\n"
+    "while k < 5:\n"
+    "{\n"
+    "  k = k + 1\n"
+    "}\n"
+    "print(k)\n",
+
+    // an if at the top level, and input() between the loops:
+    "x = 7\n"
+    "z = 0\n"
+    "u = 0\n"
+    "v = 0\n"
+    "if x > 5:\n"
+    "{\n"
+    "  y = 1\n"
+    "}\n"
+    "else:\n"
+    "{\n"
+    "  y = 2\n"
+    "}\n"
+    "while x > 0:\n"
+    "{\n"
+    "  x = x - 1\n"
+    "}\n"
+    "while z < 4:\n"
+    "{\n"
+    "  z = z + y\n"
+    "}\n"
+    "w = input('w? ')\n"
+    "while u < 2:\n"
+    "{\n"
+    "  print(w)\n"
+    "  u = u + 1\n"
+    "}\n"
+    "while v < 2:\n"
+    "{\n"
+    "  v = v + 1\n"
+    "}\n",
+
+    // the first loop fails on its first pass, the second would
+    // loop forever (so it must be stopped, not waited for):
+    "i = 0\n"
+    "while i < 3:\n"
+    "{\n"
+    "  q = 1 / i\n"
+    "  i = i + 1\n"
+    "}\n"
+    "c = 0\n"
+    "while c < 1:\n"
+    "{\n"
+    "  c = c * 1\n"
+    "}\n"
+    "print(c)\n"
+  };
+
+  int num_programs = sizeof(programs) / sizeof(programs[0]);
+  bool ok = true;
+
+  for (int p = 0; p < num_programs; p++)
+  {
+    char* expected = run_captured(programs[p], false);
+    struct TokenQueue* tokens;
+    struct STMT* program = build_program(programs[p], &tokens);
+
+    if (expected == NULL || program == NULL)
+    {
+      printf("**FAILED: parallel program %d did not parse\n", p);
+      free(expected);
+      free_program(program, tokens);
+      ok = false;
+      continue;
+    }
+
+    struct PARALLEL_PLAN* plan = parallel_plan(program, 0);
+
+    if (plan == NULL)
+    {
+      printf("**FAILED: parallel program %d has no parallel wave\n", p);
+      ok = false;
+    }
+    else
+      parallel_free(plan);
+
+    struct RAM* memory = ram_init();
+    struct OUTPUT* output = output_init_memory();
+    struct CONTEXT* context = context_for(memory, output, "");
+
+    context->threads = 4;
+    execute(program, context);
+    context_free(context);
+
+    char* actual = captured(memory, output);
+
+    if (actual == NULL || strcmp(expected, actual) != 0)
+    {
+      printf("**FAILED: parallel program %d:\n%s\nexpected:\n%s\n", p, actual ? actual : "(NULL)", expected);
+      ok = false;
+    }
+
+    free(expected);
+    free(actual);
+    free_program(program, tokens);
+  }
+
+  if (ok)
+    printf("passed: parallel top-level loops match running them in order (%d programs)\n", num_programs);
+
+  return ok;
+}
+
+
+//
+// test_batch
+//
+// A batch of programs gives the same results, in the same order,
+// on one thread as on several, where threads steal each other's
+// programs (the first ones are much slower than the rest).
+//
+static bool test_batch(void)
+{
+  char* filenames[12];
+  char names[12][32];
+  int num_files = sizeof(filenames) / sizeof(filenames[0]);
+
+  for (int i = 0; i < num_files; i++)
+  {
+    sprintf(names[i], "tests_batch%02d.py", i);
+    filenames[i] = names[i];
+
+    FILE* file = fopen(names[i], "w");
+
+    if (file == NULL)
+    {
+      printf("**FAILED: unable to write '%s'\n", names[i]);
+      return false;
+    }
+
+    fprintf(file,
+      "i = 0\n"
+      "n = %d\n"
+      "while i < n:\n"
+      "{\n"
+      "  i = i + 1\n"
+      "}\n"
+      "print('program %d')\n",
+      (i < 3) ? 2000000 : 1000, i);
+
+    fclose(file);
+  }
+
+  char* runs[2];
+  int threads[] = { 1, 4 };
+  bool ok = true;
+
+  for (int r = 0; r < 2; r++)
+  {
+    struct BATCH_OPTIONS options = { threads[r], 0, 0, 0.0 };
+    struct OUTPUT* results = output_init_memory();
+
+    batch_run(filenames, num_files, &options, results);
+
+    runs[r] = strdup(output_contents(results));
+    output_destroy(results);
+  }
+
+  //
+  // the same up to the summary, which has the # of threads:
+  //
+  for (int r = 0; r < 2; r++)
+  {
+    char summary[64];
+
+    sprintf(summary, "**BATCH: %d programs, %d threads\n", num_files, threads[r]);
+
+    char* at = strstr(runs[r], summary);
+
+    if (at == NULL)
+    {
+      printf("**FAILED: batch summary missing\n%s\n", runs[r]);
+      ok = false;
+    }
+    else
+      *at = '\0';
+  }
+
+  if (ok && strcmp(runs[0], runs[1]) != 0)
+  {
+    printf("**FAILED: batch results differ on 1 and 4 threads\n");
+    printf("1 thread:\n%s\n4 threads:\n%s\n", runs[0], runs[1]);
+    ok = false;
+  }
+
+  //
+  // in order, each with its own memory:
+  //
+  char* at = runs[1];
+
+  for (int i = 0; i < num_files && ok; i++)
+  {
+    char expected[64];
+
+    sprintf(expected, "program %d\n**done", i);
+    at = strstr(at, expected);
+
+    if (at == NULL)
+    {
+      printf("**FAILED: batch results for program %d missing or out of order\n%s\n", i, runs[1]);
+      ok = false;
+    }
+  }
+
+  for (int i = 0; i < num_files; i++)
+    remove(names[i]);
+
+  free(runs[0]);
+  free(runs[1]);
+
+  if (ok)
+    printf("passed: batch results in order on 1 and 4 threads (%d programs)\n", num_files);
+
+  return ok;
+}
+
+
+//
+// test_conversions
+//
+// int() and float() accept a string only if all of it is the
+// number ("0abc" and " 5" are errors, not 0 and 5), and agree with
+// strtol and strtod on the ones they accept, on the VM as well as
+// the tree-walker.
+//
+static bool test_conversions(void)
+{
+  struct
+  {
+    char* s;
+    bool is_int;
+    char* expected;  // value of x in memory, NULL => error
+  } cases[] =
+  {
+    { "42", true, "int 42" },
+    { "-7", true, "int -7" },
+    { "+3", true, "int 3" },
+    { "0", true, "int 0" },
+    { "007", true, "int 7" },
+    { "123456789", true, "int 123456789" },
+    { "2147483647", true, "int 2147483647" },
+    { "-2147483648", true, "int -2147483648" },
+    { "2147483648", true, NULL },
+    { "99999999999999999999", true, NULL },
+    { "0abc", true, NULL },
+    { "5abc", true, NULL },
+    { " 5", true, NULL },
+    { "5 ", true, NULL },
+    { "", true, NULL },
+    { "-", true, NULL },
+    { "1.5", true, NULL },
+    { "1.5", false, "real 1.500000" },
+    { ".5", false, "real 0.500000" },
+    { "5.", false, "real 5.000000" },
+    { "-2.25e2", false, "real -225.000000" },
+    { "1e3", false, "real 1000.000000" },
+    { "12345678.87654321", false, "real 12345678.876543" },
+    { "0", false, "real 0.000000" },
+    { "nan", false, "real nan" },
+    { "-nan", false, "real nan" },
+    { "0abc", false, NULL },
+    { " 1.5", false, NULL },
+    { "1e", false, NULL },
+    { ".", false, NULL },
+    { "0x10", false, NULL },
+    { "", false, NULL },
+  };
+  int num_cases = sizeof(cases) / sizeof(cases[0]);
+  bool ok = true;
+
+  for (int i = 0; i < num_cases && ok; i++)
+  {
+    char source[256];
+
+    snprintf(source, sizeof(source), "s = \"%s\"\nx = %s(s)\n", cases[i].s, cases[i].is_int ? "int" : "float");
+
+    for (int use_vm = 0; use_vm <= 1 && ok; use_vm++)
+    {
+      char* result = run_captured(source, use_vm);
+      char* x = (result == NULL) ? NULL : strstr(result, "x = ");
+
+      if (cases[i].expected == NULL)
+        ok = (result != NULL && strstr(result, "**SEMANTIC ERROR: invalid string for") == result && x == NULL);
+      else
+        ok = (x != NULL && strncmp(x + 4, cases[i].expected, strlen(cases[i].expected)) == 0 && x[4 + strlen(cases[i].expected)] == '\n');
+
+      if (!ok)
+        printf("**FAILED: %s(\"%s\") on the %s gave:\n%s\n", cases[i].is_int ? "int" : "float", cases[i].s, use_vm ? "VM" : "tree-walker", result == NULL ? "(no program)" : result);
+
+      free(result);
+    }
+  }
+
+  //
+  // the parsers themselves, on numbers long enough to go 8 digits
+  // at a time, and hard floats that go to strtod:
+  //
+  char* reals[] = { "3.14159265358979323846", "1e308", "1e309", "-1e-320", "123456789012345678901234", "0.1", "9007199254740993", "1.7976931348623157e308", "INF", "-nan", "Infinity" };
+  int num_reals = sizeof(reals) / sizeof(reals[0]);
+
+  for (int i = 0; i < num_reals && ok; i++)
+  {
+    double d = 0.0;
+    double expected = strtod(reals[i], NULL);
+
+    ok = arith_string_to_real(reals[i], &d) && (memcmp(&d, &expected, sizeof(d)) == 0);
+
+    if (!ok)
+      printf("**FAILED: arith_string_to_real(\"%s\") gave %.17g, expected %.17g\n", reals[i], d, expected);
+  }
+
+  int n = 0;
+  const char* digits = "1234567890123";
+  struct ARITH_PARSE result = arith_parse_int(digits, digits + 9, &n);
+
+  if (ok && (result.error != ARITH_PARSE_OK || result.end != digits + 9 || n != 123456789))
+  {
+    printf("**FAILED: arith_parse_int of 9 digits gave %d\n", n);
+    ok = false;
+  }
+
+  result = arith_parse_int(digits, digits + 13, &n);
+
+  if (ok && (result.error != ARITH_PARSE_RANGE || result.end != digits + 13))
+  {
+    printf("**FAILED: arith_parse_int of 13 digits is not a range error\n");
+    ok = false;
+  }
+
+  if (ok)
+    printf("passed: int() and float() parse the whole string (%d cases)\n", num_cases + num_reals + 2);
+
+  return ok;
+}
+
+
+//
+// main
+//
+int main(void)
+{
+  bool ok = true;
+
+  ok = test_variable_reads_do_not_allocate() && ok;
+  ok = test_vm_matches_tree() && ok;
+  ok = test_long_scripts() && ok;
+  ok = test_branchy_scripts() && ok;
+  ok = test_value_boxing() && ok;
+  ok = test_loop_invariants_hoisted() && ok;
+  ok = test_superinstructions() && ok;
+  ok = test_range_checks() && ok;
+  ok = test_counted_loops() && ok;
+  ok = test_jit_matches_tree() && ok;
+  ok = test_transpiled_matches_tree() && ok;
+  ok = test_line_profile() && ok;
+  ok = test_budget() && ok;
+  ok = test_memo() && ok;
+  ok = test_trace() && ok;
+  ok = test_timeline() && ok;
+  ok = test_contexts() && ok;
+  ok = test_input() && ok;
+  ok = test_parallel() && ok;
+  ok = test_batch() && ok;
+  ok = test_conversions() && ok;
+
+  return ok ? 0 : 1;
+}
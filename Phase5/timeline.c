@@ -0,0 +1,235 @@
+/*timeline.c*/
+
+//
+// Timeline of a nuPython run in Chrome's trace-event JSON format,
+// see timeline.h.
+//
+// Jad Dibs
+//
+// Northwestern University
+// CS 211
+//
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdbool.h>  // true, false
+#include <time.h>
+
+#include "timeline.h"
+#include "programgraph.h"
+#include "output.h"
+
+
+//
+// Private functions:
+//
+static void timeline_event(struct TIMELINE* timeline, char* name, int line, char* category, double start, double end, char* arg, long value);
+static void timeline_end_loop(struct TIMELINE* timeline, double now);
+
+
+//
+// timeline_event
+//
+// Writes a complete event; the name is followed by the line # if
+// it's > 0, and args holds arg: value if arg isn't NULL.
+//
+static void timeline_event(struct TIMELINE* timeline, char* name, int line, char* category, double start, double end, char* arg, long value)
+{
+  output_printf(timeline->output, "%s{\"name\":\"%s", timeline->events == 0 ? "\n" : ",\n", name);
+
+  if (line > 0)
+    output_printf(timeline->output, " line %d", line);
+
+  output_printf(timeline->output, "\",\"cat\":\"%s\",\"ph\":\"X\",\"ts\":%.3f,\"dur\":%.3f,\"pid\":1,\"tid\":1",
+    category, start, end - start);
+
+  if (arg != NULL)
+    output_printf(timeline->output, ",\"args\":{\"%s\":%ld}", arg, value);
+
+  output_write(timeline->output, "}", 1);
+
+  timeline->events++;
+}
+
+//
+// timeline_end_loop
+//
+// The innermost loop running is done: ends its current pass, if
+// any, and the loop.
+//
+static void timeline_end_loop(struct TIMELINE* timeline, double now)
+{
+  struct TIMELINE_LOOP* loop = &timeline->loops[timeline->num_loops - 1];
+
+  timeline->num_loops--;
+
+  if (loop->start < 0.0)  // its span was dropped
+  {
+    timeline->dropped++;
+    return;
+  }
+
+  timeline_event(timeline, "while", loop->loop->line, "loop", loop->start, now, "passes", loop->passes);
+}
+
+
+//
+// Public functions:
+//
+
+//
+// timeline_init
+//
+// Starts a timeline, at time 0, written to the given sink.
+//
+struct TIMELINE* timeline_init(struct OUTPUT* output)
+{
+  struct TIMELINE* timeline = (struct TIMELINE*) malloc(sizeof(struct TIMELINE));
+
+  if (timeline == NULL)
+    exit(0);
+
+  timeline->output = output;
+  timeline->events = 0;
+  timeline->dropped = 0;
+
+  timeline->num_loops = 0;
+  timeline->capacity = 16;
+  timeline->loops = (struct TIMELINE_LOOP*) malloc(timeline->capacity * sizeof(struct TIMELINE_LOOP));
+
+  if (timeline->loops == NULL)
+    exit(0);
+
+  timespec_get(&timeline->start, TIME_UTC);
+
+  output_printf(output, "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[");
+
+  return timeline;
+}
+
+//
+// timeline_close
+//
+// Ends the JSON, flushes the sink, and frees the timeline.
+//
+void timeline_close(struct TIMELINE* timeline)
+{
+  output_printf(timeline->output, "\n]}\n");
+  output_flush(timeline->output);
+
+  free(timeline->loops);
+  free(timeline);
+}
+
+//
+// timeline_now
+//
+// Returns the # of microseconds since the timeline started.
+//
+double timeline_now(struct TIMELINE* timeline)
+{
+  struct timespec now;
+
+  timespec_get(&now, TIME_UTC);
+
+  return (now.tv_sec - timeline->start.tv_sec) * 1e6 + (now.tv_nsec - timeline->start.tv_nsec) / 1e3;
+}
+
+//
+// timeline_span
+//
+// Adds a span with the given name and category from start to end.
+//
+void timeline_span(struct TIMELINE* timeline, char* name, char* category, double start, double end)
+{
+  timeline_event(timeline, name, 0, category, start, end, NULL, 0);
+}
+
+//
+// timeline_loop
+//
+// Called each time the condition of a while loop has been
+// evaluated. The clock is only read when a span starts or ends.
+//
+void timeline_loop(struct TIMELINE* timeline, struct STMT* loop, bool condition)
+{
+  struct TIMELINE_LOOP* running = NULL;
+  double now = -1.0;  // not read yet
+
+  if (timeline->num_loops > 0 && timeline->loops[timeline->num_loops - 1].loop == loop)
+  {
+    //
+    // back from a pass:
+    //
+    running = &timeline->loops[timeline->num_loops - 1];
+
+    if (running->pass_start >= 0.0)
+    {
+      now = timeline_now(timeline);
+      timeline_event(timeline, "pass", loop->line, "pass", running->pass_start, now, "pass", running->passes);
+    }
+    else
+      timeline->dropped++;
+  }
+  else
+  {
+    //
+    // the loop starts:
+    //
+    if (timeline->num_loops == timeline->capacity)
+    {
+      timeline->capacity *= 2;
+      timeline->loops = (struct TIMELINE_LOOP*) realloc(timeline->loops, timeline->capacity * sizeof(struct TIMELINE_LOOP));
+
+      if (timeline->loops == NULL)
+        exit(0);
+    }
+
+    running = &timeline->loops[timeline->num_loops];
+    timeline->num_loops++;
+
+    running->loop = loop;
+    running->passes = 0;
+    running->start = -1.0;  // dropped
+
+    if (timeline->events < TIMELINE_MAX_EVENTS)
+    {
+      now = timeline_now(timeline);
+      running->start = now;
+    }
+  }
+
+  if (!condition)
+  {
+    timeline_end_loop(timeline, now >= 0.0 ? now : timeline_now(timeline));
+    return;
+  }
+
+  running->passes++;
+  running->pass_start = -1.0;  // dropped
+
+  if (running->start >= 0.0 && running->passes <= TIMELINE_MAX_PASSES && timeline->events < TIMELINE_MAX_EVENTS)
+    running->pass_start = now >= 0.0 ? now : timeline_now(timeline);
+}
+
+//
+// timeline_unwind
+//
+// Execution stopped: ends the spans of the loops still running.
+//
+void timeline_unwind(struct TIMELINE* timeline)
+{
+  double now = timeline_now(timeline);
+
+  while (timeline->num_loops > 0)
+  {
+    struct TIMELINE_LOOP* running = &timeline->loops[timeline->num_loops - 1];
+
+    if (running->pass_start >= 0.0)
+      timeline_event(timeline, "pass", running->loop->line, "pass", running->pass_start, now, "pass", running->passes);
+    else
+      timeline->dropped++;
+
+    timeline_end_loop(timeline, now);
+  }
+}
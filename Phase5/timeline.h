@@ -0,0 +1,120 @@
+/*timeline.h*/
+
+//
+// Timeline of a nuPython run in Chrome's trace-event JSON format,
+// to load into chrome://tracing, Perfetto, or a flame graph tool.
+// Every span is a complete ("X") event:
+//
+//   {"name":"while line 5","cat":"loop","ph":"X","ts":10.250,
+//    "dur":81.500,"pid":1,"tid":1,"args":{"passes":10}}
+//
+// with times in microseconds since the timeline was started.
+// main adds a span per phase (cat "phase": parse, which scans as
+// it goes, programgraph_build, and execute), and the executor a
+// span each time a while loop runs (cat "loop"), with one span
+// per pass through its body inside it (cat "pass", named "pass
+// line 5"), so nested loops nest.
+//
+// A loop that runs a million times would make a timeline no
+// viewer can open, so only the first TIMELINE_MAX_PASSES passes
+// of each run of a loop get a span (the loop's span still covers
+// all of them), and after TIMELINE_MAX_EVENTS spans no more loops
+// or passes are added; the rest are counted as dropped. Events
+// are written to an output sink (see output.h), which hands them
+// to the OS in large blocks.
+//
+// Jad Dibs
+//
+// Northwestern University
+// CS 211
+//
+
+#pragma once
+
+#include <stdbool.h>  // true, false
+#include <time.h>
+
+#include "programgraph.h"
+#include "output.h"
+
+
+#define TIMELINE_MAX_PASSES 1000     // per run of a loop
+#define TIMELINE_MAX_EVENTS 1000000  // loop and pass spans
+
+
+//
+// Definition of a timeline
+//
+struct TIMELINE_LOOP
+{
+  struct STMT* loop;
+  double start;       // when the loop was reached
+  double pass_start;  // when the current pass started
+  long passes;        // # of passes started so far
+};
+
+struct TIMELINE
+{
+  struct OUTPUT* output;    // where the JSON goes, owned by the caller
+  struct timespec start;    // time 0
+  long events;              // # of spans written
+  long dropped;             // # of loop and pass spans left out
+
+  struct TIMELINE_LOOP* loops;  // the loops running, innermost last
+  int num_loops;
+  int capacity;
+};
+
+
+//
+// Public functions:
+//
+
+//
+// timeline_init
+//
+// Starts a timeline, at time 0, written to the given sink; returns
+// a pointer to it. The caller must call timeline_close.
+//
+struct TIMELINE* timeline_init(struct OUTPUT* output);
+
+//
+// timeline_close
+//
+// Ends the JSON, flushes the sink, and frees the timeline (but
+// not the sink).
+//
+void timeline_close(struct TIMELINE* timeline);
+
+//
+// timeline_now
+//
+// Returns the # of microseconds since the timeline started.
+//
+double timeline_now(struct TIMELINE* timeline);
+
+//
+// timeline_span
+//
+// Adds a span with the given name and category (e.g. "phase")
+// from start to end, as returned by timeline_now.
+//
+void timeline_span(struct TIMELINE* timeline, char* name, char* category, double start, double end);
+
+//
+// timeline_loop
+//
+// Called by the executor each time the condition of a while loop
+// has been evaluated: the loop starts (unless it's running), a
+// pass ends (if it's running), and a pass starts or the loop ends,
+// depending on the condition.
+//
+void timeline_loop(struct TIMELINE* timeline, struct STMT* loop, bool condition);
+
+//
+// timeline_unwind
+//
+// Execution stopped (normally or with an error): ends the spans
+// of the loops still running.
+//
+void timeline_unwind(struct TIMELINE* timeline);
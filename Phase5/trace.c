@@ -0,0 +1,490 @@
+/*trace.c*/
+
+//
+// Execution trace for the nuPython executor, see trace.h.
+//
+// Jad Dibs
+//
+// Northwestern University
+// CS 211
+//
+
+// mmap, ftruncate, and friends are not part of std=c11:
+#define _DEFAULT_SOURCE
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdbool.h>  // true, false
+#include <stdint.h>
+#include <string.h>
+
+#if defined(__unix__)
+#define TRACE_MMAP 1
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#else
+#define TRACE_MMAP 0
+#endif
+
+#include "trace.h"
+#include "ram.h"
+
+
+//
+// Private functions:
+//
+static void trace_string(struct TRACE* trace, char* s);
+static bool trace_read_varint(struct TRACE_READER* reader, uint64_t* value);
+static bool trace_read_string(struct TRACE_READER* reader, char** s);
+static bool trace_read_record(struct TRACE_READER* reader, struct TRACE_RECORD* record);
+
+
+//
+// trace_string
+//
+// Stores a string, with its 0 byte, at the end of the log.
+//
+static void trace_string(struct TRACE* trace, char* s)
+{
+  size_t length = strlen(s) + 1;
+
+  if (trace->size + length + TRACE_MAX_RECORD > trace->capacity)
+    trace_grow(trace, length + TRACE_MAX_RECORD);
+
+  memcpy(trace->log + trace->size, s, length);
+  trace->size += length;
+}
+
+//
+// trace_read_varint
+//
+// Reads an unsigned varint; returns false if the log ends first.
+//
+static bool trace_read_varint(struct TRACE_READER* reader, uint64_t* value)
+{
+  *value = 0;
+
+  for (int shift = 0; shift < 64 && reader->next < reader->size; shift += 7)
+  {
+    unsigned char byte = reader->log[reader->next++];
+
+    *value |= (uint64_t) (byte & 0x7F) << shift;
+
+    if ((byte & 0x80) == 0)
+      return true;
+  }
+
+  return false;
+}
+
+//
+// trace_read_string
+//
+// Points *s at the string in the log; returns false if the log
+// ends first.
+//
+static bool trace_read_string(struct TRACE_READER* reader, char** s)
+{
+  unsigned char* end = memchr(reader->log + reader->next, 0, reader->size - reader->next);
+
+  if (end == NULL)
+    return false;
+
+  *s = (char*) (reader->log + reader->next);
+  reader->next = end - reader->log + 1;
+
+  return true;
+}
+
+//
+// trace_read_record
+//
+// Reads the record at reader->next; returns false if it's
+// damaged or the log ends first.
+//
+static bool trace_read_record(struct TRACE_READER* reader, struct TRACE_RECORD* record)
+{
+  uint64_t header;
+
+  if (!trace_read_varint(reader, &header))
+    return false;
+
+  record->line = (int) (header >> 1);
+  record->address = -1;
+  record->name = NULL;
+  record->value.value_type = RAM_TYPE_NONE;
+
+  if ((header & 1) == 0)  // wrote nothing
+    return true;
+
+  uint64_t address;
+
+  if (!trace_read_varint(reader, &address) || address > (uint64_t) reader->num_cells)
+    return false;
+
+  record->address = (int) address;
+
+  if (record->address == reader->num_cells)  // new cell:
+  {
+    if (!trace_read_string(reader, &record->name))
+      return false;
+
+    reader->num_cells++;
+  }
+
+  if (reader->next >= reader->size)
+    return false;
+
+  record->value.value_type = reader->log[reader->next++];
+
+  uint64_t bits;
+
+  switch (record->value.value_type)
+  {
+  case RAM_TYPE_INT:
+  case RAM_TYPE_PTR:
+  case RAM_TYPE_BOOLEAN:
+    if (!trace_read_varint(reader, &bits))
+      return false;
+
+    record->value.types.i = (int) (int64_t) ((bits >> 1) ^ (0 - (bits & 1)));  // zigzag
+    return true;
+
+  case RAM_TYPE_REAL:
+    if (reader->size - reader->next < 8)
+      return false;
+
+    bits = 0;
+
+    for (int b = 0; b < 8; b++)
+      bits |= (uint64_t) reader->log[reader->next++] << (8 * b);
+
+    memcpy(&record->value.types.d, &bits, sizeof(bits));
+    return true;
+
+  case RAM_TYPE_STR:
+    return trace_read_string(reader, &record->value.types.s);
+
+  case RAM_TYPE_NONE:
+    return true;
+
+  default:
+    return false;
+  }
+}
+
+//
+// Public functions:
+//
+
+//
+// trace_open
+//
+// Creates (or truncates) the given file and returns a pointer to
+// a dynamically-allocated trace recording into it, or NULL if the
+// file can't be created.
+//
+struct TRACE* trace_open(char* filename)
+{
+  struct TRACE* trace = (struct TRACE*) malloc(sizeof(struct TRACE));
+
+  if (trace == NULL)
+    exit(0);
+
+  trace->size = 0;
+  trace->capacity = TRACE_INITIAL;
+  trace->num_cells = 0;
+  trace->steps = 0;
+
+  trace->filename = (char*) malloc(strlen(filename) + 1);
+
+  if (trace->filename == NULL)
+    exit(0);
+
+  strcpy(trace->filename, filename);
+
+#if TRACE_MMAP
+  trace->fd = open(filename, O_RDWR | O_CREAT | O_TRUNC, 0644);
+
+  void* log = MAP_FAILED;
+
+  if (trace->fd >= 0 && ftruncate(trace->fd, trace->capacity) == 0)
+    log = mmap(NULL, trace->capacity, PROT_READ | PROT_WRITE, MAP_SHARED, trace->fd, 0);
+
+  if (log == MAP_FAILED)
+  {
+    if (trace->fd >= 0)
+      close(trace->fd);
+
+    free(trace->filename);
+    free(trace);
+    return NULL;
+  }
+
+  trace->log = (unsigned char*) log;
+#else
+  //
+  // make sure the file can be written now, not at the end:
+  //
+  FILE* file = fopen(filename, "wb");
+
+  if (file == NULL)
+  {
+    free(trace->filename);
+    free(trace);
+    return NULL;
+  }
+
+  fclose(file);
+
+  trace->fd = -1;
+  trace->log = (unsigned char*) malloc(trace->capacity);
+
+  if (trace->log == NULL)
+    exit(0);
+#endif
+
+  memcpy(trace->log, TRACE_MAGIC, strlen(TRACE_MAGIC));
+  trace->size = strlen(TRACE_MAGIC);
+
+  return trace;
+}
+
+//
+// trace_close
+//
+// Truncates the file to the records in it, closes it, and frees
+// the trace.
+//
+bool trace_close(struct TRACE* trace)
+{
+  bool success;
+
+#if TRACE_MMAP
+  success = munmap(trace->log, trace->capacity) == 0;
+  success = ftruncate(trace->fd, trace->size) == 0 && success;
+  success = close(trace->fd) == 0 && success;
+#else
+  FILE* file = fopen(trace->filename, "wb");
+
+  success = file != NULL && fwrite(trace->log, 1, trace->size, file) == trace->size;
+
+  if (file != NULL)
+    success = fclose(file) == 0 && success;
+
+  free(trace->log);
+#endif
+
+  free(trace->filename);
+  free(trace);
+
+  return success;
+}
+
+//
+// trace_grow
+//
+// Makes room for at least n more bytes, doubling the file (or
+// buffer) until there is.
+//
+void trace_grow(struct TRACE* trace, size_t n)
+{
+  size_t capacity = trace->capacity;
+
+  while (trace->size + n > capacity)
+    capacity *= 2;
+
+#if TRACE_MMAP
+  munmap(trace->log, trace->capacity);
+
+  void* log = MAP_FAILED;
+
+  if (ftruncate(trace->fd, capacity) == 0)
+    log = mmap(NULL, capacity, PROT_READ | PROT_WRITE, MAP_SHARED, trace->fd, 0);
+
+  if (log == MAP_FAILED)  // disk full:
+  {
+    printf("**ERROR: unable to grow trace file '%s'.\n", trace->filename);
+    exit(0);
+  }
+
+  trace->log = (unsigned char*) log;
+#else
+  trace->log = (unsigned char*) realloc(trace->log, capacity);
+
+  if (trace->log == NULL)
+    exit(0);
+#endif
+
+  trace->capacity = capacity;
+}
+
+//
+// trace_write
+//
+// Records a stmt on the given line that wrote the given cell of
+// memory.
+//
+void trace_write(struct TRACE* trace, int line, struct RAM* memory, int address)
+{
+  struct RAM_CELL* cell = &memory->cells[address];
+
+  if (trace->size + TRACE_MAX_RECORD > trace->capacity)
+    trace_grow(trace, TRACE_MAX_RECORD);
+
+  trace_varint(trace, ((uint64_t) line << 1) | 1);
+  trace_varint(trace, (uint64_t) address);
+
+  if (address >= trace->num_cells)  // new cell, addresses are handed out in order:
+  {
+    trace_string(trace, cell->identifier);
+    trace->num_cells = address + 1;
+  }
+
+  int type = cell->value.value_type;
+
+  trace->log[trace->size++] = (unsigned char) type;
+
+  if (type == RAM_TYPE_INT || type == RAM_TYPE_PTR || type == RAM_TYPE_BOOLEAN)
+  {
+    int64_t i = cell->value.types.i;
+
+    trace_varint(trace, ((uint64_t) i << 1) ^ (uint64_t) (i >> 63));  // zigzag
+  }
+  else if (type == RAM_TYPE_REAL)
+  {
+    uint64_t bits;
+
+    memcpy(&bits, &cell->value.types.d, sizeof(bits));
+
+    for (int b = 0; b < 8; b++)
+      trace->log[trace->size++] = (unsigned char) (bits >> (8 * b));
+  }
+  else if (type == RAM_TYPE_STR)
+    trace_string(trace, cell->value.types.s);
+
+  trace->steps++;
+}
+
+//
+// trace_reader_open
+//
+// Opens a trace for reading. Returns NULL if the file can't be
+// read or isn't a trace.
+//
+struct TRACE_READER* trace_reader_open(char* filename)
+{
+  struct TRACE_READER* reader = (struct TRACE_READER*) malloc(sizeof(struct TRACE_READER));
+
+  if (reader == NULL)
+    exit(0);
+
+  reader->log = NULL;
+  reader->size = 0;
+  reader->steps = 0;
+  reader->num_cells = 0;
+
+#if TRACE_MMAP
+  int fd = open(filename, O_RDONLY);
+  struct stat info;
+
+  if (fd >= 0 && fstat(fd, &info) == 0 && info.st_size > 0)
+  {
+    void* log = mmap(NULL, info.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+
+    if (log != MAP_FAILED)
+    {
+      reader->log = (unsigned char*) log;
+      reader->size = info.st_size;
+    }
+  }
+
+  if (fd >= 0)
+    close(fd);
+#else
+  FILE* file = fopen(filename, "rb");
+
+  if (file != NULL)
+  {
+    size_t capacity = 4096;
+
+    reader->log = (unsigned char*) malloc(capacity);
+
+    if (reader->log == NULL)
+      exit(0);
+
+    size_t n;
+
+    while ((n = fread(reader->log + reader->size, 1, capacity - reader->size, file)) > 0)
+    {
+      reader->size += n;
+
+      if (reader->size == capacity)
+      {
+        capacity *= 2;
+        reader->log = (unsigned char*) realloc(reader->log, capacity);
+
+        if (reader->log == NULL)
+          exit(0);
+      }
+    }
+
+    fclose(file);
+  }
+#endif
+
+  size_t magic = strlen(TRACE_MAGIC);
+
+  if (reader->size < magic || memcmp(reader->log, TRACE_MAGIC, magic) != 0)
+  {
+    trace_reader_close(reader);
+    return NULL;
+  }
+
+  reader->next = magic;
+
+  return reader;
+}
+
+//
+// trace_reader_close
+//
+// Closes the trace and frees the reader.
+//
+void trace_reader_close(struct TRACE_READER* reader)
+{
+#if TRACE_MMAP
+  if (reader->log != NULL)
+    munmap(reader->log, reader->size);
+#else
+  free(reader->log);
+#endif
+
+  free(reader);
+}
+
+//
+// trace_next
+//
+// Reads the next record into *record. Returns false at the end
+// of the trace, or if the rest of it is damaged.
+//
+bool trace_next(struct TRACE_READER* reader, struct TRACE_RECORD* record)
+{
+  size_t start = reader->next;
+
+  if (reader->next >= reader->size || reader->log[reader->next] == 0)  // end, or cut short
+    return false;
+
+  if (!trace_read_record(reader, record))
+  {
+    reader->next = start;
+    return false;
+  }
+
+  reader->steps++;
+
+  return true;
+}
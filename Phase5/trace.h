@@ -0,0 +1,191 @@
+/*trace.h*/
+
+//
+// Execution trace for the nuPython executor: a log of every stmt
+// executed, in order, with the memory cell each assignment wrote
+// and its new value, so what a program did can be looked at
+// after the fact, and memory rebuilt as it was after any step
+// (see traceread.c).
+//
+// The log is a file that starts with TRACE_MAGIC, followed by
+// one record per stmt executed (step 1, 2, ...):
+//
+//   varint   line << 1 | 1 if the stmt wrote a cell
+//
+// and, if it did:
+//
+//   varint   cell address
+//   string   the variable's name, only the first time the
+//            address appears (addresses are handed out in order)
+//   byte     value type, enum RAM_VALUE_TYPES
+//   value    int, ptr, boolean: zigzag varint; real: 8 bytes,
+//            little-endian; string: its chars; None: nothing
+//
+// Varints are 7 bits a byte, low bits first, the top bit set
+// on every byte but the last; strings end with a 0 byte. An
+// assignment that stops with an error wrote nothing.
+//
+// The file is mapped into memory and records are stored
+// straight into it, so recording costs a few stores per stmt;
+// the file grows by doubling. Since line numbers start at 1, a
+// record can't start with a 0 byte, so a log cut short (the
+// process crashed before trace_close truncated the file to its
+// records) just ends at the first 0 byte. Where mmap isn't
+// available the log is built in memory and written when closed.
+//
+// Jad Dibs
+//
+// Northwestern University
+// CS 211
+//
+
+#pragma once
+
+#include <stdbool.h>  // true, false
+#include <stdint.h>
+#include <string.h>
+
+#include "ram.h"
+
+
+#define TRACE_MAGIC      "nuPytrc1"  // 8 bytes, no 0
+#define TRACE_INITIAL    (1 << 20)   // bytes mapped at first
+#define TRACE_MAX_RECORD 32          // room for any record but its strings
+
+
+//
+// Definition of a trace being recorded
+//
+struct TRACE
+{
+  unsigned char* log;  // mapped file (or memory)
+  size_t size;         // bytes recorded so far
+  size_t capacity;     // bytes mapped
+
+  int fd;              // the file, -1 if not mapped
+  char* filename;
+
+  int num_cells;       // # of cell addresses named so far
+  long steps;          // # of records
+};
+
+//
+// One record, as read back:
+//
+struct TRACE_RECORD
+{
+  int line;
+  int address;             // cell written, -1 if none
+  char* name;              // its variable, if first written here, else NULL
+  struct RAM_VALUE value;  // strings point into the log
+};
+
+//
+// Definition of a trace being read
+//
+struct TRACE_READER
+{
+  unsigned char* log;  // mapped file (or memory)
+  size_t size;
+  size_t next;         // offset of the next record
+  int num_cells;       // # of cell addresses named so far
+  long steps;          // # of records read so far
+};
+
+
+//
+// Public functions:
+//
+
+//
+// trace_open
+//
+// Creates (or truncates) the given file and returns a pointer to
+// a dynamically-allocated trace recording into it, or NULL if the
+// file can't be created. The caller must call trace_close.
+//
+struct TRACE* trace_open(char* filename);
+
+//
+// trace_close
+//
+// Truncates the file to the records in it, closes it, and frees
+// the trace. Returns false if the file couldn't be written.
+//
+bool trace_close(struct TRACE* trace);
+
+//
+// trace_grow
+//
+// Makes room for at least n more bytes; called by the recording
+// functions below.
+//
+void trace_grow(struct TRACE* trace, size_t n);
+
+//
+// trace_write
+//
+// Records a stmt on the given line that wrote the given cell of
+// memory (whose value is now the new value).
+//
+void trace_write(struct TRACE* trace, int line, struct RAM* memory, int address);
+
+//
+// trace_reader_open
+//
+// Opens a trace for reading. Returns NULL if the file can't be
+// read or isn't a trace. The caller must call trace_reader_close.
+//
+struct TRACE_READER* trace_reader_open(char* filename);
+
+//
+// trace_reader_close
+//
+// Closes the trace and frees the reader; strings in the records
+// read from it are no longer valid.
+//
+void trace_reader_close(struct TRACE_READER* reader);
+
+//
+// trace_next
+//
+// Reads the next record into *record. Returns false at the end
+// of the trace (or if the rest of it is damaged).
+//
+bool trace_next(struct TRACE_READER* reader, struct TRACE_RECORD* record);
+
+//
+// trace_varint
+//
+// Stores an unsigned varint at the end of the log; the caller has
+// made room.
+//
+static inline void trace_varint(struct TRACE* trace, uint64_t value)
+{
+  unsigned char* p = trace->log + trace->size;
+
+  while (value >= 0x80)
+  {
+    *p++ = (unsigned char) (value | 0x80);
+    value >>= 7;
+  }
+
+  *p++ = (unsigned char) value;
+
+  trace->size = p - trace->log;
+}
+
+//
+// trace_stmt
+//
+// Records a stmt on the given line that wrote nothing. Called by
+// the executor for most stmts, so it's inline.
+//
+static inline void trace_stmt(struct TRACE* trace, int line)
+{
+  if (trace->size + TRACE_MAX_RECORD > trace->capacity)
+    trace_grow(trace, TRACE_MAX_RECORD);
+
+  trace_varint(trace, (uint64_t) line << 1);
+  trace->steps++;
+}
@@ -0,0 +1,168 @@
+/*traceread.c*/
+
+//
+// Reads an execution trace recorded with main's --trace (see
+// trace.h) and rebuilds memory as it was after any step.
+//
+// usage: traceread.out [--list] trace.log [step]
+//
+// Replays the writes of steps 1..step (all of them by default)
+// into an empty memory, then prints where execution was and the
+// memory, the same way main does when a program is done. With
+// --list, every step replayed is printed too, e.g.
+//
+//   step 3: line 2: x = 5
+//   step 4: line 3
+//
+// Jad Dibs
+//
+// Northwestern University
+// CS 211
+//
+
+// to eliminate warnings about stdlib in Visual Studio
+#define _CRT_SECURE_NO_WARNINGS
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdbool.h>  // true, false
+#include <string.h>   // strcmp
+
+#include "ram.h"
+#include "trace.h"
+
+
+//
+// print_value
+//
+// Prints a value the way it would be written in nuPython.
+//
+static void print_value(struct RAM_VALUE* value)
+{
+  switch (value->value_type)
+  {
+  case RAM_TYPE_INT:
+    printf("%d", value->types.i);
+    break;
+
+  case RAM_TYPE_REAL:
+    printf("%lf", value->types.d);
+    break;
+
+  case RAM_TYPE_STR:
+    printf("'%s'", value->types.s);
+    break;
+
+  case RAM_TYPE_PTR:
+    printf("&%d", value->types.i);
+    break;
+
+  case RAM_TYPE_BOOLEAN:
+    printf("%s", value->types.i ? "True" : "False");
+    break;
+
+  default:
+    printf("None");
+    break;
+  }
+}
+
+
+//
+// main
+//
+int main(int argc, char* argv[])
+{
+  bool list = false;
+
+  if (argc > 1 && strcmp(argv[1], "--list") == 0)
+  {
+    list = true;
+    argv++;
+    argc--;
+  }
+
+  if (argc < 2 || argc > 3)
+  {
+    printf("usage: %s [--list] trace.log [step]\n", argv[0]);
+    return 0;
+  }
+
+  long last = -1;  // all steps
+
+  if (argc == 3)
+    last = atol(argv[2]);
+
+  struct TRACE_READER* reader = trace_reader_open(argv[1]);
+
+  if (reader == NULL)
+  {
+    printf("**ERROR: '%s' is not a trace.\n", argv[1]);
+    return 0;
+  }
+
+  //
+  // the name of each cell, in the order they were created, so
+  // cells are created in the same order here:
+  //
+  int capacity = 64;
+  char** names = (char**) malloc(capacity * sizeof(char*));
+
+  if (names == NULL)
+    exit(0);
+
+  struct RAM* memory = ram_init();
+  struct TRACE_RECORD record;
+  int line = 0;
+
+  while ((last < 0 || reader->steps < last) && trace_next(reader, &record))
+  {
+    line = record.line;
+
+    if (record.name != NULL)
+    {
+      if (record.address == capacity)
+      {
+        capacity *= 2;
+        names = (char**) realloc(names, capacity * sizeof(char*));
+
+        if (names == NULL)
+          exit(0);
+      }
+
+      names[record.address] = record.name;
+    }
+
+    if (list)
+    {
+      printf("step %ld: line %d", reader->steps, record.line);
+
+      if (record.address >= 0)
+      {
+        printf(": %s = ", names[record.address]);
+        print_value(&record.value);
+      }
+
+      printf("\n");
+    }
+
+    if (record.address >= 0)
+      ram_write_cell_by_name(memory, record.value, names[record.address]);
+  }
+
+  if (last > reader->steps)
+    printf("**trace has only %ld steps\n", reader->steps);
+
+  if (reader->steps == 0)
+    printf("**step 0\n");
+  else
+    printf("**step %ld: line %d\n", reader->steps, line);
+
+  ram_print(memory);
+
+  ram_destroy(memory);
+  free(names);
+  trace_reader_close(reader);
+
+  return 0;
+}
@@ -0,0 +1,1012 @@
+/*transpile.c*/
+
+//
+// Ahead-of-time C backend for nuPython, see transpile.h.
+//
+// The generated program is the runtime below (the value type and
+// the operations of execute.c, as inline functions), one static
+// variable per nuPython variable, and main(), which holds the
+// program's statements in order: a while loop becomes a C while
+// loop, an if/elif/else a C if/else, and an error returns from
+// main right after its message.
+//
+// Jad Dibs
+//
+// Northwestern University
+// CS 211
+//
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdbool.h>  // true, false
+#include <string.h>
+#include <ctype.h>   // isalnum
+#include <limits.h>
+#include <math.h>
+
+#include "programgraph.h"
+#include "walk.h"
+#include "transpile.h"
+
+
+struct TRANSPILER
+{
+  FILE* out;    // where main's statements go
+  bool ok;      // false => program uses something we can't translate
+
+  char** names; // variable i is v<i> in the generated code
+  int num_names;
+  int names_capacity;
+};
+
+//
+// Names of enum OPERATORS in the generated code:
+//
+static const char* transpile_operators[] =
+{
+  "NU_PLUS", "NU_MINUS", "NU_ASTERISK", "NU_POWER", "NU_MOD", "NU_DIV",
+  "NU_EQUAL", "NU_NOT_EQUAL", "NU_LT", "NU_LTE", "NU_GT", "NU_GTE"
+};
+
+//
+// Runtime of the generated program, copied verbatim:
+//
+static const char* transpile_runtime[] =
+{
+  "#include <stdio.h>",
+  "#include <stdlib.h>",
+  "#include <stdbool.h>",
+  "#include <string.h>",
+  "#include <math.h>",
+  "#include <errno.h>",
+  "#include <limits.h>",
+  "",
+  "//",
+  "// A variable's value, with the same types and meaning as a",
+  "// struct RAM_VALUE in the interpreter's memory. A variable owns",
+  "// its string; length and capacity describe the buffer once it",
+  "// has been appended to (s = s + t), capacity 0 => unknown.",
+  "//",
+  "enum NU_TYPES",
+  "{",
+  "  NU_UNDEFINED = 0,",
+  "  NU_INT,",
+  "  NU_REAL,",
+  "  NU_STR,",
+  "  NU_BOOL",
+  "};",
+  "",
+  "struct NU_VALUE",
+  "{",
+  "  int type;",
+  "  int i;            // int, or bool (0 or 1)",
+  "  double d;",
+  "  char* s;",
+  "  size_t length;",
+  "  size_t capacity;",
+  "};",
+  "",
+  "enum NU_OPERATORS",
+  "{",
+  "  NU_PLUS = 0, NU_MINUS, NU_ASTERISK, NU_POWER, NU_MOD, NU_DIV,",
+  "  NU_EQUAL, NU_NOT_EQUAL, NU_LT, NU_LTE, NU_GT, NU_GTE",
+  "};",
+  "",
+  "static inline struct NU_VALUE nu_int(int i)",
+  "{",
+  "  struct NU_VALUE v = { NU_INT, i, 0.0, NULL, 0, 0 };",
+  "  return v;",
+  "}",
+  "",
+  "static inline struct NU_VALUE nu_real(double d)",
+  "{",
+  "  if (d != d)  // NaN, printed as \"nan\" as in the interpreter",
+  "    d = fabs(d);",
+  "",
+  "  struct NU_VALUE v = { NU_REAL, 0, d, NULL, 0, 0 };",
+  "  return v;",
+  "}",
+  "",
+  "static inline struct NU_VALUE nu_bool(bool b)",
+  "{",
+  "  struct NU_VALUE v = { NU_BOOL, b ? 1 : 0, 0.0, NULL, 0, 0 };",
+  "  return v;",
+  "}",
+  "",
+  "static inline struct NU_VALUE nu_str(char* s)",
+  "{",
+  "  struct NU_VALUE v = { NU_STR, 0, 0.0, s, 0, 0 };",
+  "  return v;",
+  "}",
+  "",
+  "static inline void nu_undefined(const char* name, int line)",
+  "{",
+  "  printf(\"**SEMANTIC ERROR: name '%s' is not defined (line %d)\\n\", name, line);",
+  "}",
+  "",
+  "static inline char* nu_strdup(const char* s)",
+  "{",
+  "  char* copy = (char*) malloc(strlen(s) + 1);",
+  "",
+  "  if (copy == NULL)",
+  "    exit(0);",
+  "",
+  "  strcpy(copy, s);",
+  "  return copy;",
+  "}",
+  "",
+  "//",
+  "// nu_set: var = value; a string value is copied unless owned",
+  "// (just allocated for this assignment):",
+  "//",
+  "static inline void nu_set(struct NU_VALUE* var, struct NU_VALUE value, bool owned)",
+  "{",
+  "  if (value.type == NU_STR && !owned)",
+  "    value.s = nu_strdup(value.s);",
+  "",
+  "  if (var->type == NU_STR)",
+  "    free(var->s);",
+  "",
+  "  *var = value;",
+  "  var->capacity = 0;",
+  "}",
+  "",
+  "//",
+  "// nu_append: var = var + rhs in place, if both are strings;",
+  "// self => rhs is var itself (s = s + s):",
+  "//",
+  "static inline bool nu_append(struct NU_VALUE* var, struct NU_VALUE rhs, bool self)",
+  "{",
+  "  if (var->type != NU_STR || rhs.type != NU_STR)",
+  "    return false;",
+  "",
+  "  if (var->capacity == 0)",
+  "  {",
+  "    var->length = strlen(var->s);",
+  "    var->capacity = var->length + 1;",
+  "  }",
+  "",
+  "  size_t n = self ? var->length : strlen(rhs.s);",
+  "",
+  "  if (var->length + n + 1 > var->capacity)",
+  "  {",
+  "    var->capacity = (var->length + n + 1) * 2;",
+  "    var->s = (char*) realloc(var->s, var->capacity);",
+  "",
+  "    if (var->s == NULL)",
+  "      exit(0);",
+  "  }",
+  "",
+  "  memcpy(var->s + var->length, self ? var->s : rhs.s, n);",
+  "  var->length += n;",
+  "  var->s[var->length] = '\\0';",
+  "",
+  "  return true;",
+  "}",
+  "",
+  "static inline int nu_power_ints(int base, int exponent)",
+  "{",
+  "  unsigned int b = (unsigned int) base;",
+  "",
+  "  if (exponent < 0)",
+  "  {",
+  "    if (base == 1)",
+  "      return 1;",
+  "    else if (base == -1)",
+  "      return (exponent % 2 == 0) ? 1 : -1;",
+  "    else",
+  "      return 0;",
+  "  }",
+  "",
+  "  unsigned int result = 1;",
+  "  unsigned int e = (unsigned int) exponent;",
+  "",
+  "  while (e > 0)",
+  "  {",
+  "    if (e & 1)",
+  "      result *= b;",
+  "",
+  "    e >>= 1;",
+  "",
+  "    if (e > 0)",
+  "      b *= b;",
+  "  }",
+  "",
+  "  return (int) result;",
+  "}",
+  "",
+  "static inline bool nu_binary_ints(int l, int op, int r, int line, struct NU_VALUE* result)",
+  "{",
+  "  switch (op)",
+  "  {",
+  "  case NU_PLUS:      *result = nu_int((int) ((unsigned int) l + (unsigned int) r)); return true;",
+  "  case NU_MINUS:     *result = nu_int((int) ((unsigned int) l - (unsigned int) r)); return true;",
+  "  case NU_ASTERISK:  *result = nu_int((int) ((unsigned int) l * (unsigned int) r)); return true;",
+  "  case NU_POWER:     *result = nu_int(nu_power_ints(l, r)); return true;",
+  "  case NU_EQUAL:     *result = nu_bool(l == r); return true;",
+  "  case NU_NOT_EQUAL: *result = nu_bool(l != r); return true;",
+  "  case NU_LT:        *result = nu_bool(l < r);  return true;",
+  "  case NU_LTE:       *result = nu_bool(l <= r); return true;",
+  "  case NU_GT:        *result = nu_bool(l > r);  return true;",
+  "  case NU_GTE:       *result = nu_bool(l >= r); return true;",
+  "  default:  // NU_MOD, NU_DIV",
+  "    if (r == 0)",
+  "    {",
+  "      printf(\"**ZeroDivisionError: division by zero (line %d)\\n\", line);",
+  "      return false;",
+  "    }",
+  "",
+  "    *result = nu_int(op == NU_MOD ? l % r : l / r);",
+  "    return true;",
+  "  }",
+  "}",
+  "",
+  "static inline bool nu_binary_reals(double l, int op, double r, int line, struct NU_VALUE* result)",
+  "{",
+  "  switch (op)",
+  "  {",
+  "  case NU_PLUS:      *result = nu_real(l + r); return true;",
+  "  case NU_MINUS:     *result = nu_real(l - r); return true;",
+  "  case NU_ASTERISK:  *result = nu_real(l * r); return true;",
+  "  case NU_POWER:     *result = nu_real(pow(l, r)); return true;",
+  "  case NU_MOD:       *result = nu_real(fmod(l, r)); return true;",
+  "  case NU_EQUAL:     *result = nu_bool(l == r); return true;",
+  "  case NU_NOT_EQUAL: *result = nu_bool(l != r); return true;",
+  "  case NU_LT:        *result = nu_bool(l < r);  return true;",
+  "  case NU_LTE:       *result = nu_bool(l <= r); return true;",
+  "  case NU_GT:        *result = nu_bool(l > r);  return true;",
+  "  case NU_GTE:       *result = nu_bool(l >= r); return true;",
+  "  default:  // NU_DIV",
+  "    if (r == 0.0)",
+  "    {",
+  "      printf(\"**ZeroDivisionError: division by zero (line %d)\\n\", line);",
+  "      return false;",
+  "    }",
+  "",
+  "    *result = nu_real(l / r);",
+  "    return true;",
+  "  }",
+  "}",
+  "",
+  "static inline bool nu_binary_strings(char* l, int op, char* r, int line, struct NU_VALUE* result)",
+  "{",
+  "  int compare = strcmp(l, r);",
+  "",
+  "  switch (op)",
+  "  {",
+  "  case NU_PLUS:",
+  "  {",
+  "    char* s = (char*) malloc(strlen(l) + strlen(r) + 1);",
+  "",
+  "    if (s == NULL)",
+  "      exit(0);",
+  "",
+  "    strcpy(s, l);",
+  "    strcat(s, r);",
+  "    *result = nu_str(s);",
+  "    return true;",
+  "  }",
+  "",
+  "  case NU_EQUAL:     *result = nu_bool(compare == 0); return true;",
+  "  case NU_NOT_EQUAL: *result = nu_bool(compare != 0); return true;",
+  "  case NU_LT:        *result = nu_bool(compare < 0);  return true;",
+  "  case NU_LTE:       *result = nu_bool(compare <= 0); return true;",
+  "  case NU_GT:        *result = nu_bool(compare > 0);  return true;",
+  "  case NU_GTE:       *result = nu_bool(compare >= 0); return true;",
+  "  default:",
+  "    printf(\"**SEMANTIC ERROR: invalid operand types (line %d)\\n\", line);",
+  "    return false;",
+  "  }",
+  "}",
+  "",
+  "//",
+  "// nu_binary: *result = l op r; a string result is newly allocated",
+  "//",
+  "static inline bool nu_binary(struct NU_VALUE l, int op, struct NU_VALUE r, int line, struct NU_VALUE* result)",
+  "{",
+  "  if (l.type == NU_INT && r.type == NU_INT)",
+  "    return nu_binary_ints(l.i, op, r.i, line, result);",
+  "",
+  "  if ((l.type == NU_INT || l.type == NU_REAL) && (r.type == NU_INT || r.type == NU_REAL))",
+  "    return nu_binary_reals(l.type == NU_INT ? l.i : l.d, op, r.type == NU_INT ? r.i : r.d, line, result);",
+  "",
+  "  if (l.type == NU_STR && r.type == NU_STR)",
+  "    return nu_binary_strings(l.s, op, r.s, line, result);",
+  "",
+  "  printf(\"**SEMANTIC ERROR: invalid operand types (line %d)\\n\", line);",
+  "  return false;",
+  "}",
+  "",
+  "static inline bool nu_is_true(struct NU_VALUE v)",
+  "{",
+  "  if (v.type == NU_INT || v.type == NU_BOOL)",
+  "    return v.i != 0;",
+  "  else if (v.type == NU_REAL)",
+  "    return v.d != 0.0;",
+  "  else",
+  "    return v.s[0] != '\\0';",
+  "}",
+  "",
+  "//",
+  "// nu_condition: *holds = l op r is true",
+  "//",
+  "static inline bool nu_condition(struct NU_VALUE l, int op, struct NU_VALUE r, int line, bool* holds)",
+  "{",
+  "  struct NU_VALUE value;",
+  "",
+  "  if (op >= NU_EQUAL && l.type == NU_INT && r.type == NU_INT)",
+  "  {",
+  "    switch (op)",
+  "    {",
+  "    case NU_EQUAL:     *holds = l.i == r.i; return true;",
+  "    case NU_NOT_EQUAL: *holds = l.i != r.i; return true;",
+  "    case NU_LT:        *holds = l.i < r.i;  return true;",
+  "    case NU_LTE:       *holds = l.i <= r.i; return true;",
+  "    case NU_GT:        *holds = l.i > r.i;  return true;",
+  "    default:           *holds = l.i >= r.i; return true;",
+  "    }",
+  "  }",
+  "",
+  "  if (!nu_binary(l, op, r, line, &value))",
+  "    return false;",
+  "",
+  "  *holds = nu_is_true(value);",
+  "",
+  "  if (value.type == NU_STR)",
+  "    free(value.s);",
+  "",
+  "  return true;",
+  "}",
+  "",
+  "static inline void nu_print(struct NU_VALUE v)",
+  "{",
+  "  if (v.type == NU_INT)",
+  "    printf(\"%d\\n\", v.i);",
+  "  else if (v.type == NU_REAL)",
+  "    printf(\"%f\\n\", v.d);",
+  "  else if (v.type == NU_STR)",
+  "    printf(\"%s\\n\", v.s);",
+  "  else if (v.type == NU_BOOL)",
+  "    printf(v.i ? \"True\\n\" : \"False\\n\");",
+  "}",
+  "",
+  "static inline void nu_input(struct NU_VALUE* var, const char* prompt)",
+  "{",
+  "  size_t capacity = 256, length = 0;",
+  "  char* line = (char*) malloc(capacity);",
+  "",
+  "  if (line == NULL)",
+  "    exit(0);",
+  "",
+  "  printf(\"%s\", prompt);",
+  "  fflush(stdout);",
+  "",
+  "  line[0] = '\\0';",
+  "",
+  "  while (fgets(line + length, (int) (capacity - length), stdin) != NULL)  // however long",
+  "  {",
+  "    length += strlen(line + length);",
+  "",
+  "    if (length == 0 || line[length - 1] == '\\n' || length + 1 < capacity)",
+  "      break;",
+  "",
+  "    capacity *= 2;",
+  "    line = (char*) realloc(line, capacity);",
+  "",
+  "    if (line == NULL)",
+  "      exit(0);",
+  "  }",
+  "",
+  "  line[strcspn(line, \"\\r\\n\")] = '\\0';",
+  "",
+  "  nu_set(var, nu_str(line), true);",
+  "}",
+  "",
+  "//",
+  "// nu_convert: var = int(from) or float(from)",
+  "//",
+  "static inline bool nu_convert(struct NU_VALUE* var, struct NU_VALUE* from, const char* name, bool is_int, int line)",
+  "{",
+  "  if (from->type == NU_UNDEFINED)",
+  "  {",
+  "    nu_undefined(name, line);",
+  "    return false;",
+  "  }",
+  "",
+  "  if (from->type != NU_STR)",
+  "  {",
+  "    printf(\"**SEMANTIC ERROR: invalid string for %s() (line %d)\\n\", is_int ? \"int\" : \"float\", line);",
+  "    return false;",
+  "  }",
+  "",
+  "  //",
+  "  // the whole string must be the number, as in the interpreter's",
+  "  // arith_string_to_int/real: no spaces, no hex, no nan(...):",
+  "  //",
+  "  const char* s = from->s;",
+  "  const char* digits = s + (s[0] == '+' || s[0] == '-');",
+  "  char* end = NULL;",
+  "",
+  "  errno = 0;",
+  "",
+  "  if (is_int && digits[0] >= '0' && digits[0] <= '9')",
+  "  {",
+  "    long i = strtol(s, &end, 10);",
+  "",
+  "    if (*end == '\\0' && errno == 0 && i >= INT_MIN && i <= INT_MAX)",
+  "    {",
+  "      nu_set(var, nu_int((int) i), false);",
+  "      return true;",
+  "    }",
+  "  }",
+  "  else if (!is_int && digits[0] != '\\0' && strchr(\" \\t\\n\\v\\f\\r+-\", digits[0]) == NULL && strpbrk(s, \"xX(\") == NULL)",
+  "  {",
+  "    double d = strtod(s, &end);",
+  "",
+  "    if (end != s && *end == '\\0')",
+  "    {",
+  "      nu_set(var, nu_real(d), false);",
+  "      return true;",
+  "    }",
+  "  }",
+  "",
+  "  printf(\"**SEMANTIC ERROR: invalid string for %s() (line %d)\\n\", is_int ? \"int\" : \"float\", line);",
+  "  return false;",
+  "}",
+  "",
+  "//",
+  "// nu_done: the end of the program, normal or not",
+  "//",
+  "static inline int nu_done(void)",
+  "{",
+  "  fflush(stdout);",
+  "  return 0;",
+  "}",
+  NULL
+};
+
+
+//
+// Private functions:
+//
+static int transpile_var(struct TRANSPILER* t, char* name);
+static void transpile_indent(struct TRANSPILER* t, int depth);
+static void transpile_string(FILE* out, char* s);
+static bool transpile_supported(struct TRANSPILER* t, struct ELEMENT* element, int line);
+static void transpile_element(struct TRANSPILER* t, struct ELEMENT* element);
+static void transpile_check(struct TRANSPILER* t, struct ELEMENT* element, int line, int depth);
+static bool transpile_expr_ok(struct TRANSPILER* t, struct EXPR* expr, int line);
+static void transpile_assignment(struct TRANSPILER* t, struct STMT* stmt, int depth);
+static void transpile_function_call(struct TRANSPILER* t, struct STMT* stmt, int depth);
+static void transpile_condition(struct TRANSPILER* t, struct EXPR* condition, int line, int depth);
+static void transpile_seq(struct TRANSPILER* t, struct STMT* stmt, struct STMT* stop, int depth);
+
+
+//
+// transpile_var
+//
+// Returns the number of the variable with the given name, adding
+// it if it's new.
+//
+static int transpile_var(struct TRANSPILER* t, char* name)
+{
+  for (int i = 0; i < t->num_names; i++)
+    if (strcmp(t->names[i], name) == 0)
+      return i;
+
+  if (t->num_names == t->names_capacity)
+  {
+    t->names_capacity *= 2;
+    t->names = (char**) realloc(t->names, t->names_capacity * sizeof(char*));
+
+    if (t->names == NULL)
+      exit(0);
+  }
+
+  t->names[t->num_names] = name;  // borrowed from the program graph
+  t->num_names++;
+
+  return t->num_names - 1;
+}
+
+//
+// transpile_indent
+//
+// Starts a line of main at the given nesting depth.
+//
+static void transpile_indent(struct TRANSPILER* t, int depth)
+{
+  for (int i = 0; i <= depth; i++)
+    fprintf(t->out, "  ");
+}
+
+//
+// transpile_string
+//
+// Writes s as a C string literal.
+//
+static void transpile_string(FILE* out, char* s)
+{
+  fputc('"', out);
+
+  for (unsigned char* c = (unsigned char*) s; *c != '\0'; c++)
+  {
+    if (*c == '"' || *c == '\\')
+      fprintf(out, "\\%c", *c);
+    else if (*c == '\n')
+      fprintf(out, "\\n");
+    else if (*c == '\t')
+      fprintf(out, "\\t");
+    else if (*c < 0x20 || *c >= 0x7F)
+      fprintf(out, "\\%03o", *c);  // octal: a hex escape would swallow following digits
+    else
+      fputc(*c, out);
+  }
+
+  fputc('"', out);
+}
+
+//
+// transpile_supported
+//
+// None isn't supported by the executor either.
+//
+static bool transpile_supported(struct TRANSPILER* t, struct ELEMENT* element, int line)
+{
+  switch (element->element_type)
+  {
+  case ELEMENT_IDENTIFIER:
+  case ELEMENT_INT_LITERAL:
+  case ELEMENT_REAL_LITERAL:
+  case ELEMENT_STR_LITERAL:
+  case ELEMENT_TRUE:
+  case ELEMENT_FALSE:
+    return true;
+
+  default:
+    printf("**ERROR: unsupported value for the C backend (line %d)\n", line);
+    t->ok = false;
+    return false;
+  }
+}
+
+//
+// transpile_element
+//
+// Writes the element as a C expression of type struct NU_VALUE.
+// Literals are converted the way execute.c converts them, so
+// the C compiler sees exactly the same values.
+//
+static void transpile_element(struct TRANSPILER* t, struct ELEMENT* element)
+{
+  char* value = element->element_value;
+
+  switch (element->element_type)
+  {
+  case ELEMENT_IDENTIFIER:
+    fprintf(t->out, "v%d", transpile_var(t, value));
+    break;
+
+  case ELEMENT_INT_LITERAL:
+  {
+    int i = atoi(value);
+
+    if (i == INT_MIN)
+      fprintf(t->out, "nu_int(-%d - 1)", INT_MAX);
+    else
+      fprintf(t->out, "nu_int(%d)", i);
+    break;
+  }
+
+  case ELEMENT_REAL_LITERAL:
+  {
+    double d = atof(value);
+
+    if (isinf(d))
+      fprintf(t->out, "nu_real(HUGE_VAL)");
+    else
+      fprintf(t->out, "nu_real(%a)", d);  // hex: exact
+    break;
+  }
+
+  case ELEMENT_STR_LITERAL:
+    fprintf(t->out, "nu_str(");
+    transpile_string(t->out, value);
+    fprintf(t->out, ")");
+    break;
+
+  case ELEMENT_TRUE:
+    fprintf(t->out, "nu_bool(true)");
+    break;
+
+  default:
+    fprintf(t->out, "nu_bool(false)");
+    break;
+  }
+}
+
+//
+// transpile_check
+//
+// If the element is a variable, writes the check that it has
+// been assigned.
+//
+static void transpile_check(struct TRANSPILER* t, struct ELEMENT* element, int line, int depth)
+{
+  if (element->element_type != ELEMENT_IDENTIFIER)
+    return;
+
+  transpile_indent(t, depth);
+  fprintf(t->out, "if (v%d.type == NU_UNDEFINED) { nu_undefined(", transpile_var(t, element->element_value));
+  transpile_string(t->out, element->element_value);
+  fprintf(t->out, ", %d); return nu_done(); }\n", line);
+}
+
+//
+// transpile_expr_ok
+//
+// Can the expression be translated? Its operands must be plain
+// elements (no unary operators), and the operator one of the
+// arithmetic or comparison operators.
+//
+static bool transpile_expr_ok(struct TRANSPILER* t, struct EXPR* expr, int line)
+{
+  if (expr->lhs == NULL || expr->lhs->expr_type != UNARY_ELEMENT ||
+      (expr->isBinaryExpr && (expr->rhs == NULL || expr->rhs->expr_type != UNARY_ELEMENT)))
+  {
+    printf("**ERROR: unary operators are not supported by the C backend (line %d)\n", line);
+    t->ok = false;
+    return false;
+  }
+
+  if (expr->isBinaryExpr && (expr->operator < OPERATOR_PLUS || expr->operator > OPERATOR_GTE))
+  {
+    printf("**ERROR: operator not supported by the C backend (line %d)\n", line);
+    t->ok = false;
+    return false;
+  }
+
+  if (!transpile_supported(t, expr->lhs->element, line))
+    return false;
+
+  return !expr->isBinaryExpr || transpile_supported(t, expr->rhs->element, line);
+}
+
+//
+// transpile_assignment
+//
+// x = expr, x = input("..."), x = int(y), x = float(y)
+//
+static void transpile_assignment(struct TRANSPILER* t, struct STMT* stmt, int depth)
+{
+  struct STMT_ASSIGNMENT* assign = stmt->types.assignment;
+  int line = stmt->line;
+
+  if (assign->isPtrDeref)
+  {
+    printf("**ERROR: pointers are not supported by the C backend (line %d)\n", line);
+    t->ok = false;
+    return;
+  }
+
+  int dst = transpile_var(t, assign->var_name);
+
+  if (assign->rhs->value_type == VALUE_FUNCTION_CALL)
+  {
+    struct FUNCTION_CALL* func = assign->rhs->types.function_call;
+    struct ELEMENT* param = func->parameter;
+
+    if (strcmp(func->function_name, "input") == 0 && param != NULL && param->element_type == ELEMENT_STR_LITERAL)
+    {
+      transpile_indent(t, depth);
+      fprintf(t->out, "nu_input(&v%d, ", dst);
+      transpile_string(t->out, param->element_value);
+      fprintf(t->out, ");\n");
+    }
+    else if ((strcmp(func->function_name, "int") == 0 || strcmp(func->function_name, "float") == 0) && param != NULL)
+    {
+      //
+      // like execute.c, the parameter is looked up by name
+      // whatever kind of element it is:
+      //
+      transpile_indent(t, depth);
+      fprintf(t->out, "if (!nu_convert(&v%d, &v%d, ", dst, transpile_var(t, param->element_value));
+      transpile_string(t->out, param->element_value);
+      fprintf(t->out, ", %s, %d)) return nu_done();\n", func->function_name[0] == 'i' ? "true" : "false", line);
+    }
+    else
+    {
+      printf("**ERROR: function '%s' is not supported by the C backend (line %d)\n", func->function_name, line);
+      t->ok = false;
+    }
+
+    return;
+  }
+
+  struct EXPR* expr = assign->rhs->types.expr;
+
+  if (!transpile_expr_ok(t, expr, line))
+    return;
+
+  struct ELEMENT* lhs = expr->lhs->element;
+
+  transpile_check(t, lhs, line, depth);
+
+  if (!expr->isBinaryExpr)
+  {
+    transpile_indent(t, depth);
+    fprintf(t->out, "nu_set(&v%d, ", dst);
+    transpile_element(t, lhs);
+    fprintf(t->out, ", false);\n");
+    return;
+  }
+
+  struct ELEMENT* rhs = expr->rhs->element;
+
+  transpile_check(t, rhs, line, depth);
+
+  //
+  // s = s + t appends in place when both are strings:
+  //
+  bool append = expr->operator == OPERATOR_PLUS && lhs->element_type == ELEMENT_IDENTIFIER &&
+                strcmp(lhs->element_value, assign->var_name) == 0 &&
+                (rhs->element_type == ELEMENT_IDENTIFIER || rhs->element_type == ELEMENT_STR_LITERAL);
+
+  transpile_indent(t, depth);
+
+  if (append)
+  {
+    bool self = rhs->element_type == ELEMENT_IDENTIFIER &&
+                strcmp(rhs->element_value, assign->var_name) == 0;
+
+    fprintf(t->out, "if (!nu_append(&v%d, ", dst);
+    transpile_element(t, rhs);
+    fprintf(t->out, ", %s))\n", self ? "true" : "false");
+    transpile_indent(t, depth + 1);
+  }
+
+  fprintf(t->out, "{ struct NU_VALUE r; if (!nu_binary(");
+  transpile_element(t, lhs);
+  fprintf(t->out, ", %s, ", transpile_operators[expr->operator]);
+  transpile_element(t, rhs);
+  fprintf(t->out, ", %d, &r)) return nu_done(); nu_set(&v%d, r, true); }\n", line, dst);
+}
+
+//
+// transpile_function_call
+//
+// print() or print(element)
+//
+static void transpile_function_call(struct TRANSPILER* t, struct STMT* stmt, int depth)
+{
+  struct STMT_FUNCTION_CALL* call = stmt->types.function_call;
+  struct ELEMENT* param = call->parameter;
+
+  if (strcmp(call->function_name, "print") != 0)
+  {
+    printf("**ERROR: function '%s' is not supported by the C backend (line %d)\n", call->function_name, stmt->line);
+    t->ok = false;
+    return;
+  }
+
+  if (param == NULL)
+  {
+    transpile_indent(t, depth);
+    fprintf(t->out, "printf(\"\\n\");\n");
+    return;
+  }
+
+  if (!transpile_supported(t, param, stmt->line))
+    return;
+
+  transpile_check(t, param, stmt->line, depth);
+
+  transpile_indent(t, depth);
+  fprintf(t->out, "nu_print(");
+  transpile_element(t, param);
+  fprintf(t->out, ");\n");
+}
+
+//
+// transpile_condition
+//
+// Writes the evaluation of a while or if condition into the
+// variable holds, which the caller declares.
+//
+static void transpile_condition(struct TRANSPILER* t, struct EXPR* condition, int line, int depth)
+{
+  if (!transpile_expr_ok(t, condition, line))
+    return;
+
+  transpile_check(t, condition->lhs->element, line, depth);
+
+  if (!condition->isBinaryExpr)
+  {
+    transpile_indent(t, depth);
+    fprintf(t->out, "holds = nu_is_true(");
+    transpile_element(t, condition->lhs->element);
+    fprintf(t->out, ");\n");
+    return;
+  }
+
+  transpile_check(t, condition->rhs->element, line, depth);
+
+  transpile_indent(t, depth);
+  fprintf(t->out, "if (!nu_condition(");
+  transpile_element(t, condition->lhs->element);
+  fprintf(t->out, ", %s, ", transpile_operators[condition->operator]);
+  transpile_element(t, condition->rhs->element);
+  fprintf(t->out, ", %d, &holds)) return nu_done();\n", line);
+}
+
+//
+// transpile_seq
+//
+// Translates stmt and the stmts that follow it, up to (but not
+// including) stop.
+//
+static void transpile_seq(struct TRANSPILER* t, struct STMT* stmt, struct STMT* stop, int depth)
+{
+  while (stmt != NULL && stmt != stop && t->ok)
+  {
+    transpile_indent(t, depth);
+    fprintf(t->out, "// line %d\n", stmt->line);
+
+    if (stmt->stmt_type == STMT_ASSIGNMENT)
+    {
+      transpile_assignment(t, stmt, depth);
+      stmt = stmt->types.assignment->next_stmt;
+    }
+    else if (stmt->stmt_type == STMT_FUNCTION_CALL)
+    {
+      transpile_function_call(t, stmt, depth);
+      stmt = stmt->types.function_call->next_stmt;
+    }
+    else if (stmt->stmt_type == STMT_WHILE_LOOP)
+    {
+      struct STMT_WHILE_LOOP* loop = stmt->types.while_loop;
+
+      transpile_indent(t, depth);
+      fprintf(t->out, "while (true)\n");
+      transpile_indent(t, depth);
+      fprintf(t->out, "{\n");
+      transpile_indent(t, depth + 1);
+      fprintf(t->out, "bool holds;\n");
+
+      transpile_condition(t, loop->condition, stmt->line, depth + 1);
+
+      transpile_indent(t, depth + 1);
+      fprintf(t->out, "if (!holds)\n");
+      transpile_indent(t, depth + 2);
+      fprintf(t->out, "break;\n\n");
+
+      transpile_seq(t, loop->loop_body, stmt, depth + 1);  // body links back to the loop
+
+      transpile_indent(t, depth);
+      fprintf(t->out, "}\n\n");
+
+      stmt = loop->next_stmt;
+    }
+    else if (stmt->stmt_type == STMT_IF_THEN_ELSE)
+    {
+      struct STMT_IF_THEN_ELSE* if_then_else = stmt->types.if_then_else;
+      struct STMT* join = walk_join(stmt, stop);
+
+      transpile_indent(t, depth);
+      fprintf(t->out, "{\n");
+      transpile_indent(t, depth + 1);
+      fprintf(t->out, "bool holds;\n");
+
+      transpile_condition(t, if_then_else->condition, stmt->line, depth + 1);
+
+      transpile_indent(t, depth + 1);
+      fprintf(t->out, "if (holds)\n");
+      transpile_indent(t, depth + 1);
+      fprintf(t->out, "{\n");
+      transpile_seq(t, if_then_else->true_path, join, depth + 2);
+      transpile_indent(t, depth + 1);
+      fprintf(t->out, "}\n");
+      transpile_indent(t, depth + 1);
+      fprintf(t->out, "else\n");
+      transpile_indent(t, depth + 1);
+      fprintf(t->out, "{\n");
+      transpile_seq(t, if_then_else->false_path, join, depth + 2);
+      transpile_indent(t, depth + 1);
+      fprintf(t->out, "}\n");
+
+      transpile_indent(t, depth);
+      fprintf(t->out, "}\n\n");
+
+      stmt = join;
+    }
+    else if (stmt->stmt_type == STMT_PASS)
+    {
+      stmt = stmt->types.pass->next_stmt;
+    }
+    else
+    {
+      printf("**ERROR: statement not supported by the C backend (line %d)\n", stmt->line);
+      t->ok = false;
+    }
+  }
+}
+
+
+//
+// Public functions:
+//
+
+//
+// transpile
+//
+// Writes the program as C to out, returns false if unsupported.
+//
+bool transpile(struct STMT* program, FILE* out)
+{
+  struct TRANSPILER t;
+
+  //
+  // the variables are only known once main is done, so main
+  // is written to a temporary file first:
+  //
+  t.out = tmpfile();
+  t.ok = true;
+  t.num_names = 0;
+  t.names_capacity = 16;
+  t.names = (char**) malloc(t.names_capacity * sizeof(char*));
+
+  if (t.out == NULL || t.names == NULL)
+  {
+    printf("**ERROR: unable to create a temporary file for the C backend\n");
+    free(t.names);
+    return false;
+  }
+
+  transpile_seq(&t, program, NULL, 0);
+
+  if (t.ok)
+  {
+    fprintf(out, "//\n");
+    fprintf(out, "// Generated from a nuPython program; compile with\n");
+    fprintf(out, "//\n");
+    fprintf(out, "//   gcc -std=c11 -O2 program.c -lm\n");
+    fprintf(out, "//\n\n");
+
+    for (int i = 0; transpile_runtime[i] != NULL; i++)
+      fprintf(out, "%s\n", transpile_runtime[i]);
+
+    fprintf(out, "\n");
+
+    for (int i = 0; i < t.num_names; i++)
+    {
+      //
+      // named in a comment, unless the name came from int("...")
+      // and could end the comment:
+      //
+      bool plain = true;
+
+      for (char* c = t.names[i]; *c != '\0'; c++)
+        plain = plain && (isalnum((unsigned char) *c) || *c == '_');
+
+      fprintf(out, "static struct NU_VALUE v%d;", i);
+      fprintf(out, plain ? "  // %s\n" : "\n", t.names[i]);
+    }
+
+    fprintf(out, "\nint main(void)\n{\n");
+
+    rewind(t.out);
+
+    int c;
+
+    while ((c = fgetc(t.out)) != EOF)
+      fputc(c, out);
+
+    fprintf(out, "  return nu_done();\n");
+    fprintf(out, "}\n");
+  }
+
+  fclose(t.out);
+  free(t.names);
+
+  return t.ok;
+}
@@ -0,0 +1,42 @@
+/*transpile.h*/
+
+//
+// Ahead-of-time C backend for nuPython: translates a program
+// graph into a self-contained C program that, compiled with e.g.
+//
+//   gcc -std=c11 -O2 job.c -lm
+//
+// produces the same output and the same error messages as
+// executing the program, without the interpreter. Variables
+// become C variables holding a tagged value with the types of a
+// struct RAM_VALUE, so they can still change type at run time;
+// reading one before it's assigned is the usual semantic error.
+//
+// Jad Dibs
+//
+// Northwestern University
+// CS 211
+//
+
+#pragma once
+
+#include <stdio.h>
+#include <stdbool.h>  // true, false
+
+#include "programgraph.h"
+
+
+//
+// Public functions:
+//
+
+//
+// transpile
+//
+// Writes the C translation of the program to the given file.
+// Returns false if the program uses something the executor
+// doesn't support either (e.g. pointers, unary operators, or
+// None); an error message is printed, and what was written to
+// the file is incomplete.
+//
+bool transpile(struct STMT* program, FILE* out);
@@ -0,0 +1,143 @@
+/*value.h*/
+
+//
+// Values of the nuPython interpreter: the registers of the
+// virtual machine (see vm.h) and the intermediate values of the
+// tree-walking executor. Values are only created and inspected
+// through the functions below, so the representation can change
+// without touching either engine.
+//
+// A value is 8 bytes, NaN-boxed: a real is stored as its IEEE
+// double bits; every other type is stored in the bit patterns of
+// negative quiet NaNs, which no arithmetic produces once NaNs
+// are made canonical (positive) on the way in:
+//
+//   real:   any double, NaNs canonical     0x7FF8000000000000
+//   others: 1111 1111 1111 1ttt pppp ... pppp
+//           sign, exponent and quiet bit set, 3-bit tag t,
+//           48-bit payload p (int, bool, or string pointer)
+//
+// User-space pointers fit in 48 bits on x86-64 and AArch64.
+//
+// Jad Dibs
+//
+// Northwestern University
+// CS 211
+//
+
+#pragma once
+
+#include <stdbool.h>  // true, false
+#include <stdint.h>
+#include <string.h>   // memcpy
+#include <assert.h>
+
+
+//
+// What type of value is it?
+//
+enum VM_TAGS
+{
+  VM_UNDEFINED = 0,  // variable not yet assigned
+  VM_INT,
+  VM_REAL,
+  VM_STR,
+  VM_BOOL,
+  VM_NONE
+};
+
+struct VM_VALUE
+{
+  uint64_t bits;
+};
+
+_Static_assert(sizeof(struct VM_VALUE) == 8, "a value must fit in a register");
+
+#define VM_BOXED       0xFFF8000000000000ULL  // negative quiet NaN
+#define VM_CANON_NAN   0x7FF8000000000000ULL
+#define VM_TAG_SHIFT   48
+#define VM_PAYLOAD     0x0000FFFFFFFFFFFFULL
+
+
+//
+// constructors:
+//
+static inline struct VM_VALUE vm_box(int tag, uint64_t payload)
+{
+  struct VM_VALUE v;
+  v.bits = VM_BOXED | ((uint64_t) tag << VM_TAG_SHIFT) | payload;
+  return v;
+}
+
+static inline struct VM_VALUE vm_undefined(void)
+{
+  return vm_box(VM_UNDEFINED, 0);
+}
+
+static inline struct VM_VALUE vm_none(void)
+{
+  return vm_box(VM_NONE, 0);
+}
+
+static inline struct VM_VALUE vm_int(int i)
+{
+  return vm_box(VM_INT, (uint32_t) i);
+}
+
+static inline struct VM_VALUE vm_real(double d)
+{
+  struct VM_VALUE v;
+
+  if (d != d)  // NaN, must not look like a boxed value
+    v.bits = VM_CANON_NAN;
+  else
+    memcpy(&v.bits, &d, sizeof(d));
+
+  return v;
+}
+
+static inline struct VM_VALUE vm_bool(bool b)
+{
+  return vm_box(VM_BOOL, b ? 1 : 0);
+}
+
+static inline struct VM_VALUE vm_str(char* s)
+{
+  assert(((uintptr_t) s & ~VM_PAYLOAD) == 0);
+
+  return vm_box(VM_STR, (uintptr_t) s);
+}
+
+
+//
+// inspectors; the as_ functions assume the tag was checked:
+//
+static inline int vm_tag(struct VM_VALUE v)
+{
+  if (v.bits < VM_BOXED)
+    return VM_REAL;
+
+  return (int) ((v.bits >> VM_TAG_SHIFT) & 0x7);
+}
+
+static inline int vm_as_int(struct VM_VALUE v)
+{
+  return (int) (uint32_t) v.bits;
+}
+
+static inline double vm_as_real(struct VM_VALUE v)
+{
+  double d;
+  memcpy(&d, &v.bits, sizeof(d));
+  return d;
+}
+
+static inline bool vm_as_bool(struct VM_VALUE v)
+{
+  return (v.bits & 1) != 0;
+}
+
+static inline char* vm_as_str(struct VM_VALUE v)
+{
+  return (char*) (uintptr_t) (v.bits & VM_PAYLOAD);
+}
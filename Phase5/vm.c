@@ -0,0 +1,3638 @@
+/*vm.c*/
+
+//
+// Register-based virtual machine for nuPython.
+//
+// Jad Dibs
+//
+// Northwestern University
+// CS 211
+//
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdbool.h>  // true, false
+#include <string.h>
+#include <assert.h>
+#include <math.h>
+#include <limits.h>
+#include <stdatomic.h>
+
+#include "programgraph.h"
+#include "walk.h"
+#include "ram.h"
+#include "output.h"
+#include "strbuild.h"
+#include "arith.h"
+#include "value.h"
+#include "budget.h"
+#include "input.h"
+#include "context.h"
+#include "vm.h"
+#include "jit.h"
+#include "alloc.h"
+
+
+//
+// While compiling, the number of variables isn't known yet, so
+// literals and temporaries are numbered from OTHER_BASE and moved
+// to just after the variables once compilation is done:
+//
+#define OTHER_BASE (1 << 24)
+
+//
+// Type sets used by the type analysis: bit (1 << tag) is set if
+// the register may hold a value with that tag:
+//
+#define TS(tag)    ((unsigned char) (1 << (tag)))
+#define TS_ANY     ((unsigned char) (TS(VM_UNDEFINED) | TS(VM_INT) | TS(VM_REAL) | TS(VM_STR) | TS(VM_BOOL) | TS(VM_NONE)))
+
+//
+// Value ranges used by the range analysis, for registers known
+// to hold ints: the value is in lo..hi (the range is empty, lo >
+// hi, on a path that can't be taken), and isn't 0 if nonzero
+// (e.g. after if x != 0:, where the range can't say so). Ranges
+// at the top of a loop that are still growing after coming round
+// the loop VM_WIDEN_AFTER times are widened to the int limits, so
+// loops reach a fixed point quickly.
+//
+#define VM_WIDEN_AFTER 4
+
+//
+// The analysis keeps a state per basic block for each variable
+// and temporary; programs with more (block, register) pairs than
+// this (e.g. thousands of ifs, each assigning new variables) are
+// left untyped rather than analyzed in quadratic memory and time:
+//
+#define VM_MAX_ANALYSIS (1 << 18)
+
+//
+// Names and literals are looked up in the compiler by FNV-1a hash:
+//
+#define VM_HASH_SEED 14695981039346656037ULL
+#define VM_HASH_PRIME 1099511628211ULL
+
+struct VM_RANGE
+{
+  int lo;
+  int hi;
+  bool nonzero;
+};
+
+struct COMPILER
+{
+  struct VM_CODE* code;
+  bool ok;  // false => program uses something we can't compile
+
+  //
+  // literals and temporaries, numbered from OTHER_BASE:
+  //
+  struct VM_VALUE* others;
+  bool* others_literal;
+  int num_others;
+  int others_capacity;
+
+  //
+  // each distinct literal gets one register: a hash table of the
+  // literals in others, by value (index + 1, 0 => empty slot):
+  //
+  int* literals;
+  int num_literals;
+  int literals_capacity;  // a power of 2
+
+  //
+  // the same for the variables, by name (index into vars + 1):
+  //
+  int* names;
+  int names_capacity;     // a power of 2
+
+  int pending;  // # of stmts compiled since the last instruction
+};
+
+//
+// State of a running VM
+//
+struct VM_STATE
+{
+  struct VM_CODE* code;
+  struct VM_VALUE* regs;
+  int* addresses;   // memory address of each variable, -1 => not in memory yet
+  struct RAM* memory;
+  struct OUTPUT* output;
+  struct INPUT* input;
+  struct STR_BUILDERS* strings;
+
+  //
+  // when running on a budget: before[pc] is the # of stmts that
+  // start before instruction pc, and the instructions from entry
+  // on have run without a jump, so haven't been counted yet:
+  //
+  struct BUDGET* budget;
+  int* before;
+  int entry;
+};
+
+//
+// Opcode names, in the order of enum VM_OPCODES
+//
+static const char* vm_names[] =
+{
+  "halt", "move", "binary",
+  "add_ii", "sub_ii", "mul_ii", "pow_ii", "mod_ii", "div_ii",
+  "eq_ii", "ne_ii", "lt_ii", "le_ii", "gt_ii", "ge_ii",
+  "add_rr", "sub_rr", "mul_rr", "pow_rr", "mod_rr", "div_rr",
+  "eq_rr", "ne_rr", "lt_rr", "le_rr", "gt_rr", "ge_rr",
+  "move_raw", "jump", "jump_if_false", "jump_if_false_bool",
+  "print", "print_newline", "input", "to_int", "to_float",
+  "add_imm_ii",
+  "jump_unless_eq_ii", "jump_unless_ne_ii", "jump_unless_lt_ii",
+  "jump_unless_le_ii", "jump_unless_gt_ii", "jump_unless_ge_ii",
+  "jump_unless_eq_rr", "jump_unless_ne_rr", "jump_unless_lt_rr",
+  "jump_unless_le_rr", "jump_unless_gt_rr", "jump_unless_ge_rr",
+  "print_int", "print_real", "print_str",
+  "div_nz_ii", "mod_nz_ii",
+  "counted_loop"
+};
+
+_Static_assert(sizeof(vm_names) / sizeof(vm_names[0]) == VM_NUM_OPCODES, "one name per opcode");
+
+
+//
+// Private functions:
+//
+static int vm_emit(struct COMPILER* c, int opcode, int dst, int a, int b, int operator, int line);
+static int vm_var(struct COMPILER* c, char* name);
+static int vm_other(struct COMPILER* c, struct VM_VALUE initial, bool literal);
+static uint64_t vm_hash_chars(uint64_t hash, const char* s);
+static uint64_t vm_literal_hash(struct VM_VALUE value);
+static int vm_literal(struct COMPILER* c, struct VM_VALUE value);
+static int vm_element(struct COMPILER* c, struct ELEMENT* element);
+static int vm_unary(struct COMPILER* c, struct UNARY_EXPR* unary);
+static void vm_compile_expr(struct COMPILER* c, struct EXPR* expr, int dst, int line);
+static void vm_compile_assignment(struct COMPILER* c, struct STMT* stmt);
+static void vm_compile_function_call(struct COMPILER* c, struct STMT* stmt);
+static void vm_compile_seq(struct COMPILER* c, struct STMT* stmt, struct STMT* stop);
+static void vm_finish(struct COMPILER* c);
+static unsigned char vm_binary_types(int operator, unsigned char lhs, unsigned char rhs);
+static int vm_binary_tag(int lhs, int operator, int rhs);
+static struct VM_RANGE vm_range(long long lo, long long hi);
+static bool vm_excludes_zero(struct VM_RANGE range);
+static struct VM_RANGE vm_union(struct VM_RANGE x, struct VM_RANGE y);
+static struct VM_RANGE vm_binary_range(int operator, struct VM_RANGE l, struct VM_RANGE r);
+static void vm_refine(struct VM_RANGE* ranges, int operator, int a, int b, bool holds);
+static bool vm_safe_division(struct VM_RANGE l, struct VM_RANGE r);
+static void vm_transfer(struct VM_INSTR* instr, unsigned char* types, struct VM_RANGE* ranges);
+static void vm_analyze(struct VM_CODE* code, int* typed);
+static void vm_specialize(struct VM_CODE* code, int pc, unsigned char* in, struct VM_RANGE* in_ranges, int* typed);
+static bool vm_raw_writable(struct VM_CODE* code, unsigned char* types, int reg);
+static int vm_written(struct VM_INSTR* instr);
+static bool vm_invariant(struct VM_CODE* code, int* typed, int pc, int top, int bottom);
+static int vm_relocate(int target, int from, int top, int bottom, int k);
+static bool vm_hoist_loop(struct VM_CODE* code, int** typed, int top, int bottom);
+static void vm_hoist(struct VM_CODE* code, int** typed);
+static int vm_count_operand(struct COMPILER* c, struct UNARY_EXPR* unary);
+static int vm_count_degree(struct VM_COUNTED* loop, int* degrees, int k, int reg);
+static void vm_recognize_counted(struct COMPILER* c, struct STMT* stmt);
+static void vm_count_loops(struct VM_CODE* code);
+static bool vm_reads(struct VM_INSTR* instr, int reg);
+static bool vm_is_target(struct VM_CODE* code, int pc);
+static void vm_fuse(struct VM_CODE* code, int* typed);
+static inline int vm_jump(struct VM_STATE* vm, int from, int to);
+static bool vm_execute(struct VM_CODE* code, struct CONTEXT* context);
+static int vm_compare_pairs(const void* x, const void* y);
+static void vm_print_operand(struct VM_CODE* code, int reg);
+static bool vm_defined(struct VM_STATE* vm, int reg, int line);
+static void vm_set(struct VM_STATE* vm, int reg, struct VM_VALUE value);
+static void vm_power_sums(long long n, uint32_t sums[VM_COUNTED_MAX_DEGREE + 1]);
+static void vm_counted_poly(struct VM_STATE* vm, struct VM_COUNTED* loop, int k, int reg,
+                            uint32_t* counter, uint32_t (*values)[VM_COUNTED_MAX_DEGREE + 1], uint32_t* poly);
+static bool vm_run_counted(struct VM_STATE* vm, struct VM_COUNTED* loop);
+static bool vm_binary(struct VM_STATE* vm, struct VM_INSTR* instr);
+static bool vm_is_true(struct VM_VALUE value);
+static void vm_load(struct VM_STATE* vm);
+static void vm_store(struct VM_STATE* vm);
+static struct RAM_VALUE vm_to_ram(struct VM_VALUE value);
+static struct VM_VALUE vm_from_ram(struct RAM_VALUE* value);
+
+
+//
+// Compiler
+//
+
+//
+// vm_emit
+//
+// Appends an instruction to the code, returns its index.
+//
+static int vm_emit(struct COMPILER* c, int opcode, int dst, int a, int b, int operator, int line)
+{
+  struct VM_CODE* code = c->code;
+
+  if (code->num_instrs == code->instrs_capacity)
+  {
+    code->instrs_capacity *= 2;
+    code->instrs = (struct VM_INSTR*) realloc(code->instrs, code->instrs_capacity * sizeof(struct VM_INSTR));
+
+    if (code->instrs == NULL)
+      exit(0);
+  }
+
+  struct VM_INSTR* instr = &code->instrs[code->num_instrs];
+
+  instr->opcode = opcode;
+  instr->operator = operator;
+  instr->dst = dst;
+  instr->a = a;
+  instr->b = b;
+  instr->line = line;
+  instr->stmts = c->pending;
+
+  c->pending = 0;
+  code->num_instrs++;
+
+  return code->num_instrs - 1;
+}
+
+//
+// vm_hash_chars
+//
+// Returns hash with the chars of s mixed in.
+//
+static uint64_t vm_hash_chars(uint64_t hash, const char* s)
+{
+  for (; *s != '\0'; s++)
+    hash = (hash ^ (unsigned char) *s) * VM_HASH_PRIME;
+
+  return hash;
+}
+
+//
+// vm_var
+//
+// Returns the register of the given variable, adding it if
+// this is the first time we've seen it.
+//
+static int vm_var(struct COMPILER* c, char* name)
+{
+  struct VM_CODE* code = c->code;
+  int mask = c->names_capacity - 1;
+  int slot = (int) (vm_hash_chars(VM_HASH_SEED, name) & mask);
+
+  while (c->names[slot] != 0)
+  {
+    if (strcmp(code->vars[c->names[slot] - 1].name, name) == 0)
+      return c->names[slot] - 1;
+
+    slot = (slot + 1) & mask;
+  }
+
+  if (code->num_vars == code->vars_capacity)
+  {
+    code->vars_capacity *= 2;
+    code->vars = (struct VM_VAR*) realloc(code->vars, code->vars_capacity * sizeof(struct VM_VAR));
+
+    if (code->vars == NULL)
+      exit(0);
+  }
+
+  code->vars[code->num_vars].name = name;
+  code->num_vars++;
+
+  c->names[slot] = code->num_vars;
+
+  //
+  // at most half full, so the probes stay short:
+  //
+  if (2 * code->num_vars > c->names_capacity)
+  {
+    free(c->names);
+
+    c->names_capacity *= 2;
+    c->names = (int*) calloc(c->names_capacity, sizeof(int));
+
+    if (c->names == NULL)
+      exit(0);
+
+    mask = c->names_capacity - 1;
+
+    for (int v = 0; v < code->num_vars; v++)
+    {
+      slot = (int) (vm_hash_chars(VM_HASH_SEED, code->vars[v].name) & mask);
+
+      while (c->names[slot] != 0)
+        slot = (slot + 1) & mask;
+
+      c->names[slot] = v + 1;
+    }
+  }
+
+  return code->num_vars - 1;
+}
+
+//
+// vm_other
+//
+// Adds a literal or temporary register with the given initial
+// value, returns its (not yet final) register number.
+//
+static int vm_other(struct COMPILER* c, struct VM_VALUE initial, bool literal)
+{
+  if (c->num_others == c->others_capacity)
+  {
+    c->others_capacity *= 2;
+    c->others = (struct VM_VALUE*) realloc(c->others, c->others_capacity * sizeof(struct VM_VALUE));
+    c->others_literal = (bool*) realloc(c->others_literal, c->others_capacity * sizeof(bool));
+
+    if (c->others == NULL || c->others_literal == NULL)
+      exit(0);
+  }
+
+  c->others[c->num_others] = initial;
+  c->others_literal[c->num_others] = literal;
+  c->num_others++;
+
+  return OTHER_BASE + c->num_others - 1;
+}
+
+//
+// vm_literal_hash
+//
+// Returns the hash of a literal's value: of the chars of a
+// string, of the bits of anything else.
+//
+static uint64_t vm_literal_hash(struct VM_VALUE value)
+{
+  uint64_t hash = VM_HASH_SEED;
+
+  if (vm_tag(value) == VM_STR)
+    return vm_hash_chars(hash, vm_as_str(value));
+
+  for (int i = 0; i < 64; i += 8)
+    hash = (hash ^ ((value.bits >> i) & 0xFF)) * VM_HASH_PRIME;
+
+  return hash;
+}
+
+//
+// vm_literal
+//
+// Returns the register holding the given literal, adding one if
+// it's the first literal with that value. Literal registers are
+// never written, so every 1 (say) in the program can share one,
+// and a long script doesn't need a register per literal.
+//
+static int vm_literal(struct COMPILER* c, struct VM_VALUE value)
+{
+  bool is_str = (vm_tag(value) == VM_STR);
+  int mask = c->literals_capacity - 1;
+  int slot = (int) (vm_literal_hash(value) & mask);
+
+  while (c->literals[slot] != 0)
+  {
+    struct VM_VALUE other = c->others[c->literals[slot] - 1];
+
+    if (is_str ? (vm_tag(other) == VM_STR && strcmp(vm_as_str(other), vm_as_str(value)) == 0) : other.bits == value.bits)
+      return OTHER_BASE + c->literals[slot] - 1;
+
+    slot = (slot + 1) & mask;
+  }
+
+  int reg = vm_other(c, value, true);
+
+  c->literals[slot] = reg - OTHER_BASE + 1;
+  c->num_literals++;
+
+  //
+  // at most half full, so the probes stay short:
+  //
+  if (2 * c->num_literals > c->literals_capacity)
+  {
+    int* old = c->literals;
+    int old_capacity = c->literals_capacity;
+
+    c->literals_capacity *= 2;
+    c->literals = (int*) calloc(c->literals_capacity, sizeof(int));
+
+    if (c->literals == NULL)
+      exit(0);
+
+    mask = c->literals_capacity - 1;
+
+    for (int i = 0; i < old_capacity; i++)
+    {
+      if (old[i] == 0)
+        continue;
+
+      slot = (int) (vm_literal_hash(c->others[old[i] - 1]) & mask);
+
+      while (c->literals[slot] != 0)
+        slot = (slot + 1) & mask;
+
+      c->literals[slot] = old[i];
+    }
+
+    free(old);
+  }
+
+  return reg;
+}
+
+//
+// vm_element
+//
+// Returns the register holding the given identifier or literal.
+//
+static int vm_element(struct COMPILER* c, struct ELEMENT* element)
+{
+  char* value = element->element_value;
+
+  switch (element->element_type)
+  {
+  case ELEMENT_IDENTIFIER:
+    return vm_var(c, value);
+
+  case ELEMENT_INT_LITERAL:
+    return vm_literal(c, vm_int(atoi(value)));
+
+  case ELEMENT_REAL_LITERAL:
+    return vm_literal(c, vm_real(atof(value)));
+
+  case ELEMENT_STR_LITERAL:
+    return vm_literal(c, vm_str(value));  // borrowed from the program graph
+
+  case ELEMENT_TRUE:
+    return vm_literal(c, vm_bool(true));
+
+  case ELEMENT_FALSE:
+    return vm_literal(c, vm_bool(false));
+
+  default:
+    //
+    // None isn't supported by the executor either:
+    //
+    c->ok = false;
+    return 0;
+  }
+}
+
+//
+// vm_unary
+//
+// Returns the register holding the value of the unary expr.
+//
+static int vm_unary(struct COMPILER* c, struct UNARY_EXPR* unary)
+{
+  if (unary == NULL || unary->expr_type != UNARY_ELEMENT)  // no unary operators yet
+  {
+    c->ok = false;
+    return 0;
+  }
+
+  return vm_element(c, unary->element);
+}
+
+//
+// vm_compile_expr
+//
+// Emits code to compute the expression into register dst.
+//
+static void vm_compile_expr(struct COMPILER* c, struct EXPR* expr, int dst, int line)
+{
+  int lhs = vm_unary(c, expr->lhs);
+
+  if (!expr->isBinaryExpr)
+  {
+    vm_emit(c, VM_MOVE, dst, lhs, 0, OPERATOR_NO_OP, line);
+    return;
+  }
+
+  if (expr->operator < OPERATOR_PLUS || expr->operator > OPERATOR_GTE)  // is, in
+  {
+    c->ok = false;
+    return;
+  }
+
+  int rhs = vm_unary(c, expr->rhs);
+
+  vm_emit(c, VM_BINARY, dst, lhs, rhs, expr->operator, line);
+}
+
+//
+// vm_compile_assignment
+//
+// x = expr, x = input("..."), x = int(y), x = float(y)
+//
+static void vm_compile_assignment(struct COMPILER* c, struct STMT* stmt)
+{
+  struct STMT_ASSIGNMENT* assign = stmt->types.assignment;
+
+  if (assign->isPtrDeref)
+  {
+    c->ok = false;
+    return;
+  }
+
+  int dst = vm_var(c, assign->var_name);
+
+  if (assign->rhs->value_type == VALUE_EXPR)
+  {
+    vm_compile_expr(c, assign->rhs->types.expr, dst, stmt->line);
+    return;
+  }
+
+  struct FUNCTION_CALL* func = assign->rhs->types.function_call;
+  struct ELEMENT* param = func->parameter;
+
+  if (strcmp(func->function_name, "input") == 0 && param != NULL && param->element_type == ELEMENT_STR_LITERAL)
+  {
+    vm_emit(c, VM_INPUT, dst, vm_element(c, param), 0, OPERATOR_NO_OP, stmt->line);
+  }
+  else if (strcmp(func->function_name, "int") == 0 && param != NULL)
+  {
+    //
+    // the parameter is always looked up as a variable name:
+    //
+    vm_emit(c, VM_TO_INT, dst, vm_var(c, param->element_value), 0, OPERATOR_NO_OP, stmt->line);
+  }
+  else if (strcmp(func->function_name, "float") == 0 && param != NULL)
+  {
+    vm_emit(c, VM_TO_FLOAT, dst, vm_var(c, param->element_value), 0, OPERATOR_NO_OP, stmt->line);
+  }
+  else
+  {
+    c->ok = false;
+  }
+}
+
+//
+// vm_compile_function_call
+//
+// print() or print(element)
+//
+static void vm_compile_function_call(struct COMPILER* c, struct STMT* stmt)
+{
+  struct STMT_FUNCTION_CALL* call = stmt->types.function_call;
+
+  if (strcmp(call->function_name, "print") != 0)
+  {
+    c->ok = false;
+    return;
+  }
+
+  if (call->parameter == NULL)
+    vm_emit(c, VM_PRINT_NEWLINE, 0, 0, 0, OPERATOR_NO_OP, stmt->line);
+  else
+    vm_emit(c, VM_PRINT, 0, vm_element(c, call->parameter), 0, OPERATOR_NO_OP, stmt->line);
+}
+
+//
+// vm_compile_seq
+//
+// Compiles stmt and the stmts that follow it, up to (but not
+// including) stop.
+//
+static void vm_compile_seq(struct COMPILER* c, struct STMT* stmt, struct STMT* stop)
+{
+  while (stmt != NULL && stmt != stop && c->ok)
+  {
+    c->pending++;  // counted at the stmt's first instruction
+
+    if (stmt->stmt_type == STMT_ASSIGNMENT)
+    {
+      vm_compile_assignment(c, stmt);
+      stmt = stmt->types.assignment->next_stmt;
+    }
+    else if (stmt->stmt_type == STMT_FUNCTION_CALL)
+    {
+      vm_compile_function_call(c, stmt);
+      stmt = stmt->types.function_call->next_stmt;
+    }
+    else if (stmt->stmt_type == STMT_WHILE_LOOP)
+    {
+      struct STMT_WHILE_LOOP* loop = stmt->types.while_loop;
+
+      //
+      // top: if not condition: goto exit
+      //      body
+      //      goto top
+      // exit:
+      //
+      //
+      // the stmts before the loop can't be counted at its top,
+      // which runs every time around:
+      //
+      if (c->pending > 1)
+      {
+        c->pending--;
+        vm_emit(c, VM_JUMP, 0, c->code->num_instrs + 1, 0, OPERATOR_NO_OP, stmt->line);
+        c->pending = 1;
+      }
+
+      int cond = vm_other(c, vm_undefined(), false);
+      int top = c->code->num_instrs;
+
+      vm_compile_expr(c, loop->condition, cond, stmt->line);
+      int branch = vm_emit(c, VM_JUMP_IF_FALSE, 0, cond, -1, OPERATOR_NO_OP, stmt->line);
+
+      vm_compile_seq(c, loop->loop_body, stmt);  // body links back to the loop
+      vm_emit(c, VM_JUMP, 0, top, 0, OPERATOR_NO_OP, stmt->line);
+
+      c->code->instrs[branch].b = c->code->num_instrs;
+
+      vm_recognize_counted(c, stmt);
+
+      stmt = loop->next_stmt;
+    }
+    else if (stmt->stmt_type == STMT_IF_THEN_ELSE)
+    {
+      struct STMT_IF_THEN_ELSE* if_then_else = stmt->types.if_then_else;
+      struct STMT* join = walk_join(stmt, stop);
+
+      //
+      //      if not condition: goto else
+      //      true path
+      //      goto join
+      // else:
+      //      false path
+      // join:
+      //
+      int cond = vm_other(c, vm_undefined(), false);
+
+      vm_compile_expr(c, if_then_else->condition, cond, stmt->line);
+      int branch = vm_emit(c, VM_JUMP_IF_FALSE, 0, cond, -1, OPERATOR_NO_OP, stmt->line);
+
+      vm_compile_seq(c, if_then_else->true_path, join);
+      int skip = vm_emit(c, VM_JUMP, 0, -1, 0, OPERATOR_NO_OP, stmt->line);
+
+      c->code->instrs[branch].b = c->code->num_instrs;
+
+      vm_compile_seq(c, if_then_else->false_path, join);
+
+      //
+      // a pass at the end of the false path has no instruction
+      // of its own to be counted at, and the join is reached from
+      // the true path too:
+      //
+      if (c->pending > 0)
+        vm_emit(c, VM_JUMP, 0, c->code->num_instrs + 1, 0, OPERATOR_NO_OP, stmt->line);
+
+      c->code->instrs[skip].a = c->code->num_instrs;
+
+      stmt = join;
+    }
+    else if (stmt->stmt_type == STMT_PASS)
+    {
+      stmt = stmt->types.pass->next_stmt;
+    }
+    else
+    {
+      c->ok = false;
+    }
+  }
+}
+
+//
+// vm_finish
+//
+// Moves temporaries and then literals to the registers after the
+// variables, and renumbers the operands that refer to them.
+// Literals go last so the type analysis can leave them out of the
+// state it keeps per block (see vm_analyze).
+//
+static void vm_finish(struct COMPILER* c)
+{
+  struct VM_CODE* code = c->code;
+
+  code->num_regs = code->num_vars + c->num_others;
+  code->regs_capacity = code->num_regs;
+
+  code->initial = (struct VM_VALUE*) malloc((code->num_regs + 1) * sizeof(struct VM_VALUE));
+  code->is_literal = (bool*) malloc((code->num_regs + 1) * sizeof(bool));
+  int* placed = (int*) malloc((c->num_others + 1) * sizeof(int));  // register of each other
+
+  if (code->initial == NULL || code->is_literal == NULL || placed == NULL)
+    exit(0);
+
+  for (int r = 0; r < code->num_vars; r++)
+  {
+    code->initial[r] = vm_undefined();
+    code->is_literal[r] = false;
+  }
+
+  int next = code->num_vars;
+
+  for (int pass = 0; pass < 2; pass++)  // temporaries, then literals
+  {
+    for (int o = 0; o < c->num_others; o++)
+    {
+      if (c->others_literal[o] != (pass == 1))
+        continue;
+
+      placed[o] = next;
+      code->initial[next] = c->others[o];
+      code->is_literal[next] = c->others_literal[o];
+      next++;
+    }
+  }
+
+  for (int i = 0; i < code->num_instrs; i++)
+  {
+    struct VM_INSTR* instr = &code->instrs[i];
+    int opcode = instr->opcode;
+
+    bool jump_a = (opcode == VM_JUMP);
+    bool jump_b = (opcode == VM_JUMP_IF_FALSE);
+
+    if (instr->dst >= OTHER_BASE)
+      instr->dst = placed[instr->dst - OTHER_BASE];
+
+    if (!jump_a && instr->a >= OTHER_BASE)
+      instr->a = placed[instr->a - OTHER_BASE];
+
+    if (!jump_b && instr->b >= OTHER_BASE)
+      instr->b = placed[instr->b - OTHER_BASE];
+  }
+
+  for (int d = 0; d < code->num_counted; d++)
+  {
+    struct VM_COUNTED* loop = &code->counted[d];
+
+    if (loop->limit >= OTHER_BASE)
+      loop->limit = placed[loop->limit - OTHER_BASE];
+
+    for (int k = 0; k < loop->num_steps; k++)
+    {
+      if (loop->steps[k].a >= OTHER_BASE)
+        loop->steps[k].a = placed[loop->steps[k].a - OTHER_BASE];
+
+      if (loop->steps[k].b >= OTHER_BASE)
+        loop->steps[k].b = placed[loop->steps[k].b - OTHER_BASE];
+    }
+  }
+
+  free(placed);
+}
+
+
+//
+// Type analysis
+//
+
+//
+// vm_binary_tag
+//
+// Returns the tag of lhs operator rhs for operands with the
+// given tags, or VM_UNDEFINED if that's a semantic error.
+//
+static int vm_binary_tag(int lhs, int operator, int rhs)
+{
+  bool compare = (operator >= OPERATOR_EQUAL);
+  bool lhs_num = (lhs == VM_INT || lhs == VM_REAL);
+  bool rhs_num = (rhs == VM_INT || rhs == VM_REAL);
+
+  if (lhs_num && rhs_num)
+  {
+    if (compare)
+      return VM_BOOL;
+    else if (lhs == VM_INT && rhs == VM_INT)
+      return VM_INT;
+    else
+      return VM_REAL;
+  }
+
+  if (lhs == VM_STR && rhs == VM_STR)
+  {
+    if (compare)
+      return VM_BOOL;
+    else if (operator == OPERATOR_PLUS)
+      return VM_STR;
+  }
+
+  return VM_UNDEFINED;
+}
+
+//
+// vm_binary_types
+//
+// Returns the set of tags lhs operator rhs can produce when it
+// succeeds, given the sets of tags of the operands.
+//
+static unsigned char vm_binary_types(int operator, unsigned char lhs, unsigned char rhs)
+{
+  unsigned char result = 0;
+
+  for (int l = VM_INT; l <= VM_NONE; l++)
+  {
+    if (!(lhs & TS(l)))
+      continue;
+
+    for (int r = VM_INT; r <= VM_NONE; r++)
+    {
+      if (!(rhs & TS(r)))
+        continue;
+
+      int tag = vm_binary_tag(l, operator, r);
+
+      if (tag != VM_UNDEFINED)
+        result |= TS(tag);
+    }
+  }
+
+  return result;
+}
+
+//
+// vm_range
+//
+// Returns the range lo..hi, clipped to the ints; empty if lo > hi.
+//
+static struct VM_RANGE vm_range(long long lo, long long hi)
+{
+  struct VM_RANGE range;
+
+  if (lo < INT_MIN)
+    lo = INT_MIN;
+
+  if (hi > INT_MAX)
+    hi = INT_MAX;
+
+  if (lo > hi)  // empty
+  {
+    lo = INT_MAX;
+    hi = INT_MIN;
+  }
+
+  range.lo = (int) lo;
+  range.hi = (int) hi;
+  range.nonzero = false;
+
+  return range;
+}
+
+//
+// vm_excludes_zero
+//
+// Is 0 known not to be in the range?
+//
+static bool vm_excludes_zero(struct VM_RANGE range)
+{
+  return range.nonzero || range.lo > 0 || range.hi < 0;
+}
+
+//
+// vm_union
+//
+// Returns the smallest range holding both ranges.
+//
+static struct VM_RANGE vm_union(struct VM_RANGE x, struct VM_RANGE y)
+{
+  if (x.lo > x.hi)
+    return y;
+
+  if (y.lo > y.hi)
+    return x;
+
+  struct VM_RANGE range = vm_range(x.lo < y.lo ? x.lo : y.lo, x.hi > y.hi ? x.hi : y.hi);
+
+  range.nonzero = vm_excludes_zero(x) && vm_excludes_zero(y);
+
+  return range;
+}
+
+//
+// vm_binary_range
+//
+// Returns the range of l operator r for ints in the given ranges.
+// Anything that might wrap around, or that isn't worth the
+// trouble (**, comparisons), gets the full range.
+//
+static struct VM_RANGE vm_binary_range(int operator, struct VM_RANGE l, struct VM_RANGE r)
+{
+  struct VM_RANGE full = vm_range(INT_MIN, INT_MAX);
+
+  if (l.lo > l.hi || r.lo > r.hi)
+    return vm_range(1, 0);  // can't happen, nor can this
+
+  if (operator == OPERATOR_PLUS || operator == OPERATOR_MINUS || operator == OPERATOR_ASTERISK ||
+      (operator == OPERATOR_DIV && (r.lo > 0 || r.hi < 0)))
+  {
+    //
+    // these are monotone in each operand (division as long as
+    // the divisor's sign doesn't change), so the extremes are
+    // at the corners:
+    //
+    long long ls[2] = { l.lo, l.hi };
+    long long rs[2] = { r.lo, r.hi };
+    long long lo = LLONG_MAX;
+    long long hi = LLONG_MIN;
+
+    for (int i = 0; i < 2; i++)
+    {
+      for (int j = 0; j < 2; j++)
+      {
+        long long value;
+
+        if (operator == OPERATOR_PLUS)
+          value = ls[i] + rs[j];
+        else if (operator == OPERATOR_MINUS)
+          value = ls[i] - rs[j];
+        else if (operator == OPERATOR_ASTERISK)
+          value = ls[i] * rs[j];
+        else
+          value = ls[i] / rs[j];
+
+        if (value < lo)
+          lo = value;
+
+        if (value > hi)
+          hi = value;
+      }
+    }
+
+    if (lo < INT_MIN || hi > INT_MAX)  // wraps around
+      return full;
+
+    return vm_range(lo, hi);
+  }
+
+  if (operator == OPERATOR_MOD && vm_excludes_zero(r))
+  {
+    //
+    // smaller than the divisor, with the sign of the dividend:
+    //
+    long long m = (-(long long) r.lo > r.hi) ? -(long long) r.lo : r.hi;
+
+    return vm_range((l.lo < 0) ? 1 - m : 0, (l.hi > 0) ? m - 1 : 0);
+  }
+
+  return full;
+}
+
+//
+// vm_refine
+//
+// Narrows the ranges of int registers a and b to the values for
+// which (a operator b) == holds.
+//
+static void vm_refine(struct VM_RANGE* ranges, int operator, int a, int b, bool holds)
+{
+  //
+  // the negation of each comparison, in the order of enum OPERATORS:
+  //
+  static const int negated[] = { OPERATOR_NOT_EQUAL, OPERATOR_EQUAL, OPERATOR_GTE, OPERATOR_GT, OPERATOR_LTE, OPERATOR_LT };
+
+  if (a == b)
+    return;
+
+  if (!holds)
+    operator = negated[operator - OPERATOR_EQUAL];
+
+  if (operator == OPERATOR_GT || operator == OPERATOR_GTE)  // b < a, b <= a
+  {
+    int temp = a;
+    a = b;
+    b = temp;
+    operator = (operator == OPERATOR_GT) ? OPERATOR_LT : OPERATOR_LTE;
+  }
+
+  struct VM_RANGE x = ranges[a];
+  struct VM_RANGE y = ranges[b];
+
+  switch (operator)
+  {
+  case OPERATOR_EQUAL:
+    x = vm_range(x.lo > y.lo ? x.lo : y.lo, x.hi < y.hi ? x.hi : y.hi);
+    x.nonzero = ranges[a].nonzero || ranges[b].nonzero;
+    y = x;
+    break;
+
+  case OPERATOR_NOT_EQUAL:
+    //
+    // only a single value can be excluded, at the ends (or 0):
+    //
+    for (int k = 0; k < 2; k++)
+    {
+      struct VM_RANGE* other = (k == 0) ? &x : &y;
+      struct VM_RANGE value = (k == 0) ? ranges[b] : ranges[a];
+
+      if (value.lo != value.hi)
+        continue;
+
+      bool nonzero = other->nonzero || value.lo == 0;
+
+      if (other->lo == value.lo)
+        *other = vm_range((long long) other->lo + 1, other->hi);
+      else if (other->hi == value.lo)
+        *other = vm_range(other->lo, (long long) other->hi - 1);
+
+      other->nonzero = nonzero;
+    }
+    break;
+
+  case OPERATOR_LT:
+    x = vm_range(x.lo, (x.hi < (long long) y.hi - 1) ? x.hi : (long long) y.hi - 1);
+    y = vm_range((y.lo > (long long) ranges[a].lo + 1) ? y.lo : (long long) ranges[a].lo + 1, y.hi);
+    x.nonzero = ranges[a].nonzero;
+    y.nonzero = ranges[b].nonzero;
+    break;
+
+  default:  // OPERATOR_LTE
+    x = vm_range(x.lo, (x.hi < y.hi) ? x.hi : y.hi);
+    y = vm_range((y.lo > ranges[a].lo) ? y.lo : ranges[a].lo, y.hi);
+    x.nonzero = ranges[a].nonzero;
+    y.nonzero = ranges[b].nonzero;
+    break;
+  }
+
+  ranges[a] = x;
+  ranges[b] = y;
+}
+
+//
+// vm_safe_division
+//
+// Can l / r and l % r be computed without checks, for ints in
+// these ranges? Not if r may be 0, nor if l may be INT_MIN and r
+// -1 (which overflows, and traps on x86).
+//
+static bool vm_safe_division(struct VM_RANGE l, struct VM_RANGE r)
+{
+  if (!vm_excludes_zero(r))
+    return false;
+
+  return !(l.lo == INT_MIN && r.lo <= -1 && r.hi >= -1);
+}
+
+//
+// vm_transfer
+//
+// Updates the types and ranges of the registers, as they were
+// before the (non-jump) instruction, to what they are after it:
+// only the destination register changes, and only on the path
+// where the instruction succeeds.
+//
+static void vm_transfer(struct VM_INSTR* instr, unsigned char* types, struct VM_RANGE* ranges)
+{
+  switch (instr->opcode)
+  {
+  case VM_MOVE:
+    types[instr->dst] = types[instr->a] & ~TS(VM_UNDEFINED);
+    ranges[instr->dst] = ranges[instr->a];
+    break;
+
+  case VM_BINARY:
+  {
+    unsigned char a = types[instr->a];
+    unsigned char b = types[instr->b];
+
+    if (a == TS(VM_INT) && b == TS(VM_INT))
+      ranges[instr->dst] = vm_binary_range(instr->operator, ranges[instr->a], ranges[instr->b]);
+    else
+      ranges[instr->dst] = vm_range(INT_MIN, INT_MAX);
+
+    types[instr->dst] = vm_binary_types(instr->operator, a, b);
+    break;
+  }
+
+  case VM_INPUT:
+    types[instr->dst] = TS(VM_STR);
+    ranges[instr->dst] = vm_range(INT_MIN, INT_MAX);
+    break;
+
+  case VM_TO_INT:
+    types[instr->dst] = TS(VM_INT);
+    ranges[instr->dst] = vm_range(INT_MIN, INT_MAX);
+    break;
+
+  case VM_TO_FLOAT:
+    types[instr->dst] = TS(VM_REAL);
+    ranges[instr->dst] = vm_range(INT_MIN, INT_MAX);
+    break;
+
+  default:  // jumps, print
+    break;
+  }
+}
+
+//
+// vm_analyze
+//
+// Computes, for every instruction, the set of tags each register
+// may hold when the instruction starts, and for registers that
+// hold ints, the range of their values (forward dataflow to a
+// fixed point), then specializes the instructions. typed[pc] is
+// set to the typed opcode that computes instruction pc, or to
+// VM_HALT if the operand types aren't known.
+//
+// The dataflow is over basic blocks (a block starts at 0, at each
+// jump target, and after each jump), and only the state at the
+// start of each block is kept: the state at an instruction is
+// recomputed from there when the block is specialized. A long
+// script with few ifs and loops is then analyzed in a few copies
+// of the registers, not one copy per instruction. Literals never
+// change, so they're left out of those copies (vm_finish puts them
+// last): a block starts with the literals' own types and ranges.
+// If the copies would still be too big (see VM_MAX_ANALYSIS),
+// nothing is specialized and the code stays generic.
+//
+// Variables may already be in memory when the VM starts, so at
+// the start they can hold anything; temporaries start out
+// undefined, literals always hold their literal.
+//
+// Ranges are narrowed by conditions: after while i < n: (a
+// compare right before the branch), i < n on the way into the
+// loop, and i >= n on the way out. That's what makes e.g. the
+// divisor in if d != 0: x = 100 / d, or in a loop from 1 up,
+// known not to be 0.
+//
+static void vm_analyze(struct VM_CODE* code, int* typed)
+{
+  int n = code->num_instrs;
+  int R = code->num_regs;
+  int RR = R;  // registers before the literals
+
+  while (RR > code->num_vars && code->is_literal[RR - 1])
+    RR--;
+
+  //
+  // the blocks, and which one starts at each leader:
+  //
+  bool* leader = (bool*) calloc(n + 1, sizeof(bool));
+  int* block_of = (int*) malloc((n + 1) * sizeof(int));
+  int* starts = (int*) malloc((n + 1) * sizeof(int));
+
+  if (leader == NULL || block_of == NULL || starts == NULL)
+    exit(0);
+
+  leader[0] = true;
+
+  for (int pc = 0; pc < n; pc++)
+  {
+    struct VM_INSTR* instr = &code->instrs[pc];
+
+    if (instr->opcode == VM_JUMP)
+      leader[instr->a] = true;
+    else if (instr->opcode == VM_JUMP_IF_FALSE)
+      leader[instr->b] = true;
+
+    if (instr->opcode == VM_JUMP || instr->opcode == VM_JUMP_IF_FALSE || instr->opcode == VM_HALT)
+      leader[pc + 1] = true;
+  }
+
+  int B = 0;
+
+  for (int pc = 0; pc < n; pc++)
+  {
+    if (leader[pc])
+      starts[B++] = pc;
+
+    block_of[pc] = B - 1;
+  }
+
+  starts[B] = n;
+
+  if ((size_t) B * RR > VM_MAX_ANALYSIS)
+  {
+    for (int pc = 0; pc < n; pc++)
+      typed[pc] = VM_HALT;
+
+    free(starts);
+    free(block_of);
+    free(leader);
+    return;
+  }
+
+  //
+  // the state at the start of each block, a working copy, and the
+  // literals every block starts with:
+  //
+  unsigned char* types = (unsigned char*) calloc((size_t) B * RR + 1, sizeof(unsigned char));
+  struct VM_RANGE* ranges = (struct VM_RANGE*) malloc(((size_t) B * RR + 1) * sizeof(struct VM_RANGE));
+  bool* queued = (bool*) calloc(B, sizeof(bool));
+  bool* visited = (bool*) calloc(B, sizeof(bool));
+  int* visits = (int*) calloc(B, sizeof(int));
+  unsigned char* out = (unsigned char*) malloc(R + 1);
+  struct VM_RANGE* out_ranges[2];  // fall through, jump
+
+  out_ranges[0] = (struct VM_RANGE*) malloc((R + 1) * sizeof(struct VM_RANGE));
+  out_ranges[1] = (struct VM_RANGE*) malloc((R + 1) * sizeof(struct VM_RANGE));
+  unsigned char* literal_types = (unsigned char*) malloc(R + 1);
+  struct VM_RANGE* literal_ranges = (struct VM_RANGE*) malloc((R + 1) * sizeof(struct VM_RANGE));
+
+  if (types == NULL || ranges == NULL || queued == NULL || visited == NULL || visits == NULL ||
+      out == NULL || out_ranges[0] == NULL || out_ranges[1] == NULL ||
+      literal_types == NULL || literal_ranges == NULL)
+    exit(0);
+
+  for (int r = 0; r < R; r++)
+  {
+    unsigned char* type = (r < RR) ? &types[r] : &literal_types[r];
+    struct VM_RANGE* range = (r < RR) ? &ranges[r] : &literal_ranges[r];
+
+    if (r < code->num_vars)
+      *type = TS_ANY;
+    else
+      *type = TS(vm_tag(code->initial[r]));
+
+    if (*type == TS(VM_INT))
+      *range = vm_range(vm_as_int(code->initial[r]), vm_as_int(code->initial[r]));
+    else
+      *range = vm_range(INT_MIN, INT_MAX);
+  }
+
+  //
+  // the queued blocks are processed in order, wrapping around, so
+  // a block comes after those before it: straight-line code and
+  // chains of ifs are then processed once, not once per path:
+  //
+  int num_queued = 1;
+  int b = -1;
+
+  queued[0] = true;
+  visited[0] = true;
+
+  while (num_queued > 0)
+  {
+    do
+      b = (b + 1) % B;
+    while (!queued[b]);
+
+    queued[b] = false;
+    num_queued--;
+
+    memcpy(out, &types[(size_t) b * RR], RR);
+    memcpy(out_ranges[0], &ranges[(size_t) b * RR], RR * sizeof(struct VM_RANGE));
+    memcpy(&out[RR], &literal_types[RR], R - RR);
+    memcpy(&out_ranges[0][RR], &literal_ranges[RR], (R - RR) * sizeof(struct VM_RANGE));
+
+    int last = starts[b + 1] - 1;
+
+    for (int pc = starts[b]; pc < last; pc++)
+      vm_transfer(&code->instrs[pc], out, out_ranges[0]);
+
+    //
+    // the block's last instruction decides where it goes next:
+    //
+    struct VM_INSTR* instr = &code->instrs[last];
+    int successors[2];
+    int num_successors = 0;
+
+    switch (instr->opcode)
+    {
+    case VM_HALT:
+      break;
+
+    case VM_JUMP:
+      successors[num_successors++] = instr->a;
+      break;
+
+    case VM_JUMP_IF_FALSE:
+    {
+      successors[num_successors++] = last + 1;
+      successors[num_successors++] = instr->b;
+
+      memcpy(out_ranges[1], out_ranges[0], R * sizeof(struct VM_RANGE));
+
+      //
+      // branching on an int comparison just made (and the only
+      // way here): narrow its operands on each path:
+      //
+      struct VM_INSTR* compare = (last > starts[b]) ? &code->instrs[last - 1] : NULL;
+
+      if (compare != NULL && compare->opcode == VM_BINARY &&
+          compare->operator >= OPERATOR_EQUAL && compare->operator <= OPERATOR_GTE &&
+          compare->dst == instr->a && compare->dst != compare->a && compare->dst != compare->b &&
+          out[compare->a] == TS(VM_INT) && out[compare->b] == TS(VM_INT))
+      {
+        vm_refine(out_ranges[0], compare->operator, compare->a, compare->b, true);
+        vm_refine(out_ranges[1], compare->operator, compare->a, compare->b, false);
+      }
+      break;
+    }
+
+    default:
+      vm_transfer(instr, out, out_ranges[0]);
+      successors[num_successors++] = last + 1;
+      break;
+    }
+
+    //
+    // merge into the successors, revisit those that changed:
+    //
+    for (int s = 0; s < num_successors; s++)
+    {
+      int next = block_of[successors[s]];
+      unsigned char* next_in = &types[(size_t) next * RR];
+      struct VM_RANGE* next_ranges = &ranges[(size_t) next * RR];
+      struct VM_RANGE* from = out_ranges[s];
+      bool changed = false;
+      bool widen = (starts[next] <= last && ++visits[next] > VM_WIDEN_AFTER);  // at a loop's top
+
+      for (int r = 0; r < RR; r++)
+      {
+        unsigned char merged = next_in[r] | out[r];
+
+        if (merged != next_in[r])
+        {
+          next_in[r] = merged;
+          changed = true;
+        }
+
+        struct VM_RANGE range = visited[next] ? vm_union(next_ranges[r], from[r]) : from[r];
+        struct VM_RANGE old = next_ranges[r];
+
+        if (widen && range.lo < old.lo)
+          range.lo = INT_MIN;
+
+        if (widen && range.hi > old.hi)
+          range.hi = INT_MAX;
+
+        if (!visited[next] || range.lo != old.lo || range.hi != old.hi || range.nonzero != old.nonzero)
+        {
+          next_ranges[r] = range;
+          changed = true;
+        }
+      }
+
+      //
+      // the first visit counts as a change:
+      //
+      if ((changed || !visited[next]) && !queued[next])
+      {
+        queued[next] = true;
+        num_queued++;
+      }
+
+      visited[next] = true;
+    }
+  }
+
+  //
+  // specialize each instruction given the state it starts in,
+  // recomputed from the start of its block; unreachable blocks
+  // are left alone:
+  //
+  for (b = 0; b < B; b++)
+  {
+    memcpy(out, &types[(size_t) b * RR], RR);
+    memcpy(out_ranges[0], &ranges[(size_t) b * RR], RR * sizeof(struct VM_RANGE));
+    memcpy(&out[RR], &literal_types[RR], R - RR);
+    memcpy(&out_ranges[0][RR], &literal_ranges[RR], (R - RR) * sizeof(struct VM_RANGE));
+
+    for (int pc = starts[b]; pc < starts[b + 1]; pc++)
+    {
+      struct VM_INSTR instr = code->instrs[pc];
+
+      typed[pc] = VM_HALT;
+
+      if (visited[b])
+      {
+        vm_specialize(code, pc, out, out_ranges[0], typed);
+        vm_transfer(&instr, out, out_ranges[0]);
+      }
+    }
+  }
+
+  free(literal_ranges);
+  free(literal_types);
+  free(out_ranges[1]);
+  free(out_ranges[0]);
+  free(out);
+  free(visits);
+  free(visited);
+  free(queued);
+  free(ranges);
+  free(types);
+  free(starts);
+  free(block_of);
+  free(leader);
+}
+
+//
+// vm_raw_writable
+//
+// Can a typed instruction store into reg without any bookkeeping?
+// Not if reg may hold a string (which has to be freed), and not
+// if reg is a variable that may be undefined (its memory cell has
+// to be created on the first assignment).
+//
+static bool vm_raw_writable(struct VM_CODE* code, unsigned char* types, int reg)
+{
+  if (types[reg] & TS(VM_STR))
+    return false;
+
+  if (reg < code->num_vars && (types[reg] & TS(VM_UNDEFINED)))
+    return false;
+
+  return true;
+}
+
+//
+// vm_specialize
+//
+// Replaces the instruction at pc with a typed version if the
+// analysis proved the operand types, given the types (and ranges)
+// of the registers when it starts.
+//
+// A binary expression with known operand types whose result
+// can't be stored raw (e.g. the first assignment to a variable)
+// stays generic, but is still recorded in typed[]. So is the
+// typed version of a print, for vm_fuse. An int division whose
+// operand ranges make it safe drops its checks as well.
+//
+static void vm_specialize(struct VM_CODE* code, int pc, unsigned char* in, struct VM_RANGE* in_ranges, int* typed)
+{
+  struct VM_INSTR* instr = &code->instrs[pc];
+
+  if (instr->opcode == VM_BINARY)
+  {
+    unsigned char a = in[instr->a];
+    unsigned char b = in[instr->b];
+
+    if (a == TS(VM_INT) && b == TS(VM_INT))
+      typed[pc] = VM_ADD_II + instr->operator;
+    else if (a == TS(VM_REAL) && b == TS(VM_REAL))
+      typed[pc] = VM_ADD_RR + instr->operator;
+
+    if (typed[pc] != VM_HALT && vm_raw_writable(code, in, instr->dst))
+      instr->opcode = typed[pc];
+
+    if ((instr->opcode == VM_DIV_II || instr->opcode == VM_MOD_II) &&
+        vm_safe_division(in_ranges[instr->a], in_ranges[instr->b]))
+      instr->opcode = (instr->opcode == VM_DIV_II) ? VM_DIV_NZ_II : VM_MOD_NZ_II;
+  }
+  else if (instr->opcode == VM_MOVE)
+  {
+    unsigned char a = in[instr->a];
+
+    if ((a == TS(VM_INT) || a == TS(VM_REAL) || a == TS(VM_BOOL)) && vm_raw_writable(code, in, instr->dst))
+      instr->opcode = VM_MOVE_RAW;
+  }
+  else if (instr->opcode == VM_JUMP_IF_FALSE)
+  {
+    if (in[instr->a] == TS(VM_BOOL))
+      instr->opcode = VM_JUMP_IF_FALSE_BOOL;
+  }
+  else if (instr->opcode == VM_PRINT)
+  {
+    unsigned char a = in[instr->a];
+
+    if (a == TS(VM_INT))
+      typed[pc] = VM_PRINT_INT;
+    else if (a == TS(VM_REAL))
+      typed[pc] = VM_PRINT_REAL;
+    else if (a == TS(VM_STR))
+      typed[pc] = VM_PRINT_STR;
+  }
+}
+
+//
+// Loop-invariant code motion
+//
+
+//
+// vm_written
+//
+// Returns the register the instruction writes, or -1 if none.
+//
+static int vm_written(struct VM_INSTR* instr)
+{
+  switch (instr->opcode)
+  {
+  case VM_HALT:
+  case VM_JUMP:
+  case VM_JUMP_IF_FALSE:
+  case VM_JUMP_IF_FALSE_BOOL:
+  case VM_PRINT:
+  case VM_PRINT_NEWLINE:
+  case VM_PRINT_INT:
+  case VM_PRINT_REAL:
+  case VM_PRINT_STR:
+    return -1;
+
+  default:
+    if (instr->opcode >= VM_JUMP_UNLESS_EQ_II && instr->opcode <= VM_JUMP_UNLESS_GE_RR)
+      return -1;  // dst is the jump target
+
+    return instr->dst;
+  }
+}
+
+//
+// vm_invariant
+//
+// Can the instruction at pc, inside the loop top..bottom, be
+// computed once before the loop? Its operand types must be known
+// (so they are defined and of the right type), it must not be
+// able to fail, and neither operand may be written in the loop.
+//
+static bool vm_invariant(struct VM_CODE* code, int* typed, int pc, int top, int bottom)
+{
+  struct VM_INSTR* instr = &code->instrs[pc];
+
+  if (typed[pc] < VM_ADD_II || typed[pc] > VM_GE_RR)
+    return false;
+
+  //
+  // division by zero is an error, so only a literal divisor
+  // that isn't zero will do:
+  //
+  if (instr->operator == OPERATOR_MOD || instr->operator == OPERATOR_DIV)
+  {
+    struct VM_VALUE divisor = code->initial[instr->b];
+
+    if (!code->is_literal[instr->b])
+      return false;
+
+    if (vm_tag(divisor) == VM_INT && vm_as_int(divisor) == 0)
+      return false;
+
+    if (vm_tag(divisor) == VM_REAL && vm_as_real(divisor) == 0.0)
+      return false;
+  }
+
+  for (int i = top; i <= bottom; i++)
+  {
+    int written = vm_written(&code->instrs[i]);
+
+    if (written == instr->a || written == instr->b)
+      return false;
+  }
+
+  return true;
+}
+
+//
+// vm_relocate
+//
+// Returns where a jump from instruction from to target goes once
+// k instructions have been inserted before the loop top..bottom:
+// into the loop from inside it (the back edge), to the inserted
+// instructions from outside it.
+//
+static int vm_relocate(int target, int from, int top, int bottom, int k)
+{
+  if (target < top)
+    return target;
+
+  if (target == top && (from < top || from > bottom))
+    return target;
+
+  return target + k;
+}
+
+//
+// vm_hoist_loop
+//
+// Moves the invariant expressions of the loop top..bottom (the
+// loop's last instruction jumps back to its first) to just
+// before the loop. Each one is computed into a new temporary by
+// a typed instruction, and the instruction in the loop becomes a
+// move from it. Returns true if anything was moved.
+//
+static bool vm_hoist_loop(struct VM_CODE* code, int** typed, int top, int bottom)
+{
+  int k = 0;
+
+  for (int pc = top; pc <= bottom; pc++)
+    if (vm_invariant(code, *typed, pc, top, bottom))
+      k++;
+
+  if (k == 0)
+    return false;
+
+  int n = code->num_instrs;
+  struct VM_INSTR* instrs = (struct VM_INSTR*) malloc((n + k) * sizeof(struct VM_INSTR));
+  int* new_typed = (int*) malloc((n + k) * sizeof(int));
+
+  if (instrs == NULL || new_typed == NULL)
+    exit(0);
+
+  for (int pc = 0; pc < n; pc++)
+  {
+    struct VM_INSTR instr = code->instrs[pc];
+
+    if (instr.opcode == VM_JUMP)
+      instr.a = vm_relocate(instr.a, pc, top, bottom, k);
+    else if (instr.opcode == VM_JUMP_IF_FALSE || instr.opcode == VM_JUMP_IF_FALSE_BOOL)
+      instr.b = vm_relocate(instr.b, pc, top, bottom, k);
+
+    instrs[pc < top ? pc : pc + k] = instr;
+    new_typed[pc < top ? pc : pc + k] = (*typed)[pc];
+  }
+
+  //
+  // one new temporary per hoisted expression:
+  //
+  if (code->num_regs + k > code->regs_capacity)
+  {
+    code->regs_capacity = (code->num_regs + k) * 2;
+    code->initial = (struct VM_VALUE*) realloc(code->initial, code->regs_capacity * sizeof(struct VM_VALUE));
+    code->is_literal = (bool*) realloc(code->is_literal, code->regs_capacity * sizeof(bool));
+
+    if (code->initial == NULL || code->is_literal == NULL)
+      exit(0);
+  }
+
+  if (code->num_hoisted + k > code->hoisted_capacity)
+  {
+    code->hoisted_capacity = (code->num_hoisted + k) * 2;
+    code->hoisted = (struct VM_HOIST*) realloc(code->hoisted, code->hoisted_capacity * sizeof(struct VM_HOIST));
+
+    if (code->hoisted == NULL)
+      exit(0);
+  }
+
+  int before = top;
+
+  for (int pc = top; pc <= bottom; pc++)
+  {
+    if (!vm_invariant(code, *typed, pc, top, bottom))
+      continue;
+
+    struct VM_INSTR* instr = &instrs[pc + k];
+    int temp = code->num_regs++;
+
+    code->initial[temp] = vm_undefined();
+    code->is_literal[temp] = false;
+
+    //
+    // an expression already moved out of an inner loop is now
+    // moved further out, report it once:
+    //
+    struct VM_HOIST* hoist = NULL;
+
+    for (int h = 0; h < code->num_hoisted; h++)
+      if (code->hoisted[h].temp == instr->dst)
+        hoist = &code->hoisted[h];
+
+    if (hoist == NULL)
+    {
+      hoist = &code->hoisted[code->num_hoisted++];
+
+      hoist->line = instr->line;
+      hoist->operator = instr->operator;
+      hoist->a = instr->a;
+      hoist->b = instr->b;
+    }
+
+    hoist->loop_line = instrs[bottom + k].line;
+    hoist->temp = temp;
+
+    //
+    // the temporary never holds a string, so the typed version
+    // can always write it:
+    //
+    instrs[before] = *instr;
+    instrs[before].opcode = new_typed[pc + k];
+    instrs[before].dst = temp;
+    instrs[before].stmts = 0;  // still counted in the loop
+    new_typed[before] = new_typed[pc + k];
+    before++;
+
+    //
+    // a typed instruction could write its destination raw, so
+    // the move can too:
+    //
+    instr->opcode = (instr->opcode == VM_BINARY) ? VM_MOVE : VM_MOVE_RAW;
+    instr->operator = OPERATOR_NO_OP;
+    instr->a = temp;
+    instr->b = 0;
+    new_typed[pc + k] = VM_HALT;
+  }
+
+  free(code->instrs);
+  free(*typed);
+
+  code->instrs = instrs;
+  code->num_instrs = n + k;
+  code->instrs_capacity = n + k;
+  *typed = new_typed;
+
+  return true;
+}
+
+//
+// vm_hoist
+//
+// Moves invariant expressions out of every while loop. A loop
+// is the range from a backward jump's target to the jump. After
+// a loop changes, the search starts over: instructions moved out
+// of an inner loop land in the outer loop, and may be invariant
+// there too.
+//
+static void vm_hoist(struct VM_CODE* code, int** typed)
+{
+  bool changed = true;
+
+  while (changed)
+  {
+    changed = false;
+
+    for (int pc = 0; pc < code->num_instrs && !changed; pc++)
+    {
+      struct VM_INSTR* instr = &code->instrs[pc];
+
+      if (instr->opcode == VM_JUMP && instr->a <= pc)
+        changed = vm_hoist_loop(code, typed, instr->a, pc);
+    }
+  }
+}
+
+
+//
+// Counted loops
+//
+
+//
+// vm_count_operand
+//
+// Returns the register of an int operand of a counted loop: a
+// variable or an int literal; -1 if it's anything else.
+//
+static int vm_count_operand(struct COMPILER* c, struct UNARY_EXPR* unary)
+{
+  if (unary == NULL || unary->expr_type != UNARY_ELEMENT)
+    return -1;
+
+  struct ELEMENT* element = unary->element;
+
+  if (element->element_type != ELEMENT_IDENTIFIER && element->element_type != ELEMENT_INT_LITERAL)
+    return -1;
+
+  return vm_element(c, element);
+}
+
+//
+// vm_count_degree
+//
+// Returns the degree of register reg as a polynomial in the
+// iteration # at step k of the counted loop: 1 for the counter,
+// that of the value assigned for a variable assigned earlier in
+// the body, 0 for anything not written in the loop. Returns -1
+// for a variable assigned later (or by a sum), whose value comes
+// from the previous iteration.
+//
+static int vm_count_degree(struct VM_COUNTED* loop, int* degrees, int k, int reg)
+{
+  if (reg == loop->counter)
+    return 1;
+
+  for (int s = 0; s < loop->num_steps; s++)
+  {
+    if (loop->steps[s].dst != reg)
+      continue;
+
+    if (s < k && loop->steps[s].kind == VM_COUNT_VALUE)
+      return degrees[s];
+
+    return -1;
+  }
+
+  return 0;
+}
+
+//
+// vm_recognize_counted
+//
+// If the while loop is a counted loop (see struct VM_COUNTED),
+// records it in the code, for vm_count_loops to find once the
+// code is final.
+//
+static void vm_recognize_counted(struct COMPILER* c, struct STMT* stmt)
+{
+  static const int swapped[] = { [OPERATOR_LT] = OPERATOR_GT, [OPERATOR_LTE] = OPERATOR_GTE,
+                                 [OPERATOR_GT] = OPERATOR_LT, [OPERATOR_GTE] = OPERATOR_LTE };
+
+  struct STMT_WHILE_LOOP* while_loop = stmt->types.while_loop;
+  struct EXPR* condition = while_loop->condition;
+  struct VM_COUNTED loop;
+  struct STMT_ASSIGNMENT* assigns[VM_COUNTED_MAX_STEPS];
+  int degrees[VM_COUNTED_MAX_STEPS];
+
+  if (!condition->isBinaryExpr || condition->operator < OPERATOR_LT || condition->operator > OPERATOR_GTE)
+    return;
+
+  //
+  // the body: assignments of a variable or an int literal, or of
+  // a + - * of two of them, each variable assigned once:
+  //
+  loop.line = stmt->line;
+  loop.num_steps = 0;
+
+  for (struct STMT* s = while_loop->loop_body; s != stmt; s = walk_next(s, stmt))
+  {
+    if (s == NULL)
+      return;
+
+    if (s->stmt_type == STMT_PASS)
+      continue;
+
+    if (s->stmt_type != STMT_ASSIGNMENT || loop.num_steps == VM_COUNTED_MAX_STEPS)
+      return;
+
+    struct STMT_ASSIGNMENT* assign = s->types.assignment;
+
+    if (assign->isPtrDeref || assign->rhs->value_type != VALUE_EXPR)
+      return;
+
+    struct EXPR* expr = assign->rhs->types.expr;
+    struct VM_COUNTED_STEP* step = &loop.steps[loop.num_steps];
+
+    step->kind = VM_COUNT_VALUE;
+    step->dst = vm_var(c, assign->var_name);
+    step->operator = OPERATOR_NO_OP;
+    step->a = vm_count_operand(c, expr->lhs);
+    step->b = step->a;
+
+    if (expr->isBinaryExpr)
+    {
+      if (expr->operator != OPERATOR_PLUS && expr->operator != OPERATOR_MINUS && expr->operator != OPERATOR_ASTERISK)
+        return;
+
+      step->operator = expr->operator;
+      step->b = vm_count_operand(c, expr->rhs);
+    }
+
+    if (step->a < 0 || step->b < 0)
+      return;
+
+    for (int k = 0; k < loop.num_steps; k++)
+      if (loop.steps[k].dst == step->dst)
+        return;
+
+    assigns[loop.num_steps] = assign;
+    loop.num_steps++;
+  }
+
+  //
+  // the counter is the variable in the condition stepped by a
+  // nonzero literal, on the left once the condition is flipped:
+  //
+  int lhs = vm_count_operand(c, condition->lhs);
+  int rhs = vm_count_operand(c, condition->rhs);
+
+  if (lhs < 0 || rhs < 0)
+    return;
+
+  loop.counter = -1;
+
+  for (int k = 0; k < loop.num_steps && loop.counter < 0; k++)
+  {
+    struct VM_COUNTED_STEP* step = &loop.steps[k];
+    struct EXPR* expr = assigns[k]->rhs->types.expr;
+    int literal;
+
+    if (step->dst != lhs && step->dst != rhs)
+      continue;
+
+    if (step->operator == OPERATOR_PLUS && step->a == step->dst && expr->rhs->element->element_type == ELEMENT_INT_LITERAL)
+      literal = atoi(expr->rhs->element->element_value);
+    else if (step->operator == OPERATOR_PLUS && step->b == step->dst && expr->lhs->element->element_type == ELEMENT_INT_LITERAL)
+      literal = atoi(expr->lhs->element->element_value);
+    else if (step->operator == OPERATOR_MINUS && step->a == step->dst && expr->rhs->element->element_type == ELEMENT_INT_LITERAL)
+      literal = -atoi(expr->rhs->element->element_value);
+    else
+      continue;
+
+    if (literal == 0 || literal == INT_MIN)
+      continue;
+
+    step->kind = VM_COUNT_STEP;
+    loop.counter = step->dst;
+    loop.limit = (step->dst == lhs) ? rhs : lhs;
+    loop.operator = (step->dst == lhs) ? condition->operator : swapped[condition->operator];
+    loop.step = literal;
+  }
+
+  if (loop.counter < 0 || vm_count_degree(&loop, degrees, 0, loop.limit) != 0)
+    return;
+
+  //
+  // the rest are sums (v = v + x, v = x + v, v = v - x, v read
+  // nowhere else) or functions of the counter, of degree up to
+  // VM_COUNTED_MAX_DEGREE:
+  //
+  for (int k = 0; k < loop.num_steps; k++)
+  {
+    struct VM_COUNTED_STEP* step = &loop.steps[k];
+
+    if (step->kind == VM_COUNT_STEP)
+      continue;
+
+    if (step->operator == OPERATOR_PLUS && (step->a == step->dst) != (step->b == step->dst))
+    {
+      step->kind = VM_COUNT_ADD;
+      step->a = (step->a == step->dst) ? step->b : step->a;
+      step->b = step->a;
+    }
+    else if (step->operator == OPERATOR_MINUS && step->a == step->dst && step->b != step->dst)
+    {
+      step->kind = VM_COUNT_SUB;
+      step->a = step->b;
+    }
+
+    int a = vm_count_degree(&loop, degrees, k, step->a);
+    int b = vm_count_degree(&loop, degrees, k, step->b);
+
+    if (a < 0 || b < 0)
+      return;
+
+    if (step->kind != VM_COUNT_VALUE)
+      degrees[k] = a;
+    else if (step->operator == OPERATOR_ASTERISK)
+      degrees[k] = a + b;
+    else
+      degrees[k] = (a > b) ? a : b;
+
+    if (degrees[k] > VM_COUNTED_MAX_DEGREE)
+      return;
+  }
+
+  //
+  // record it:
+  //
+  struct VM_CODE* code = c->code;
+
+  if (code->num_counted == code->counted_capacity)
+  {
+    code->counted_capacity = (code->counted_capacity == 0) ? 4 : code->counted_capacity * 2;
+    code->counted = (struct VM_COUNTED*) realloc(code->counted, code->counted_capacity * sizeof(struct VM_COUNTED));
+
+    if (code->counted == NULL)
+      exit(0);
+  }
+
+  code->counted[code->num_counted++] = loop;
+}
+
+//
+// vm_count_loops
+//
+// Puts a counted_loop instruction at the top of every counted
+// loop, where the loop is entered (the back edge goes past it).
+// The instruction runs the loop in closed form and jumps to its
+// exit, or else falls into the loop.
+//
+static void vm_count_loops(struct VM_CODE* code)
+{
+  for (int d = 0; d < code->num_counted; d++)
+  {
+    int top = -1;
+    int bottom = -1;
+
+    for (int pc = 0; pc < code->num_instrs && top < 0; pc++)
+    {
+      struct VM_INSTR* instr = &code->instrs[pc];
+
+      if (instr->opcode == VM_JUMP && instr->a <= pc && code->instrs[instr->a].line == code->counted[d].line)
+      {
+        top = instr->a;
+        bottom = pc;
+      }
+    }
+
+    if (top < 0)
+      continue;
+
+    if (code->num_instrs == code->instrs_capacity)
+    {
+      code->instrs_capacity *= 2;
+      code->instrs = (struct VM_INSTR*) realloc(code->instrs, code->instrs_capacity * sizeof(struct VM_INSTR));
+
+      if (code->instrs == NULL)
+        exit(0);
+    }
+
+    memmove(&code->instrs[top + 1], &code->instrs[top], (code->num_instrs - top) * sizeof(struct VM_INSTR));
+    code->num_instrs++;
+
+    for (int pc = 0; pc < code->num_instrs; pc++)
+    {
+      struct VM_INSTR* instr = &code->instrs[pc];
+      int from = (pc <= top) ? pc : pc - 1;
+
+      if (pc == top)
+        continue;
+
+      if (instr->opcode == VM_JUMP)
+        instr->a = vm_relocate(instr->a, from, top, bottom, 1);
+      else if (instr->opcode == VM_JUMP_IF_FALSE || instr->opcode == VM_JUMP_IF_FALSE_BOOL)
+        instr->b = vm_relocate(instr->b, from, top, bottom, 1);
+      else if ((instr->opcode >= VM_JUMP_UNLESS_EQ_II && instr->opcode <= VM_JUMP_UNLESS_GE_RR) || instr->opcode == VM_COUNTED_LOOP)
+        instr->dst = vm_relocate(instr->dst, from, top, bottom, 1);
+    }
+
+    struct VM_INSTR* instr = &code->instrs[top];
+
+    instr->opcode = VM_COUNTED_LOOP;
+    instr->operator = OPERATOR_NO_OP;
+    instr->dst = bottom + 2;  // the exit, past the back edge
+    instr->a = d;
+    instr->b = 0;
+    instr->stmts = 0;  // the loop's stmts are counted inside it
+  }
+}
+
+
+//
+// Superinstructions
+//
+
+//
+// vm_reads
+//
+// Does the instruction read the given register?
+//
+static bool vm_reads(struct VM_INSTR* instr, int reg)
+{
+  switch (instr->opcode)
+  {
+  case VM_HALT:
+  case VM_JUMP:
+  case VM_PRINT_NEWLINE:
+    return false;
+
+  case VM_MOVE:
+  case VM_MOVE_RAW:
+  case VM_JUMP_IF_FALSE:
+  case VM_JUMP_IF_FALSE_BOOL:
+  case VM_PRINT:
+  case VM_PRINT_INT:
+  case VM_PRINT_REAL:
+  case VM_PRINT_STR:
+  case VM_INPUT:
+  case VM_TO_INT:
+  case VM_TO_FLOAT:
+  case VM_ADD_IMM_II:
+    return instr->a == reg;
+
+  default:
+    return instr->a == reg || instr->b == reg;
+  }
+}
+
+//
+// vm_is_target
+//
+// Does any jump go to the instruction at pc?
+//
+static bool vm_is_target(struct VM_CODE* code, int pc)
+{
+  for (int i = 0; i < code->num_instrs; i++)
+  {
+    struct VM_INSTR* instr = &code->instrs[i];
+
+    if (instr->opcode == VM_JUMP && instr->a == pc)
+      return true;
+
+    if ((instr->opcode == VM_JUMP_IF_FALSE || instr->opcode == VM_JUMP_IF_FALSE_BOOL) && instr->b == pc)
+      return true;
+  }
+
+  return false;
+}
+
+//
+// vm_fuse
+//
+// Replaces the most common instruction sequences with single
+// instructions, so the loop in vm_run dispatches less often:
+//
+//   add_ii x, x, 1  =>  add_imm_ii x, x, #1    (also x - 1, 1 + x)
+//
+//   lt_ii t, i, n   =>  jump_unless_lt_ii i, n, @target
+//   jump_if_false_bool t, @target
+//
+//   print x         =>  print_int x            (x known to be an int)
+//
+// A compare and branch are only fused if the compare's result
+// is a temporary that nothing else reads, and no jump lands on
+// the branch. The branches fused away are then deleted, and the
+// jump targets renumbered.
+//
+static void vm_fuse(struct VM_CODE* code, int* typed)
+{
+  int n = code->num_instrs;
+  bool* deleted = (bool*) malloc((n + 1) * sizeof(bool));
+  int* renumbered = (int*) malloc((n + 1) * sizeof(int));
+
+  if (deleted == NULL || renumbered == NULL)
+    exit(0);
+
+  for (int pc = 0; pc < n; pc++)
+    deleted[pc] = false;
+
+  for (int pc = 0; pc < n; pc++)
+  {
+    struct VM_INSTR* instr = &code->instrs[pc];
+
+    if (instr->opcode == VM_PRINT && typed[pc] != VM_HALT)
+    {
+      instr->opcode = typed[pc];
+    }
+    else if (instr->opcode == VM_ADD_II || instr->opcode == VM_SUB_II)
+    {
+      //
+      // x + K, x - K, or K + x; the literal itself goes in b,
+      // and x - K becomes x + -K (wrapping, like the subtraction):
+      //
+      if (instr->opcode == VM_ADD_II && code->is_literal[instr->a] && !code->is_literal[instr->b])
+      {
+        int temp = instr->a;
+        instr->a = instr->b;
+        instr->b = temp;
+      }
+
+      if (code->is_literal[instr->b])
+      {
+        unsigned int K = (unsigned int) vm_as_int(code->initial[instr->b]);
+
+        instr->b = (int) ((instr->opcode == VM_SUB_II) ? 0u - K : K);
+        instr->opcode = VM_ADD_IMM_II;
+      }
+    }
+    else if ((instr->opcode >= VM_EQ_II && instr->opcode <= VM_GE_II) ||
+             (instr->opcode >= VM_EQ_RR && instr->opcode <= VM_GE_RR))
+    {
+      struct VM_INSTR* branch = &code->instrs[pc + 1];  // HALT is last, so pc + 1 exists
+      int temp = instr->dst;
+
+      if (branch->opcode != VM_JUMP_IF_FALSE_BOOL || branch->a != temp)
+        continue;
+
+      if (temp < code->num_vars || vm_is_target(code, pc + 1))
+        continue;
+
+      bool read_elsewhere = false;
+
+      for (int i = 0; i < n; i++)
+        if (i != pc + 1 && vm_reads(&code->instrs[i], temp))
+          read_elsewhere = true;
+
+      if (read_elsewhere)
+        continue;
+
+      if (instr->opcode <= VM_GE_II)
+        instr->opcode = VM_JUMP_UNLESS_EQ_II + (instr->opcode - VM_EQ_II);
+      else
+        instr->opcode = VM_JUMP_UNLESS_EQ_RR + (instr->opcode - VM_EQ_RR);
+
+      instr->dst = branch->b;
+      instr->stmts += branch->stmts;
+      deleted[pc + 1] = true;
+      pc++;
+    }
+  }
+
+  //
+  // delete the fused branches; nothing jumps to them, so every
+  // target survives:
+  //
+  int count = 0;
+
+  for (int pc = 0; pc < n; pc++)
+  {
+    renumbered[pc] = count;
+
+    if (!deleted[pc])
+      code->instrs[count++] = code->instrs[pc];
+  }
+
+  code->num_instrs = count;
+
+  for (int pc = 0; pc < count; pc++)
+  {
+    struct VM_INSTR* instr = &code->instrs[pc];
+
+    if (instr->opcode == VM_JUMP)
+      instr->a = renumbered[instr->a];
+    else if (instr->opcode == VM_JUMP_IF_FALSE || instr->opcode == VM_JUMP_IF_FALSE_BOOL)
+      instr->b = renumbered[instr->b];
+    else if (instr->opcode >= VM_JUMP_UNLESS_EQ_II && instr->opcode <= VM_JUMP_UNLESS_GE_RR)
+      instr->dst = renumbered[instr->dst];
+  }
+
+  free(deleted);
+  free(renumbered);
+}
+
+
+//
+// Runtime
+//
+
+//
+// vm_defined
+//
+// Returns true if the register holds a value; if not, it is an
+// undefined variable, and an error message is output.
+//
+static bool vm_defined(struct VM_STATE* vm, int reg, int line)
+{
+  if (vm_tag(vm->regs[reg]) != VM_UNDEFINED)
+    return true;
+
+  output_printf(vm->output, "**SEMANTIC ERROR: name '%s' is not defined (line %d)\n", vm->code->vars[reg].name, line);
+  return false;
+}
+
+//
+// vm_set
+//
+// Stores value into reg, which takes ownership of it (if it's a
+// string). Frees the string being replaced, and creates the
+// variable's memory cell on its first assignment.
+//
+static void vm_set(struct VM_STATE* vm, int reg, struct VM_VALUE value)
+{
+  struct VM_VALUE old = vm->regs[reg];
+
+  vm->regs[reg] = value;
+
+  if (vm_tag(old) == VM_STR)
+  {
+    free(vm_as_str(old));
+
+    if (vm->strings->num_active > 0)
+      strbuild_forget(vm->strings, reg);
+  }
+  else if (vm_tag(old) == VM_UNDEFINED && reg < vm->code->num_vars && vm->addresses[reg] < 0)
+  {
+    char* name = vm->code->vars[reg].name;
+
+    int previous = alloc_enter(ALLOC_RAM);
+
+    //
+    // a new variable: it wasn't in memory when the VM started,
+    // and only the VM writes memory, so its cell is the one just
+    // added, and addresses never change (see ram.h):
+    //
+    ram_write_cell_by_name(vm->memory, vm_to_ram(value), name);
+    vm->addresses[reg] = vm->memory->num_values - 1;
+
+    alloc_leave(previous);
+  }
+}
+
+//
+// vm_is_true
+//
+// Returns the truthiness of a value, as in Python.
+//
+static bool vm_is_true(struct VM_VALUE value)
+{
+  switch (vm_tag(value))
+  {
+  case VM_INT:
+  case VM_BOOL:
+    return vm_as_int(value) != 0;
+
+  case VM_REAL:
+    return vm_as_real(value) != 0.0;
+
+  case VM_STR:
+    return vm_as_str(value)[0] != '\0';
+
+  default:
+    return false;
+  }
+}
+
+//
+// vm_binary
+//
+// Executes dst = a op b for operands of any type, with the same
+// checks and error messages as the tree-walking interpreter.
+// Returns false on a semantic error.
+//
+static bool vm_binary(struct VM_STATE* vm, struct VM_INSTR* instr)
+{
+  if (!vm_defined(vm, instr->a, instr->line) || !vm_defined(vm, instr->b, instr->line))
+    return false;
+
+  struct VM_VALUE lhs = vm->regs[instr->a];
+  struct VM_VALUE rhs = vm->regs[instr->b];
+  int operator = instr->operator;
+
+  int tag = vm_binary_tag(vm_tag(lhs), operator, vm_tag(rhs));
+
+  if (tag == VM_UNDEFINED)
+  {
+    output_printf(vm->output, "**SEMANTIC ERROR: invalid operand types (line %d)\n", instr->line);
+    return false;
+  }
+
+  if (vm_tag(lhs) == VM_STR)
+  {
+    char* l = vm_as_str(lhs);
+    char* r = vm_as_str(rhs);
+
+    if (operator != OPERATOR_PLUS)
+    {
+      int compare = strcmp(l, r);
+      bool result;
+
+      switch (operator)
+      {
+      case OPERATOR_EQUAL:     result = compare == 0; break;
+      case OPERATOR_NOT_EQUAL: result = compare != 0; break;
+      case OPERATOR_LT:        result = compare < 0;  break;
+      case OPERATOR_LTE:       result = compare <= 0; break;
+      case OPERATOR_GT:        result = compare > 0;  break;
+      default:                 result = compare >= 0; break;
+      }
+
+      vm_set(vm, instr->dst, vm_bool(result));
+      return true;
+    }
+
+    if (instr->dst == instr->a)
+    {
+      //
+      // s = s + t: the register owns the string, grow it in place:
+      //
+      vm->regs[instr->dst] = vm_str(strbuild_append(vm->strings, instr->dst, l, r));
+      return true;
+    }
+
+    char* concatenated = (char*) malloc(strlen(l) + strlen(r) + 1);
+
+    if (concatenated == NULL)
+      exit(0);
+
+    strcpy(concatenated, l);
+    strcat(concatenated, r);
+
+    vm_set(vm, instr->dst, vm_str(concatenated));
+    return true;
+  }
+
+  if (vm_tag(lhs) == VM_INT && vm_tag(rhs) == VM_INT)
+  {
+    unsigned int l = (unsigned int) vm_as_int(lhs);
+    unsigned int r = (unsigned int) vm_as_int(rhs);
+    int result;
+
+    switch (operator)
+    {
+    case OPERATOR_PLUS:     result = (int) (l + r); break;
+    case OPERATOR_MINUS:    result = (int) (l - r); break;
+    case OPERATOR_ASTERISK: result = (int) (l * r); break;
+    case OPERATOR_POWER:    result = arith_power_ints((int) l, (int) r); break;
+
+    case OPERATOR_MOD:
+    case OPERATOR_DIV:
+      if (r == 0)
+      {
+        output_printf(vm->output, "**ZeroDivisionError: division by zero (line %d)\n", instr->line);
+        return false;
+      }
+
+      result = (operator == OPERATOR_MOD) ? (int) l % (int) r : (int) l / (int) r;
+      break;
+
+    case OPERATOR_EQUAL:     vm_set(vm, instr->dst, vm_bool(l == r)); return true;
+    case OPERATOR_NOT_EQUAL: vm_set(vm, instr->dst, vm_bool(l != r)); return true;
+    case OPERATOR_LT:        vm_set(vm, instr->dst, vm_bool((int) l < (int) r)); return true;
+    case OPERATOR_LTE:       vm_set(vm, instr->dst, vm_bool((int) l <= (int) r)); return true;
+    case OPERATOR_GT:        vm_set(vm, instr->dst, vm_bool((int) l > (int) r)); return true;
+    default:                 vm_set(vm, instr->dst, vm_bool((int) l >= (int) r)); return true;
+    }
+
+    vm_set(vm, instr->dst, vm_int(result));
+    return true;
+  }
+
+  //
+  // at least one real:
+  //
+  double l = (vm_tag(lhs) == VM_INT) ? vm_as_int(lhs) : vm_as_real(lhs);
+  double r = (vm_tag(rhs) == VM_INT) ? vm_as_int(rhs) : vm_as_real(rhs);
+  double result;
+
+  switch (operator)
+  {
+  case OPERATOR_PLUS:     result = l + r; break;
+  case OPERATOR_MINUS:    result = l - r; break;
+  case OPERATOR_ASTERISK: result = l * r; break;
+  case OPERATOR_POWER:    result = pow(l, r); break;
+  case OPERATOR_MOD:      result = fmod(l, r); break;
+
+  case OPERATOR_DIV:
+    if (r == 0.0)
+    {
+      output_printf(vm->output, "**ZeroDivisionError: division by zero (line %d)\n", instr->line);
+      return false;
+    }
+
+    result = l / r;
+    break;
+
+  case OPERATOR_EQUAL:     vm_set(vm, instr->dst, vm_bool(l == r)); return true;
+  case OPERATOR_NOT_EQUAL: vm_set(vm, instr->dst, vm_bool(l != r)); return true;
+  case OPERATOR_LT:        vm_set(vm, instr->dst, vm_bool(l < r));  return true;
+  case OPERATOR_LTE:       vm_set(vm, instr->dst, vm_bool(l <= r)); return true;
+  case OPERATOR_GT:        vm_set(vm, instr->dst, vm_bool(l > r));  return true;
+  default:                 vm_set(vm, instr->dst, vm_bool(l >= r)); return true;
+  }
+
+  vm_set(vm, instr->dst, vm_real(result));
+  return true;
+}
+
+//
+// vm_to_ram
+//
+// Converts a register value to a memory value; a string is
+// borrowed, not copied.
+//
+static struct RAM_VALUE vm_to_ram(struct VM_VALUE value)
+{
+  struct RAM_VALUE ram_value;
+
+  switch (vm_tag(value))
+  {
+  case VM_INT:
+    ram_value.value_type = RAM_TYPE_INT;
+    ram_value.types.i = vm_as_int(value);
+    break;
+
+  case VM_REAL:
+    ram_value.value_type = RAM_TYPE_REAL;
+    ram_value.types.d = vm_as_real(value);
+    break;
+
+  case VM_STR:
+    ram_value.value_type = RAM_TYPE_STR;
+    ram_value.types.s = vm_as_str(value);
+    break;
+
+  case VM_BOOL:
+    ram_value.value_type = RAM_TYPE_BOOLEAN;
+    ram_value.types.i = vm_as_int(value);
+    break;
+
+  default:
+    ram_value.value_type = RAM_TYPE_NONE;
+    ram_value.types.i = 0;
+    break;
+  }
+
+  return ram_value;
+}
+
+//
+// vm_from_ram
+//
+// Converts a memory value to a register value; a string is
+// copied, since registers own their strings.
+//
+static struct VM_VALUE vm_from_ram(struct RAM_VALUE* value)
+{
+  switch (value->value_type)
+  {
+  case RAM_TYPE_INT:
+  case RAM_TYPE_PTR:  // no pointer operations in nuPython yet
+    return vm_int(value->types.i);
+
+  case RAM_TYPE_REAL:
+    return vm_real(value->types.d);
+
+  case RAM_TYPE_BOOLEAN:
+    return vm_bool(value->types.i != 0);
+
+  case RAM_TYPE_STR:
+  {
+    char* s = (char*) malloc(strlen(value->types.s) + 1);
+
+    if (s == NULL)
+      exit(0);
+
+    strcpy(s, value->types.s);
+    return vm_str(s);
+  }
+
+  default:
+    return vm_none();
+  }
+}
+
+//
+// vm_load
+//
+// Sets up the registers: literals and temporaries from the code,
+// variables from memory if they're already there.
+//
+static void vm_load(struct VM_STATE* vm)
+{
+  struct VM_CODE* code = vm->code;
+
+  for (int r = 0; r < code->num_regs; r++)
+    vm->regs[r] = code->initial[r];
+
+  for (int v = 0; v < code->num_vars; v++)
+  {
+    int address = ram_get_addr(vm->memory, code->vars[v].name);
+
+    vm->addresses[v] = address;
+
+    if (address >= 0)
+      vm->regs[v] = vm_from_ram(&vm->memory->cells[address].value);
+  }
+}
+
+//
+// vm_store
+//
+// Writes every variable back to its memory cell, then frees
+// the strings still owned by the registers.
+//
+static void vm_store(struct VM_STATE* vm)
+{
+  struct VM_CODE* code = vm->code;
+  int previous = alloc_enter(ALLOC_RAM);
+
+  for (int v = 0; v < code->num_vars; v++)
+  {
+    struct VM_VALUE value = vm->regs[v];
+
+    if (vm->addresses[v] < 0 || vm_tag(value) == VM_UNDEFINED)
+      continue;
+
+    if (vm_tag(value) != VM_STR)
+    {
+      ram_write_cell_by_addr(vm->memory, vm_to_ram(value), vm->addresses[v]);
+      continue;
+    }
+
+    //
+    // the register's string is handed over to memory rather
+    // than copied, strings built in a loop can be large:
+    //
+    struct RAM_VALUE* cell = &vm->memory->cells[vm->addresses[v]].value;
+
+    if (cell->value_type == RAM_TYPE_STR)
+      free(cell->types.s);
+
+    *cell = vm_to_ram(value);
+
+    vm->regs[v] = vm_undefined();
+  }
+
+  alloc_leave(previous);
+
+  for (int r = 0; r < code->num_regs; r++)
+  {
+    if (!code->is_literal[r] && vm_tag(vm->regs[r]) == VM_STR)
+      free(vm_as_str(vm->regs[r]));
+  }
+}
+
+
+//
+// vm_print_operand
+//
+// Prints a register the way it appears in the program: a
+// variable's name, or a literal's value.
+//
+static void vm_print_operand(struct VM_CODE* code, int reg)
+{
+  struct VM_VALUE value = code->initial[reg];
+
+  if (reg < code->num_vars)
+    printf("%s", code->vars[reg].name);
+  else if (vm_tag(value) == VM_INT)
+    printf("%d", vm_as_int(value));
+  else if (vm_tag(value) == VM_REAL)
+    printf("%f", vm_as_real(value));
+  else if (vm_tag(value) == VM_STR)
+    printf("\"%s\"", vm_as_str(value));
+  else if (vm_tag(value) == VM_BOOL)
+    printf(vm_as_bool(value) ? "True" : "False");
+  else
+    printf("r%d", reg);
+}
+
+
+//
+// vm_power_sums
+//
+// Computes sums[d] = 0^d + 1^d + ... + (n-1)^d mod 2^32, for d up
+// to VM_COUNTED_MAX_DEGREE (0 < n < 2^33). The divisions in the
+// formulas are exact, so they're done before multiplying, while
+// the factors are still whole.
+//
+static void vm_power_sums(long long n, uint32_t sums[VM_COUNTED_MAX_DEGREE + 1])
+{
+  unsigned long long x = (unsigned long long) n - 1;  // n(n-1)/2
+  unsigned long long y = (unsigned long long) n;
+  unsigned long long z = 2 * (unsigned long long) n - 1;  // (n-1)n(2n-1)/6
+
+  if (x % 2 == 0)
+    x /= 2;
+  else
+    y /= 2;
+
+  sums[0] = (uint32_t) n;
+  sums[1] = (uint32_t) x * (uint32_t) y;
+  sums[3] = sums[1] * sums[1];
+
+  if (x % 3 == 0)
+    x /= 3;
+  else if (y % 3 == 0)
+    y /= 3;
+  else
+    z /= 3;
+
+  sums[2] = (uint32_t) x * (uint32_t) y * (uint32_t) z;
+}
+
+//
+// vm_counted_poly
+//
+// Returns, in poly, the value of register reg at step k of the
+// counted loop, as a polynomial in the iteration # (coefficients
+// mod 2^32, as int arithmetic wraps): the counter is counter,
+// values assigned earlier in the body are in values, anything
+// else is the constant in the register.
+//
+static void vm_counted_poly(struct VM_STATE* vm, struct VM_COUNTED* loop, int k, int reg,
+                            uint32_t* counter, uint32_t (*values)[VM_COUNTED_MAX_DEGREE + 1], uint32_t* poly)
+{
+  uint32_t* found = NULL;
+
+  if (reg == loop->counter)
+    found = counter;
+
+  for (int s = 0; s < k && found == NULL; s++)
+    if (loop->steps[s].kind == VM_COUNT_VALUE && loop->steps[s].dst == reg)
+      found = values[s];
+
+  for (int d = 0; d <= VM_COUNTED_MAX_DEGREE; d++)
+    poly[d] = (found != NULL) ? found[d] : 0;
+
+  if (found == NULL)
+    poly[0] = (uint32_t) vm_as_int(vm->regs[reg]);
+}
+
+//
+// vm_run_counted
+//
+// Runs the counted loop in closed form: computes the # of times
+// around, then the final value of every variable the body
+// assigns, exactly as the loop would (ints wrap mod 2^32), and
+// assigns them in body order. Returns false, having changed
+// nothing, if the loop must run as usual: a value read isn't an
+// int, or the counter would wrap around (or never stop).
+//
+static bool vm_run_counted(struct VM_STATE* vm, struct VM_COUNTED* loop)
+{
+  struct VM_VALUE* regs = vm->regs;
+
+  //
+  // values from before the loop must be ints; values assigned
+  // earlier in the body are ints by then:
+  //
+  if (vm_tag(regs[loop->counter]) != VM_INT || vm_tag(regs[loop->limit]) != VM_INT)
+    return false;
+
+  for (int k = 0; k < loop->num_steps; k++)
+  {
+    struct VM_COUNTED_STEP* step = &loop->steps[k];
+    int reads[3] = { step->a, step->b, (step->kind == VM_COUNT_VALUE) ? step->a : step->dst };
+
+    for (int r = 0; r < 3; r++)
+    {
+      bool assigned = false;
+
+      for (int s = 0; s < k; s++)
+        if (loop->steps[s].kind == VM_COUNT_VALUE && loop->steps[s].dst == reads[r])
+          assigned = true;
+
+      if (!assigned && vm_tag(regs[reads[r]]) != VM_INT)
+        return false;
+    }
+  }
+
+  //
+  // # of times around: while i < end (or i > end) with i going
+  // from i0 by delta:
+  //
+  long long i0 = vm_as_int(regs[loop->counter]);
+  long long limit = vm_as_int(regs[loop->limit]);
+  long long delta = loop->step;
+  long long n;
+
+  if (loop->operator == OPERATOR_LT || loop->operator == OPERATOR_LTE)
+  {
+    long long end = (loop->operator == OPERATOR_LT) ? limit : limit + 1;
+
+    if (i0 >= end)
+      n = 0;
+    else if (delta < 0)
+      return false;
+    else
+      n = (end - i0 + delta - 1) / delta;
+  }
+  else
+  {
+    long long end = (loop->operator == OPERATOR_GT) ? limit : limit - 1;
+
+    if (i0 <= end)
+      n = 0;
+    else if (delta > 0)
+      return false;
+    else
+      n = (i0 - end - delta - 1) / -delta;
+  }
+
+  long long last = i0 + n * delta;  // the counter once the loop is done
+
+  if (last < INT_MIN || last > INT_MAX)
+    return false;
+
+  if (n == 0)
+    return true;
+
+  //
+  // the value of each step as a polynomial in the iteration # j,
+  // and from those the final values:
+  //
+  uint32_t sums[VM_COUNTED_MAX_DEGREE + 1];
+  uint32_t counter[VM_COUNTED_MAX_DEGREE + 1] = { (uint32_t) i0, (uint32_t) delta };
+  uint32_t values[VM_COUNTED_MAX_STEPS][VM_COUNTED_MAX_DEGREE + 1];
+  uint32_t finals[VM_COUNTED_MAX_STEPS];
+
+  vm_power_sums(n, sums);
+
+  for (int k = 0; k < loop->num_steps; k++)
+  {
+    struct VM_COUNTED_STEP* step = &loop->steps[k];
+    uint32_t a[VM_COUNTED_MAX_DEGREE + 1];
+    uint32_t b[VM_COUNTED_MAX_DEGREE + 1];
+    uint32_t* value = values[k];
+
+    if (step->kind == VM_COUNT_STEP)
+    {
+      counter[0] += (uint32_t) loop->step;
+      finals[k] = (uint32_t) last;
+      continue;
+    }
+
+    vm_counted_poly(vm, loop, k, step->a, counter, values, a);
+    vm_counted_poly(vm, loop, k, step->b, counter, values, b);
+
+    for (int d = 0; d <= VM_COUNTED_MAX_DEGREE; d++)
+    {
+      if (step->operator == OPERATOR_PLUS && step->kind == VM_COUNT_VALUE)
+        value[d] = a[d] + b[d];
+      else if (step->operator == OPERATOR_MINUS && step->kind == VM_COUNT_VALUE)
+        value[d] = a[d] - b[d];
+      else if (step->operator == OPERATOR_ASTERISK)
+      {
+        value[d] = 0;
+
+        for (int e = 0; e <= d; e++)
+          value[d] += a[e] * b[d - e];
+      }
+      else
+        value[d] = a[d];
+    }
+
+    //
+    // a value ends up as it was in the last iteration, a sum
+    // adds up the value over all of them:
+    //
+    uint32_t total = 0;
+    uint32_t power = 1;
+    uint32_t j = (uint32_t) (n - 1);
+
+    for (int d = 0; d <= VM_COUNTED_MAX_DEGREE; d++)
+    {
+      if (step->kind == VM_COUNT_VALUE)
+        total += value[d] * power;
+      else
+        total += value[d] * sums[d];
+
+      power *= j;
+    }
+
+    if (step->kind == VM_COUNT_ADD)
+      total = (uint32_t) vm_as_int(regs[step->dst]) + total;
+    else if (step->kind == VM_COUNT_SUB)
+      total = (uint32_t) vm_as_int(regs[step->dst]) - total;
+
+    finals[k] = total;
+  }
+
+  for (int k = 0; k < loop->num_steps; k++)
+    vm_set(vm, loop->steps[k].dst, vm_int((int) finals[k]));
+
+  return true;
+}
+
+//
+// vm_jump
+//
+// Returns to, the target of a jump taken at from. On a budget,
+// the stmts in the instructions that ran since the last jump are
+// counted first.
+//
+static inline int vm_jump(struct VM_STATE* vm, int from, int to)
+{
+  if (vm->budget != NULL)
+  {
+    vm->budget->stmts += vm->before[from + 1] - vm->before[vm->entry];
+    vm->entry = to;
+  }
+
+  return to;
+}
+
+//
+// vm_execute
+//
+// The interpreter loop of vm_run. Counts pairs if the context
+// has a VM profile, and stmts if it has a budget. Hot loops go to
+// the JIT if the code was compiled with VM_JIT (but not when
+// profiling, on a budget, or with a stop flag: the machine code
+// doesn't count pairs or stmts, and doesn't look at the flag).
+//
+static bool vm_execute(struct VM_CODE* code, struct CONTEXT* context)
+{
+  struct VM_STATE vm;
+  struct JIT* jit = NULL;
+  struct RAM* memory = context->memory;
+  struct OUTPUT* output = context->output;
+  struct VM_PROFILE* profile = context->pairs;
+  struct BUDGET* budget = context->budget;
+  atomic_bool* stop = context->stop;
+
+  if ((code->options & VM_JIT) && profile == NULL && budget == NULL && stop == NULL)
+    jit = jit_init(code);
+
+  vm.code = code;
+  vm.memory = memory;
+  vm.output = output;
+  vm.input = context->input;
+  vm.regs = (struct VM_VALUE*) malloc((code->num_regs + 1) * sizeof(struct VM_VALUE));
+  vm.addresses = (int*) malloc((code->num_vars + 1) * sizeof(int));
+  vm.strings = strbuild_init();
+
+  vm.budget = budget;
+  vm.before = NULL;
+  vm.entry = 0;
+
+  if (vm.regs == NULL || vm.addresses == NULL)
+    exit(0);
+
+  if (budget != NULL)
+  {
+    vm.before = (int*) malloc((code->num_instrs + 1) * sizeof(int));
+
+    if (vm.before == NULL)
+      exit(0);
+
+    vm.before[0] = 0;
+
+    for (int pc = 0; pc < code->num_instrs; pc++)
+      vm.before[pc + 1] = vm.before[pc] + code->instrs[pc].stmts;
+  }
+
+  vm_load(&vm);
+
+  struct VM_VALUE* regs = vm.regs;
+  struct VM_INSTR* instrs = code->instrs;
+  struct VM_INSTR* instr = NULL;
+  bool success = true;
+  int pc = 0;
+  int previous = VM_HALT;  // opcode executed last, when profiling
+
+  while (success)
+  {
+    instr = &instrs[pc];
+
+    if (profile != NULL)
+    {
+      if (pc != 0)
+        profile->pairs[previous][instr->opcode]++;
+
+      previous = instr->opcode;
+    }
+
+    switch (instr->opcode)
+    {
+    case VM_HALT:
+      goto done;
+
+    case VM_MOVE:
+    {
+      if (!vm_defined(&vm, instr->a, instr->line))
+      {
+        success = false;
+        break;
+      }
+
+      struct VM_VALUE value = regs[instr->a];
+
+      if (instr->dst == instr->a)  // x = x
+      {
+        pc++;
+        break;
+      }
+
+      if (vm_tag(value) == VM_STR)
+      {
+        char* s = (char*) malloc(strlen(vm_as_str(value)) + 1);
+
+        if (s == NULL)
+          exit(0);
+
+        strcpy(s, vm_as_str(value));
+        value = vm_str(s);
+      }
+
+      vm_set(&vm, instr->dst, value);
+      pc++;
+      break;
+    }
+
+    case VM_MOVE_RAW:
+      regs[instr->dst] = regs[instr->a];
+      pc++;
+      break;
+
+    case VM_BINARY:
+      success = vm_binary(&vm, instr);
+      pc++;
+      break;
+
+    //
+    // typed int operations, wrapping on overflow like the
+    // generic version:
+    //
+    case VM_ADD_II:
+      regs[instr->dst] = vm_int((int) ((unsigned int) vm_as_int(regs[instr->a]) + (unsigned int) vm_as_int(regs[instr->b])));
+      pc++;
+      break;
+
+    case VM_SUB_II:
+      regs[instr->dst] = vm_int((int) ((unsigned int) vm_as_int(regs[instr->a]) - (unsigned int) vm_as_int(regs[instr->b])));
+      pc++;
+      break;
+
+    case VM_MUL_II:
+      regs[instr->dst] = vm_int((int) ((unsigned int) vm_as_int(regs[instr->a]) * (unsigned int) vm_as_int(regs[instr->b])));
+      pc++;
+      break;
+
+    case VM_POW_II:
+      regs[instr->dst] = vm_int(arith_power_ints(vm_as_int(regs[instr->a]), vm_as_int(regs[instr->b])));
+      pc++;
+      break;
+
+    case VM_MOD_II:
+    case VM_DIV_II:
+    {
+      int l = vm_as_int(regs[instr->a]);
+      int r = vm_as_int(regs[instr->b]);
+
+      if (r == 0)
+      {
+        output_printf(output, "**ZeroDivisionError: division by zero (line %d)\n", instr->line);
+        success = false;
+        break;
+      }
+
+      regs[instr->dst] = vm_int(instr->opcode == VM_MOD_II ? l % r : l / r);
+      pc++;
+      break;
+    }
+
+    case VM_DIV_NZ_II:
+      regs[instr->dst] = vm_int(vm_as_int(regs[instr->a]) / vm_as_int(regs[instr->b]));
+      pc++;
+      break;
+
+    case VM_MOD_NZ_II:
+      regs[instr->dst] = vm_int(vm_as_int(regs[instr->a]) % vm_as_int(regs[instr->b]));
+      pc++;
+      break;
+
+    case VM_COUNTED_LOOP:
+      //
+      // on a budget or profiling, the loop runs as usual so its
+      // stmts and pairs are counted:
+      //
+      if (budget == NULL && profile == NULL && vm_run_counted(&vm, &code->counted[instr->a]))
+        pc = instr->dst;
+      else
+        pc++;
+      break;
+
+    case VM_EQ_II:
+      regs[instr->dst] = vm_bool(vm_as_int(regs[instr->a]) == vm_as_int(regs[instr->b]));
+      pc++;
+      break;
+
+    case VM_NE_II:
+      regs[instr->dst] = vm_bool(vm_as_int(regs[instr->a]) != vm_as_int(regs[instr->b]));
+      pc++;
+      break;
+
+    case VM_LT_II:
+      regs[instr->dst] = vm_bool(vm_as_int(regs[instr->a]) < vm_as_int(regs[instr->b]));
+      pc++;
+      break;
+
+    case VM_LE_II:
+      regs[instr->dst] = vm_bool(vm_as_int(regs[instr->a]) <= vm_as_int(regs[instr->b]));
+      pc++;
+      break;
+
+    case VM_GT_II:
+      regs[instr->dst] = vm_bool(vm_as_int(regs[instr->a]) > vm_as_int(regs[instr->b]));
+      pc++;
+      break;
+
+    case VM_GE_II:
+      regs[instr->dst] = vm_bool(vm_as_int(regs[instr->a]) >= vm_as_int(regs[instr->b]));
+      pc++;
+      break;
+
+    //
+    // typed real operations:
+    //
+    case VM_ADD_RR:
+      regs[instr->dst] = vm_real(vm_as_real(regs[instr->a]) + vm_as_real(regs[instr->b]));
+      pc++;
+      break;
+
+    case VM_SUB_RR:
+      regs[instr->dst] = vm_real(vm_as_real(regs[instr->a]) - vm_as_real(regs[instr->b]));
+      pc++;
+      break;
+
+    case VM_MUL_RR:
+      regs[instr->dst] = vm_real(vm_as_real(regs[instr->a]) * vm_as_real(regs[instr->b]));
+      pc++;
+      break;
+
+    case VM_POW_RR:
+      regs[instr->dst] = vm_real(pow(vm_as_real(regs[instr->a]), vm_as_real(regs[instr->b])));
+      pc++;
+      break;
+
+    case VM_MOD_RR:
+      regs[instr->dst] = vm_real(fmod(vm_as_real(regs[instr->a]), vm_as_real(regs[instr->b])));
+      pc++;
+      break;
+
+    case VM_DIV_RR:
+    {
+      double r = vm_as_real(regs[instr->b]);
+
+      if (r == 0.0)
+      {
+        output_printf(output, "**ZeroDivisionError: division by zero (line %d)\n", instr->line);
+        success = false;
+        break;
+      }
+
+      regs[instr->dst] = vm_real(vm_as_real(regs[instr->a]) / r);
+      pc++;
+      break;
+    }
+
+    case VM_EQ_RR:
+      regs[instr->dst] = vm_bool(vm_as_real(regs[instr->a]) == vm_as_real(regs[instr->b]));
+      pc++;
+      break;
+
+    case VM_NE_RR:
+      regs[instr->dst] = vm_bool(vm_as_real(regs[instr->a]) != vm_as_real(regs[instr->b]));
+      pc++;
+      break;
+
+    case VM_LT_RR:
+      regs[instr->dst] = vm_bool(vm_as_real(regs[instr->a]) < vm_as_real(regs[instr->b]));
+      pc++;
+      break;
+
+    case VM_LE_RR:
+      regs[instr->dst] = vm_bool(vm_as_real(regs[instr->a]) <= vm_as_real(regs[instr->b]));
+      pc++;
+      break;
+
+    case VM_GT_RR:
+      regs[instr->dst] = vm_bool(vm_as_real(regs[instr->a]) > vm_as_real(regs[instr->b]));
+      pc++;
+      break;
+
+    case VM_GE_RR:
+      regs[instr->dst] = vm_bool(vm_as_real(regs[instr->a]) >= vm_as_real(regs[instr->b]));
+      pc++;
+      break;
+
+    case VM_JUMP:
+      if (instr->a > pc)
+        pc = vm_jump(&vm, pc, instr->a);
+      else if (stop != NULL && atomic_load_explicit(stop, memory_order_relaxed))
+      {
+        success = false;  // stopped from outside, no message
+        break;
+      }
+      else if (budget != NULL)  // back edge of a while loop
+      {
+        vm_jump(&vm, pc, instr->a);
+
+        if (!budget_check(budget, output, instr->line))
+        {
+          success = false;
+          break;
+        }
+
+        pc = instr->a;
+      }
+      else if (jit != NULL)
+        pc = jit_run(jit, instr->a, pc, regs);
+      else
+        pc = instr->a;
+      break;
+
+    case VM_JUMP_IF_FALSE:
+      if (!vm_defined(&vm, instr->a, instr->line))
+      {
+        success = false;
+        break;
+      }
+
+      pc = vm_is_true(regs[instr->a]) ? pc + 1 : vm_jump(&vm, pc, instr->b);
+      break;
+
+    case VM_JUMP_IF_FALSE_BOOL:
+      pc = vm_as_bool(regs[instr->a]) ? pc + 1 : vm_jump(&vm, pc, instr->b);
+      break;
+
+    case VM_PRINT:
+    {
+      if (!vm_defined(&vm, instr->a, instr->line))
+      {
+        success = false;
+        break;
+      }
+
+      struct VM_VALUE value = regs[instr->a];
+
+      if (vm_tag(value) == VM_INT)
+        output_printf(output, "%d\n", vm_as_int(value));
+      else if (vm_tag(value) == VM_REAL)
+        output_printf(output, "%f\n", vm_as_real(value));
+      else if (vm_tag(value) == VM_STR)
+        output_printf(output, "%s\n", vm_as_str(value));
+      else if (vm_tag(value) == VM_BOOL)
+        output_printf(output, vm_as_bool(value) ? "True\n" : "False\n");
+
+      pc++;
+      break;
+    }
+
+    case VM_PRINT_NEWLINE:
+      output_printf(output, "\n");
+      pc++;
+      break;
+
+    case VM_PRINT_INT:
+      output_printf(output, "%d\n", vm_as_int(regs[instr->a]));
+      pc++;
+      break;
+
+    case VM_PRINT_REAL:
+      output_printf(output, "%f\n", vm_as_real(regs[instr->a]));
+      pc++;
+      break;
+
+    case VM_PRINT_STR:
+      output_printf(output, "%s\n", vm_as_str(regs[instr->a]));
+      pc++;
+      break;
+
+    //
+    // superinstructions:
+    //
+    case VM_ADD_IMM_II:
+      regs[instr->dst] = vm_int((int) ((unsigned int) vm_as_int(regs[instr->a]) + (unsigned int) instr->b));
+      pc++;
+      break;
+
+    case VM_JUMP_UNLESS_EQ_II:
+      pc = (vm_as_int(regs[instr->a]) == vm_as_int(regs[instr->b])) ? pc + 1 : vm_jump(&vm, pc, instr->dst);
+      break;
+
+    case VM_JUMP_UNLESS_NE_II:
+      pc = (vm_as_int(regs[instr->a]) != vm_as_int(regs[instr->b])) ? pc + 1 : vm_jump(&vm, pc, instr->dst);
+      break;
+
+    case VM_JUMP_UNLESS_LT_II:
+      pc = (vm_as_int(regs[instr->a]) < vm_as_int(regs[instr->b])) ? pc + 1 : vm_jump(&vm, pc, instr->dst);
+      break;
+
+    case VM_JUMP_UNLESS_LE_II:
+      pc = (vm_as_int(regs[instr->a]) <= vm_as_int(regs[instr->b])) ? pc + 1 : vm_jump(&vm, pc, instr->dst);
+      break;
+
+    case VM_JUMP_UNLESS_GT_II:
+      pc = (vm_as_int(regs[instr->a]) > vm_as_int(regs[instr->b])) ? pc + 1 : vm_jump(&vm, pc, instr->dst);
+      break;
+
+    case VM_JUMP_UNLESS_GE_II:
+      pc = (vm_as_int(regs[instr->a]) >= vm_as_int(regs[instr->b])) ? pc + 1 : vm_jump(&vm, pc, instr->dst);
+      break;
+
+    case VM_JUMP_UNLESS_EQ_RR:
+      pc = (vm_as_real(regs[instr->a]) == vm_as_real(regs[instr->b])) ? pc + 1 : vm_jump(&vm, pc, instr->dst);
+      break;
+
+    case VM_JUMP_UNLESS_NE_RR:
+      pc = (vm_as_real(regs[instr->a]) != vm_as_real(regs[instr->b])) ? pc + 1 : vm_jump(&vm, pc, instr->dst);
+      break;
+
+    case VM_JUMP_UNLESS_LT_RR:
+      pc = (vm_as_real(regs[instr->a]) < vm_as_real(regs[instr->b])) ? pc + 1 : vm_jump(&vm, pc, instr->dst);
+      break;
+
+    case VM_JUMP_UNLESS_LE_RR:
+      pc = (vm_as_real(regs[instr->a]) <= vm_as_real(regs[instr->b])) ? pc + 1 : vm_jump(&vm, pc, instr->dst);
+      break;
+
+    case VM_JUMP_UNLESS_GT_RR:
+      pc = (vm_as_real(regs[instr->a]) > vm_as_real(regs[instr->b])) ? pc + 1 : vm_jump(&vm, pc, instr->dst);
+      break;
+
+    case VM_JUMP_UNLESS_GE_RR:
+      pc = (vm_as_real(regs[instr->a]) >= vm_as_real(regs[instr->b])) ? pc + 1 : vm_jump(&vm, pc, instr->dst);
+      break;
+
+    case VM_INPUT:
+    {
+      output_printf(output, "%s", vm_as_str(regs[instr->a]));
+
+      //
+      // the prompt must be visible before we block on input:
+      //
+      output_flush(output);
+
+      char* user_input;
+
+      input_read_line(vm.input, &user_input);
+
+      vm_set(&vm, instr->dst, vm_str(user_input));
+      pc++;
+      break;
+    }
+
+    case VM_TO_INT:
+    case VM_TO_FLOAT:
+    {
+      if (!vm_defined(&vm, instr->a, instr->line))
+      {
+        success = false;
+        break;
+      }
+
+      struct VM_VALUE value = regs[instr->a];
+      bool is_int = (instr->opcode == VM_TO_INT);
+
+      if (vm_tag(value) != VM_STR)
+      {
+        output_printf(output, "**SEMANTIC ERROR: invalid string for %s() (line %d)\n", is_int ? "int" : "float", instr->line);
+        success = false;
+        break;
+      }
+
+      char* s = vm_as_str(value);
+
+      if (is_int)
+      {
+        int var_int;
+
+        if (!arith_string_to_int(s, &var_int))
+        {
+          output_printf(output, "**SEMANTIC ERROR: invalid string for int() (line %d)\n", instr->line);
+          success = false;
+          break;
+        }
+
+        vm_set(&vm, instr->dst, vm_int(var_int));
+      }
+      else
+      {
+        double var_float;
+
+        if (!arith_string_to_real(s, &var_float))
+        {
+          output_printf(output, "**SEMANTIC ERROR: invalid string for float() (line %d)\n", instr->line);
+          success = false;
+          break;
+        }
+
+        vm_set(&vm, instr->dst, vm_real(var_float));
+      }
+
+      pc++;
+      break;
+    }
+
+    default:
+      output_printf(output, "**INTERNAL ERROR: unexpected opcode (%d) in vm_run\n", instr->opcode);
+      success = false;
+      break;
+    }
+  }
+
+done:
+  //
+  // on a budget, count the stmts since the last jump, up to the
+  // instruction that halted or failed:
+  //
+  if (budget != NULL && !budget->exhausted)
+  {
+    int last = (int) (instr - instrs);
+
+    budget->stmts += vm.before[last + 1] - vm.before[vm.entry];
+
+    if (!success)
+      budget->line = instr->line;
+  }
+
+  vm_store(&vm);
+  output_flush(output);
+
+  strbuild_destroy(vm.strings);
+  jit_destroy(jit);
+  free(vm.before);
+  free(vm.addresses);
+  free(vm.regs);
+
+  return success;
+}
+
+//
+// vm_compare_pairs
+//
+// qsort comparison for vm_print_profile: pairs are numbered
+// x * VM_NUM_OPCODES + y, ordered by decreasing count.
+//
+static const struct VM_PROFILE* vm_sorting;
+
+static int vm_compare_pairs(const void* x, const void* y)
+{
+  int px = *(const int*) x;
+  int py = *(const int*) y;
+  long cx = vm_sorting->pairs[px / VM_NUM_OPCODES][px % VM_NUM_OPCODES];
+  long cy = vm_sorting->pairs[py / VM_NUM_OPCODES][py % VM_NUM_OPCODES];
+
+  if (cx != cy)
+    return (cx > cy) ? -1 : 1;
+
+  return px - py;
+}
+
+//
+// Public functions:
+//
+
+//
+// vm_compile
+//
+// Compiles the program graph, returns NULL if unsupported.
+//
+struct VM_CODE* vm_compile(struct STMT* program, int options)
+{
+  return vm_compile_until(program, NULL, options);
+}
+
+//
+// vm_compile_until
+//
+// Compiles the stmts from program up to stop, returns NULL if
+// unsupported.
+//
+struct VM_CODE* vm_compile_until(struct STMT* program, struct STMT* stop, int options)
+{
+  struct VM_CODE* code = (struct VM_CODE*) malloc(sizeof(struct VM_CODE));
+  struct COMPILER c;
+
+  if (code == NULL)
+    exit(0);
+
+  code->num_instrs = 0;
+  code->instrs_capacity = 16;
+  code->instrs = (struct VM_INSTR*) malloc(code->instrs_capacity * sizeof(struct VM_INSTR));
+
+  code->num_vars = 0;
+  code->vars_capacity = 8;
+  code->vars = (struct VM_VAR*) malloc(code->vars_capacity * sizeof(struct VM_VAR));
+
+  code->initial = NULL;
+  code->is_literal = NULL;
+  code->num_regs = 0;
+  code->regs_capacity = 0;
+
+  code->hoisted = NULL;
+  code->num_hoisted = 0;
+  code->hoisted_capacity = 0;
+
+  code->counted = NULL;
+  code->num_counted = 0;
+  code->counted_capacity = 0;
+
+  code->options = options;
+
+  c.code = code;
+  c.ok = true;
+  c.pending = 0;
+  c.num_others = 0;
+  c.others_capacity = 16;
+  c.others = (struct VM_VALUE*) malloc(c.others_capacity * sizeof(struct VM_VALUE));
+  c.others_literal = (bool*) malloc(c.others_capacity * sizeof(bool));
+  c.num_literals = 0;
+  c.literals_capacity = 16;
+  c.literals = (int*) calloc(c.literals_capacity, sizeof(int));
+  c.names_capacity = 16;
+  c.names = (int*) calloc(c.names_capacity, sizeof(int));
+
+  if (code->instrs == NULL || code->vars == NULL || c.others == NULL || c.others_literal == NULL ||
+      c.literals == NULL || c.names == NULL)
+    exit(0);
+
+  vm_compile_seq(&c, program, stop);
+  vm_emit(&c, VM_HALT, 0, 0, 0, OPERATOR_NO_OP, 0);
+
+  if (c.ok)
+  {
+    vm_finish(&c);
+    int* typed = (int*) malloc((code->num_instrs + 1) * sizeof(int));
+
+    if (typed == NULL)
+      exit(0);
+
+    vm_analyze(code, typed);
+    vm_hoist(code, &typed);
+
+    if (!(options & VM_NO_SUPERINSTRUCTIONS))
+      vm_fuse(code, typed);
+
+    vm_count_loops(code);
+    free(typed);
+  }
+
+  free(c.others);
+  free(c.others_literal);
+  free(c.literals);
+  free(c.names);
+
+  if (!c.ok)
+  {
+    vm_free(code);
+    return NULL;
+  }
+
+  return code;
+}
+
+//
+// vm_free
+//
+// Frees the VM code.
+//
+void vm_free(struct VM_CODE* code)
+{
+  if (code == NULL)
+    return;
+
+  free(code->instrs);
+  free(code->vars);
+  free(code->initial);
+  free(code->is_literal);
+  free(code->hoisted);
+  free(code->counted);
+  free(code);
+}
+
+//
+// vm_run
+//
+// Runs the VM code in the given context, returns false on a
+// semantic error.
+//
+bool vm_run(struct VM_CODE* code, struct CONTEXT* context)
+{
+  return vm_execute(code, context);
+}
+
+//
+// vm_print
+//
+// Prints the VM code to the console, for debugging.
+//
+void vm_print(struct VM_CODE* code)
+{
+  printf("**VM CODE**\n");
+  printf("Registers: %d (%d variables)\n", code->num_regs, code->num_vars);
+
+  for (int v = 0; v < code->num_vars; v++)
+    printf(" r%d: %s\n", v, code->vars[v].name);
+
+  for (int pc = 0; pc < code->num_instrs; pc++)
+  {
+    struct VM_INSTR* instr = &code->instrs[pc];
+
+    printf(" %4d: %-18s dst=r%d a=%d b=%d op=%d (line %d)\n",
+      pc, vm_names[instr->opcode], instr->dst, instr->a, instr->b, instr->operator, instr->line);
+  }
+
+  printf("**END VM CODE**\n");
+}
+
+//
+// vm_print_hoisted
+//
+// Prints the expressions that were moved out of while loops.
+//
+void vm_print_hoisted(struct VM_CODE* code)
+{
+  static const char* symbols[] =
+  {
+    "+", "-", "*", "**", "%", "/", "==", "!=", "<", "<=", ">", ">="
+  };
+
+  //
+  // in line order:
+  //
+  int* order = (int*) malloc((code->num_hoisted + 1) * sizeof(int));
+
+  if (order == NULL)
+    exit(0);
+
+  for (int h = 0; h < code->num_hoisted; h++)
+  {
+    int i = h;
+
+    while (i > 0 && code->hoisted[order[i - 1]].line > code->hoisted[h].line)
+    {
+      order[i] = order[i - 1];
+      i--;
+    }
+
+    order[i] = h;
+  }
+
+  for (int h = 0; h < code->num_hoisted; h++)
+  {
+    struct VM_HOIST* hoist = &code->hoisted[order[h]];
+
+    printf("**hoisted: line %d: ", hoist->line);
+    vm_print_operand(code, hoist->a);
+    printf(" %s ", symbols[hoist->operator]);
+    vm_print_operand(code, hoist->b);
+    printf(" (out of while loop at line %d)\n", hoist->loop_line);
+  }
+
+  free(order);
+}
+
+//
+// vm_print_profile
+//
+// Prints the n most frequent instruction pairs.
+//
+void vm_print_profile(struct VM_PROFILE* profile, int n)
+{
+  int order[VM_NUM_OPCODES * VM_NUM_OPCODES];
+  int num_pairs = 0;
+  long total = 0;
+
+  for (int p = 0; p < VM_NUM_OPCODES * VM_NUM_OPCODES; p++)
+  {
+    long count = profile->pairs[p / VM_NUM_OPCODES][p % VM_NUM_OPCODES];
+
+    if (count > 0)
+      order[num_pairs++] = p;
+
+    total += count;
+  }
+
+  vm_sorting = profile;
+  qsort(order, num_pairs, sizeof(int), vm_compare_pairs);
+
+  for (int i = 0; i < num_pairs && i < n; i++)
+  {
+    int x = order[i] / VM_NUM_OPCODES;
+    int y = order[i] % VM_NUM_OPCODES;
+    long count = profile->pairs[x][y];
+
+    printf("**pair: %ld %s -> %s (%.1f%%)\n", count, vm_names[x], vm_names[y], 100.0 * count / total);
+  }
+}
@@ -0,0 +1,363 @@
+/*vm.h*/
+
+//
+// Register-based virtual machine for nuPython. A program graph
+// is compiled into a flat array of 3-address instructions whose
+// operands are virtual registers: one per variable, one per
+// distinct literal value, and one per temporary (e.g. a loop
+// condition). A type analysis over the compiled code then
+// replaces instructions whose operand types are known with
+// typed versions that do no tag checks, so e.g. an int-only
+// counting loop runs without a single type test (very large,
+// branchy programs are left untyped instead). The analysis also
+// tracks the range of each int, narrowed by the conditions of
+// ifs and while loops, so an int division whose divisor can't be
+// 0 (e.g. inside if d != 0:, or by a loop counter that starts at
+// 1) skips that check too.
+//
+// Typed expressions inside a while loop whose operands are not
+// written anywhere in the loop are then computed once, before the
+// loop, into a temporary; only expressions that can't fail are
+// moved (e.g. not x / y, which may divide by zero), so moving
+// them past print() and input() changes neither output nor
+// errors.
+//
+// While loops that just count, summing functions of the counter
+// (see struct VM_COUNTED), are run in closed form: whatever the #
+// of iterations, the final values are computed directly, exactly
+// as the loop would wrap them, and the loop is skipped. When the
+// values turn out not to be ints, or the counter would wrap
+// around, the loop runs as usual.
+//
+// Finally the most common instruction sequences are fused into
+// superinstructions: adding a literal (i = i + 1), comparing and
+// branching on the result (while i <= n:), and printing a value
+// of known type. vm_run can count which pairs of opcodes
+// execute back to back, to find the next candidates.
+//
+// Variables live in registers while the VM runs. A variable's
+// memory cell is created when the variable is first assigned
+// (so memory has the same layout as with the tree-walking
+// interpreter), and every cell is brought up to date when the
+// VM stops, whether or not an error occurred.
+//
+// Jad Dibs
+//
+// Northwestern University
+// CS 211
+//
+
+#pragma once
+
+#include <stdbool.h>  // true, false
+
+#include "programgraph.h"
+#include "ram.h"
+#include "output.h"
+#include "value.h"
+#include "budget.h"
+#include "context.h"
+
+
+//
+// Instructions
+//
+enum VM_OPCODES
+{
+  VM_HALT = 0,
+  VM_MOVE,              // dst = a
+  VM_BINARY,            // dst = a op b, any types
+
+  //
+  // typed versions of VM_BINARY, in the order of enum OPERATORS
+  // so that opcode = VM_ADD_II + operator:
+  //
+  VM_ADD_II,            // int op int
+  VM_SUB_II,
+  VM_MUL_II,
+  VM_POW_II,
+  VM_MOD_II,
+  VM_DIV_II,
+  VM_EQ_II,
+  VM_NE_II,
+  VM_LT_II,
+  VM_LE_II,
+  VM_GT_II,
+  VM_GE_II,
+
+  VM_ADD_RR,            // real op real
+  VM_SUB_RR,
+  VM_MUL_RR,
+  VM_POW_RR,
+  VM_MOD_RR,
+  VM_DIV_RR,
+  VM_EQ_RR,
+  VM_NE_RR,
+  VM_LT_RR,
+  VM_LE_RR,
+  VM_GT_RR,
+  VM_GE_RR,
+
+  VM_MOVE_RAW,          // dst = a, a is not a string and dst needs no cleanup
+  VM_JUMP,              // goto a
+  VM_JUMP_IF_FALSE,     // if not a: goto b
+  VM_JUMP_IF_FALSE_BOOL,// same, a is known to be a boolean
+  VM_PRINT,             // print(a)
+  VM_PRINT_NEWLINE,     // print()
+  VM_INPUT,             // dst = input(a)
+  VM_TO_INT,            // dst = int(a)
+  VM_TO_FLOAT,          // dst = float(a)
+
+  //
+  // superinstructions, see vm_fuse:
+  //
+  VM_ADD_IMM_II,        // dst = a + b, b is the literal itself (e.g. i = i + 1)
+
+  VM_JUMP_UNLESS_EQ_II, // if not a op b: goto dst, in the order of
+  VM_JUMP_UNLESS_NE_II, // enum OPERATORS (e.g. while i <= n:)
+  VM_JUMP_UNLESS_LT_II,
+  VM_JUMP_UNLESS_LE_II,
+  VM_JUMP_UNLESS_GT_II,
+  VM_JUMP_UNLESS_GE_II,
+
+  VM_JUMP_UNLESS_EQ_RR,
+  VM_JUMP_UNLESS_NE_RR,
+  VM_JUMP_UNLESS_LT_RR,
+  VM_JUMP_UNLESS_LE_RR,
+  VM_JUMP_UNLESS_GT_RR,
+  VM_JUMP_UNLESS_GE_RR,
+
+  VM_PRINT_INT,         // print(a), a is known to be an int
+  VM_PRINT_REAL,        // ... a real
+  VM_PRINT_STR,         // ... a string
+
+  //
+  // int division the range analysis proved safe: the divisor
+  // can't be 0 (nor -1 if the dividend can be INT_MIN):
+  //
+  VM_DIV_NZ_II,         // dst = a / b, no checks
+  VM_MOD_NZ_II,         // dst = a % b, no checks
+
+  VM_COUNTED_LOOP,      // run counted loop a in closed form and goto dst,
+                        // or go on into the loop, see vm_count_loops
+
+  VM_NUM_OPCODES
+};
+
+struct VM_INSTR
+{
+  int opcode;    // enum VM_OPCODES
+  int operator;  // enum OPERATORS, for VM_BINARY
+  int dst;       // destination register, or jump target
+  int a;         // first operand register, or jump target
+  int b;         // second operand register, jump target, or literal
+  int line;      // line # of the nuPython stmt
+  int stmts;     // # of stmts that start here, see vm_run
+};
+
+//
+// Options for vm_compile:
+//
+#define VM_NO_SUPERINSTRUCTIONS 1  // don't fuse instructions
+#define VM_JIT                  2  // compile hot loops to machine code, see jit.h
+
+//
+// Instruction-pair counts from a profiled run: pairs[x][y] is
+// the # of times opcode y executed right after opcode x
+//
+struct VM_PROFILE
+{
+  long pairs[VM_NUM_OPCODES][VM_NUM_OPCODES];
+};
+
+struct VM_VAR
+{
+  char* name;    // variable name, owned by the program graph
+};
+
+struct VM_HOIST
+{
+  int line;       // line # of the stmt the expression came from
+  int loop_line;  // line # of the while loop it was hoisted out of
+  int operator;   // the expression: a operator b
+  int a;
+  int b;
+  int temp;       // register it is now computed into
+};
+
+//
+// A counted loop: an int counter stepped by a literal until it
+// reaches a limit, in a body of int + - * assignments that are
+// either functions of the counter or sums over the iterations:
+//
+//   while i < n:       i = a; while i < n: { t = i * k
+//   {                                        acc = acc + t
+//     t = i * k                              i = i + 1 }
+//     acc = acc + t
+//     i = i + 1
+//   }
+//
+// Every value in such a loop is a polynomial in the iteration #
+// (of degree VM_COUNTED_MAX_DEGREE at most), so the loop can be
+// run in closed form.
+//
+#define VM_COUNTED_MAX_STEPS  16
+#define VM_COUNTED_MAX_DEGREE 3
+
+enum VM_COUNTED_KINDS
+{
+  VM_COUNT_STEP = 0,  // counter = counter + step
+  VM_COUNT_VALUE,     // dst = a operator b, or dst = a if no operator
+  VM_COUNT_ADD,       // dst = dst + a
+  VM_COUNT_SUB        // dst = dst - a
+};
+
+struct VM_COUNTED_STEP
+{
+  int kind;      // enum VM_COUNTED_KINDS
+  int dst;       // register assigned
+  int operator;  // for VM_COUNT_VALUE: +, -, *, or OPERATOR_NO_OP
+  int a;         // operand registers
+  int b;
+};
+
+struct VM_COUNTED
+{
+  int line;      // line # of the while loop
+  int counter;   // register of the counter
+  int limit;     // register it's compared to, not written in the loop
+  int operator;  // while counter operator limit: <, <=, >, >=
+  int step;      // added to the counter each time around
+
+  struct VM_COUNTED_STEP steps[VM_COUNTED_MAX_STEPS];  // the body, in order
+  int num_steps;
+};
+
+struct VM_CODE
+{
+  struct VM_INSTR* instrs;  // the program
+  int num_instrs;
+  int instrs_capacity;
+
+  //
+  // registers 0..num_vars-1 are the variables, then come the
+  // temporaries and then the literals (temporaries made when
+  // hoisting are added at the end); initial holds the starting
+  // value of every register (literals are pre-loaded, the rest
+  // are undefined):
+  //
+  struct VM_VAR* vars;
+  int num_vars;
+  int vars_capacity;
+
+  struct VM_VALUE* initial;
+  bool* is_literal;
+  int num_regs;
+  int regs_capacity;
+
+  //
+  // loop-invariant expressions moved out of while loops:
+  //
+  struct VM_HOIST* hoisted;
+  int num_hoisted;
+  int hoisted_capacity;
+
+  //
+  // counted loops, run in closed form:
+  //
+  struct VM_COUNTED* counted;
+  int num_counted;
+  int counted_capacity;
+
+  int options;  // as given to vm_compile
+};
+
+
+//
+// Public functions:
+//
+
+//
+// vm_compile
+//
+// Compiles the given program graph into VM code, runs the type
+// analysis that selects typed instructions, moves loop-invariant
+// expressions out of while loops, and fuses common instruction
+// sequences into superinstructions (unless options include
+// VM_NO_SUPERINSTRUCTIONS). Returns NULL if the program uses
+// something the VM doesn't support (e.g. pointers or unary
+// operators); such programs are left to the tree-walking
+// interpreter. With VM_JIT, vm_run compiles hot while loops to
+// machine code where the platform allows.
+//
+struct VM_CODE* vm_compile(struct STMT* program, int options);
+
+//
+// vm_compile_until
+//
+// Same as vm_compile, but compiles only the stmts from program up
+// to (not including) stop, which must follow program at the same
+// level, e.g. a later top-level stmt; the code halts when it gets
+// there. vm_compile is vm_compile_until with a stop of NULL.
+//
+struct VM_CODE* vm_compile_until(struct STMT* program, struct STMT* stop, int options);
+
+//
+// vm_free
+//
+// Frees the VM code.
+//
+void vm_free(struct VM_CODE* code);
+
+//
+// vm_run
+//
+// Runs the VM code in the given context: against its memory,
+// with all output going to its sink, and input() reading from
+// its input source. Variables already in memory are visible to
+// the program. Returns true if the program ran to completion,
+// false if it stopped with a semantic error (the error message
+// has been output). Either way memory holds the final value of
+// every variable, and the sink is flushed.
+//
+// If the context has a VM profile, every pair of consecutively
+// executed opcodes is counted into it (the caller zeroes it).
+//
+// If the context has a budget, execution stops with an error
+// once it runs out (see budget.h), and the stmts executed are
+// counted. Each instruction knows how many stmts start at it,
+// so stmts are only counted when a jump is taken, and the budget
+// is checked at the jump back to the top of a while loop.
+//
+// If the context has a stop flag, it is checked there too: once
+// another thread sets it, execution stops and vm_run returns
+// false, with no error message.
+//
+bool vm_run(struct VM_CODE* code, struct CONTEXT* context);
+
+//
+// vm_print_profile
+//
+// Prints the n most frequent instruction pairs of a profile,
+// most frequent first, e.g.
+//
+//   **pair: 10000000 add_ii -> jump (25.0%)
+//
+void vm_print_profile(struct VM_PROFILE* profile, int n);
+
+//
+// vm_print
+//
+// Prints the VM code to the console, for debugging.
+//
+void vm_print(struct VM_CODE* code);
+
+//
+// vm_print_hoisted
+//
+// Prints the expressions that were moved out of while loops,
+// one per line, e.g.
+//
+//   **hoisted: line 7: y * 2 (out of while loop at line 4)
+//
+void vm_print_hoisted(struct VM_CODE* code);
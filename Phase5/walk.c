@@ -0,0 +1,82 @@
+/*walk.c*/
+
+//
+// Walking the program graph one level at a time, see walk.h.
+//
+// Jad Dibs
+//
+// Northwestern University
+// CS 211
+//
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdbool.h>  // true, false
+#include <assert.h>
+
+#include "walk.h"
+#include "programgraph.h"
+
+
+//
+// Public functions:
+//
+
+//
+// walk_next
+//
+// Returns the stmt after the given one at the same level.
+//
+struct STMT* walk_next(struct STMT* stmt, struct STMT* stop)
+{
+  switch (stmt->stmt_type)
+  {
+  case STMT_ASSIGNMENT:
+    return stmt->types.assignment->next_stmt;
+
+  case STMT_FUNCTION_CALL:
+    return stmt->types.function_call->next_stmt;
+
+  case STMT_WHILE_LOOP:
+    return stmt->types.while_loop->next_stmt;
+
+  case STMT_IF_THEN_ELSE:
+    return walk_join(stmt, stop);
+
+  default:
+    assert(stmt->stmt_type == STMT_PASS);
+    return stmt->types.pass->next_stmt;
+  }
+}
+
+
+//
+// walk_join
+//
+// Along each path the stmts come in source order, and the join
+// comes after every stmt on either path, so the two paths are
+// walked together, always stepping the one that's behind, until
+// they meet.
+//
+struct STMT* walk_join(struct STMT* stmt, struct STMT* stop)
+{
+  struct STMT_IF_THEN_ELSE* if_then_else = stmt->types.if_then_else;
+  struct STMT* t = if_then_else->true_path;
+  struct STMT* f = if_then_else->false_path;
+
+  while (t != f)
+  {
+    bool t_ended = (t == NULL || t == stop);
+    bool f_ended = (f == NULL || f == stop);
+
+    if (t_ended && f_ended)
+      return stop;
+
+    if (f_ended || (!t_ended && t->line < f->line))
+      t = walk_next(t, stop);
+    else
+      f = walk_next(f, stop);
+  }
+
+  return t;
+}
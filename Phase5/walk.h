@@ -0,0 +1,45 @@
+/*walk.h*/
+
+//
+// Walking the program graph one level at a time: the stmt after
+// a stmt, stepping over the body of a loop and both paths of an
+// if. Used by the compilers (vm.c, transpile.c) and parallel.c,
+// which handle each block of stmts in turn.
+//
+// Jad Dibs
+//
+// Northwestern University
+// CS 211
+//
+
+#pragma once
+
+#include "programgraph.h"
+
+
+//
+// Public functions:
+//
+
+//
+// walk_next
+//
+// Returns the stmt that follows the given stmt once it (and, for
+// a loop or if, everything inside it) is done. stop is where the
+// enclosing sequence ends: the enclosing while loop, or NULL at
+// the top level.
+//
+struct STMT* walk_next(struct STMT* stmt, struct STMT* stop);
+
+//
+// walk_join
+//
+// Both paths of an if stmt link to the stmt after the if; returns
+// that stmt, the first one reachable along both paths, or stop if
+// they only meet where the enclosing sequence ends.
+//
+// NOTE: takes as many steps as there are stmts on the two paths,
+// so a long chain of ifs doesn't walk the rest of the program for
+// each one.
+//
+struct STMT* walk_join(struct STMT* stmt, struct STMT* stop);